@@ -0,0 +1,121 @@
+//
+// Adaptive data rate: per-peer SNR/RSSI history picks the fastest SF/BW/CR that keeps
+// a configurable SNR margin, and optionally lowers TX power with what is left over.
+//
+// SNR values are centi-dB (1/100 dB). The PAN3031 reports SNR in the current bandwidth,
+// it is normalized to 125 kHz before comparing against the demodulation floor of each rate.
+//
+// A node receives at one rate, its listen rate; frames to a peer go at the listen rate of that peer,
+// with the TX power picked for it. rf_adr_init hooks rf_frame_xmit, which moves the radio to the
+// rate of the destination for each frame and back to the listen rate once it is sent. Broadcasts
+// and peers not in the table get the rate configured when rf_adr_init ran, the one every node
+// starts with. The PAN3031 demodulates one rate at a time, so the listen rate is the slowest of
+// the rates picked for each peer: every one of them is still heard.
+//
+// A listen rate change is announced to each peer over CTRL frames (RF_FRAME_FLAG_CTRL):
+//   node -> ADR_REQ(token, sf, bw, cr)       to every peer, repeated until it answers
+//   peer -> ADR_ACK(token)                   still sending at the old rate
+//        or ADR_NAK(token)                   for a rate not in its table, the peer is left out
+//   node switches once every peer answered, or when RF_ADR_SWITCH_MS passed and one did
+//   node -> ADR_CONFIRM(token, sf, bw, cr)   the rate it listens at now, to every peer asked
+//   peer -> ADR_ACK(token)                   at the new rate, from then on everything goes at it
+// A peer only leaves the old rate once the node listens at the new one, so none of its frames
+// fall between the two. CONFIRM is repeated, less often each time, until the peer answers or data
+// from it is heard at the new rate, so a peer that missed the REQ follows as well instead of being lost.
+// Two nodes may switch at the same time: every other repeat goes at the rate the peer asked for
+// in its last REQ, so the two find each other even when both CONFIRMs went to the old rates.
+// A peer that does not answer the REQ is left out of the next decisions until it is heard again.
+//
+
+#ifndef PROJECT_RF_ADR_H
+#define PROJECT_RF_ADR_H
+
+#include "stdint.h"
+
+#ifndef RF_ADR_MAX_PEERS
+#define RF_ADR_MAX_PEERS            8
+#endif
+// required SNR above the demodulation floor
+#ifndef RF_ADR_MARGIN_CDB
+#define RF_ADR_MARGIN_CDB           500
+#endif
+// extra margin and consecutive samples needed before going faster
+#ifndef RF_ADR_HYST_CDB
+#define RF_ADR_HYST_CDB             300
+#endif
+#ifndef RF_ADR_UP_HOLD
+#define RF_ADR_UP_HOLD              4
+#endif
+// SNR cost of each code rate step below 4/8
+#ifndef RF_ADR_CR_PENALTY_CDB
+#define RF_ADR_CR_PENALTY_CDB       50
+#endif
+// payload length used to rank the rates by airtime
+#ifndef RF_ADR_REF_LEN
+#define RF_ADR_REF_LEN              32
+#endif
+// longest wait for the peers to answer each step of a switch, and the interval of REQ and CONFIRM
+// repeats: RF_ADR_RETRY_MS plus RF_ADR_RETRY_AIRTIMES RF_ADR_REF_LEN frames at the peer's rate
+#ifndef RF_ADR_SWITCH_MS
+#define RF_ADR_SWITCH_MS            10000
+#endif
+#ifndef RF_ADR_RETRY_MS
+#define RF_ADR_RETRY_MS             500
+#endif
+#ifndef RF_ADR_RETRY_AIRTIMES
+#define RF_ADR_RETRY_AIRTIMES       4
+#endif
+#ifndef RF_ADR_MAX_POWER_STEPS
+#define RF_ADR_MAX_POWER_STEPS      8
+#endif
+
+// SF_7..SF_9 x BW_125K..BW_500K x CODE_RATE_45..CODE_RATE_48
+#define RF_ADR_RATE_NUM             36
+
+#define RF_ADR_CMD_REQ              0x01
+#define RF_ADR_CMD_ACK              0x02
+#define RF_ADR_CMD_CONFIRM          0x03
+#define RF_ADR_CMD_NAK              0x04
+
+#define RF_ADR_STATE_IDLE           0
+#define RF_ADR_STATE_WAIT_ACK       1       // REQ sent
+#define RF_ADR_STATE_ACKED          2       // REQ answered, waiting for the other peers
+#define RF_ADR_STATE_WAIT_CONFIRM   3       // listening at the new rate, CONFIRM sent
+
+typedef struct {
+    uint8_t sf;
+    uint8_t bw;
+    uint8_t cr;
+    int16_t req_snr_cdb;        // floor at 125 kHz plus bandwidth and code rate cost
+    uint32_t airtime_us;        // for RF_ADR_REF_LEN bytes
+} rf_adr_rate_t;
+
+typedef struct {
+    uint8_t addr;
+    uint8_t used;
+    uint8_t rate;               // listen rate of the peer, index into the airtime-sorted rate table
+    uint8_t power;              // index into the power table, for frames to the peer
+    uint8_t state;              // RF_ADR_STATE_* of the peer in our listen rate switch
+    uint8_t req_rate;           // rate of the peer's last REQ, where it listens if its CONFIRM was lost
+    uint8_t tries;              // repeats of our REQ or CONFIRM to the peer without an answer
+    uint16_t samples;           // 0 after a switch it did not answer, until heard again
+    uint32_t retry;             // HAL tick of the next ADR_REQ
+    int32_t snr_ewma;           // centi-dB x 16, normalized to 125 kHz
+    int32_t rssi_ewma;          // centi-dBm x 16
+} rf_adr_peer_t;
+
+void rf_adr_init(void);
+uint32_t rf_adr_set_power_table(const uint8_t *codes, const int16_t *dbm_cdb, uint8_t num);
+uint32_t rf_adr_input(uint8_t *frame, uint16_t len, int16_t rssi_cdb, int16_t snr_cdb);
+void rf_adr_observe(uint8_t src, int16_t rssi_cdb, int16_t snr_cdb);
+uint8_t rf_adr_select(const rf_adr_peer_t *peer, uint8_t *power);
+void rf_adr_poll(void);
+const rf_adr_peer_t *rf_adr_get_peer(uint8_t addr);
+const rf_adr_rate_t *rf_adr_get_rate(uint8_t index);
+uint8_t rf_adr_get_listen(void);
+uint8_t rf_adr_get_state(uint8_t addr);
+void rf_adr_tx_rate(uint8_t dst, uint8_t done);
+
+void rf_adr_switch_event(uint8_t peer, const rf_adr_rate_t *rate);
+
+#endif //PROJECT_RF_ADR_H
@@ -0,0 +1,45 @@
+//
+// Small-message aggregation: several application messages share one rf_frame, so the
+// preamble and header airtime (12.25 + 8 symbols) is paid once per frame instead of per message.
+//
+// Frame: rf_frame header with RF_FRAME_FLAG_AGG, then len(1) data, len(1) data, ...
+// A frame is sent when the next message does not fit, when the earliest deadline of the
+// messages it holds expires (rf_agg_poll), or on rf_agg_flush.
+//
+
+#ifndef PROJECT_RF_AGG_H
+#define PROJECT_RF_AGG_H
+
+#include "stdint.h"
+#include "rf_frame.h"
+
+// destinations aggregated at the same time, RF_FRAME_MAX_LEN bytes of RAM each
+#ifndef RF_AGG_SLOTS
+#define RF_AGG_SLOTS                2
+#endif
+
+#define RF_AGG_MAX_MSG              (RF_FRAME_MAX_PAYLOAD - 1)
+
+typedef struct {
+    uint32_t frames;
+    uint32_t msgs;
+    uint32_t bytes;             // aggregated payload bytes, length prefixes included
+    uint32_t deadline_flush;    // frames sent because a deadline expired
+    uint32_t airtime_us;        // airtime of the aggregated frames
+    uint32_t airtime_single_us; // airtime the same messages would take one frame each
+    uint32_t rx_frames;
+    uint32_t rx_msgs;
+    uint32_t rx_bad;
+} rf_agg_stats_t;
+
+void rf_agg_init(void);
+uint32_t rf_agg_send(uint8_t dst, const uint8_t *msg, uint8_t len, uint32_t deadline_ms);
+uint32_t rf_agg_flush(void);
+void rf_agg_poll(void);
+uint32_t rf_agg_input(uint8_t *frame, uint16_t len);
+uint32_t rf_agg_get_fill(void);
+const rf_agg_stats_t *rf_agg_get_stats(void);
+
+void rf_agg_rx_event(uint8_t src, uint8_t *msg, uint8_t len);
+
+#endif //PROJECT_RF_AGG_H
@@ -0,0 +1,77 @@
+//
+// Reliable delivery over rf_frame: selective-repeat sliding window ARQ.
+//
+// The sender transmits up to RF_ARQ_WINDOW frames back to back, the last one with
+// RF_FRAME_FLAG_AREQ, then listens for one ACK covering the whole burst.
+// DATA frame: header seq = sequence, payload = ctl(1) datagram, ctl bits 4:0 = seq - the sender's
+// window base (oldest unacknowledged sequence), bit 7 = RF_ARQ_CTL_SYN.
+// ACK frame: header seq = next expected sequence (cumulative), payload = 32-bit little
+// endian bitmap, bit i set when sequence seq + 1 + i was received out of order.
+// Sessions: the sender sets SYN until its first ACK after rf_arq_init or a dropped window. The
+// receiver starts over at the sender's base on a SYN, on a new sender, or when the base does not
+// fit its window, so it never acknowledges a sequence it did not receive in this session. A SYN
+// repeated within RF_ARQ_SYN_HOLD_MS of the one that started the session is a retransmission.
+// The retransmission timeout is derived from the airtime of an ACK at the current modem
+// parameters (rf_get_airtime_us), so it follows SF/BW/CR changes.
+// One sending session and one receiving session at a time.
+// rf_arq_input answers with an ACK from inside the call and waits for TX done: call it from the
+// main loop, never from an interrupt handler.
+//
+
+#ifndef PROJECT_RF_ARQ_H
+#define PROJECT_RF_ARQ_H
+
+#include "stdint.h"
+#include "rf_frame.h"
+
+// power of 2, at most 32; RAM use is about 2 * RF_ARQ_WINDOW * RF_ARQ_MAX_PAYLOAD
+#ifndef RF_ARQ_WINDOW
+#define RF_ARQ_WINDOW               4
+#endif
+#ifndef RF_ARQ_MAX_RETRY
+#define RF_ARQ_MAX_RETRY            8
+#endif
+// receiver processing and RX/TX switching on both ends
+#ifndef RF_ARQ_TURNAROUND_US
+#define RF_ARQ_TURNAROUND_US        20000
+#endif
+// a SYN with the same base this soon after the last one repeats it instead of starting over
+#ifndef RF_ARQ_SYN_HOLD_MS
+#define RF_ARQ_SYN_HOLD_MS          10000
+#endif
+
+#define RF_ARQ_CTL_LEN              1
+#define RF_ARQ_CTL_SYN              0x80
+#define RF_ARQ_CTL_OFF              0x1F
+#define RF_ARQ_MAX_PAYLOAD          (RF_FRAME_MAX_PAYLOAD - RF_ARQ_CTL_LEN)
+#define RF_ARQ_ACK_LEN              (RF_FRAME_HDR_LEN + 4)
+
+#define RF_ARQ_STATE_IDLE           0
+#define RF_ARQ_STATE_SEND           1
+#define RF_ARQ_STATE_WAIT_ACK       2
+
+typedef struct {
+    uint32_t tx_frames;
+    uint32_t retransmits;
+    uint32_t acks_rx;
+    uint32_t acks_tx;
+    uint32_t timeouts;
+    uint32_t dropped;
+    uint32_t rx_delivered;
+    uint32_t rx_duplicates;
+    uint32_t rx_resync;
+} rf_arq_stats_t;
+
+void rf_arq_init(void);
+uint32_t rf_arq_send(uint8_t dst, const uint8_t *data, uint8_t len);
+uint32_t rf_arq_pending(void);
+uint32_t rf_arq_get_rto_ms(void);
+void rf_arq_input(uint8_t *frame, uint16_t len);
+void rf_arq_poll(void);
+uint8_t rf_arq_get_state(void);
+const rf_arq_stats_t *rf_arq_get_stats(void);
+
+void rf_arq_rx_event(uint8_t src, uint8_t *data, uint8_t len);
+void rf_arq_fail_event(uint8_t dst, uint32_t lost);
+
+#endif //PROJECT_RF_ARQ_H
@@ -0,0 +1,16 @@
+//
+// On-target benchmarks, reported over USART1.
+//
+
+#ifndef PROJECT_RF_BENCH_H
+#define PROJECT_RF_BENCH_H
+
+#include "stdint.h"
+
+uint32_t bench_cycles(void);
+void rf_bench_crc(void);
+void rf_bench_lz(void);
+void rf_bench_driver(void);
+void rf_bench_run(void);
+
+#endif //PROJECT_RF_BENCH_H
@@ -0,0 +1,62 @@
+//
+// Airtime accountant: charges each frame against per-band sliding-window duty-cycle budgets
+// before it is transmitted.
+//
+// A band is a frequency range [lo, hi) with a duty cycle in permille over a window, e.g.
+// 1% over one hour is rf_duty_add_band(lo, hi, 10, 3600000). Its budget is
+// window_ms * permille us of airtime. Bands may overlap, a frame is charged to every band
+// containing the current frequency; frequencies outside every band are not limited.
+//
+// The window is kept as RF_DUTY_BUCKETS ring buckets of window / RF_DUTY_BUCKETS ms rounded up, the
+// oldest one counts in full until it expires, so the accountant errs on the safe side by at most
+// one bucket and never counts over less than the window.
+// Airtime is rf_get_airtime_us, the integer model of the current modem parameters.
+//
+// rf_duty_check may be asked again and again while the caller waits. A band that held the frame
+// back counts it as deferred once rf_duty_charge sends it, or as rejected when the caller gives
+// up with rf_duty_refuse; a frame is counted once either way.
+//
+
+#ifndef PROJECT_RF_DUTY_H
+#define PROJECT_RF_DUTY_H
+
+#include "stdint.h"
+
+#ifndef RF_DUTY_MAX_BANDS
+#define RF_DUTY_MAX_BANDS           4
+#endif
+#if RF_DUTY_MAX_BANDS > 8
+#error "RF_DUTY_MAX_BANDS is at most 8, one bit per band"
+#endif
+#ifndef RF_DUTY_BUCKETS
+#define RF_DUTY_BUCKETS             16
+#endif
+
+#define RF_DUTY_ALLOW               0
+#define RF_DUTY_DEFER               1
+#define RF_DUTY_REJECT              2
+
+typedef struct {
+    uint32_t lo_hz;
+    uint32_t hi_hz;
+    uint32_t budget_us;
+    uint32_t bucket_ms;
+    uint32_t bucket_start;      // HAL tick when the current bucket opened
+    uint8_t cur;
+    uint8_t used;
+    uint32_t bucket_us[RF_DUTY_BUCKETS];
+    uint32_t charged;           // frames charged
+    uint32_t deferred;          // frames charged after this band held them back
+    uint32_t rejected;          // frames refused while this band held them back
+} rf_duty_band_t;
+
+void rf_duty_init(void);
+uint32_t rf_duty_add_band(uint32_t lo_hz, uint32_t hi_hz, uint16_t permille, uint32_t window_ms);
+uint32_t rf_duty_check(uint8_t len, uint32_t *wait_ms);
+void rf_duty_charge(uint8_t len);
+void rf_duty_refuse(void);
+uint32_t rf_duty_get_used_us(uint8_t band);
+uint32_t rf_duty_get_utilization(uint8_t band);
+const rf_duty_band_t *rf_duty_get_band(uint8_t band);
+
+#endif //PROJECT_RF_DUTY_H
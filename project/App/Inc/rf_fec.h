@@ -0,0 +1,63 @@
+//
+// Cross-packet forward error correction: systematic Reed-Solomon erasure code over rf_frame.
+//
+// Datagrams are grouped K at a time, each group is followed by M repair frames. A receiver that
+// gets any K of the K + M frames of a group recovers every datagram, without return traffic.
+// Frames lost on air or dropped by the radio CRC check (rf_rx_err_event) count as erasures.
+//
+// Frame: rf_frame header with RF_FRAME_FLAG_FEC, seq = group id, then
+//   index(1) k(4 bits) << 4 | m(4 bits)  data or repair symbol
+// Symbol i of a group is len(1) data zero-padded to the group symbol size S, data frames send
+// only the data; repair frame j carries S bytes, sum over i of C[j][i] * symbol i in GF(2^8),
+// C a Cauchy matrix so any K frames are enough.
+//
+// With RF_FEC_DEPTH > 1 that many groups are sent column by column (frame 0 of every group,
+// then frame 1, ...), so a burst of lost frames is spread over several groups.
+// Datagrams are held until RF_FEC_DEPTH * RF_FEC_K are queued or rf_fec_flush is called.
+//
+
+#ifndef PROJECT_RF_FEC_H
+#define PROJECT_RF_FEC_H
+
+#include "stdint.h"
+#include "rf_frame.h"
+
+// data frames per group, 1..15
+#ifndef RF_FEC_K
+#define RF_FEC_K                    4
+#endif
+// repair frames per group, 0..15
+#ifndef RF_FEC_M
+#define RF_FEC_M                    2
+#endif
+// groups interleaved on air
+#ifndef RF_FEC_DEPTH
+#define RF_FEC_DEPTH                1
+#endif
+// longest datagram; RAM use is about RF_FEC_MAX_LEN times
+// RF_FEC_DEPTH * RF_FEC_K (sender) + (RF_FEC_DEPTH + 1) * (RF_FEC_K + RF_FEC_M) (receiver)
+#ifndef RF_FEC_MAX_LEN
+#define RF_FEC_MAX_LEN              64
+#endif
+
+#define RF_FEC_HDR_LEN              2
+#define RF_FEC_SYMBOL_LEN           (RF_FEC_MAX_LEN + 1)
+
+typedef struct {
+    uint32_t tx_data;
+    uint32_t tx_repair;
+    uint32_t rx_data;
+    uint32_t rx_repair;
+    uint32_t recovered;         // datagrams rebuilt from repair frames
+    uint32_t lost;              // datagrams missing from a group that could not be repaired
+} rf_fec_stats_t;
+
+void rf_fec_init(void);
+uint32_t rf_fec_send(uint8_t dst, const uint8_t *data, uint8_t len);
+uint32_t rf_fec_flush(void);
+uint32_t rf_fec_input(uint8_t *frame, uint16_t len);
+const rf_fec_stats_t *rf_fec_get_stats(void);
+
+void rf_fec_rx_event(uint8_t src, uint8_t *data, uint8_t len);
+
+#endif //PROJECT_RF_FEC_H
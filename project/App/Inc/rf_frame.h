@@ -0,0 +1,117 @@
+//
+// Packet framing on top of radio.h: addressing, fragmentation and reassembly.
+//
+// Frame layout, multi-byte fields are little endian:
+//   dst(1) src(1) seq(1) flags(1) [frag(1)] payload
+// frag is only present when RF_FRAME_FLAG_FRAG is set and holds the fragment index,
+// RF_FRAME_FLAG_LAST marks the last fragment so the count is index + 1 of that frame.
+// A message that fits in one frame pays 4 bytes, each fragment of a larger one 5 bytes.
+// A fragmented message is followed by a crc16 (RadioCrc_t, CRC_TYPE_IBM, high byte first) over its
+// bytes and split together with it, so the CRC over message and CRC is 0 at the receiver. Both ends
+// compute it inside the FIFO transfers (rf_set_fifo_crc) while the fragments cross the SPI bus.
+// With RF_LZ_STAGE (radio.h) every packet carries the stage header byte, so a frame is at most
+// RF_LZ_MAX_PAYLOAD bytes, and the message CRC is computed in software over the uncompressed bytes.
+//
+
+#ifndef PROJECT_RF_FRAME_H
+#define PROJECT_RF_FRAME_H
+
+#include "stdint.h"
+#include "radio.h"
+
+#if RF_LZ_STAGE
+#define RF_FRAME_MAX_LEN            RF_LZ_MAX_PAYLOAD
+#else
+#define RF_FRAME_MAX_LEN            255
+#endif
+#define RF_FRAME_HDR_LEN            4
+#define RF_FRAME_FRAG_HDR_LEN       5
+#define RF_FRAME_MAX_PAYLOAD        (RF_FRAME_MAX_LEN - RF_FRAME_HDR_LEN)
+#define RF_FRAME_FRAG_PAYLOAD       (RF_FRAME_MAX_LEN - RF_FRAME_FRAG_HDR_LEN)
+#define RF_FRAME_CRC_LEN            2
+
+#define RF_FRAME_ADDR_BROADCAST     0xFF
+
+#define RF_FRAME_FLAG_FRAG          0x01
+#define RF_FRAME_FLAG_LAST          0x02
+#define RF_FRAME_FLAG_ARQ           0x04    // reliable data frame, seq is the ARQ sequence, see rf_arq.h
+#define RF_FRAME_FLAG_ACK           0x08    // selective ACK, seq is the next expected sequence
+#define RF_FRAME_FLAG_AREQ          0x10    // last frame of a burst, the receiver answers with an ACK now
+#define RF_FRAME_FLAG_CTRL          0x20    // link control, payload[0] is the command, see rf_adr.h
+#define RF_FRAME_FLAG_FEC           0x40    // erasure coded group member, seq is the group id, see rf_fec.h
+#define RF_FRAME_FLAG_AGG           0x80    // several messages, each len(1) data, see rf_agg.h
+
+// reassembly table, RAM use is RF_FRAME_REASM_SLOTS * (RF_FRAME_REASM_MAX_MSG + 36), linked in when
+// rf_frame_input is used, which includes every rf_arq image since rf_arq_input passes other frames on.
+// Of the F030's 8 KB, heap and stack take 2 KB, the UART rings 1.5 KB, the ARQ windows about 2 KB
+// and the frame, aggregation and mesh buffers most of the rest, so RF_FRAME_REASM_RAM_MAX keeps the
+// table to about 1 KB. An image without rf_arq can raise both, e.g. RF_FRAME_REASM_MAX_MSG=4096 with
+// RF_FRAME_REASM_RAM_MAX=4200.
+#ifndef RF_FRAME_REASM_SLOTS
+#define RF_FRAME_REASM_SLOTS        1
+#endif
+#ifndef RF_FRAME_REASM_MAX_MSG
+#define RF_FRAME_REASM_MAX_MSG      1024
+#endif
+#ifndef RF_FRAME_REASM_RAM_MAX
+#define RF_FRAME_REASM_RAM_MAX      1100
+#endif
+#if RF_FRAME_REASM_SLOTS * (RF_FRAME_REASM_MAX_MSG + 36) > RF_FRAME_REASM_RAM_MAX
+#error "reassembly table over RF_FRAME_REASM_RAM_MAX, see the RAM budget above"
+#endif
+#ifndef RF_FRAME_REASM_TIMEOUT_MS
+#define RF_FRAME_REASM_TIMEOUT_MS   5000
+#endif
+#ifndef RF_FRAME_TX_TIMEOUT_MS
+#define RF_FRAME_TX_TIMEOUT_MS      3000
+#endif
+// longest wait for duty-cycle budget before a frame is refused, see rf_duty.h
+#ifndef RF_FRAME_DUTY_DEFER_MS
+#define RF_FRAME_DUTY_DEFER_MS      1000
+#endif
+
+// at most 32 fragments, tracked in one bitmap word
+#define RF_FRAME_MAX_FRAGS          32
+// largest message, rf_frame_send refuses what the receiver could not reassemble
+#define RF_FRAME_MAX_MSG            RF_FRAME_REASM_MAX_MSG
+#if RF_FRAME_REASM_MAX_MSG + RF_FRAME_CRC_LEN > RF_FRAME_MAX_FRAGS * RF_FRAME_FRAG_PAYLOAD
+#error "RF_FRAME_REASM_MAX_MSG takes more than RF_FRAME_MAX_FRAGS fragments"
+#endif
+
+typedef struct {
+    uint8_t dst;
+    uint8_t src;
+    uint8_t seq;
+    uint8_t flags;
+    uint8_t frag;
+} rf_frame_hdr_t;
+
+typedef struct {
+    uint32_t tx_frames;
+    uint32_t rx_frames;
+    uint32_t rx_msgs;
+    uint32_t rx_bad;
+    uint32_t reasm_timeout;
+    uint32_t reasm_overflow;
+    uint32_t rx_crc_err;
+    uint32_t duty_blocked;
+} rf_frame_stats_t;
+
+// called by rf_frame_xmit with the destination of each frame, done 0 before it is sent and
+// 1 once it is on the air or refused, see rf_adr.h
+typedef void (*rf_frame_tx_hook_t)(uint8_t dst, uint8_t done);
+
+void rf_frame_init(uint8_t addr);
+uint8_t rf_frame_get_addr(void);
+uint8_t rf_frame_encode(uint8_t *frame, const rf_frame_hdr_t *hdr);
+uint8_t rf_frame_decode(const uint8_t *frame, uint16_t len, rf_frame_hdr_t *hdr);
+uint32_t rf_frame_xmit(uint8_t *frame, uint8_t len);
+void rf_frame_set_tx_hook(rf_frame_tx_hook_t hook);
+uint32_t rf_frame_send(uint8_t dst, const uint8_t *msg, uint32_t len);
+void rf_frame_input(uint8_t *frame, uint16_t len);
+void rf_frame_poll(void);
+const rf_frame_stats_t *rf_frame_get_stats(void);
+
+void rf_frame_rx_event(const rf_frame_hdr_t *hdr, uint8_t *msg, uint32_t len);
+
+#endif //PROJECT_RF_FRAME_H
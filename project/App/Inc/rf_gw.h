@@ -0,0 +1,85 @@
+//
+// Gateway mode: per-node statistics table and binary export of every received frame.
+//
+// Nodes are kept in an open-addressing hash table (linear probing, backward-shift delete)
+// keyed by node address, so a lookup per received frame stays O(1) with a few hundred nodes.
+// Each frame goes out on USART1 as one record, little endian:
+//   RF_GW_REC_RX:   type(1) tick(4) addr(2) seq(1) rssi_cdb(2) snr_cdb(2) lost(2) len(1) frame
+//   RF_GW_REC_NODE: type(1) tick(4) addr(2) seq(1) rssi_cdb(2) snr_cdb(2) lost(2) rx(2) age_ms(4)
+// rf_gw_export_event sends each one as a COBS framed rf_uart record (rf_uart.h).
+// A dump of the table is paced by the UART: rf_gw_poll sends NODE records while the TX ring has
+// room for one and goes on from there on the next call.
+//
+// RAM: 12 bytes per slot, RF_GW_TABLE_SIZE slots, 4116 bytes for the default 300 nodes.
+// The last-heard time is kept in units of 1 << RF_GW_SEEN_SHIFT ms, so age_ms of a NODE record is
+// a multiple of 16384 ms; the RX records carry the exact tick.
+//
+
+#ifndef PROJECT_RF_GW_H
+#define PROJECT_RF_GW_H
+
+#include "stdint.h"
+#include "rf_uart.h"
+
+// nodes tracked, new nodes beyond it are not
+#ifndef RF_GW_MAX_NODES
+#define RF_GW_MAX_NODES             300
+#endif
+// nodes not heard for this long are dropped by rf_gw_expire
+#ifndef RF_GW_EXPIRE_MS
+#define RF_GW_EXPIRE_MS             (3600UL * 1000)
+#endif
+// rf_gw_poll runs rf_gw_expire and starts rf_gw_dump this often, 0 never
+#ifndef RF_GW_DUMP_MS
+#define RF_GW_DUMP_MS               60000
+#endif
+
+// 8 slots per 7 nodes: at 7/8 load a hit takes 4.5 probes on average
+#define RF_GW_TABLE_SIZE            (RF_GW_MAX_NODES * 8 / 7 + 1)
+#define RF_GW_ADDR_NONE             0xFFFF
+#define RF_GW_SEEN_SHIFT            14
+
+// the 8-bit last-heard time has to outlast the expiry, rf_gw_expire runs every RF_GW_DUMP_MS
+#if ((RF_GW_EXPIRE_MS + RF_GW_DUMP_MS) >> RF_GW_SEEN_SHIFT) > 0xFF
+#error "RF_GW_EXPIRE_MS + RF_GW_DUMP_MS beyond the range of rf_gw_node_t.seen"
+#endif
+#if RF_GW_TABLE_SIZE > 0xFFFF
+#error "RF_GW_MAX_NODES too large"
+#endif
+
+#define RF_GW_REC_RX                RF_UART_REC_RX
+#define RF_GW_REC_NODE              RF_UART_REC_NODE
+#define RF_GW_REC_RX_HDR_LEN        15
+#define RF_GW_REC_NODE_LEN          20
+
+typedef struct {
+    uint16_t addr;              // RF_GW_ADDR_NONE when free
+    uint16_t rx;                // frames received, saturating
+    uint16_t lost;              // sequence gaps, saturating
+    int16_t rssi_cdb;           // EWMA
+    int16_t snr_cdb;            // EWMA
+    uint8_t seq;                // last sequence number
+    uint8_t seen;               // HAL tick >> RF_GW_SEEN_SHIFT, modulo 256
+} rf_gw_node_t;
+
+typedef struct {
+    uint32_t rx;
+    uint32_t rx_err;
+    uint32_t not_frame;         // too short for an rf_frame header
+    uint32_t dup;               // frames repeating the last sequence number of their node
+    uint32_t table_full;
+    uint32_t expired;
+    uint32_t nodes;
+} rf_gw_stats_t;
+
+void rf_gw_init(void);
+rf_gw_node_t *rf_gw_lookup(uint16_t addr, uint8_t add);
+void rf_gw_input(uint8_t *frame, uint16_t len, int16_t rssi_cdb, int16_t snr_cdb);
+void rf_gw_poll(void);
+void rf_gw_expire(void);
+void rf_gw_dump(void);
+const rf_gw_stats_t *rf_gw_get_stats(void);
+
+void rf_gw_export_event(const uint8_t *rec, uint16_t len);
+
+#endif //PROJECT_RF_GW_H
@@ -0,0 +1,98 @@
+//
+// Multi-hop mesh toward one sink: gradient routing over link-quality costs.
+//
+// The sink floods HELLO(seq, cost 0) every RF_MESH_HELLO_MS. A node hearing a new seq picks the
+// neighbor with the lowest advertised cost + link cost as parent, then rebroadcasts HELLO with
+// its own cost after a random jitter. Costs are in 1/16 hop, a link costs one hop plus a
+// penalty for every dB its SNR EWMA is below RF_MESH_GOOD_SNR_CDB.
+// DATA frames go hop by hop to the parent until they reach the sink; (origin, mseq) pairs
+// already seen are dropped, and forwarding waits a random jitter to avoid collisions
+// with siblings relaying the same frame.
+//
+// Both are CTRL frames (RF_FRAME_FLAG_CTRL), payload
+//   HELLO: RF_MESH_CMD_HELLO(1) sink(1) seq(1) cost(2, little endian)
+//   DATA:  RF_MESH_CMD_DATA(1) origin(1) mseq(1) ttl(1) data
+// RAM: about RF_MESH_FWD_QUEUE * 256 + RF_MESH_MAX_NEIGHBORS * 16 + RF_MESH_DUP_CACHE * 2 bytes.
+//
+
+#ifndef PROJECT_RF_MESH_H
+#define PROJECT_RF_MESH_H
+
+#include "stdint.h"
+#include "rf_frame.h"
+
+#ifndef RF_MESH_MAX_NEIGHBORS
+#define RF_MESH_MAX_NEIGHBORS       8
+#endif
+#ifndef RF_MESH_DUP_CACHE
+#define RF_MESH_DUP_CACHE           16
+#endif
+#ifndef RF_MESH_FWD_QUEUE
+#define RF_MESH_FWD_QUEUE           2
+#endif
+#ifndef RF_MESH_HELLO_MS
+#define RF_MESH_HELLO_MS            60000
+#endif
+#ifndef RF_MESH_NEIGHBOR_TIMEOUT_MS
+#define RF_MESH_NEIGHBOR_TIMEOUT_MS (3 * RF_MESH_HELLO_MS)
+#endif
+// random delay before a rebroadcast or a forward
+#ifndef RF_MESH_JITTER_MS
+#define RF_MESH_JITTER_MS           500
+#endif
+#ifndef RF_MESH_TTL
+#define RF_MESH_TTL                 8
+#endif
+// links at or above this SNR cost exactly one hop
+#ifndef RF_MESH_GOOD_SNR_CDB
+#define RF_MESH_GOOD_SNR_CDB        500
+#endif
+// a new parent has to be this much cheaper, 1/16 hop
+#ifndef RF_MESH_SWITCH_HYST
+#define RF_MESH_SWITCH_HYST         8
+#endif
+
+// CTRL commands, shares the command space with rf_adr.h and rf_tdma.h
+#define RF_MESH_CMD_HELLO           0x20
+#define RF_MESH_CMD_DATA            0x21
+
+#define RF_MESH_HOP_COST            16
+#define RF_MESH_COST_INF            0xFFFF
+#define RF_MESH_DATA_HDR_LEN        4
+#define RF_MESH_MAX_DATA            (RF_FRAME_MAX_PAYLOAD - RF_MESH_DATA_HDR_LEN)
+
+typedef struct {
+    uint8_t addr;
+    uint8_t used;
+    uint8_t seq;                // HELLO seq last heard from it
+    uint16_t cost;              // its advertised cost to the sink
+    int16_t snr_cdb;            // EWMA
+    int16_t rssi_cdb;           // EWMA
+    uint32_t heard;             // HAL tick
+} rf_mesh_neighbor_t;
+
+typedef struct {
+    uint32_t hello_tx;
+    uint32_t hello_rx;
+    uint32_t data_tx;
+    uint32_t data_fwd;
+    uint32_t data_rx;           // delivered at the sink
+    uint32_t dup_drop;
+    uint32_t ttl_drop;
+    uint32_t queue_drop;
+    uint32_t no_route;
+    uint32_t parent_changes;
+} rf_mesh_stats_t;
+
+void rf_mesh_init(uint8_t sink);
+uint32_t rf_mesh_send(const uint8_t *data, uint8_t len);
+uint32_t rf_mesh_input(uint8_t *frame, uint16_t len, int16_t rssi_cdb, int16_t snr_cdb);
+void rf_mesh_poll(void);
+uint8_t rf_mesh_get_parent(void);
+uint16_t rf_mesh_get_cost(void);
+const rf_mesh_neighbor_t *rf_mesh_get_neighbor(uint8_t index);
+const rf_mesh_stats_t *rf_mesh_get_stats(void);
+
+void rf_mesh_rx_event(uint8_t origin, uint8_t *data, uint8_t len);
+
+#endif //PROJECT_RF_MESH_H
@@ -0,0 +1,92 @@
+//
+// Network co-processor mode: the radio driven by a host over USART1.
+//
+// Commands, replies and events are rf_uart records (rf_uart.h), little endian:
+//   RF_NCP_REC_CMD (host): type(1) seq(1) cmd(1) args
+//   RF_NCP_REC_RSP:        type(1) seq(1) cmd(1) status(1) data
+//   RF_NCP_REC_EVT:        type(1) event(1) data
+// Commands run in arrival order and each one gets exactly one reply with its seq, so the host
+// can keep commands in flight and match the replies later. A TX holds back the commands behind it
+// until its TX done event; they wait in the RX DMA ring, so a host keeps at most RF_UART_RX_BUF
+// encoded bytes unanswered.
+//
+//   cmd           args                  reply data
+//   PING          -                     version(1) rx_buf(2) max_payload(1)
+//   SET_PARA      para(1) value(4)      -                  rf_para_type_t, leaves the radio in standby
+//   GET_PARA      para(1)               value(4)           leaves the radio in standby
+//   SET_DEFAULT   -                     -
+//   TX            payload               airtime_ms(4)      RF_NCP_EVT_TX_DONE follows
+//   RX            timeout(4)            -                  see rf_enter_single_timeout_rx, 0 continuous
+//   STANDBY       -                     -
+//   SLEEP         -                     -
+//   WAKEUP        -                     -
+//   SET_SYNCWORD  sync(1)               -
+//   SET_PREAMBLE  symbols(2)            -
+//   GET_STATS     -                     rf_ncp_stats_t, then rx_bad(4) dropped(4) of rf_uart
+//
+//   event         data
+//   BOOT          version(1)
+//   RX_DONE       tick(4) rssi_cdb(2) snr_cdb(2) payload
+//   TX_DONE       seq(1) status(1) tick(4)
+//   RX_TIMEOUT    tick(4)
+//   RX_ERR        tick(4)
+//
+
+#ifndef PROJECT_RF_NCP_H
+#define PROJECT_RF_NCP_H
+
+#include "stdint.h"
+#include "rf_uart.h"
+
+// TX done later than airtime + this is reported with RF_NCP_ERR_TIMEOUT
+#ifndef RF_NCP_TX_GUARD_MS
+#define RF_NCP_TX_GUARD_MS          100
+#endif
+
+#define RF_NCP_VERSION              1
+#define RF_NCP_MAX_PAYLOAD          255
+
+#define RF_NCP_REC_CMD              RF_UART_REC_NCP_CMD
+#define RF_NCP_REC_RSP              RF_UART_REC_NCP_RSP
+#define RF_NCP_REC_EVT              RF_UART_REC_NCP_EVT
+
+#define RF_NCP_CMD_PING             0x00
+#define RF_NCP_CMD_SET_PARA         0x01
+#define RF_NCP_CMD_GET_PARA         0x02
+#define RF_NCP_CMD_SET_DEFAULT      0x03
+#define RF_NCP_CMD_TX               0x04
+#define RF_NCP_CMD_RX               0x05
+#define RF_NCP_CMD_STANDBY          0x06
+#define RF_NCP_CMD_SLEEP            0x07
+#define RF_NCP_CMD_WAKEUP           0x08
+#define RF_NCP_CMD_SET_SYNCWORD     0x09
+#define RF_NCP_CMD_SET_PREAMBLE     0x0A
+#define RF_NCP_CMD_GET_STATS        0x0B
+
+#define RF_NCP_EVT_BOOT             0x00
+#define RF_NCP_EVT_RX_DONE          0x01
+#define RF_NCP_EVT_TX_DONE          0x02
+#define RF_NCP_EVT_RX_TIMEOUT       0x03
+#define RF_NCP_EVT_RX_ERR           0x04
+
+#define RF_NCP_OK                   0x00
+#define RF_NCP_ERR_FAIL             0x01    // the driver returned FAIL
+#define RF_NCP_ERR_CMD              0x02    // unknown command
+#define RF_NCP_ERR_ARG              0x03    // wrong argument length or value
+#define RF_NCP_ERR_TIMEOUT          0x04    // no TX done
+
+typedef struct {
+    uint32_t cmds;
+    uint32_t bad_cmds;          // not a command record, or too short
+    uint32_t tx;
+    uint32_t rx;
+    uint32_t rx_err;
+    uint32_t tx_timeout;
+    uint32_t evt_dropped;       // events that did not fit the UART ring
+} rf_ncp_stats_t;
+
+void rf_ncp_init(void);
+void rf_ncp_poll(void);
+const rf_ncp_stats_t *rf_ncp_get_stats(void);
+
+#endif //PROJECT_RF_NCP_H
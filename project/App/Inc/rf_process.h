@@ -8,6 +8,9 @@
 
 // #define WORK_MODE_TX
 #define WROK_MODE_RX
+// #define WORK_MODE_BENCH
+// #define WORK_MODE_GATEWAY
+// #define WORK_MODE_NCP
 
 void rf_tx_demo(void);
 void rf_rx_demo(void);
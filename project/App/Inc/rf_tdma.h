@@ -0,0 +1,73 @@
+//
+// Beacon-synchronized TDMA MAC.
+//
+// Superframe: the coordinator's beacon slot, then RF_TDMA_MAX_SLOTS data slots, each one long
+// enough for a full frame at the current SF/BW/CR (rf_get_airtime_us) plus RF_TDMA_GUARD_US.
+// A node sends only in its own slot and keeps the radio in sleep otherwise, waking up for the
+// beacon window (rf_enter_single_timeout_rx) and its slot.
+//
+// Beacon: rf_frame CTRL frame to RF_FRAME_ADDR_BROADCAST, payload
+//   RF_TDMA_CMD_BEACON(1) bsn(1) slots(1) slot_ms(2) period_ms(2), little endian
+// Nodes time the superframe from the RX-done tick of each beacon and learn the drift of their
+// HSI against the coordinator from the beacon spacing, so slots stay aligned between beacons
+// and the beacon window can stay narrow.
+//
+
+#ifndef PROJECT_RF_TDMA_H
+#define PROJECT_RF_TDMA_H
+
+#include "stdint.h"
+
+#ifndef RF_TDMA_MAX_SLOTS
+#define RF_TDMA_MAX_SLOTS           8
+#endif
+// RX/TX switching and timing error at each slot edge
+#ifndef RF_TDMA_GUARD_US
+#define RF_TDMA_GUARD_US            5000
+#endif
+// radio sleep to STB3 plus main loop latency
+#ifndef RF_TDMA_WAKEUP_MS
+#define RF_TDMA_WAKEUP_MS           3
+#endif
+// worst clock error assumed when beacons are missed, HSI is +-1% over temperature
+#ifndef RF_TDMA_MAX_DRIFT_PPM
+#define RF_TDMA_MAX_DRIFT_PPM       10000
+#endif
+#ifndef RF_TDMA_MAX_MISS
+#define RF_TDMA_MAX_MISS            4
+#endif
+
+// CTRL command, shares the command space with rf_adr.h
+#define RF_TDMA_CMD_BEACON          0x10
+#define RF_TDMA_BEACON_LEN          7
+
+#define RF_TDMA_ROLE_OFF            0
+#define RF_TDMA_ROLE_COORDINATOR    1
+#define RF_TDMA_ROLE_NODE           2
+
+#define RF_TDMA_STATE_SCAN          0   // no sync, continuous RX
+#define RF_TDMA_STATE_SLEEP         1
+#define RF_TDMA_STATE_BEACON        2   // beacon window open
+#define RF_TDMA_STATE_LISTEN        3   // coordinator, RX between beacons
+
+typedef struct {
+    uint32_t beacons_tx;
+    uint32_t beacons_rx;
+    uint32_t beacons_missed;
+    uint32_t sync_lost;
+    uint32_t slots_used;
+    int32_t drift_ppm;          // local clock against the coordinator, positive when fast
+    int32_t last_error_ms;      // beacon arrival against the prediction
+} rf_tdma_stats_t;
+
+uint32_t rf_tdma_slot_ms(void);
+uint32_t rf_tdma_start_coordinator(uint8_t slots);
+uint32_t rf_tdma_start_node(uint8_t slot);
+void rf_tdma_stop(void);
+uint32_t rf_tdma_send(uint8_t *frame, uint8_t len);
+uint32_t rf_tdma_input(uint8_t *frame, uint16_t len, uint32_t rx_tick);
+void rf_tdma_poll(void);
+uint8_t rf_tdma_get_state(void);
+const rf_tdma_stats_t *rf_tdma_get_stats(void);
+
+#endif //PROJECT_RF_TDMA_H
@@ -0,0 +1,70 @@
+//
+// Time-series encoding for periodic sensor telemetry: many samples per frame, a few bits each.
+//
+// A sample is a timestamp (ms) and up to RF_TS_MAX_CHANNELS values, each channel either an
+// int32 or a float. Frame layout:
+//   channels(1) float mask(1) samples(1) bitstream, MSB first
+// The first sample is stored in full, the rest relative to the previous one in the same frame,
+// so every frame decodes on its own:
+//   timestamp  delta of delta, zigzag: '0' | '10'+7 | '110'+9 | '1110'+12 | '1111'+32 bits
+//   int        delta, zigzag varint in nibbles (3 bits + continuation): '0' unchanged | '1' varint
+//   float      XOR with the previous value: '0' equal | '10' bits in the previous window |
+//              '11' + 5 bits leading zeros + 5 bits length - 1 + bits
+//
+// Encoder and decoder are plain C without HAL or radio dependencies.
+//
+
+#ifndef PROJECT_RF_TS_H
+#define PROJECT_RF_TS_H
+
+#include "stdint.h"
+
+#define RF_TS_MAX_CHANNELS          8
+#define RF_TS_HDR_LEN               3
+#define RF_TS_MAX_FRAME             255
+
+// results, the values of OK and FAIL in pan3031.h
+#define RF_TS_OK                    0
+#define RF_TS_FAIL                  1
+
+typedef union {
+    int32_t i;
+    float f;
+    uint32_t bits;
+} rf_ts_value_t;
+
+// prediction state, restored as a whole when a sample does not fit
+typedef struct {
+    uint32_t bitpos;
+    uint8_t count;
+    uint32_t ts;
+    int32_t ts_delta;
+    rf_ts_value_t prev[RF_TS_MAX_CHANNELS];
+    uint8_t lead[RF_TS_MAX_CHANNELS];
+    uint8_t len[RF_TS_MAX_CHANNELS];  // 0: no XOR window yet
+} rf_ts_state_t;
+
+typedef struct {
+    uint8_t *buf;
+    uint16_t cap;
+    uint8_t nch;
+    uint8_t float_mask;
+    rf_ts_state_t st;
+} rf_ts_enc_t;
+
+typedef struct {
+    const uint8_t *buf;
+    uint16_t len;
+    uint8_t nch;
+    uint8_t float_mask;
+    uint8_t total;
+    rf_ts_state_t st;
+} rf_ts_dec_t;
+
+uint32_t rf_ts_enc_init(rf_ts_enc_t *enc, uint8_t *buf, uint16_t cap, uint8_t nch, uint8_t float_mask);
+uint32_t rf_ts_enc_add(rf_ts_enc_t *enc, uint32_t ts, const rf_ts_value_t *val);
+uint16_t rf_ts_enc_finish(rf_ts_enc_t *enc);
+uint32_t rf_ts_dec_init(rf_ts_dec_t *dec, const uint8_t *buf, uint16_t len);
+uint32_t rf_ts_dec_next(rf_ts_dec_t *dec, uint32_t *ts, rf_ts_value_t *val);
+
+#endif //PROJECT_RF_TS_H
@@ -0,0 +1,71 @@
+//
+// Non-blocking USART1 output: TX ring buffer drained by DMA, COBS framed binary records.
+// Records from the host arrive the same way through a circular RX DMA ring (rf_uart_read_record).
+//
+// Record on the wire: COBS(type(1) data crc16(2, little endian)) 0x00
+// crc16 is RadioComputeCRC(CRC_TYPE_CCITT) over type and data. COBS removes every 0x00 from the record,
+// so a reader resyncs on the next 0x00 after a lost byte.
+// printf text goes through the same ring unframed; a record after text starts with an extra
+// 0x00 so the text never runs into it.
+//
+
+#ifndef PROJECT_RF_UART_H
+#define PROJECT_RF_UART_H
+
+#include "stdint.h"
+
+// ring size in bytes, one full ring drains in RF_UART_TX_BUF * 10 / baud seconds
+#ifndef RF_UART_TX_BUF
+#define RF_UART_TX_BUF              1024
+#endif
+#ifndef RF_UART_MAX_RECORD
+#define RF_UART_MAX_RECORD          300
+#endif
+// RX DMA ring, holds what the host sends between two rf_uart_read_record calls
+#ifndef RF_UART_RX_BUF
+#define RF_UART_RX_BUF              512
+#endif
+// longest record body accepted from the host
+#ifndef RF_UART_MAX_RX_RECORD
+#define RF_UART_MAX_RX_RECORD       260
+#endif
+// longest rf_uart_printf output
+#ifndef RF_UART_FMT_MAX
+#define RF_UART_FMT_MAX             96
+#endif
+
+// record types
+#define RF_UART_REC_RX              0x01    // rf_gw.h
+#define RF_UART_REC_NODE            0x02    // rf_gw.h
+#define RF_UART_REC_DEMO_TX         0x10    // tick(4) index(4) payload
+#define RF_UART_REC_DEMO_RX         0x11    // tick(4) index(4) rssi_cdb(2) snr_cdb(2) payload
+#define RF_UART_REC_NCP_CMD         0x20    // rf_ncp.h, host to NCP
+#define RF_UART_REC_NCP_RSP         0x21    // rf_ncp.h
+#define RF_UART_REC_NCP_EVT         0x22    // rf_ncp.h
+
+// COBS worst case: one code byte per 254 bytes, the first code byte, delimiters
+#define RF_UART_COBS_MAX(n)         ((n) + (n) / 254 + 3)
+
+typedef struct {
+    uint32_t records;
+    uint32_t bytes;             // queued on the wire, framing included
+    uint32_t dropped;           // records or text bytes that did not fit
+    uint32_t dma_starts;
+    uint16_t high_water;        // most bytes ever pending in the ring
+    uint16_t rx_restarts;       // RX DMA restarted after a UART error
+    uint32_t rx_bytes;
+    uint32_t rx_records;
+    uint32_t rx_bad;            // CRC or COBS errors, records too long
+} rf_uart_stats_t;
+
+void rf_uart_putc(uint8_t ch);
+uint32_t rf_uart_write(const uint8_t *data, uint16_t len);
+uint32_t rf_uart_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+uint32_t rf_uart_send_record(uint8_t type, const uint8_t *data, uint16_t len);
+uint32_t rf_uart_flush(uint32_t timeout_ms);
+uint16_t rf_uart_tx_room(void);
+void rf_uart_rx_start(void);
+uint16_t rf_uart_read_record(const uint8_t **rec);
+const rf_uart_stats_t *rf_uart_get_stats(void);
+
+#endif //PROJECT_RF_UART_H
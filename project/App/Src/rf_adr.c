@@ -0,0 +1,567 @@
+//
+// Adaptive data rate: per-peer SNR/RSSI history picks the fastest SF/BW/CR that keeps
+// a configurable SNR margin, and optionally lowers TX power with what is left over.
+//
+#include "rf_adr.h"
+#include "rf_frame.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+#define ADR_EWMA_SHIFT      3       // alpha = 1/8
+#define ADR_SCALE           16      // fixed point of the EWMA fields
+
+// demodulation floor at 125 kHz, SF7 -7.5 dB, SF8 -10 dB, SF9 -12.5 dB
+static const int16_t adr_sf_floor_cdb[] = { -750, -1000, -1250 };
+// SNR is measured in-band, each bandwidth doubling costs 3.01 dB
+static const int16_t adr_bw_cost_cdb[] = { 0, 301, 602 };
+
+static rf_adr_rate_t adr_rates[RF_ADR_RATE_NUM];
+static rf_adr_peer_t adr_peers[RF_ADR_MAX_PEERS];
+static uint8_t adr_power_code[RF_ADR_MAX_POWER_STEPS];
+static int16_t adr_power_cdb[RF_ADR_MAX_POWER_STEPS];
+static uint8_t adr_power_num;
+
+static uint8_t adr_base;                              // rate at rf_adr_init
+static uint8_t adr_listen;                            // rate the node receives at
+static uint8_t adr_radio;                             // rate the radio is set to
+static uint8_t adr_radio_power;                       // power table index the radio is set to
+static uint8_t adr_state = RF_ADR_STATE_IDLE;         // step of the listen rate switch
+static uint8_t adr_token;
+static uint8_t adr_target;
+static uint8_t adr_up_hold;
+static uint8_t adr_asked;                             // peers told of the switch, and how many answered
+static uint8_t adr_answered;
+static uint32_t adr_deadline;
+static uint32_t adr_quiet;                            // no REQ or CONFIRM before, an answer may be on the way
+static uint32_t adr_rand = 1;
+static uint8_t adr_frame[RF_FRAME_HDR_LEN + 5];
+
+// REQ and CONFIRM repeats spread over 1/2 .. 3/2 of the interval, two nodes switching together
+// drift apart; at slow rates the interval grows with the airtime so the repeats leave room for
+// the answers and everyone else's traffic
+static uint32_t rf_adr_retry(uint8_t rate)
+{
+    uint32_t ms = RF_ADR_RETRY_MS + RF_ADR_RETRY_AIRTIMES * adr_rates[rate].airtime_us / 1000;
+
+    adr_rand = adr_rand * 1103515245UL + 12345UL;
+    return ms / 2 + (adr_rand >> 16) % (ms + 1);
+}
+
+// RF_ADR_RATE_NUM when the rate is not in the table
+static uint8_t rf_adr_find_rate(uint8_t sf, uint8_t bw, uint8_t cr)
+{
+    uint8_t i;
+
+    for (i = 0; i < RF_ADR_RATE_NUM; i++) {
+        if (adr_rates[i].sf == sf && adr_rates[i].bw == bw && adr_rates[i].cr == cr) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief build the rate table sorted by airtime (slowest first) and forget all peers
+ * @param[in] <none>
+ * @return none
+ */
+void rf_adr_init(void)
+{
+    const struct RfModemCfg *cfg = rf_get_modem_cfg();
+    rf_adr_rate_t r;
+    uint8_t sf, bw, cr, n = 0;
+    int8_t j;
+
+    for (sf = SF_7; sf <= SF_9; sf++) {
+        for (bw = BW_125K; bw <= BW_500K; bw++) {
+            for (cr = CODE_RATE_45; cr <= CODE_RATE_48; cr++) {
+                r.sf = sf;
+                r.bw = bw;
+                r.cr = cr;
+                r.req_snr_cdb = adr_sf_floor_cdb[sf - SF_7] + adr_bw_cost_cdb[bw - BW_125K] +
+                                (CODE_RATE_48 - cr) * RF_ADR_CR_PENALTY_CDB;
+                r.airtime_us = rf_calc_airtime_us(sf, bw, cr, cfg->Crc, RF_ADR_REF_LEN);
+                // insertion sort, longest airtime first
+                for (j = n - 1; j >= 0 && adr_rates[j].airtime_us < r.airtime_us; j--) {
+                    adr_rates[j + 1] = adr_rates[j];
+                }
+                adr_rates[j + 1] = r;
+                n++;
+            }
+        }
+    }
+
+    memset(adr_peers, 0, sizeof(adr_peers));
+    adr_power_code[0] = cfg->TxPower;
+    adr_power_cdb[0] = 0;
+    adr_power_num = 1;
+    adr_base = rf_adr_find_rate(cfg->Sf, cfg->Bw, cfg->Cr);
+    if (adr_base == RF_ADR_RATE_NUM) {
+        adr_base = 0;
+    }
+    adr_listen = adr_base;
+    adr_radio = adr_base;
+    adr_radio_power = 0;
+    adr_state = RF_ADR_STATE_IDLE;
+    adr_up_hold = 0;
+    adr_rand = (HAL_GetTick() << 8) ^ rf_frame_get_addr() ^ 0x5A5A5A5AUL;
+    rf_frame_set_tx_hook(rf_adr_tx_rate);
+}
+
+/**
+ * @brief set the TX power steps ADR may use, without it ADR never changes power
+ * @param[in] <codes> rf_set_para(RF_PARA_TYPE_TXPOWER) codes, strongest first
+ * @param[in] <dbm_cdb> output power of each code in centi-dBm, from the datasheet of the module
+ * @param[in] <num> number of steps
+ * @return result
+ */
+uint32_t rf_adr_set_power_table(const uint8_t *codes, const int16_t *dbm_cdb, uint8_t num)
+{
+    uint8_t i;
+
+    if (num == 0 || num > RF_ADR_MAX_POWER_STEPS) {
+        return FAIL;
+    }
+    for (i = 0; i < num; i++) {
+        adr_power_code[i] = codes[i];
+        adr_power_cdb[i] = dbm_cdb[i];
+    }
+    adr_power_num = num;
+    return OK;
+}
+
+static rf_adr_peer_t *rf_adr_peer(uint8_t addr, uint8_t create)
+{
+    rf_adr_peer_t *free_peer = NULL;
+    uint8_t i;
+
+    for (i = 0; i < RF_ADR_MAX_PEERS; i++) {
+        if (adr_peers[i].used && adr_peers[i].addr == addr) {
+            return &adr_peers[i];
+        }
+        if (!adr_peers[i].used && free_peer == NULL) {
+            free_peer = &adr_peers[i];
+        }
+    }
+    if (!create || free_peer == NULL) {
+        return NULL;
+    }
+    memset(free_peer, 0, sizeof(*free_peer));
+    free_peer->used = 1;
+    free_peer->addr = addr;
+    free_peer->rate = adr_base;
+    free_peer->req_rate = adr_base;
+    return free_peer;
+}
+
+/**
+ * @brief add one RX sample of a peer to its history
+ * @param[in] <src> peer address
+ * @param[in] <rssi_cdb> RSSI in centi-dBm
+ * @param[in] <snr_cdb> SNR in centi-dB at the current bandwidth
+ * @return none
+ */
+void rf_adr_observe(uint8_t src, int16_t rssi_cdb, int16_t snr_cdb)
+{
+    rf_adr_peer_t *peer = rf_adr_peer(src, 1);
+    int32_t snr = (snr_cdb + adr_bw_cost_cdb[adr_rates[adr_listen].bw - BW_125K]) * ADR_SCALE;
+    int32_t rssi = rssi_cdb * ADR_SCALE;
+
+    if (peer == NULL) {
+        return;
+    }
+    if (peer->samples == 0) {
+        peer->snr_ewma = snr;
+        peer->rssi_ewma = rssi;
+    } else {
+        peer->snr_ewma += (snr - peer->snr_ewma) / (1 << ADR_EWMA_SHIFT);
+        peer->rssi_ewma += (rssi - peer->rssi_ewma) / (1 << ADR_EWMA_SHIFT);
+    }
+    if (peer->samples < 0xFFFF) {
+        peer->samples++;
+    }
+}
+
+/**
+ * @brief fastest rate the peer can be heard at with the margin, with hysteresis towards rates
+ *        faster than the listen rate
+ * @param[in] <peer> peer history
+ * @param[out] <power> power table index for frames to the peer at its rate, may be NULL
+ * @return rate table index
+ */
+uint8_t rf_adr_select(const rf_adr_peer_t *peer, uint8_t *power)
+{
+    int32_t snr = peer->snr_ewma / ADR_SCALE;
+    int32_t surplus;
+    uint8_t i, best = 0, p = 0;
+
+    for (i = 0; i < RF_ADR_RATE_NUM; i++) {
+        // faster than the listen rate needs the extra hysteresis margin
+        int32_t need = RF_ADR_MARGIN_CDB + ((i > adr_listen) ? RF_ADR_HYST_CDB : 0);
+        if (snr - adr_rates[i].req_snr_cdb >= need) {
+            best = i;
+        }
+    }
+
+    surplus = snr - adr_rates[peer->rate].req_snr_cdb - RF_ADR_MARGIN_CDB - RF_ADR_HYST_CDB;
+    while (p + 1 < adr_power_num && adr_power_cdb[0] - adr_power_cdb[p + 1] <= surplus) {
+        p++;
+    }
+    if (power != NULL) {
+        *power = p;
+    }
+    return best;
+}
+
+static void rf_adr_radio(uint8_t rate)
+{
+    if (rate != adr_radio) {
+        rf_set_rate(adr_rates[rate].sf, adr_rates[rate].bw, adr_rates[rate].cr);
+        adr_radio = rate;
+    }
+}
+
+/**
+ * @brief move the radio to the rate and TX power of a destination before a frame and back to the
+ *        listen rate after it, rf_frame_xmit calls it once rf_adr_init has run
+ * @param[in] <dst> destination address
+ * @param[in] <done> 0 before the frame is sent, 1 after
+ * @return none
+ */
+void rf_adr_tx_rate(uint8_t dst, uint8_t done)
+{
+    const rf_adr_peer_t *peer = (dst == RF_FRAME_ADDR_BROADCAST) ? NULL : rf_adr_peer(dst, 0);
+    uint8_t power = (peer != NULL) ? peer->power : 0;
+
+    if (done) {
+        rf_adr_radio(adr_listen);
+        return;
+    }
+    rf_adr_radio((peer != NULL) ? peer->rate : adr_base);
+    if (power != adr_radio_power) {
+        rf_set_para(RF_PARA_TYPE_TXPOWER, adr_power_code[power]);
+        adr_radio_power = power;
+    }
+}
+
+static void rf_adr_send_ctrl(rf_adr_peer_t *peer, uint8_t cmd, uint8_t token)
+{
+    rf_frame_hdr_t hdr;
+    uint8_t hlen, len, rate;
+
+    hdr.dst = peer->addr;
+    hdr.src = rf_frame_get_addr();
+    hdr.seq = token;
+    hdr.flags = RF_FRAME_FLAG_CTRL;
+    hdr.frag = 0;
+    hlen = rf_frame_encode(adr_frame, &hdr);
+    adr_frame[hlen] = cmd;
+    adr_frame[hlen + 1] = token;
+    len = hlen + 2;
+    if (cmd == RF_ADR_CMD_REQ || cmd == RF_ADR_CMD_CONFIRM) {
+        rate = (cmd == RF_ADR_CMD_REQ) ? adr_target : adr_listen;
+        adr_frame[hlen + 2] = adr_rates[rate].sf;
+        adr_frame[hlen + 3] = adr_rates[rate].bw;
+        adr_frame[hlen + 4] = adr_rates[rate].cr;
+        len += 3;
+    }
+    rf_frame_xmit(adr_frame, len);
+    rf_enter_continous_rx();
+    // the answer comes at the listen rate, the next REQ or CONFIRM waits for it
+    if (cmd == RF_ADR_CMD_REQ || cmd == RF_ADR_CMD_CONFIRM) {
+        adr_quiet = HAL_GetTick() + adr_rates[adr_listen].airtime_us / 1000;
+    }
+}
+
+// a REQ or CONFIRM repeat, every other one at the rate the peer asked for in its last REQ
+static void rf_adr_send_repeat(rf_adr_peer_t *peer, uint8_t cmd)
+{
+    uint8_t rate = peer->rate;
+
+    if (peer->tries & 1) {
+        peer->rate = peer->req_rate;
+    }
+    rf_adr_send_ctrl(peer, cmd, adr_token);
+    peer->rate = rate;
+    if (peer->tries < 0xFF) {
+        peer->tries++;
+    }
+}
+
+static void rf_adr_ctrl(uint8_t src, const uint8_t *payload, uint16_t len)
+{
+    rf_adr_peer_t *peer = rf_adr_peer(src, 1);
+    uint8_t rate;
+
+    if (len < 2 || peer == NULL) {
+        return;
+    }
+    switch (payload[0]) {
+        case RF_ADR_CMD_REQ:
+        case RF_ADR_CMD_CONFIRM:
+            if (len < 5) {
+                break;
+            }
+            rate = rf_adr_find_rate(payload[2], payload[3], payload[4]);
+            if (rate == RF_ADR_RATE_NUM) {
+                rf_adr_send_ctrl(peer, RF_ADR_CMD_NAK, payload[1]);
+                break;
+            }
+            // a REQ is answered at the old rate, the node listens at the new one once it confirms
+            peer->req_rate = rate;
+            if (payload[0] == RF_ADR_CMD_CONFIRM && rate != peer->rate) {
+                peer->rate = rate;
+                rf_adr_switch_event(src, &adr_rates[rate]);
+            }
+            rf_adr_send_ctrl(peer, RF_ADR_CMD_ACK, payload[1]);
+            break;
+        case RF_ADR_CMD_ACK:
+            if (payload[1] != adr_token) {
+                break;
+            }
+            if (peer->state == RF_ADR_STATE_WAIT_ACK) {
+                peer->state = RF_ADR_STATE_ACKED;
+                adr_answered++;
+            } else if (peer->state == RF_ADR_STATE_WAIT_CONFIRM) {
+                peer->state = RF_ADR_STATE_IDLE;
+            }
+            break;
+        case RF_ADR_CMD_NAK:
+            // the peer cannot follow, it is left out like one that does not answer
+            if (peer->state != RF_ADR_STATE_IDLE && payload[1] == adr_token) {
+                if (peer->state == RF_ADR_STATE_ACKED) {
+                    adr_answered--;
+                }
+                peer->state = RF_ADR_STATE_IDLE;
+                peer->samples = 0;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void rf_adr_confirmed(uint8_t src)
+{
+    rf_adr_peer_t *peer = rf_adr_peer(src, 0);
+
+    if (peer != NULL && peer->state == RF_ADR_STATE_WAIT_CONFIRM) {
+        peer->state = RF_ADR_STATE_IDLE;
+    }
+}
+
+/**
+ * @brief feed a received frame with its metadata, records the sample and handles ADR commands
+ * @param[in] <frame> received frame
+ * @param[in] <len> frame length
+ * @param[in] <rssi_cdb> RSSI in centi-dBm
+ * @param[in] <snr_cdb> SNR in centi-dB
+ * @return 1 when the frame was an ADR command and is consumed, 0 otherwise
+ */
+uint32_t rf_adr_input(uint8_t *frame, uint16_t len, int16_t rssi_cdb, int16_t snr_cdb)
+{
+    rf_frame_hdr_t hdr;
+    uint8_t hlen;
+
+    hlen = rf_frame_decode(frame, len, &hdr);
+    if (hlen == 0) {
+        return 0;
+    }
+    // the peers are the nodes sending to us, others overheard do not hold the listen rate down
+    if (hdr.dst != rf_frame_get_addr()) {
+        return 0;
+    }
+    rf_adr_observe(hdr.src, rssi_cdb, snr_cdb);
+    // data heard at the new listen rate, the peer got the CONFIRM; CTRL repeats may go at a guessed rate
+    if (!(hdr.flags & RF_FRAME_FLAG_CTRL)) {
+        rf_adr_confirmed(hdr.src);
+        return 0;
+    }
+    rf_adr_ctrl(hdr.src, frame + hlen, len - hlen);
+    return 1;
+}
+
+// the REQ round of a listen rate switch, at most one REQ per call
+static void rf_adr_switch_poll(void)
+{
+    rf_adr_peer_t *peer;
+    uint8_t i, waiting = 0, switched;
+    uint8_t late = (int32_t)(HAL_GetTick() - adr_deadline) >= 0;
+
+    for (i = 0; i < RF_ADR_MAX_PEERS; i++) {
+        peer = &adr_peers[i];
+        if (!peer->used || peer->state != RF_ADR_STATE_WAIT_ACK || late) {
+            continue;
+        }
+        waiting = 1;
+        if ((int32_t)(HAL_GetTick() - peer->retry) >= 0 && (int32_t)(HAL_GetTick() - adr_quiet) >= 0) {
+            rf_adr_send_repeat(peer, RF_ADR_CMD_REQ);
+            peer->retry = HAL_GetTick() + rf_adr_retry(peer->rate);
+            return;
+        }
+    }
+    if (waiting) {
+        return;
+    }
+    adr_state = RF_ADR_STATE_IDLE;
+    switched = adr_asked == 0 || adr_answered != 0;
+    if (switched) {
+        adr_listen = adr_target;
+        rf_adr_radio(adr_listen);
+        rf_enter_continous_rx();
+        rf_adr_switch_event(rf_frame_get_addr(), &adr_rates[adr_listen]);
+    }
+
+    // the peers that did not answer are left out, but still told where the node listens
+    for (i = 0; i < RF_ADR_MAX_PEERS; i++) {
+        peer = &adr_peers[i];
+        if (peer->used && peer->state == RF_ADR_STATE_WAIT_ACK) {
+            peer->samples = 0;
+        }
+        if (peer->used && (peer->state == RF_ADR_STATE_WAIT_ACK || peer->state == RF_ADR_STATE_ACKED)) {
+            peer->state = switched ? RF_ADR_STATE_WAIT_CONFIRM : RF_ADR_STATE_IDLE;
+            peer->tries = 0;
+            peer->retry = HAL_GetTick();
+        }
+    }
+}
+
+// CONFIRM repeats, the wait doubles every second one up to RF_ADR_SWITCH_MS; 1 when one was sent
+static uint32_t rf_adr_confirm_poll(void)
+{
+    rf_adr_peer_t *peer;
+    uint32_t wait;
+    uint8_t i;
+
+    if ((int32_t)(HAL_GetTick() - adr_quiet) < 0) {
+        return 0;
+    }
+    for (i = 0; i < RF_ADR_MAX_PEERS; i++) {
+        peer = &adr_peers[i];
+        if (!peer->used || peer->state != RF_ADR_STATE_WAIT_CONFIRM || (int32_t)(HAL_GetTick() - peer->retry) < 0) {
+            continue;
+        }
+        wait = rf_adr_retry(peer->rate) << ((peer->tries < 16) ? peer->tries / 2 : 8);
+        rf_adr_send_repeat(peer, RF_ADR_CMD_CONFIRM);
+        peer->retry = HAL_GetTick() + ((wait < RF_ADR_SWITCH_MS) ? wait : RF_ADR_SWITCH_MS);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief run ADR decisions and timers, call it from the main loop
+ * @param[in] <none>
+ * @return none
+ */
+void rf_adr_poll(void)
+{
+    rf_adr_peer_t *peer;
+    uint8_t target = RF_ADR_RATE_NUM, rate, power, i;
+
+    if (adr_state != RF_ADR_STATE_IDLE) {
+        rf_adr_switch_poll();
+        return;
+    }
+    if (rf_adr_confirm_poll()) {
+        return;
+    }
+
+    // the slowest of the rates the peers can be heard at
+    for (i = 0; i < RF_ADR_MAX_PEERS; i++) {
+        peer = &adr_peers[i];
+        if (!peer->used || peer->samples < RF_ADR_UP_HOLD) {
+            continue;
+        }
+        rate = rf_adr_select(peer, &power);
+        peer->power = power;
+        if (rate < target) {
+            target = rate;
+        }
+    }
+    if (target == RF_ADR_RATE_NUM || target == adr_listen) {
+        adr_up_hold = 0;
+        return;
+    }
+    // slower right away, faster only after RF_ADR_UP_HOLD consistent decisions
+    if (target > adr_listen && ++adr_up_hold < RF_ADR_UP_HOLD) {
+        return;
+    }
+
+    adr_up_hold = 0;
+    adr_target = target;
+    // 0 is what a peer never asked for anything holds
+    if (++adr_token == 0) {
+        adr_token = 1;
+    }
+    adr_asked = 0;
+    adr_answered = 0;
+    for (i = 0; i < RF_ADR_MAX_PEERS; i++) {
+        peer = &adr_peers[i];
+        // one still to confirm the last switch is told the new rate with its next CONFIRM
+        if (peer->used && peer->samples != 0 && peer->state != RF_ADR_STATE_WAIT_CONFIRM) {
+            peer->state = RF_ADR_STATE_WAIT_ACK;
+            peer->tries = 0;
+            peer->retry = HAL_GetTick();
+            adr_asked++;
+        }
+    }
+    adr_deadline = HAL_GetTick() + RF_ADR_SWITCH_MS;
+    adr_state = RF_ADR_STATE_WAIT_ACK;
+    rf_adr_switch_poll();
+}
+
+/**
+ * @brief get the history of a peer
+ * @param[in] <addr> peer address
+ * @return peer, NULL when never heard
+ */
+const rf_adr_peer_t *rf_adr_get_peer(uint8_t addr)
+{
+    return rf_adr_peer(addr, 0);
+}
+
+/**
+ * @brief get one entry of the rate table, index 0 is the slowest
+ * @param[in] <index> Range:0..RF_ADR_RATE_NUM-1
+ * @return rate
+ */
+const rf_adr_rate_t *rf_adr_get_rate(uint8_t index)
+{
+    return &adr_rates[index < RF_ADR_RATE_NUM ? index : 0];
+}
+
+/**
+ * @brief get the rate the node receives at
+ * @param[in] <none>
+ * @return rate table index
+ */
+uint8_t rf_adr_get_listen(void)
+{
+    return adr_listen;
+}
+
+/**
+ * @brief get the step a peer is at in the listen rate switch
+ * @param[in] <addr> peer address
+ * @return RF_ADR_STATE_IDLE / RF_ADR_STATE_WAIT_ACK / RF_ADR_STATE_ACKED / RF_ADR_STATE_WAIT_CONFIRM
+ */
+uint8_t rf_adr_get_state(uint8_t addr)
+{
+    const rf_adr_peer_t *peer = rf_adr_peer(addr, 0);
+
+    return (peer != NULL) ? peer->state : RF_ADR_STATE_IDLE;
+}
+
+/**
+ * @brief frames to a peer go at a new rate, the peer is our own address when the listen rate changed
+ * @param[in] <peer> peer address
+ * @param[in] <rate> new rate
+ * @return none
+ */
+__weak void rf_adr_switch_event(uint8_t peer, const rf_adr_rate_t *rate)
+{
+    (void)peer;
+    (void)rate;
+}
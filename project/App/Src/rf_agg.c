@@ -0,0 +1,239 @@
+//
+// Small-message aggregation into full frames with a latency deadline.
+//
+#include "rf_agg.h"
+#include "rf_frame.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+typedef struct {
+    uint8_t used;
+    uint8_t dst;
+    uint8_t msgs;
+    uint8_t len;                // frame length so far, header included
+    uint32_t deadline;          // HAL tick by which the frame has to go out
+    uint32_t single_us;         // airtime of the held messages sent one per frame
+    uint8_t frame[RF_FRAME_MAX_LEN];
+} rf_agg_slot_t;
+
+static rf_agg_slot_t agg_slot[RF_AGG_SLOTS];
+static uint8_t agg_seq = 0;
+static rf_agg_stats_t agg_stats;
+
+/**
+ * @brief drop every pending message
+ * @param[in] <none>
+ * @return none
+ */
+void rf_agg_init(void)
+{
+    memset(agg_slot, 0, sizeof(agg_slot));
+    memset(&agg_stats, 0, sizeof(agg_stats));
+}
+
+static uint32_t rf_agg_xmit(rf_agg_slot_t *slot)
+{
+    uint32_t res;
+
+    if (!slot->used) {
+        return OK;
+    }
+    res = rf_frame_xmit(slot->frame, slot->len);
+    rf_enter_continous_rx();
+    if (res == OK) {
+        agg_stats.frames++;
+        agg_stats.msgs += slot->msgs;
+        agg_stats.bytes += slot->len - RF_FRAME_HDR_LEN;
+        agg_stats.airtime_us += rf_get_airtime_us(slot->len);
+        agg_stats.airtime_single_us += slot->single_us;
+    }
+    slot->used = 0;
+    return res;
+}
+
+static rf_agg_slot_t *rf_agg_open(uint8_t dst, uint32_t *res)
+{
+    rf_agg_slot_t *slot = NULL;
+    rf_frame_hdr_t hdr;
+    uint8_t i;
+
+    for (i = 0; i < RF_AGG_SLOTS; i++) {
+        if (!agg_slot[i].used) {
+            slot = &agg_slot[i];
+            break;
+        }
+        // all busy: the one due first goes out now
+        if (slot == NULL || (int32_t)(agg_slot[i].deadline - slot->deadline) < 0) {
+            slot = &agg_slot[i];
+        }
+    }
+    *res |= rf_agg_xmit(slot);
+
+    hdr.dst = dst;
+    hdr.src = rf_frame_get_addr();
+    hdr.seq = agg_seq++;
+    hdr.flags = RF_FRAME_FLAG_AGG;
+    hdr.frag = 0;
+    slot->len = rf_frame_encode(slot->frame, &hdr);
+    slot->used = 1;
+    slot->dst = dst;
+    slot->msgs = 0;
+    slot->single_us = 0;
+    return slot;
+}
+
+/**
+ * @brief queue a message for aggregation
+ * @param[in] <dst> destination address
+ * @param[in] <msg> message
+ * @param[in] <len> message length, at most RF_AGG_MAX_MSG
+ * @param[in] <deadline_ms> longest time the message may wait, 0 sends the frame right away
+ * @return result, FAIL when a frame sent on the way (full, pushed out or due now) failed
+ */
+uint32_t rf_agg_send(uint8_t dst, const uint8_t *msg, uint8_t len, uint32_t deadline_ms)
+{
+    rf_agg_slot_t *slot = NULL;
+    uint32_t res = OK;
+    uint32_t deadline = HAL_GetTick() + deadline_ms;
+    uint8_t i;
+
+    if (len > RF_AGG_MAX_MSG) {
+        return FAIL;
+    }
+
+    for (i = 0; i < RF_AGG_SLOTS; i++) {
+        if (agg_slot[i].used && agg_slot[i].dst == dst) {
+            slot = &agg_slot[i];
+            break;
+        }
+    }
+    if (slot != NULL && slot->len + 1 + len > RF_FRAME_MAX_LEN) {
+        res = rf_agg_xmit(slot);
+        slot = NULL;
+    }
+    if (slot == NULL) {
+        slot = rf_agg_open(dst, &res);
+        slot->deadline = deadline;
+    }
+
+    slot->frame[slot->len++] = len;
+    memcpy(slot->frame + slot->len, msg, len);
+    slot->len += len;
+    slot->msgs++;
+    slot->single_us += rf_get_airtime_us(RF_FRAME_HDR_LEN + len);
+    if ((int32_t)(deadline - slot->deadline) < 0) {
+        slot->deadline = deadline;
+    }
+
+    if (deadline_ms == 0 || slot->len + 1 >= RF_FRAME_MAX_LEN) {
+        res |= rf_agg_xmit(slot);
+    }
+    return res;
+}
+
+/**
+ * @brief send every pending frame now
+ * @param[in] <none>
+ * @return result
+ */
+uint32_t rf_agg_flush(void)
+{
+    uint32_t res = OK;
+    uint8_t i;
+
+    for (i = 0; i < RF_AGG_SLOTS; i++) {
+        res |= rf_agg_xmit(&agg_slot[i]);
+    }
+    return res;
+}
+
+/**
+ * @brief send frames whose deadline expired, call it from the main loop
+ * @param[in] <none>
+ * @return none
+ */
+void rf_agg_poll(void)
+{
+    uint32_t now = HAL_GetTick();
+    uint8_t i;
+
+    for (i = 0; i < RF_AGG_SLOTS; i++) {
+        if (agg_slot[i].used && (int32_t)(now - agg_slot[i].deadline) >= 0) {
+            agg_stats.deadline_flush++;
+            rf_agg_xmit(&agg_slot[i]);
+        }
+    }
+}
+
+/**
+ * @brief feed a received frame, an aggregate is split into its messages
+ * @param[in] <frame> received frame
+ * @param[in] <len> frame length
+ * @return 1 when the frame was an aggregate and has been consumed, 0 otherwise
+ */
+uint32_t rf_agg_input(uint8_t *frame, uint16_t len)
+{
+    rf_frame_hdr_t hdr;
+    uint16_t pos;
+    uint8_t mlen;
+
+    pos = rf_frame_decode(frame, len, &hdr);
+    if (pos == 0 || !(hdr.flags & RF_FRAME_FLAG_AGG)) {
+        return 0;
+    }
+    if (hdr.dst != rf_frame_get_addr() && hdr.dst != RF_FRAME_ADDR_BROADCAST) {
+        return 1;
+    }
+
+    agg_stats.rx_frames++;
+    while (pos < len) {
+        mlen = frame[pos++];
+        if (pos + mlen > len) {
+            // truncated, the messages before it were fine
+            agg_stats.rx_bad++;
+            break;
+        }
+        agg_stats.rx_msgs++;
+        rf_agg_rx_event(hdr.src, frame + pos, mlen);
+        pos += mlen;
+    }
+    return 1;
+}
+
+/**
+ * @brief how full the aggregated frames were
+ * @param[in] <none>
+ * @return payload bytes sent in permille of frames * RF_FRAME_MAX_PAYLOAD
+ */
+uint32_t rf_agg_get_fill(void)
+{
+    if (agg_stats.frames == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)agg_stats.bytes * 1000 / ((uint64_t)agg_stats.frames * RF_FRAME_MAX_PAYLOAD));
+}
+
+/**
+ * @brief get aggregation counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_agg_stats_t *rf_agg_get_stats(void)
+{
+    return &agg_stats;
+}
+
+/**
+ * @brief one message of a received aggregate
+ * @param[in] <src> sender address
+ * @param[in] <msg> message
+ * @param[in] <len> message length
+ * @return none
+ */
+__weak void rf_agg_rx_event(uint8_t src, uint8_t *msg, uint8_t len)
+{
+    (void)src;
+    (void)msg;
+    (void)len;
+}
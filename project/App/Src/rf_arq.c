@@ -0,0 +1,393 @@
+//
+// Reliable delivery over rf_frame: selective-repeat sliding window ARQ.
+//
+#include "rf_arq.h"
+#include "rf_frame.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+#if (RF_ARQ_WINDOW & (RF_ARQ_WINDOW - 1)) || RF_ARQ_WINDOW > 32
+#error "RF_ARQ_WINDOW must be a power of 2, at most 32"
+#endif
+
+#define ARQ_SLOT(seq)       ((seq) & (RF_ARQ_WINDOW - 1))
+
+typedef struct {
+    uint8_t len;
+    uint8_t acked;
+    uint8_t data[RF_ARQ_MAX_PAYLOAD];
+} rf_arq_slot_t;
+
+// sender
+static uint8_t arq_state = RF_ARQ_STATE_IDLE;
+static uint8_t arq_dst;
+static uint8_t arq_base;        // oldest unacknowledged sequence
+static uint8_t arq_next;        // next sequence to assign
+static uint8_t arq_retry;
+static uint8_t arq_synced;      // an ACK arrived in this session, SYN no longer needed
+static uint32_t arq_deadline;
+static rf_arq_slot_t arq_tx[RF_ARQ_WINDOW];
+
+// receiver
+static uint8_t arq_peer = RF_FRAME_ADDR_BROADCAST;
+static uint8_t arq_expected;    // next in-order sequence
+static uint32_t arq_rx_map;     // bit i: arq_expected + 1 + i buffered
+static uint8_t arq_unacked;     // frames since the last ACK we sent
+static uint8_t arq_syn_open;    // the session began with a SYN at arq_syn_base, no plain frame yet
+static uint8_t arq_syn_base;
+static uint32_t arq_syn_tick;
+static rf_arq_slot_t arq_rx[RF_ARQ_WINDOW];
+
+static uint8_t arq_frame[RF_FRAME_MAX_LEN];
+static rf_arq_stats_t arq_stats;
+
+/**
+ * @brief reset both ends of the ARQ
+ * @param[in] <none>
+ * @return none
+ */
+void rf_arq_init(void)
+{
+    arq_state = RF_ARQ_STATE_IDLE;
+    arq_base = 0;
+    arq_next = 0;
+    arq_retry = 0;
+    arq_synced = 0;
+    arq_peer = RF_FRAME_ADDR_BROADCAST;
+    arq_expected = 0;
+    arq_rx_map = 0;
+    arq_unacked = 0;
+    arq_syn_open = 0;
+    memset(arq_tx, 0, sizeof(arq_tx));
+    memset(&arq_stats, 0, sizeof(arq_stats));
+}
+
+/**
+ * @brief queue one datagram for reliable delivery, rf_arq_poll sends it
+ * @param[in] <dst> destination, must match the queued datagrams until they are acknowledged
+ * @param[in] <data> datagram
+ * @param[in] <len> datagram length, at most RF_ARQ_MAX_PAYLOAD
+ * @return OK, or FAIL when the window is full
+ */
+uint32_t rf_arq_send(uint8_t dst, const uint8_t *data, uint8_t len)
+{
+    rf_arq_slot_t *slot;
+
+    if (len > RF_ARQ_MAX_PAYLOAD || rf_arq_pending() >= RF_ARQ_WINDOW) {
+        return FAIL;
+    }
+    if (rf_arq_pending() != 0 && dst != arq_dst) {
+        return FAIL;
+    }
+
+    arq_dst = dst;
+    slot = &arq_tx[ARQ_SLOT(arq_next)];
+    memcpy(slot->data, data, len);
+    slot->len = len;
+    slot->acked = 0;
+    arq_next++;
+    if (arq_state == RF_ARQ_STATE_IDLE) {
+        arq_state = RF_ARQ_STATE_SEND;
+    }
+    return OK;
+}
+
+/**
+ * @brief number of datagrams not yet acknowledged
+ * @param[in] <none>
+ * @return count
+ */
+uint32_t rf_arq_pending(void)
+{
+    return (uint8_t)(arq_next - arq_base);
+}
+
+/**
+ * @brief retransmission timeout for the current modem parameters
+ * @param[in] <none>
+ * @return timeout(ms)
+ */
+uint32_t rf_arq_get_rto_ms(void)
+{
+    return (2 * rf_get_airtime_us(RF_ARQ_ACK_LEN) + RF_ARQ_TURNAROUND_US + 999) / 1000;
+}
+
+static void rf_arq_send_ack(uint8_t dst)
+{
+    rf_frame_hdr_t hdr;
+    uint8_t hlen;
+
+    hdr.dst = dst;
+    hdr.src = rf_frame_get_addr();
+    hdr.seq = arq_expected;
+    hdr.flags = RF_FRAME_FLAG_ACK;
+    hdr.frag = 0;
+    hlen = rf_frame_encode(arq_frame, &hdr);
+    arq_frame[hlen + 0] = arq_rx_map;
+    arq_frame[hlen + 1] = arq_rx_map >> 8;
+    arq_frame[hlen + 2] = arq_rx_map >> 16;
+    arq_frame[hlen + 3] = arq_rx_map >> 24;
+
+    rf_frame_xmit(arq_frame, hlen + 4);
+    rf_enter_continous_rx();
+    arq_unacked = 0;
+    arq_stats.acks_tx++;
+}
+
+// start the receive window over at the sender's base
+static void rf_arq_rx_resync(uint8_t src, uint8_t base, uint8_t syn)
+{
+    arq_peer = src;
+    arq_expected = base;
+    arq_rx_map = 0;
+    arq_syn_open = syn;
+    arq_syn_base = base;
+    arq_syn_tick = HAL_GetTick();
+    arq_stats.rx_resync++;
+}
+
+static void rf_arq_rx_data(const rf_frame_hdr_t *hdr, uint8_t *payload, uint8_t len)
+{
+    uint8_t syn, base, off;
+    rf_arq_slot_t *slot;
+
+    if (len < RF_ARQ_CTL_LEN || (payload[0] & RF_ARQ_CTL_OFF) >= RF_ARQ_WINDOW) {
+        return;
+    }
+    syn = payload[0] & RF_ARQ_CTL_SYN;
+    base = hdr->seq - (payload[0] & RF_ARQ_CTL_OFF);
+    payload += RF_ARQ_CTL_LEN;
+    len -= RF_ARQ_CTL_LEN;
+
+    // a new sender, a new session of this one, or a base our window cannot have come from:
+    // the sender has been acked up to base at most, nothing before it is ours to ack
+    if (hdr->src != arq_peer ||
+        (syn && !(arq_syn_open && base == arq_syn_base && HAL_GetTick() - arq_syn_tick <= RF_ARQ_SYN_HOLD_MS)) ||
+        (uint8_t)(arq_expected - base) > RF_ARQ_WINDOW) {
+        rf_arq_rx_resync(hdr->src, base, syn);
+    } else if (!syn) {
+        arq_syn_open = 0;
+    }
+    off = hdr->seq - arq_expected;
+
+    if (off == 0) {
+        arq_stats.rx_delivered++;
+        rf_arq_rx_event(hdr->src, payload, len);
+        arq_expected++;
+        // release the in-order run that was buffered behind the gap
+        while (arq_rx_map & 1) {
+            slot = &arq_rx[ARQ_SLOT(arq_expected)];
+            arq_rx_map >>= 1;
+            arq_stats.rx_delivered++;
+            rf_arq_rx_event(hdr->src, slot->data, slot->len);
+            arq_expected++;
+        }
+        arq_rx_map >>= 1;
+    } else if (off < RF_ARQ_WINDOW) {
+        if (arq_rx_map & (1UL << (off - 1))) {
+            arq_stats.rx_duplicates++;
+        } else {
+            slot = &arq_rx[ARQ_SLOT(hdr->seq)];
+            memcpy(slot->data, payload, len);
+            slot->len = len;
+            arq_rx_map |= 1UL << (off - 1);
+        }
+    } else {
+        // behind the window, not before base: already delivered, the ACK got lost
+        arq_stats.rx_duplicates++;
+    }
+
+    arq_unacked++;
+    if ((hdr->flags & RF_FRAME_FLAG_AREQ) || arq_unacked >= RF_ARQ_WINDOW) {
+        rf_arq_send_ack(hdr->src);
+    }
+}
+
+static void rf_arq_rx_ack(const rf_frame_hdr_t *hdr, const uint8_t *payload, uint16_t len)
+{
+    uint32_t map;
+    uint8_t cum = hdr->seq;
+    uint8_t i, seq;
+
+    if (arq_state != RF_ARQ_STATE_WAIT_ACK || hdr->src != arq_dst || len < 4) {
+        return;
+    }
+    // cumulative part must lie inside what we sent
+    if ((uint8_t)(cum - arq_base) > rf_arq_pending()) {
+        return;
+    }
+    arq_stats.acks_rx++;
+    arq_synced = 1;
+
+    map = payload[0] | ((uint32_t)payload[1] << 8) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    arq_base = cum;
+    for (i = 0; i < 32; i++) {
+        seq = cum + 1 + i;
+        if ((uint8_t)(seq - arq_base) >= rf_arq_pending()) {
+            break;
+        }
+        if (map & (1UL << i)) {
+            arq_tx[ARQ_SLOT(seq)].acked = 1;
+        }
+    }
+
+    arq_retry = 0;
+    arq_state = rf_arq_pending() ? RF_ARQ_STATE_SEND : RF_ARQ_STATE_IDLE;
+}
+
+/**
+ * @brief feed a received frame; ARQ and ACK frames are consumed, others go to rf_frame_input.
+ *        May send an ACK and wait for TX done, so call it from the main loop, not from an interrupt
+ * @param[in] <frame> received frame
+ * @param[in] <len> frame length
+ * @return none
+ */
+void rf_arq_input(uint8_t *frame, uint16_t len)
+{
+    rf_frame_hdr_t hdr;
+    uint8_t hlen;
+
+    hlen = rf_frame_decode(frame, len, &hdr);
+    if (hlen == 0 || !(hdr.flags & (RF_FRAME_FLAG_ARQ | RF_FRAME_FLAG_ACK))) {
+        rf_frame_input(frame, len);
+        return;
+    }
+    if (hdr.dst != rf_frame_get_addr()) {
+        return;
+    }
+
+    if (hdr.flags & RF_FRAME_FLAG_ACK) {
+        rf_arq_rx_ack(&hdr, frame + hlen, len - hlen);
+    } else {
+        rf_arq_rx_data(&hdr, frame + hlen, len - hlen);
+    }
+}
+
+static void rf_arq_send_burst(void)
+{
+    rf_frame_hdr_t hdr;
+    rf_arq_slot_t *slot;
+    uint8_t seq, last = 0, found = 0;
+    uint8_t hlen;
+
+    for (seq = arq_base; seq != arq_next; seq++) {
+        if (!arq_tx[ARQ_SLOT(seq)].acked) {
+            last = seq;
+            found = 1;
+        }
+    }
+    if (!found) {
+        // everything selectively acked, wait for the cumulative ACK
+        arq_base = arq_next;
+        arq_state = RF_ARQ_STATE_IDLE;
+        return;
+    }
+
+    hdr.dst = arq_dst;
+    hdr.src = rf_frame_get_addr();
+    hdr.frag = 0;
+    for (seq = arq_base; ; seq++) {
+        slot = &arq_tx[ARQ_SLOT(seq)];
+        if (!slot->acked) {
+            hdr.seq = seq;
+            hdr.flags = RF_FRAME_FLAG_ARQ | ((seq == last) ? RF_FRAME_FLAG_AREQ : 0);
+            hlen = rf_frame_encode(arq_frame, &hdr);
+            arq_frame[hlen] = (uint8_t)(seq - arq_base) | (arq_synced ? 0 : RF_ARQ_CTL_SYN);
+            memcpy(arq_frame + hlen + RF_ARQ_CTL_LEN, slot->data, slot->len);
+            rf_frame_xmit(arq_frame, hlen + RF_ARQ_CTL_LEN + slot->len);
+            arq_stats.tx_frames++;
+            if (arq_retry) {
+                arq_stats.retransmits++;
+            }
+        }
+        if (seq == last) {
+            break;
+        }
+    }
+
+    rf_enter_continous_rx();
+    arq_deadline = HAL_GetTick() + rf_arq_get_rto_ms();
+    arq_state = RF_ARQ_STATE_WAIT_ACK;
+}
+
+/**
+ * @brief run the sender, call it from the main loop
+ * @param[in] <none>
+ * @return none
+ */
+void rf_arq_poll(void)
+{
+    uint32_t lost;
+
+    switch (arq_state) {
+        case RF_ARQ_STATE_SEND:
+            rf_arq_send_burst();
+            break;
+        case RF_ARQ_STATE_WAIT_ACK:
+            if ((int32_t)(HAL_GetTick() - arq_deadline) < 0) {
+                break;
+            }
+            arq_stats.timeouts++;
+            if (++arq_retry > RF_ARQ_MAX_RETRY) {
+                lost = rf_arq_pending();
+                arq_stats.dropped += lost;
+                arq_base = arq_next;
+                arq_retry = 0;
+                arq_synced = 0;
+                arq_state = RF_ARQ_STATE_IDLE;
+                rf_arq_fail_event(arq_dst, lost);
+            } else {
+                arq_state = RF_ARQ_STATE_SEND;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief get sender state
+ * @param[in] <none>
+ * @return RF_ARQ_STATE_IDLE / RF_ARQ_STATE_SEND / RF_ARQ_STATE_WAIT_ACK
+ */
+uint8_t rf_arq_get_state(void)
+{
+    return arq_state;
+}
+
+/**
+ * @brief get ARQ counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_arq_stats_t *rf_arq_get_stats(void)
+{
+    return &arq_stats;
+}
+
+/**
+ * @brief a datagram was delivered in order
+ * @param[in] <src> sender address
+ * @param[in] <data> datagram
+ * @param[in] <len> datagram length
+ * @return none
+ */
+__weak void rf_arq_rx_event(uint8_t src, uint8_t *data, uint8_t len)
+{
+    (void)src;
+    (void)data;
+    (void)len;
+}
+
+/**
+ * @brief the window was dropped after RF_ARQ_MAX_RETRY timeouts
+ * @param[in] <dst> destination
+ * @param[in] <lost> number of datagrams dropped
+ * @return none
+ */
+__weak void rf_arq_fail_event(uint8_t dst, uint32_t lost)
+{
+    (void)dst;
+    (void)lost;
+}
@@ -0,0 +1,405 @@
+//
+// On-target benchmarks, reported over USART1.
+// Cycle counts come from SysTick, the M0 has no DWT cycle counter.
+//
+#include "rf_bench.h"
+#include "main.h"
+#include "crc.h"
+#include "lz.h"
+#include "pan3031.h"
+#include "radio.h"
+#include "string.h"
+#include "rf_uart.h"
+
+#define BENCH_ROUNDS    16
+#define BENCH_IRQ_MS    200     // longest wait for the radio to raise its IRQ pin
+#define BENCH_PEER_MS   3000    // window for packets from a second board running WORK_MODE_TX
+
+typedef struct {
+    uint32_t n;
+    uint32_t min;
+    uint32_t max;
+    uint32_t sum;
+} bench_stat_t;
+
+extern struct RxDoneMsg RxDoneParams;
+
+typedef uint16_t (*bench_crc_fn_t)(uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType);
+
+static uint8_t bench_buf[255];
+
+/**
+ * @brief free running cycle counter built from the HAL tick and the SysTick down counter
+ * @param[in] <none>
+ * @return core cycles, wraps after 2^32 cycles
+ */
+uint32_t bench_cycles(void)
+{
+    uint32_t tick, val;
+
+    do {
+        tick = HAL_GetTick();
+        val = SysTick->VAL;
+    } while (tick != HAL_GetTick());
+
+    return tick * (SysTick->LOAD + 1) + (SysTick->LOAD - val);
+}
+
+static uint32_t bench_crc_one(bench_crc_fn_t fn, uint32_t len, uint8_t type)
+{
+    uint32_t i, start, best = 0xFFFFFFFF;
+    volatile uint16_t sink;
+
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+        sink = fn(CRC_CCITT_SEED, bench_buf, len, type);
+        start = bench_cycles() - start;
+        if (start < best) {
+            best = start;
+        }
+    }
+    (void)sink;
+    return best;
+}
+
+/**
+ * @brief time every CRC engine, prints "crc,<engine>,<len>,<cycles>,<cycles per byte x100>"
+ * @param[in] <none>
+ * @return none
+ */
+void rf_bench_crc(void)
+{
+    static const struct {
+        const char *name;
+        bench_crc_fn_t fn;
+    } engines[] = {
+        { "bitwise", ComputeCrcBitwise },
+        { "nibble", ComputeCrcNibble },
+        { "table", ComputeCrcTable },
+    };
+    static const uint16_t lengths[] = { 16, 64, 255 };
+    uint32_t e, l, cycles, overhead;
+
+    for (l = 0; l < sizeof(bench_buf); l++) {
+        bench_buf[l] = (uint8_t)(l * 7 + 3);
+    }
+
+    overhead = bench_crc_one(ComputeCrcTable, 0, CRC_TYPE_CCITT);
+    for (e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            cycles = bench_crc_one(engines[e].fn, lengths[l], CRC_TYPE_CCITT) - overhead;
+            rf_uart_printf("crc,%s,%u,%lu,%lu\r\n", engines[e].name, lengths[l],
+                   (unsigned long)cycles, (unsigned long)(cycles * 100 / lengths[l]));
+        }
+    }
+}
+
+/**
+ * @brief time the payload codec on one telemetry report, without and with a preset dictionary,
+ *        prints "lz,<dict len>,<len in>,<len out>,<compress cycles>,<decompress cycles>"
+ * @param[in] <none>
+ * @return none
+ */
+void rf_bench_lz(void)
+{
+    static const char dict[] = "id=17,seq=1041,t=23.40,h=45.2,p=1013.2,bat=3310";
+    static const char report[] = "id=17,seq=1042,t=23.45,h=45.1,p=1013.2,bat=3309";
+    static uint8_t work[sizeof(dict) + sizeof(report)];
+    static uint8_t out[sizeof(report)];
+    uint32_t d, in_len, out_len, dict_len, c_cycles, d_cycles;
+
+    in_len = sizeof(report) - 1;
+    for (d = 0; d < 2; d++) {
+        dict_len = d ? sizeof(dict) - 1 : 0;
+        memcpy(work, dict, dict_len);
+        memcpy(work + dict_len, report, in_len);
+
+        c_cycles = bench_cycles();
+        out_len = LzCompress(work, dict_len, in_len, out, in_len - 1);
+        c_cycles = bench_cycles() - c_cycles;
+
+        d_cycles = 0;
+        if (out_len != 0) {
+            d_cycles = bench_cycles();
+            LzDecompress(out, out_len, work, dict_len, sizeof(work));
+            d_cycles = bench_cycles() - d_cycles;
+        }
+        rf_uart_printf("lz,%lu,%lu,%lu,%lu,%lu\r\n", (unsigned long)dict_len, (unsigned long)in_len,
+               (unsigned long)(out_len ? out_len : in_len), (unsigned long)c_cycles, (unsigned long)d_cycles);
+    }
+}
+
+static void bench_stat_add(bench_stat_t *s, uint32_t cycles, uint32_t overhead)
+{
+    cycles = (cycles > overhead) ? cycles - overhead : 0;
+    if (s->n == 0 || cycles < s->min) {
+        s->min = cycles;
+    }
+    if (cycles > s->max) {
+        s->max = cycles;
+    }
+    s->sum += cycles;
+    s->n++;
+}
+
+static void bench_stat_print(const char *name, uint32_t arg, const bench_stat_t *s)
+{
+    rf_uart_printf("cyc,%s,%lu,%lu,%lu,%lu,%lu\r\n", name, (unsigned long)arg, (unsigned long)s->n,
+           (unsigned long)s->min, (unsigned long)(s->n ? s->sum / s->n : 0), (unsigned long)s->max);
+}
+
+// the cost of an empty measurement, subtracted from every sample
+static uint32_t bench_overhead(void)
+{
+    uint32_t i, start, best = 0xFFFFFFFF;
+
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+        start = bench_cycles() - start;
+        if (start < best) {
+            best = start;
+        }
+    }
+    return best;
+}
+
+static uint32_t bench_wait_irq(uint32_t timeout_ms)
+{
+    uint32_t start = HAL_GetTick();
+
+    while (HAL_GPIO_ReadPin(RF_IRQ_GPIO_Port, RF_IRQ_Pin) != GPIO_PIN_SET) {
+        if (HAL_GetTick() - start > timeout_ms) {
+            return FAIL;
+        }
+    }
+    return OK;
+}
+
+#if PAN3031_BENCH
+// register and FIFO access, the primitives everything else in the driver is made of
+static void bench_spi(uint32_t overhead)
+{
+    static const uint16_t lengths[] = { 1, 16, 64, 255 };
+    bench_stat_t st;
+    uint32_t i, l, p, start;
+    volatile uint32_t sink;
+    uint8_t sys_ctl;
+
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+        sink = PAN3031_read_reg(REG_SYS_CTL);
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    bench_stat_print("read_reg", REG_SYS_CTL, &st);
+
+    // the current value, so nothing changes; the write includes its read back
+    sys_ctl = PAN3031_read_reg(REG_SYS_CTL);
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+        sink = PAN3031_write_reg(REG_SYS_CTL, sys_ctl);
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    bench_stat_print("write_reg", REG_SYS_CTL, &st);
+
+    // every round is a real switch, page 0 is selected again at the end
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        p = (i + 1) & 0x03;
+        start = bench_cycles();
+        sink = PAN3031_switch_page((enum PAGE_SEL)p);
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    PAN3031_switch_page(PAGE0_SEL);
+    bench_stat_print("switch_page", 0, &st);
+
+    for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        memset(&st, 0, sizeof(st));
+        for (i = 0; i < BENCH_ROUNDS; i++) {
+            start = bench_cycles();
+            PAN3031_write_fifo(REG_FIFO_ACC_ADDR, bench_buf, lengths[l]);
+            bench_stat_add(&st, bench_cycles() - start, overhead);
+        }
+        bench_stat_print("write_fifo", lengths[l], &st);
+
+        memset(&st, 0, sizeof(st));
+        for (i = 0; i < BENCH_ROUNDS; i++) {
+            start = bench_cycles();
+            PAN3031_read_fifo(REG_FIFO_ACC_ADDR, bench_buf, lengths[l]);
+            bench_stat_add(&st, bench_cycles() - start, overhead);
+        }
+        bench_stat_print("read_fifo", lengths[l], &st);
+    }
+    (void)sink;
+}
+#endif
+
+// the handler on an IRQ raised for real, the stat is picked by the flag the handler sets
+static void bench_irq_one(bench_stat_t *done, bench_stat_t *other, uint32_t overhead)
+{
+    uint32_t start;
+
+    rf_set_transmit_flag(RADIO_FLAG_IDLE);
+    rf_set_recv_flag(RADIO_FLAG_IDLE);
+    start = bench_cycles();
+    PAN3031_irq_handler();
+    start = bench_cycles() - start;
+    if (rf_get_transmit_flag() == RADIO_FLAG_TXDONE || rf_get_recv_flag() == RADIO_FLAG_RXDONE
+        || rf_get_recv_flag() == RADIO_FLAG_RXTIMEOUT) {
+        bench_stat_add(done, start, overhead);
+    } else if (other != NULL) {
+        bench_stat_add(other, start, overhead);
+    }
+}
+
+/**
+ * @brief time PAN3031_irq_handler per IRQ type with the RF EXTI masked, so the bench calls the
+ *        handler itself once the IRQ pin is up. RX done and CRC error need a second board sending
+ *        within BENCH_PEER_MS, without one they are reported with n = 0
+ * @param[in] <overhead> cycles of an empty measurement
+ * @return none
+ */
+static void bench_irq(uint32_t overhead)
+{
+    bench_stat_t st, err;
+    uint32_t i, tx_time, start;
+
+    // nothing pending, the IRQ status read and nothing else
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+        PAN3031_irq_handler();
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    bench_stat_print("irq_none", 0, &st);
+
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        if (rf_single_tx_data(bench_buf, 8, &tx_time) == OK && bench_wait_irq(BENCH_IRQ_MS) == OK) {
+            bench_irq_one(&st, NULL, overhead);
+        }
+    }
+    bench_stat_print("irq_tx_done", 8, &st);
+
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        if (rf_enter_single_timeout_rx(5) == OK && bench_wait_irq(BENCH_IRQ_MS) == OK) {
+            bench_irq_one(&st, NULL, overhead);
+        }
+    }
+    bench_stat_print("irq_rx_timeout", 0, &st);
+
+    memset(&st, 0, sizeof(st));
+    memset(&err, 0, sizeof(err));
+    start = HAL_GetTick();
+    if (rf_enter_continous_rx() == OK) {
+        while (st.n < BENCH_ROUNDS && HAL_GetTick() - start < BENCH_PEER_MS) {
+            if (HAL_GPIO_ReadPin(RF_IRQ_GPIO_Port, RF_IRQ_Pin) == GPIO_PIN_SET) {
+                bench_irq_one(&st, &err, overhead);
+            }
+        }
+    }
+    bench_stat_print("irq_rx_done", st.n ? RxDoneParams.Size : 0, &st);
+    bench_stat_print("irq_crc_err", 0, &err);
+    PAN3031_set_mode(PAN3031_MODE_STB3);
+}
+
+/**
+ * @brief time the driver on the radio, prints one
+ *        "cyc,<routine>,<arg>,<n>,<min>,<mean>,<max>" line per routine, in core cycles with the
+ *        measurement overhead taken off. arg is the length, register or payload size measured.
+ *        The register and FIFO primitives are only there when built with PAN3031_BENCH
+ * @param[in] <none>
+ * @return none
+ */
+void rf_bench_driver(void)
+{
+    static const uint16_t lengths[] = { 16, 64, 255 };
+    bench_stat_t st;
+    uint32_t i, l, freq, overhead, start;
+    volatile uint32_t sink;
+
+    for (l = 0; l < sizeof(bench_buf); l++) {
+        bench_buf[l] = (uint8_t)(l * 7 + 3);
+    }
+    // the bench runs the handler itself
+    HAL_NVIC_DisableIRQ(EXTI0_1_IRQn);
+    overhead = bench_overhead();
+    PAN3031_set_mode(PAN3031_MODE_STB3);
+
+#if PAN3031_BENCH
+    bench_spi(overhead);
+#endif
+
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+#if RF_INT_METADATA
+        sink = (uint32_t)PAN3031_get_snr_cdb();
+#else
+        sink = (uint32_t)PAN3031_get_snr();
+#endif
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    bench_stat_print("get_snr", 0, &st);
+
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+#if RF_INT_METADATA
+        sink = (uint32_t)PAN3031_get_rssi_cdb();
+#else
+        sink = (uint32_t)PAN3031_get_rssi();
+#endif
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    bench_stat_print("get_rssi", 0, &st);
+
+    // the frequency already set, the radio stays where it was
+    freq = rf_get_modem_cfg()->Freq;
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+        sink = PAN3031_set_freq(freq);
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    bench_stat_print("set_freq", freq, &st);
+
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = bench_cycles();
+        sink = PAN3031_calculate_tx_time();
+        bench_stat_add(&st, bench_cycles() - start, overhead);
+    }
+    bench_stat_print("calculate_tx_time", 0, &st);
+
+    for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        memset(&st, 0, sizeof(st));
+        for (i = 0; i < BENCH_ROUNDS; i++) {
+            start = bench_cycles();
+            sink = RadioComputeCRC(bench_buf, lengths[l], CRC_TYPE_CCITT);
+            bench_stat_add(&st, bench_cycles() - start, overhead);
+        }
+        bench_stat_print("RadioComputeCRC", lengths[l], &st);
+    }
+
+    bench_irq(overhead);
+
+    __HAL_GPIO_EXTI_CLEAR_IT(RF_IRQ_Pin);
+    HAL_NVIC_ClearPendingIRQ(EXTI0_1_IRQn);
+    HAL_NVIC_EnableIRQ(EXTI0_1_IRQn);
+    (void)sink;
+}
+
+/**
+ * @brief run all benchmarks once
+ * @param[in] <none>
+ * @return none
+ */
+void rf_bench_run(void)
+{
+    rf_bench_crc();
+    rf_bench_lz();
+    rf_bench_driver();
+}
@@ -0,0 +1,228 @@
+//
+// Airtime accountant: charges each frame against per-band sliding-window duty-cycle budgets.
+//
+#include "rf_duty.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+static rf_duty_band_t duty_band[RF_DUTY_MAX_BANDS];
+static uint8_t duty_band_num = 0;
+static uint8_t duty_held;       // bands that held back the frame being checked, bit per band
+
+/**
+ * @brief drop every band, frames are no longer limited
+ * @param[in] <none>
+ * @return none
+ */
+void rf_duty_init(void)
+{
+    memset(duty_band, 0, sizeof(duty_band));
+    duty_band_num = 0;
+    duty_held = 0;
+}
+
+/**
+ * @brief add a duty-cycle band, bands are numbered in the order they are added
+ * @param[in] <lo_hz> lowest frequency of the band
+ * @param[in] <hi_hz> first frequency above the band
+ * @param[in] <permille> allowed airtime per window, 1..1000
+ * @param[in] <window_ms> window length, at least RF_DUTY_BUCKETS ms
+ * @return result
+ */
+uint32_t rf_duty_add_band(uint32_t lo_hz, uint32_t hi_hz, uint16_t permille, uint32_t window_ms)
+{
+    rf_duty_band_t *band;
+
+    if (duty_band_num >= RF_DUTY_MAX_BANDS || lo_hz >= hi_hz) {
+        return FAIL;
+    }
+    if (permille == 0 || permille > 1000 || window_ms < RF_DUTY_BUCKETS) {
+        return FAIL;
+    }
+    // window_ms * 1000 us * permille / 1000
+    if (window_ms > UINT32_MAX / permille) {
+        return FAIL;
+    }
+
+    band = &duty_band[duty_band_num++];
+    memset(band, 0, sizeof(*band));
+    band->lo_hz = lo_hz;
+    band->hi_hz = hi_hz;
+    band->budget_us = window_ms * permille;
+    // rounded up, the buckets cover at least the whole window
+    band->bucket_ms = window_ms / RF_DUTY_BUCKETS + (window_ms % RF_DUTY_BUCKETS != 0);
+    band->bucket_start = HAL_GetTick();
+    band->used = 1;
+    return OK;
+}
+
+static void rf_duty_advance(rf_duty_band_t *band, uint32_t now)
+{
+    uint32_t steps = (now - band->bucket_start) / band->bucket_ms;
+
+    if (steps >= RF_DUTY_BUCKETS) {
+        // idle for a whole window
+        memset(band->bucket_us, 0, sizeof(band->bucket_us));
+        band->bucket_start = now;
+        return;
+    }
+    while (steps--) {
+        band->cur = (band->cur + 1) % RF_DUTY_BUCKETS;
+        band->bucket_us[band->cur] = 0;
+        band->bucket_start += band->bucket_ms;
+    }
+}
+
+static uint32_t rf_duty_sum(const rf_duty_band_t *band)
+{
+    uint32_t sum = 0;
+    uint8_t i;
+
+    for (i = 0; i < RF_DUTY_BUCKETS; i++) {
+        sum += band->bucket_us[i];
+    }
+    return sum;
+}
+
+static uint8_t rf_duty_in_band(const rf_duty_band_t *band, uint32_t freq)
+{
+    return band->used && freq >= band->lo_hz && freq < band->hi_hz;
+}
+
+/**
+ * @brief ask whether a frame may go out now with the current modem parameters
+ * @param[in] <len> payload length handed to the radio
+ * @param[out] <wait_ms> with RF_DUTY_DEFER, time until enough airtime has left the window; may be NULL
+ * @return RF_DUTY_ALLOW / RF_DUTY_DEFER / RF_DUTY_REJECT (the frame alone exceeds a budget)
+ */
+uint32_t rf_duty_check(uint8_t len, uint32_t *wait_ms)
+{
+    uint32_t freq = rf_get_modem_cfg()->Freq;
+    uint32_t need = rf_get_airtime_us(len);
+    uint32_t now = HAL_GetTick();
+    uint32_t sum, wait = 0, band_wait;
+    uint8_t i, age;
+    rf_duty_band_t *band;
+
+    for (i = 0; i < duty_band_num; i++) {
+        band = &duty_band[i];
+        if (!rf_duty_in_band(band, freq)) {
+            continue;
+        }
+        if (need > band->budget_us) {
+            duty_held |= 1 << i;
+            return RF_DUTY_REJECT;
+        }
+        rf_duty_advance(band, now);
+        sum = rf_duty_sum(band);
+        if (sum + need <= band->budget_us) {
+            continue;
+        }
+        // the bucket of age a is cleared (RF_DUTY_BUCKETS - a) buckets after the current one opened
+        for (age = RF_DUTY_BUCKETS - 1; ; age--) {
+            sum -= band->bucket_us[(band->cur + RF_DUTY_BUCKETS - age) % RF_DUTY_BUCKETS];
+            if (sum + need <= band->budget_us || age == 0) {
+                break;
+            }
+        }
+        band_wait = band->bucket_start + (RF_DUTY_BUCKETS - age) * band->bucket_ms - now;
+        if (band_wait > wait) {
+            wait = band_wait;
+        }
+        duty_held |= 1 << i;
+    }
+
+    if (wait_ms != NULL) {
+        *wait_ms = wait;
+    }
+    return wait ? RF_DUTY_DEFER : RF_DUTY_ALLOW;
+}
+
+/**
+ * @brief charge a frame that is about to be transmitted to every band of the current frequency,
+ *        the bands that held it back count it as deferred
+ * @param[in] <len> payload length handed to the radio
+ * @return none
+ */
+void rf_duty_charge(uint8_t len)
+{
+    uint32_t freq = rf_get_modem_cfg()->Freq;
+    uint32_t airtime = rf_get_airtime_us(len);
+    uint32_t now = HAL_GetTick();
+    rf_duty_band_t *band;
+    uint8_t i;
+
+    for (i = 0; i < duty_band_num; i++) {
+        band = &duty_band[i];
+        if (!rf_duty_in_band(band, freq)) {
+            continue;
+        }
+        rf_duty_advance(band, now);
+        band->bucket_us[band->cur] += airtime;
+        band->charged++;
+    }
+    for (i = 0; i < duty_band_num; i++) {
+        if (duty_held & (1 << i)) {
+            duty_band[i].deferred++;
+        }
+    }
+    duty_held = 0;
+}
+
+/**
+ * @brief the frame rf_duty_check held back is dropped, the bands that held it count it as rejected
+ * @param[in] <none>
+ * @return none
+ */
+void rf_duty_refuse(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < duty_band_num; i++) {
+        if (duty_held & (1 << i)) {
+            duty_band[i].rejected++;
+        }
+    }
+    duty_held = 0;
+}
+
+/**
+ * @brief airtime charged to a band inside its current window
+ * @param[in] <band> band number
+ * @return airtime(us)
+ */
+uint32_t rf_duty_get_used_us(uint8_t band)
+{
+    if (band >= duty_band_num) {
+        return 0;
+    }
+    rf_duty_advance(&duty_band[band], HAL_GetTick());
+    return rf_duty_sum(&duty_band[band]);
+}
+
+/**
+ * @brief budget utilization of a band
+ * @param[in] <band> band number
+ * @return used airtime in permille of the budget
+ */
+uint32_t rf_duty_get_utilization(uint8_t band)
+{
+    if (band >= duty_band_num) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)rf_duty_get_used_us(band) * 1000 / duty_band[band].budget_us);
+}
+
+/**
+ * @brief get a band with its counters
+ * @param[in] <band> band number
+ * @return band, NULL when it does not exist
+ */
+const rf_duty_band_t *rf_duty_get_band(uint8_t band)
+{
+    if (band >= duty_band_num) {
+        return NULL;
+    }
+    return &duty_band[band];
+}
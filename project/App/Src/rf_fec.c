@@ -0,0 +1,472 @@
+//
+// Cross-packet forward error correction: systematic Reed-Solomon erasure code over rf_frame.
+//
+#include "rf_fec.h"
+#include "rf_frame.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+#if RF_FEC_K < 1 || RF_FEC_K > 15 || RF_FEC_M > 15
+#error "RF_FEC_K must be 1..15 and RF_FEC_M 0..15"
+#endif
+#if RF_FEC_HDR_LEN + RF_FEC_SYMBOL_LEN > RF_FRAME_MAX_PAYLOAD
+#error "RF_FEC_MAX_LEN does not fit in a frame"
+#endif
+
+#define FEC_N                   (RF_FEC_K + RF_FEC_M)
+// Cauchy points: data symbol i is y = i, repair symbol j is x = 16 + j, x ^ y never 0
+#define FEC_X(j)                (16 + (j))
+
+/*
+ * GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D) and generator 2.
+ * gf_exp is doubled so gf_log[a] + gf_log[b] needs no reduction.
+ */
+static const uint8_t gf_exp[510] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26,
+    0x4C, 0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0,
+    0x9D, 0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23,
+    0x46, 0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1,
+    0x5F, 0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0,
+    0xFD, 0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2,
+    0xD9, 0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE,
+    0x81, 0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC,
+    0x85, 0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54,
+    0xA8, 0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73,
+    0xE6, 0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF,
+    0xE3, 0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6,
+    0x51, 0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09,
+    0x12, 0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16,
+    0x2C, 0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E, 0x01,
+    0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26, 0x4C,
+    0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x9D,
+    0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23, 0x46,
+    0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1, 0x5F,
+    0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0, 0xFD,
+    0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2, 0xD9,
+    0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE, 0x81,
+    0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC, 0x85,
+    0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54, 0xA8,
+    0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73, 0xE6,
+    0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF, 0xE3,
+    0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41, 0x82,
+    0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6, 0x51,
+    0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09, 0x12,
+    0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16, 0x2C,
+    0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E
+};
+
+static const uint8_t gf_log[256] = {
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1A, 0xC6, 0x03, 0xDF, 0x33, 0xEE, 0x1B, 0x68, 0xC7, 0x4B,
+    0x04, 0x64, 0xE0, 0x0E, 0x34, 0x8D, 0xEF, 0x81, 0x1C, 0xC1, 0x69, 0xF8, 0xC8, 0x08, 0x4C, 0x71,
+    0x05, 0x8A, 0x65, 0x2F, 0xE1, 0x24, 0x0F, 0x21, 0x35, 0x93, 0x8E, 0xDA, 0xF0, 0x12, 0x82, 0x45,
+    0x1D, 0xB5, 0xC2, 0x7D, 0x6A, 0x27, 0xF9, 0xB9, 0xC9, 0x9A, 0x09, 0x78, 0x4D, 0xE4, 0x72, 0xA6,
+    0x06, 0xBF, 0x8B, 0x62, 0x66, 0xDD, 0x30, 0xFD, 0xE2, 0x98, 0x25, 0xB3, 0x10, 0x91, 0x22, 0x88,
+    0x36, 0xD0, 0x94, 0xCE, 0x8F, 0x96, 0xDB, 0xBD, 0xF1, 0xD2, 0x13, 0x5C, 0x83, 0x38, 0x46, 0x40,
+    0x1E, 0x42, 0xB6, 0xA3, 0xC3, 0x48, 0x7E, 0x6E, 0x6B, 0x3A, 0x28, 0x54, 0xFA, 0x85, 0xBA, 0x3D,
+    0xCA, 0x5E, 0x9B, 0x9F, 0x0A, 0x15, 0x79, 0x2B, 0x4E, 0xD4, 0xE5, 0xAC, 0x73, 0xF3, 0xA7, 0x57,
+    0x07, 0x70, 0xC0, 0xF7, 0x8C, 0x80, 0x63, 0x0D, 0x67, 0x4A, 0xDE, 0xED, 0x31, 0xC5, 0xFE, 0x18,
+    0xE3, 0xA5, 0x99, 0x77, 0x26, 0xB8, 0xB4, 0x7C, 0x11, 0x44, 0x92, 0xD9, 0x23, 0x20, 0x89, 0x2E,
+    0x37, 0x3F, 0xD1, 0x5B, 0x95, 0xBC, 0xCF, 0xCD, 0x90, 0x87, 0x97, 0xB2, 0xDC, 0xFC, 0xBE, 0x61,
+    0xF2, 0x56, 0xD3, 0xAB, 0x14, 0x2A, 0x5D, 0x9E, 0x84, 0x3C, 0x39, 0x53, 0x47, 0x6D, 0x41, 0xA2,
+    0x1F, 0x2D, 0x43, 0xD8, 0xB7, 0x7B, 0xA4, 0x76, 0xC4, 0x17, 0x49, 0xEC, 0x7F, 0x0C, 0x6F, 0xF6,
+    0x6C, 0xA1, 0x3B, 0x52, 0x29, 0x9D, 0x55, 0xAA, 0xFB, 0x60, 0x86, 0xB1, 0xBB, 0xCC, 0x3E, 0x5A,
+    0xCB, 0x59, 0x5F, 0xB0, 0x9C, 0xA9, 0xA0, 0x51, 0x0B, 0xF5, 0x16, 0xEB, 0x7A, 0x75, 0x2C, 0xD7,
+    0x4F, 0xAE, 0xD5, 0xE9, 0xE6, 0xE7, 0xAD, 0xE8, 0x74, 0xD6, 0xF4, 0xEA, 0xA8, 0x50, 0x58, 0xAF
+};
+
+
+#define FEC_RX_SLOTS            (RF_FEC_DEPTH + 1)
+#define FEC_E_MAX               (RF_FEC_M > 0 ? RF_FEC_M : 1)
+
+typedef struct {
+    uint8_t used;
+    uint8_t src;
+    uint8_t group;
+    uint8_t k;
+    uint8_t m;
+    uint8_t size;               // symbol size S, known once a repair frame arrives
+    uint32_t have;              // bit i: symbol i present
+    uint32_t delivered;         // bit i: datagram i handed to rf_fec_rx_event
+    uint32_t stamp;
+    uint8_t sym[FEC_N][RF_FEC_SYMBOL_LEN];
+} rf_fec_rx_t;
+
+// sender: symbols of the queued datagrams, len(1) data zero padded
+static uint8_t fec_dst;
+static uint8_t fec_group = 0;
+static uint8_t fec_queued = 0;
+static uint8_t fec_tx[RF_FEC_DEPTH * RF_FEC_K][RF_FEC_SYMBOL_LEN];
+
+// receiver
+static rf_fec_rx_t fec_rx[FEC_RX_SLOTS];
+static uint32_t fec_rx_clock = 0;
+
+static uint8_t fec_frame[RF_FRAME_MAX_LEN];
+static rf_fec_stats_t fec_stats;
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static uint8_t gf_inv(uint8_t a)
+{
+    return gf_exp[255 - gf_log[a]];
+}
+
+// dst ^= c * src
+static void gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, uint8_t len)
+{
+    uint16_t lc;
+    uint8_t n;
+
+    if (c == 0) {
+        return;
+    }
+    lc = gf_log[c];
+    for (n = 0; n < len; n++) {
+        if (src[n]) {
+            dst[n] ^= gf_exp[lc + gf_log[src[n]]];
+        }
+    }
+}
+
+static uint8_t rf_fec_coef(uint8_t repair, uint8_t data)
+{
+    return gf_inv(FEC_X(repair) ^ data);
+}
+
+static uint8_t rf_fec_popcount(uint32_t v)
+{
+    uint8_t n = 0;
+
+    for (; v; v &= v - 1) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief drop queued datagrams and partial groups
+ * @param[in] <none>
+ * @return none
+ */
+void rf_fec_init(void)
+{
+    fec_queued = 0;
+    fec_rx_clock = 0;
+    memset(fec_rx, 0, sizeof(fec_rx));
+    memset(&fec_stats, 0, sizeof(fec_stats));
+}
+
+/**
+ * @brief queue one datagram, the group goes out once RF_FEC_DEPTH * RF_FEC_K are queued
+ * @param[in] <dst> destination, usually RF_FRAME_ADDR_BROADCAST; must match the queued datagrams
+ * @param[in] <data> datagram
+ * @param[in] <len> datagram length, at most RF_FEC_MAX_LEN
+ * @return result
+ */
+uint32_t rf_fec_send(uint8_t dst, const uint8_t *data, uint8_t len)
+{
+    uint8_t *sym;
+
+    if (len > RF_FEC_MAX_LEN || (fec_queued != 0 && dst != fec_dst)) {
+        return FAIL;
+    }
+
+    fec_dst = dst;
+    sym = fec_tx[fec_queued++];
+    sym[0] = len;
+    memcpy(sym + 1, data, len);
+    memset(sym + 1 + len, 0, RF_FEC_MAX_LEN - len);
+
+    if (fec_queued == RF_FEC_DEPTH * RF_FEC_K) {
+        return rf_fec_flush();
+    }
+    return OK;
+}
+
+/**
+ * @brief send the queued datagrams now, the last group may be shorter than RF_FEC_K
+ * @param[in] <none>
+ * @return result, FAIL when any frame failed to go out
+ */
+uint32_t rf_fec_flush(void)
+{
+    uint8_t groups = (fec_queued + RF_FEC_K - 1) / RF_FEC_K;
+    uint8_t k[RF_FEC_DEPTH] = {0}, size[RF_FEC_DEPTH] = {0};
+    uint8_t g, i, idx, hlen, first;
+    uint32_t res = OK;
+    rf_frame_hdr_t hdr;
+
+    for (g = 0; g < groups; g++) {
+        first = g * RF_FEC_K;
+        k[g] = (fec_queued - first < RF_FEC_K) ? fec_queued - first : RF_FEC_K;
+        size[g] = 1;
+        for (i = 0; i < k[g]; i++) {
+            if (fec_tx[first + i][0] + 1 > size[g]) {
+                size[g] = fec_tx[first + i][0] + 1;
+            }
+        }
+    }
+
+    hdr.dst = fec_dst;
+    hdr.src = rf_frame_get_addr();
+    hdr.flags = RF_FRAME_FLAG_FEC;
+    hdr.frag = 0;
+    // column by column, so a burst of losses hits different groups
+    for (idx = 0; idx < FEC_N; idx++) {
+        for (g = 0; g < groups; g++) {
+            if (idx >= k[g] + RF_FEC_M) {
+                continue;
+            }
+            first = g * RF_FEC_K;
+            hdr.seq = fec_group + g;
+            hlen = rf_frame_encode(fec_frame, &hdr);
+            fec_frame[hlen++] = idx;
+            fec_frame[hlen++] = (k[g] << 4) | RF_FEC_M;
+
+            if (idx < k[g]) {
+                memcpy(fec_frame + hlen, fec_tx[first + idx] + 1, fec_tx[first + idx][0]);
+                hlen += fec_tx[first + idx][0];
+                fec_stats.tx_data++;
+            } else {
+                memset(fec_frame + hlen, 0, size[g]);
+                for (i = 0; i < k[g]; i++) {
+                    gf_mul_add(fec_frame + hlen, fec_tx[first + i], rf_fec_coef(idx - k[g], i), size[g]);
+                }
+                hlen += size[g];
+                fec_stats.tx_repair++;
+            }
+            if (rf_frame_xmit(fec_frame, hlen) != OK) {
+                res = FAIL;
+            }
+        }
+    }
+
+    rf_enter_continous_rx();
+    fec_group += groups;
+    fec_queued = 0;
+    return res;
+}
+
+static rf_fec_rx_t *rf_fec_rx_slot(uint8_t src, uint8_t group, uint8_t k, uint8_t m)
+{
+    rf_fec_rx_t *slot = NULL, *oldest = &fec_rx[0];
+    uint8_t i;
+
+    for (i = 0; i < FEC_RX_SLOTS; i++) {
+        if (fec_rx[i].used && fec_rx[i].src == src && fec_rx[i].group == group) {
+            slot = &fec_rx[i];
+            if (slot->k == k && slot->m == m) {
+                slot->stamp = fec_rx_clock;
+                return slot;
+            }
+            // same id but another shape: the sender restarted, start over
+            break;
+        }
+        if (!fec_rx[i].used) {
+            slot = &fec_rx[i];
+        } else if (slot == NULL && (int32_t)(fec_rx[i].stamp - oldest->stamp) < 0) {
+            oldest = &fec_rx[i];
+        }
+    }
+    if (slot == NULL) {
+        slot = oldest;
+    }
+
+    if (slot->used) {
+        fec_stats.lost += slot->k - rf_fec_popcount(slot->delivered);
+    }
+    slot->used = 1;
+    slot->src = src;
+    slot->group = group;
+    slot->k = k;
+    slot->m = m;
+    slot->size = 0;
+    slot->have = 0;
+    slot->delivered = 0;
+    slot->stamp = fec_rx_clock;
+    return slot;
+}
+
+/*
+ * Solve for the missing datagrams once K symbols of the group are present:
+ * for the chosen repair rows r, rhs_r = repair_r - sum over known i of C[r][i] * data_i,
+ * then missing = inverse(C restricted to rows r and missing columns) * rhs.
+ */
+static void rf_fec_recover(rf_fec_rx_t *slot)
+{
+    uint8_t a[FEC_E_MAX][FEC_E_MAX], inv[FEC_E_MAX][FEC_E_MAX];
+    uint8_t rows[FEC_E_MAX], cols[FEC_E_MAX];
+    uint32_t missing = ((1UL << slot->k) - 1) & ~slot->have;
+    uint8_t e = 0, r = 0, i, j, c, p, t;
+
+    if (missing == 0 || slot->size == 0) {
+        return;
+    }
+    for (i = 0; i < slot->k; i++) {
+        if (missing & (1UL << i)) {
+            cols[e++] = i;
+        }
+    }
+    for (j = 0; j < slot->m && r < e; j++) {
+        if (slot->have & (1UL << (slot->k + j))) {
+            rows[r++] = j;
+        }
+    }
+    if (r < e) {
+        return;
+    }
+
+    for (r = 0; r < e; r++) {
+        for (i = 0; i < slot->k; i++) {
+            if (!(missing & (1UL << i))) {
+                gf_mul_add(slot->sym[slot->k + rows[r]], slot->sym[i], rf_fec_coef(rows[r], i), slot->size);
+            }
+        }
+        for (c = 0; c < e; c++) {
+            a[r][c] = rf_fec_coef(rows[r], cols[c]);
+            inv[r][c] = (r == c);
+        }
+    }
+
+    // Gauss-Jordan, any square Cauchy submatrix is invertible
+    for (c = 0; c < e; c++) {
+        for (p = c; p < e && a[p][c] == 0; p++) {
+        }
+        if (p == e) {
+            return;
+        }
+        for (j = 0; j < e; j++) {
+            t = a[c][j]; a[c][j] = a[p][j]; a[p][j] = t;
+            t = inv[c][j]; inv[c][j] = inv[p][j]; inv[p][j] = t;
+        }
+        t = gf_inv(a[c][c]);
+        for (j = 0; j < e; j++) {
+            a[c][j] = gf_mul(a[c][j], t);
+            inv[c][j] = gf_mul(inv[c][j], t);
+        }
+        for (r = 0; r < e; r++) {
+            if (r != c && a[r][c] != 0) {
+                t = a[r][c];
+                for (j = 0; j < e; j++) {
+                    a[r][j] ^= gf_mul(a[c][j], t);
+                    inv[r][j] ^= gf_mul(inv[c][j], t);
+                }
+            }
+        }
+    }
+
+    for (c = 0; c < e; c++) {
+        memset(slot->sym[cols[c]], 0, RF_FEC_SYMBOL_LEN);
+        for (r = 0; r < e; r++) {
+            gf_mul_add(slot->sym[cols[c]], slot->sym[slot->k + rows[r]], inv[c][r], slot->size);
+        }
+    }
+    // the repair rows now hold partial sums, they are used up
+    for (r = 0; r < e; r++) {
+        slot->have &= ~(1UL << (slot->k + rows[r]));
+    }
+    for (c = 0; c < e; c++) {
+        i = cols[c];
+        slot->have |= 1UL << i;
+        slot->delivered |= 1UL << i;
+        if (slot->sym[i][0] < slot->size) {
+            fec_stats.recovered++;
+            rf_fec_rx_event(slot->src, slot->sym[i] + 1, slot->sym[i][0]);
+        } else {
+            fec_stats.lost++;
+        }
+    }
+}
+
+/**
+ * @brief feed a received frame
+ * @param[in] <frame> received frame
+ * @param[in] <len> frame length
+ * @return 1 when the frame was an FEC frame and has been consumed, 0 otherwise
+ */
+uint32_t rf_fec_input(uint8_t *frame, uint16_t len)
+{
+    rf_frame_hdr_t hdr;
+    rf_fec_rx_t *slot;
+    uint8_t hlen, idx, k, m, plen;
+    uint8_t *sym;
+
+    hlen = rf_frame_decode(frame, len, &hdr);
+    if (hlen == 0 || !(hdr.flags & RF_FRAME_FLAG_FEC)) {
+        return 0;
+    }
+    if ((hdr.dst != rf_frame_get_addr() && hdr.dst != RF_FRAME_ADDR_BROADCAST) ||
+        len < hlen + RF_FEC_HDR_LEN) {
+        return 1;
+    }
+    idx = frame[hlen];
+    k = frame[hlen + 1] >> 4;
+    m = frame[hlen + 1] & 0x0F;
+    plen = len - hlen - RF_FEC_HDR_LEN;
+    if (k == 0 || k > RF_FEC_K || m > RF_FEC_M || idx >= k + m) {
+        return 1;
+    }
+    if ((idx < k && plen > RF_FEC_MAX_LEN) || (idx >= k && (plen == 0 || plen > RF_FEC_SYMBOL_LEN))) {
+        return 1;
+    }
+
+    fec_rx_clock++;
+    slot = rf_fec_rx_slot(hdr.src, hdr.seq, k, m);
+    if ((slot->have | slot->delivered) & (1UL << idx)) {
+        return 1;
+    }
+    sym = slot->sym[idx];
+    if (idx < k) {
+        sym[0] = plen;
+        memcpy(sym + 1, frame + hlen + RF_FEC_HDR_LEN, plen);
+        memset(sym + 1 + plen, 0, RF_FEC_MAX_LEN - plen);
+        slot->have |= 1UL << idx;
+        slot->delivered |= 1UL << idx;
+        fec_stats.rx_data++;
+        rf_fec_rx_event(hdr.src, sym + 1, plen);
+    } else {
+        if (slot->size != 0 && slot->size != plen) {
+            return 1;
+        }
+        slot->size = plen;
+        memcpy(sym, frame + hlen + RF_FEC_HDR_LEN, plen);
+        memset(sym + plen, 0, RF_FEC_SYMBOL_LEN - plen);
+        slot->have |= 1UL << idx;
+        fec_stats.rx_repair++;
+    }
+
+    rf_fec_recover(slot);
+    return 1;
+}
+
+/**
+ * @brief get FEC counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_fec_stats_t *rf_fec_get_stats(void)
+{
+    return &fec_stats;
+}
+
+/**
+ * @brief a datagram was received or recovered, datagrams of a group may arrive out of order
+ * @param[in] <src> sender address
+ * @param[in] <data> datagram
+ * @param[in] <len> datagram length
+ * @return none
+ */
+__weak void rf_fec_rx_event(uint8_t src, uint8_t *data, uint8_t len)
+{
+    (void)src;
+    (void)data;
+    (void)len;
+}
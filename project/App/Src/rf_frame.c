@@ -0,0 +1,482 @@
+//
+// Packet framing on top of radio.h: addressing, fragmentation and reassembly.
+//
+#include "rf_frame.h"
+#include "rf_duty.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+// the LZ stage changes the bytes on the bus, the message CRC is then computed in software
+#if PAN3031_FIFO_CRC && !RF_LZ_STAGE
+#define RF_FRAME_FIFO_CRC           1
+#else
+#define RF_FRAME_FIFO_CRC           0
+#endif
+
+extern struct RxDoneMsg RxDoneParams;
+
+typedef struct {
+    uint8_t used;
+    uint8_t src;
+    uint8_t dst;
+    uint8_t seq;
+    uint8_t frags;      // fragment count, 0 until the last fragment is seen
+    uint8_t next;       // fragments 0..next-1 are in crc
+    uint32_t bitmap;    // received fragment indices
+    uint32_t len;
+    uint32_t stamp;     // HAL tick of the last fragment
+    RadioCrc_t crc;
+    uint8_t buf[RF_FRAME_REASM_MAX_MSG + RF_FRAME_CRC_LEN];
+} rf_frame_reasm_t;
+
+static uint8_t frame_addr = RF_FRAME_ADDR_BROADCAST;
+static uint8_t frame_seq = 0;
+static uint8_t frame_tx_buf[RF_FRAME_MAX_LEN];
+static rf_frame_reasm_t frame_reasm[RF_FRAME_REASM_SLOTS];
+_Static_assert(sizeof(frame_reasm) <= RF_FRAME_REASM_RAM_MAX, "reassembly table over RF_FRAME_REASM_RAM_MAX");
+static rf_frame_stats_t frame_stats;
+static rf_frame_tx_hook_t frame_tx_hook;
+#if RF_FRAME_FIFO_CRC
+// continues the CRC of frame_rx_armed while the next packet is read from the FIFO, or starts a
+// new one for the first fragment of a message when no message is in progress
+static RadioCrc_t frame_rx_crc;
+static rf_frame_reasm_t *frame_rx_armed;
+static uint8_t frame_rx_fresh;
+static uint32_t frame_rx_armed_len;
+#endif
+
+/**
+ * @brief set the local address and drop any partial message
+ * @param[in] <addr> local address, RF_FRAME_ADDR_BROADCAST is reserved
+ * @return none
+ */
+void rf_frame_init(uint8_t addr)
+{
+    frame_addr = addr;
+    frame_seq = 0;
+#if RF_FRAME_FIFO_CRC
+    rf_set_fifo_crc(PAN3031_FIFO_RX, NULL, 0);
+    frame_rx_armed = NULL;
+    frame_rx_fresh = 0;
+#endif
+    memset(frame_reasm, 0, sizeof(frame_reasm));
+    memset(&frame_stats, 0, sizeof(frame_stats));
+}
+
+/**
+ * @brief get the local address
+ * @param[in] <none>
+ * @return local address
+ */
+uint8_t rf_frame_get_addr(void)
+{
+    return frame_addr;
+}
+
+/**
+ * @brief write a frame header
+ * @param[in] <frame> output, at least RF_FRAME_FRAG_HDR_LEN bytes
+ * @param[in] <hdr> header fields
+ * @return header length
+ */
+uint8_t rf_frame_encode(uint8_t *frame, const rf_frame_hdr_t *hdr)
+{
+    frame[0] = hdr->dst;
+    frame[1] = hdr->src;
+    frame[2] = hdr->seq;
+    frame[3] = hdr->flags;
+    if (hdr->flags & RF_FRAME_FLAG_FRAG) {
+        frame[4] = hdr->frag;
+        return RF_FRAME_FRAG_HDR_LEN;
+    }
+    return RF_FRAME_HDR_LEN;
+}
+
+/**
+ * @brief parse a frame header
+ * @param[in] <frame> received frame
+ * @param[in] <len> frame length
+ * @param[out] <hdr> header fields
+ * @return header length, 0 when the frame is too short
+ */
+uint8_t rf_frame_decode(const uint8_t *frame, uint16_t len, rf_frame_hdr_t *hdr)
+{
+    if (len < RF_FRAME_HDR_LEN) {
+        return 0;
+    }
+    hdr->dst = frame[0];
+    hdr->src = frame[1];
+    hdr->seq = frame[2];
+    hdr->flags = frame[3];
+    hdr->frag = 0;
+    if (hdr->flags & RF_FRAME_FLAG_FRAG) {
+        if (len < RF_FRAME_FRAG_HDR_LEN) {
+            return 0;
+        }
+        hdr->frag = frame[4];
+        return RF_FRAME_FRAG_HDR_LEN;
+    }
+    return RF_FRAME_HDR_LEN;
+}
+
+static uint32_t rf_frame_xmit_now(uint8_t *frame, uint8_t len)
+{
+    uint32_t tx_time, start, wait;
+    uint32_t duty;
+    // the LZ stage adds its header byte, the packet is len + 1 when the frame does not compress
+    uint8_t air_len = len + (RF_LZ_STAGE ? 1 : 0);
+
+    // charge the airtime before it is spent, wait briefly if the budget frees up soon
+    while ((duty = rf_duty_check(air_len, &wait)) != RF_DUTY_ALLOW) {
+        if (duty == RF_DUTY_REJECT || wait > RF_FRAME_DUTY_DEFER_MS) {
+            rf_duty_refuse();
+            frame_stats.duty_blocked++;
+            return FAIL;
+        }
+        HAL_Delay(wait);
+    }
+    rf_duty_charge(air_len);
+
+    rf_set_transmit_flag(RADIO_FLAG_IDLE);
+    if (rf_single_tx_data(frame, len, &tx_time) != OK) {
+        return FAIL;
+    }
+
+    start = HAL_GetTick();
+    while (rf_get_transmit_flag() == RADIO_FLAG_IDLE) {
+        if (HAL_GetTick() - start > RF_FRAME_TX_TIMEOUT_MS) {
+            return FAIL;
+        }
+    }
+    rf_set_transmit_flag(RADIO_FLAG_IDLE);
+    frame_stats.tx_frames++;
+    return OK;
+}
+
+/**
+ * @brief send one raw frame in single tx mode and wait for TX done, subject to the duty-cycle budget
+ * @param[in] <frame> complete frame
+ * @param[in] <len> frame length
+ * @return result, FAIL also when the duty-cycle budget refuses the frame
+ */
+uint32_t rf_frame_xmit(uint8_t *frame, uint8_t len)
+{
+    uint32_t res;
+
+    // the hook may change the rate, the airtime is charged at the rate the frame goes out with
+    if (frame_tx_hook != NULL) {
+        frame_tx_hook(frame[0], 0);
+    }
+    res = rf_frame_xmit_now(frame, len);
+    if (frame_tx_hook != NULL) {
+        frame_tx_hook(frame[0], 1);
+    }
+    return res;
+}
+
+/**
+ * @brief set the function rf_frame_xmit calls around each frame, it survives rf_frame_init
+ * @param[in] <hook> NULL for none
+ * @return none
+ */
+void rf_frame_set_tx_hook(rf_frame_tx_hook_t hook)
+{
+    frame_tx_hook = hook;
+}
+
+// fragments of msg followed by its CRC, the CRC is finished in software just before the first
+// fragment that carries it, the fragments before are covered while they are written to the FIFO
+static uint32_t rf_frame_send_frags(rf_frame_hdr_t *hdr, const uint8_t *msg, uint32_t len, RadioCrc_t *crc)
+{
+    uint32_t total = len + RF_FRAME_CRC_LEN;
+    uint32_t off, chunk, part;
+    uint8_t trailer[RF_FRAME_CRC_LEN];
+    uint8_t hlen;
+
+    for (off = 0; off < total; off += chunk) {
+        chunk = total - off;
+        hdr->flags = RF_FRAME_FLAG_FRAG;
+        if (chunk > RF_FRAME_FRAG_PAYLOAD) {
+            chunk = RF_FRAME_FRAG_PAYLOAD;
+        } else {
+            hdr->flags |= RF_FRAME_FLAG_LAST;
+        }
+        part = (off < len) ? len - off : 0;
+        if (part > chunk) {
+            part = chunk;
+        }
+        hlen = rf_frame_encode(frame_tx_buf, hdr);
+        memcpy(frame_tx_buf + hlen, msg + off, part);
+        if (part < chunk) {
+            if (off <= len) {
+#if RF_FRAME_FIFO_CRC
+                rf_set_fifo_crc(PAN3031_FIFO_TX, NULL, 0);
+#endif
+                RadioCrcUpdate(crc, msg + off, part);
+                trailer[0] = (uint8_t)(crc->Crc >> 8);
+                trailer[1] = (uint8_t)crc->Crc;
+            }
+            memcpy(frame_tx_buf + hlen + part, trailer + (off + part - len), chunk - part);
+        } else {
+#if !RF_FRAME_FIFO_CRC
+            RadioCrcUpdate(crc, msg + off, part);
+#endif
+        }
+        if (rf_frame_xmit(frame_tx_buf, hlen + chunk) != OK) {
+            return FAIL;
+        }
+        hdr->frag++;
+    }
+    return OK;
+}
+
+/**
+ * @brief send a message, messages longer than one frame go out as back-to-back fragments
+ * @param[in] <dst> destination address
+ * @param[in] <msg> message
+ * @param[in] <len> message length, at most RF_FRAME_MAX_MSG
+ * @return result
+ */
+uint32_t rf_frame_send(uint8_t dst, const uint8_t *msg, uint32_t len)
+{
+    rf_frame_hdr_t hdr;
+    RadioCrc_t crc;
+    uint32_t res;
+    uint8_t hlen;
+
+    if (len > RF_FRAME_MAX_MSG) {
+        return FAIL;
+    }
+
+    hdr.dst = dst;
+    hdr.src = frame_addr;
+    hdr.seq = frame_seq++;
+    hdr.flags = 0;
+    hdr.frag = 0;
+
+    if (len <= RF_FRAME_MAX_PAYLOAD) {
+        hlen = rf_frame_encode(frame_tx_buf, &hdr);
+        memcpy(frame_tx_buf + hlen, msg, len);
+        return rf_frame_xmit(frame_tx_buf, hlen + len);
+    }
+
+    RadioCrcInit(&crc, CRC_TYPE_IBM);
+#if RF_FRAME_FIFO_CRC
+    rf_set_fifo_crc(PAN3031_FIFO_TX, &crc, RF_FRAME_FRAG_HDR_LEN);
+#endif
+    res = rf_frame_send_frags(&hdr, msg, len, &crc);
+#if RF_FRAME_FIFO_CRC
+    rf_set_fifo_crc(PAN3031_FIFO_TX, NULL, 0);
+#endif
+    return res;
+}
+
+static rf_frame_reasm_t *rf_frame_reasm_get(const rf_frame_hdr_t *hdr, uint32_t now)
+{
+    rf_frame_reasm_t *slot = NULL;
+    uint32_t i;
+
+    for (i = 0; i < RF_FRAME_REASM_SLOTS; i++) {
+        if (frame_reasm[i].used && frame_reasm[i].src == hdr->src && frame_reasm[i].seq == hdr->seq) {
+            return &frame_reasm[i];
+        }
+    }
+
+    // a free slot, or the one idle for the longest time
+    for (i = 0; i < RF_FRAME_REASM_SLOTS; i++) {
+        if (!frame_reasm[i].used) {
+            slot = &frame_reasm[i];
+            break;
+        }
+        if (slot == NULL || (now - frame_reasm[i].stamp) > (now - slot->stamp)) {
+            slot = &frame_reasm[i];
+        }
+    }
+    if (slot->used) {
+        frame_stats.reasm_overflow++;
+    }
+
+    slot->used = 1;
+    slot->src = hdr->src;
+    slot->dst = hdr->dst;
+    slot->seq = hdr->seq;
+    slot->frags = 0;
+    slot->next = 0;
+    slot->bitmap = 0;
+    slot->len = 0;
+    RadioCrcInit(&slot->crc, CRC_TYPE_IBM);
+#if RF_FRAME_FIFO_CRC
+    if (frame_rx_armed == slot) {
+        frame_rx_armed = NULL;
+    }
+#endif
+    return slot;
+}
+
+// add a fragment's payload to the message CRC, taken from the FIFO read when exactly this payload
+// was read since the slot was armed
+static void rf_frame_crc_update(rf_frame_reasm_t *slot, const uint8_t *payload, uint32_t plen)
+{
+#if RF_FRAME_FIFO_CRC
+    if ((frame_rx_armed == slot || (frame_rx_fresh && slot->next == 0)) &&
+        frame_rx_crc.Length == frame_rx_armed_len + plen) {
+        slot->crc = frame_rx_crc;
+        return;
+    }
+#endif
+    RadioCrcUpdate(&slot->crc, payload, plen);
+}
+
+// let the next packet read from the FIFO continue the CRC of the message in slot
+static void rf_frame_crc_arm(rf_frame_reasm_t *slot)
+{
+#if RF_FRAME_FIFO_CRC
+    frame_rx_armed = (slot != NULL && slot->used) ? slot : NULL;
+    frame_rx_fresh = (frame_rx_armed == NULL);
+    if (frame_rx_fresh) {
+        RadioCrcInit(&frame_rx_crc, CRC_TYPE_IBM);
+    } else {
+        frame_rx_crc = slot->crc;
+    }
+    frame_rx_armed_len = frame_rx_crc.Length;
+    rf_set_fifo_crc(PAN3031_FIFO_RX, &frame_rx_crc, RF_FRAME_FRAG_HDR_LEN);
+#else
+    (void)slot;
+#endif
+}
+
+// returns the slot while the message is incomplete
+static rf_frame_reasm_t *rf_frame_reasm_input(const rf_frame_hdr_t *hdr, const uint8_t *payload, uint32_t plen)
+{
+    uint32_t now = HAL_GetTick();
+    uint32_t off = (uint32_t)hdr->frag * RF_FRAME_FRAG_PAYLOAD;
+    rf_frame_reasm_t *slot;
+    rf_frame_hdr_t msg_hdr;
+
+    if (hdr->frag >= RF_FRAME_MAX_FRAGS ||
+        (!(hdr->flags & RF_FRAME_FLAG_LAST) && plen != RF_FRAME_FRAG_PAYLOAD)) {
+        frame_stats.rx_bad++;
+        return NULL;
+    }
+
+    slot = rf_frame_reasm_get(hdr, now);
+    if (off + plen > RF_FRAME_REASM_MAX_MSG + RF_FRAME_CRC_LEN) {
+        frame_stats.reasm_overflow++;
+        slot->used = 0;
+        return NULL;
+    }
+
+    memcpy(slot->buf + off, payload, plen);
+    slot->bitmap |= 1UL << hdr->frag;
+    slot->stamp = now;
+    if (hdr->frag == slot->next) {
+        rf_frame_crc_update(slot, payload, plen);
+        slot->next++;
+    }
+    if (hdr->flags & RF_FRAME_FLAG_LAST) {
+        slot->frags = hdr->frag + 1;
+        slot->len = off + plen;
+    }
+
+    if (slot->frags != 0 && slot->bitmap == (0xFFFFFFFFUL >> (32 - slot->frags))) {
+        slot->used = 0;
+        // fragments came out of order, the CRC is redone over the whole message
+        if (slot->next != slot->frags) {
+            RadioCrcInit(&slot->crc, CRC_TYPE_IBM);
+            RadioCrcUpdate(&slot->crc, slot->buf, slot->len);
+        }
+        if (slot->len < RF_FRAME_CRC_LEN || slot->crc.Crc != 0) {
+            frame_stats.rx_crc_err++;
+            return NULL;
+        }
+        msg_hdr.dst = slot->dst;
+        msg_hdr.src = slot->src;
+        msg_hdr.seq = slot->seq;
+        msg_hdr.flags = hdr->flags & ~(RF_FRAME_FLAG_FRAG | RF_FRAME_FLAG_LAST);
+        msg_hdr.frag = 0;
+        frame_stats.rx_msgs++;
+        rf_frame_rx_event(&msg_hdr, slot->buf, slot->len - RF_FRAME_CRC_LEN);
+        return NULL;
+    }
+    return slot;
+}
+
+/**
+ * @brief feed a received frame, complete messages are passed to rf_frame_rx_event
+ * @param[in] <frame> received frame, e.g. RxDoneParams.Payload
+ * @param[in] <len> frame length
+ * @return none
+ */
+void rf_frame_input(uint8_t *frame, uint16_t len)
+{
+    rf_frame_reasm_t *slot = NULL;
+    rf_frame_hdr_t hdr;
+    uint8_t hlen;
+
+#if RF_FRAME_FIFO_CRC
+    // frame_rx_crc stays as the read of this frame left it, a frame the caller rebuilt or copied
+    // elsewhere is not the one the FIFO read covered
+    rf_set_fifo_crc(PAN3031_FIFO_RX, NULL, 0);
+    if (frame != RxDoneParams.Payload) {
+        frame_rx_armed = NULL;
+        frame_rx_fresh = 0;
+    }
+#endif
+    hlen = rf_frame_decode(frame, len, &hdr);
+    if (hlen == 0) {
+        frame_stats.rx_bad++;
+    } else if (hdr.dst == frame_addr || hdr.dst == RF_FRAME_ADDR_BROADCAST) {
+        frame_stats.rx_frames++;
+        rf_frame_poll();
+        if (hdr.flags & RF_FRAME_FLAG_FRAG) {
+            slot = rf_frame_reasm_input(&hdr, frame + hlen, len - hlen);
+        } else {
+            frame_stats.rx_msgs++;
+            rf_frame_rx_event(&hdr, frame + hlen, len - hlen);
+        }
+    }
+    rf_frame_crc_arm(slot);
+}
+
+/**
+ * @brief drop partial messages that got no fragment for RF_FRAME_REASM_TIMEOUT_MS
+ * @param[in] <none>
+ * @return none
+ */
+void rf_frame_poll(void)
+{
+    uint32_t now = HAL_GetTick();
+    uint32_t i;
+
+    for (i = 0; i < RF_FRAME_REASM_SLOTS; i++) {
+        if (frame_reasm[i].used && now - frame_reasm[i].stamp > RF_FRAME_REASM_TIMEOUT_MS) {
+            frame_reasm[i].used = 0;
+            frame_stats.reasm_timeout++;
+        }
+    }
+}
+
+/**
+ * @brief get framing counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_frame_stats_t *rf_frame_get_stats(void)
+{
+    return &frame_stats;
+}
+
+/**
+ * @brief a complete message was received
+ * @param[in] <hdr> header of the message, frag fields cleared
+ * @param[in] <msg> message, valid until the next rf_frame_input
+ * @param[in] <len> message length
+ * @return none
+ */
+__weak void rf_frame_rx_event(const rf_frame_hdr_t *hdr, uint8_t *msg, uint32_t len)
+{
+    (void)hdr;
+    (void)msg;
+    (void)len;
+}
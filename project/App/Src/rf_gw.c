@@ -0,0 +1,318 @@
+//
+// Gateway mode: per-node statistics table and binary export of every received frame.
+//
+#include "rf_gw.h"
+#include "rf_frame.h"
+#include "radio.h"
+#include "main.h"
+#include "rf_uart.h"
+#include "string.h"
+
+#define GW_EWMA_SHIFT       3       // alpha = 1/8
+
+extern struct RxDoneMsg RxDoneParams;
+
+static rf_gw_node_t gw_table[RF_GW_TABLE_SIZE];
+static rf_gw_stats_t gw_stats;
+static uint8_t gw_rec[RF_GW_REC_RX_HDR_LEN + RF_FRAME_MAX_LEN];
+static uint32_t gw_dump_tick = 0;
+static uint16_t gw_dump_pos = RF_GW_TABLE_SIZE;    // next slot of the running dump
+
+static uint32_t rf_gw_hash(uint16_t addr)
+{
+    // Fibonacci hashing, the top 16 bits of addr * 2^32 / phi scaled to the table size
+    return (((uint32_t)addr * 2654435761U) >> 16) * RF_GW_TABLE_SIZE >> 16;
+}
+
+static uint32_t rf_gw_next(uint32_t i)
+{
+    return (i + 1 == RF_GW_TABLE_SIZE) ? 0 : i + 1;
+}
+
+// slots from i forward to j, around the end of the table
+static uint32_t rf_gw_dist(uint32_t i, uint32_t j)
+{
+    return (j >= i) ? j - i : j + RF_GW_TABLE_SIZE - i;
+}
+
+static uint8_t rf_gw_seen_now(void)
+{
+    return (uint8_t)(HAL_GetTick() >> RF_GW_SEEN_SHIFT);
+}
+
+/**
+ * @brief clear the node table
+ * @param[in] <none>
+ * @return none
+ */
+void rf_gw_init(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < RF_GW_TABLE_SIZE; i++) {
+        gw_table[i].addr = RF_GW_ADDR_NONE;
+    }
+    memset(&gw_stats, 0, sizeof(gw_stats));
+    gw_dump_tick = HAL_GetTick();
+    gw_dump_pos = RF_GW_TABLE_SIZE;
+}
+
+/**
+ * @brief find a node, optionally adding it
+ * @param[in] <addr> node address, not RF_GW_ADDR_NONE
+ * @param[in] <add> 1 to add a missing node
+ * @return entry, NULL when missing (or the table is full)
+ */
+rf_gw_node_t *rf_gw_lookup(uint16_t addr, uint8_t add)
+{
+    uint32_t i = rf_gw_hash(addr);
+    rf_gw_node_t *node;
+
+    while (1) {
+        node = &gw_table[i];
+        if (node->addr == addr) {
+            return node;
+        }
+        if (node->addr == RF_GW_ADDR_NONE) {
+            break;
+        }
+        i = rf_gw_next(i);
+    }
+    if (!add || addr == RF_GW_ADDR_NONE) {
+        return NULL;
+    }
+    if (gw_stats.nodes >= RF_GW_MAX_NODES) {
+        gw_stats.table_full++;
+        return NULL;
+    }
+    memset(node, 0, sizeof(*node));
+    node->addr = addr;
+    node->seen = rf_gw_seen_now();
+    gw_stats.nodes++;
+    return node;
+}
+
+static void rf_gw_remove(uint32_t i)
+{
+    uint32_t j = i, k;
+
+    // backward shift: pull later members of the probe chain into the hole
+    while (1) {
+        j = rf_gw_next(j);
+        if (gw_table[j].addr == RF_GW_ADDR_NONE) {
+            break;
+        }
+        k = rf_gw_hash(gw_table[j].addr);
+        // entry j may move to i only if its home slot k is not cyclically in (i, j]
+        if (rf_gw_dist(k, j) >= rf_gw_dist(i, j)) {
+            gw_table[i] = gw_table[j];
+            i = j;
+        }
+    }
+    gw_table[i].addr = RF_GW_ADDR_NONE;
+    gw_stats.nodes--;
+}
+
+static void rf_gw_update(rf_gw_node_t *node, uint8_t seq, int16_t rssi_cdb, int16_t snr_cdb)
+{
+    uint8_t gap = (uint8_t)(seq - node->seq - 1);
+
+    if (node->rx == 0) {
+        node->rssi_cdb = rssi_cdb;
+        node->snr_cdb = snr_cdb;
+    } else {
+        if (gap == 0xFF) {
+            gw_stats.dup++;
+        } else if (gap < 0x80) {
+            // a jump backwards is a restarted node, not a loss
+            node->lost = (node->lost + gap > 0xFFFF) ? 0xFFFF : node->lost + gap;
+        }
+        node->rssi_cdb += (rssi_cdb - node->rssi_cdb) / (1 << GW_EWMA_SHIFT);
+        node->snr_cdb += (snr_cdb - node->snr_cdb) / (1 << GW_EWMA_SHIFT);
+    }
+    if (node->rx < 0xFFFF) {
+        node->rx++;
+    }
+    node->seq = seq;
+    node->seen = rf_gw_seen_now();
+}
+
+static uint8_t rf_gw_put_rec(uint8_t *rec, uint8_t type, const rf_gw_node_t *node, uint16_t addr,
+                             uint8_t seq, int16_t rssi_cdb, int16_t snr_cdb)
+{
+    uint32_t tick = HAL_GetTick();
+    uint16_t lost = (node != NULL) ? node->lost : 0;
+
+    rec[0] = type;
+    rec[1] = (uint8_t)tick;
+    rec[2] = (uint8_t)(tick >> 8);
+    rec[3] = (uint8_t)(tick >> 16);
+    rec[4] = (uint8_t)(tick >> 24);
+    rec[5] = (uint8_t)addr;
+    rec[6] = (uint8_t)(addr >> 8);
+    rec[7] = seq;
+    rec[8] = (uint8_t)rssi_cdb;
+    rec[9] = (uint8_t)((uint16_t)rssi_cdb >> 8);
+    rec[10] = (uint8_t)snr_cdb;
+    rec[11] = (uint8_t)((uint16_t)snr_cdb >> 8);
+    rec[12] = (uint8_t)lost;
+    rec[13] = (uint8_t)(lost >> 8);
+    return 14;
+}
+
+/**
+ * @brief account a received frame to its sender and export it
+ * @param[in] <frame> received frame, an rf_frame header is expected
+ * @param[in] <len> frame length
+ * @param[in] <rssi_cdb> RSSI in centi-dBm
+ * @param[in] <snr_cdb> SNR in centi-dB
+ * @return none
+ */
+void rf_gw_input(uint8_t *frame, uint16_t len, int16_t rssi_cdb, int16_t snr_cdb)
+{
+    rf_frame_hdr_t hdr;
+    rf_gw_node_t *node = NULL;
+    uint16_t addr = RF_GW_ADDR_NONE;
+    uint8_t pos;
+
+    gw_stats.rx++;
+    if (len > RF_FRAME_MAX_LEN) {
+        len = RF_FRAME_MAX_LEN;
+    }
+    if (rf_frame_decode(frame, len, &hdr) == 0) {
+        // still exported, with no sender
+        gw_stats.not_frame++;
+        hdr.seq = 0;
+    } else {
+        addr = hdr.src;
+        node = rf_gw_lookup(addr, 1);
+        if (node != NULL) {
+            rf_gw_update(node, hdr.seq, rssi_cdb, snr_cdb);
+        }
+    }
+
+    pos = rf_gw_put_rec(gw_rec, RF_GW_REC_RX, node, addr, hdr.seq, rssi_cdb, snr_cdb);
+    gw_rec[pos++] = (uint8_t)len;
+    memcpy(gw_rec + pos, frame, len);
+    rf_gw_export_event(gw_rec, pos + len);
+}
+
+static void rf_gw_dump_step(void)
+{
+    uint8_t rec[RF_GW_REC_NODE_LEN];
+    const rf_gw_node_t *node;
+    uint32_t age;
+    uint8_t pos, now = rf_gw_seen_now();
+
+    for (; gw_dump_pos < RF_GW_TABLE_SIZE; gw_dump_pos++) {
+        node = &gw_table[gw_dump_pos];
+        if (node->addr == RF_GW_ADDR_NONE) {
+            continue;
+        }
+        // type, body and CRC are COBS framed, RF_GW_REC_NODE_LEN + 2 bytes
+        if (rf_uart_tx_room() < RF_UART_COBS_MAX(RF_GW_REC_NODE_LEN + 2)) {
+            // ring full, this node goes first on the next rf_gw_poll
+            break;
+        }
+        pos = rf_gw_put_rec(rec, RF_GW_REC_NODE, node, node->addr, node->seq, node->rssi_cdb, node->snr_cdb);
+        age = (uint32_t)(uint8_t)(now - node->seen) << RF_GW_SEEN_SHIFT;
+        rec[pos++] = (uint8_t)node->rx;
+        rec[pos++] = (uint8_t)(node->rx >> 8);
+        rec[pos++] = (uint8_t)age;
+        rec[pos++] = (uint8_t)(age >> 8);
+        rec[pos++] = (uint8_t)(age >> 16);
+        rec[pos++] = (uint8_t)(age >> 24);
+        rf_gw_export_event(rec, pos);
+    }
+}
+
+/**
+ * @brief gateway main loop step, takes the last received frame from the radio and dumps the table
+ * @param[in] <none>
+ * @return none
+ */
+void rf_gw_poll(void)
+{
+    uint32_t flag = rf_get_recv_flag();
+
+    if (flag == RADIO_FLAG_RXDONE) {
+        rf_set_recv_flag(RADIO_FLAG_IDLE);
+        rf_gw_input(RxDoneParams.Payload, RxDoneParams.Size,
+                    RF_META_TO_CDB(RxDoneParams.Rssi), RF_META_TO_CDB(RxDoneParams.Snr));
+    } else if (flag == RADIO_FLAG_RXERR) {
+        rf_set_recv_flag(RADIO_FLAG_IDLE);
+        gw_stats.rx_err++;
+    } else if (flag == RADIO_FLAG_RXTIMEOUT) {
+        rf_set_recv_flag(RADIO_FLAG_IDLE);
+    }
+
+#if RF_GW_DUMP_MS
+    if (HAL_GetTick() - gw_dump_tick >= RF_GW_DUMP_MS) {
+        gw_dump_tick = HAL_GetTick();
+        rf_gw_expire();
+        rf_gw_dump();
+    }
+#endif
+    if (gw_dump_pos < RF_GW_TABLE_SIZE) {
+        rf_gw_dump_step();
+    }
+}
+
+/**
+ * @brief drop nodes not heard for RF_GW_EXPIRE_MS
+ * @param[in] <none>
+ * @return none
+ */
+void rf_gw_expire(void)
+{
+    uint8_t now = rf_gw_seen_now();
+    uint32_t i = 0;
+
+    while (i < RF_GW_TABLE_SIZE) {
+        if (gw_table[i].addr != RF_GW_ADDR_NONE &&
+            (uint8_t)(now - gw_table[i].seen) >= (RF_GW_EXPIRE_MS >> RF_GW_SEEN_SHIFT)) {
+            // the shift may have moved another entry into slot i, look at it again
+            rf_gw_remove(i);
+            gw_stats.expired++;
+            continue;
+        }
+        i++;
+    }
+    // entries moved behind the cursor of a running dump would be missed, start it over
+    if (gw_dump_pos < RF_GW_TABLE_SIZE) {
+        gw_dump_pos = 0;
+    }
+}
+
+/**
+ * @brief start exporting one RF_GW_REC_NODE record per known node, as many as the UART ring
+ *        takes now, rf_gw_poll sends the rest
+ * @param[in] <none>
+ * @return none
+ */
+void rf_gw_dump(void)
+{
+    gw_dump_pos = 0;
+    rf_gw_dump_step();
+}
+
+/**
+ * @brief get gateway counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_gw_stats_t *rf_gw_get_stats(void)
+{
+    return &gw_stats;
+}
+
+/**
+ * @brief put one record on the wire as an rf_uart record, rec[0] is its type
+ * @param[in] <rec> record
+ * @param[in] <len> record length
+ * @return none
+ */
+__weak void rf_gw_export_event(const uint8_t *rec, uint16_t len)
+{
+    rf_uart_send_record(rec[0], rec + 1, len - 1);
+}
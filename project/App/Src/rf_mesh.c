@@ -0,0 +1,462 @@
+//
+// Multi-hop mesh forwarding toward one sink.
+//
+#include "rf_mesh.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+#define MESH_EWMA_SHIFT     3       // alpha = 1/8
+#define MESH_HELLO_LEN      5
+#define MESH_DB_COST        4       // 1/16 hop per dB of SNR below RF_MESH_GOOD_SNR_CDB
+#define MESH_MAX_PENALTY    (4 * RF_MESH_HOP_COST)
+
+typedef struct {
+    uint8_t used;
+    uint8_t len;
+    uint32_t due;               // HAL tick
+    uint8_t payload[RF_FRAME_MAX_PAYLOAD];
+} rf_mesh_fwd_t;
+
+typedef struct {
+    uint8_t origin;
+    uint8_t mseq;
+} rf_mesh_dup_t;
+
+static rf_mesh_neighbor_t mesh_nb[RF_MESH_MAX_NEIGHBORS];
+static rf_mesh_fwd_t mesh_fwd[RF_MESH_FWD_QUEUE];
+static rf_mesh_dup_t mesh_dup[RF_MESH_DUP_CACHE];
+static uint8_t mesh_dup_pos = 0;
+static uint8_t mesh_dup_num = 0;
+static uint8_t mesh_tx[RF_FRAME_MAX_LEN];
+static rf_mesh_stats_t mesh_stats;
+
+static uint8_t mesh_is_sink = 0;
+static uint8_t mesh_sink = RF_FRAME_ADDR_BROADCAST;
+static uint8_t mesh_parent = RF_FRAME_ADDR_BROADCAST;
+static uint16_t mesh_cost = RF_MESH_COST_INF;
+static uint8_t mesh_seq = 0;            // HELLO round
+static uint8_t mesh_seq_valid = 0;
+static uint8_t mesh_mseq = 0;           // own DATA sequence
+static uint8_t mesh_fseq = 0;           // rf_frame sequence
+static uint8_t mesh_hello_pending = 0;
+static uint32_t mesh_hello_due = 0;
+static uint32_t mesh_rand = 1;
+
+static uint32_t rf_mesh_jitter(void)
+{
+    // LCG, good enough to spread neighbors apart
+    mesh_rand = mesh_rand * 1103515245UL + 12345UL;
+    return (mesh_rand >> 16) % (RF_MESH_JITTER_MS + 1);
+}
+
+/**
+ * @brief reset the mesh state
+ * @param[in] <sink> 1 when this node is the sink, rf_frame_init has to be called before
+ * @return none
+ */
+void rf_mesh_init(uint8_t sink)
+{
+    memset(mesh_nb, 0, sizeof(mesh_nb));
+    memset(mesh_fwd, 0, sizeof(mesh_fwd));
+    memset(&mesh_stats, 0, sizeof(mesh_stats));
+    mesh_dup_pos = 0;
+    mesh_dup_num = 0;
+    mesh_is_sink = sink;
+    mesh_seq = 0;
+    mesh_seq_valid = sink;
+    mesh_parent = RF_FRAME_ADDR_BROADCAST;
+    mesh_rand = (HAL_GetTick() << 8) ^ rf_frame_get_addr() ^ 0x5A5A5A5AUL;
+    if (sink) {
+        mesh_sink = rf_frame_get_addr();
+        mesh_cost = 0;
+        // first flood on the next rf_mesh_poll
+        mesh_hello_pending = 1;
+        mesh_hello_due = HAL_GetTick();
+    } else {
+        mesh_sink = RF_FRAME_ADDR_BROADCAST;
+        mesh_cost = RF_MESH_COST_INF;
+        mesh_hello_pending = 0;
+    }
+}
+
+static uint8_t rf_mesh_nb_valid(const rf_mesh_neighbor_t *nb, uint32_t now)
+{
+    return nb->used && nb->cost != RF_MESH_COST_INF &&
+           (int32_t)(now - nb->heard) < RF_MESH_NEIGHBOR_TIMEOUT_MS &&
+           (uint8_t)(mesh_seq - nb->seq) <= 1;
+}
+
+static rf_mesh_neighbor_t *rf_mesh_nb_find(uint8_t addr, uint8_t add)
+{
+    rf_mesh_neighbor_t *victim = NULL;
+    uint8_t i;
+
+    for (i = 0; i < RF_MESH_MAX_NEIGHBORS; i++) {
+        if (mesh_nb[i].used && mesh_nb[i].addr == addr) {
+            return &mesh_nb[i];
+        }
+        // a free entry, else the one heard least recently, never the parent
+        if (!mesh_nb[i].used) {
+            if (victim == NULL || victim->used) {
+                victim = &mesh_nb[i];
+            }
+        } else if (mesh_nb[i].addr != mesh_parent &&
+                   (victim == NULL || (victim->used && (int32_t)(mesh_nb[i].heard - victim->heard) < 0))) {
+            victim = &mesh_nb[i];
+        }
+    }
+    if (!add || victim == NULL) {
+        return NULL;
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->addr = addr;
+    victim->cost = RF_MESH_COST_INF;
+    return victim;
+}
+
+static void rf_mesh_observe(rf_mesh_neighbor_t *nb, int16_t rssi_cdb, int16_t snr_cdb)
+{
+    if (!nb->used) {
+        nb->snr_cdb = snr_cdb;
+        nb->rssi_cdb = rssi_cdb;
+        nb->used = 1;
+    } else {
+        nb->snr_cdb += (snr_cdb - nb->snr_cdb) / (1 << MESH_EWMA_SHIFT);
+        nb->rssi_cdb += (rssi_cdb - nb->rssi_cdb) / (1 << MESH_EWMA_SHIFT);
+    }
+    nb->heard = HAL_GetTick();
+}
+
+static uint32_t rf_mesh_link_cost(const rf_mesh_neighbor_t *nb)
+{
+    int32_t penalty = (RF_MESH_GOOD_SNR_CDB - nb->snr_cdb) * MESH_DB_COST / 100;
+
+    if (penalty < 0) {
+        penalty = 0;
+    } else if (penalty > MESH_MAX_PENALTY) {
+        penalty = MESH_MAX_PENALTY;
+    }
+    return RF_MESH_HOP_COST + penalty;
+}
+
+static void rf_mesh_route(void)
+{
+    uint32_t now = HAL_GetTick();
+    uint32_t best_cost = RF_MESH_COST_INF, cur_cost = RF_MESH_COST_INF, c;
+    uint8_t best = RF_FRAME_ADDR_BROADCAST;
+    uint8_t i;
+
+    if (mesh_is_sink) {
+        return;
+    }
+    for (i = 0; i < RF_MESH_MAX_NEIGHBORS; i++) {
+        if (!rf_mesh_nb_valid(&mesh_nb[i], now)) {
+            continue;
+        }
+        c = mesh_nb[i].cost + rf_mesh_link_cost(&mesh_nb[i]);
+        if (c >= RF_MESH_COST_INF) {
+            continue;
+        }
+        if (mesh_nb[i].addr == mesh_parent) {
+            cur_cost = c;
+        }
+        if (c < best_cost) {
+            best_cost = c;
+            best = mesh_nb[i].addr;
+        }
+    }
+
+    if (cur_cost != RF_MESH_COST_INF && best_cost + RF_MESH_SWITCH_HYST >= cur_cost) {
+        mesh_cost = cur_cost;
+        return;
+    }
+    if (best != mesh_parent) {
+        mesh_parent = best;
+        mesh_stats.parent_changes++;
+    }
+    mesh_cost = best_cost;
+}
+
+static uint32_t rf_mesh_xmit(uint8_t dst, const uint8_t *payload, uint8_t len)
+{
+    rf_frame_hdr_t hdr;
+    uint8_t hlen;
+    uint32_t res;
+
+    hdr.dst = dst;
+    hdr.src = rf_frame_get_addr();
+    hdr.seq = mesh_fseq++;
+    hdr.flags = RF_FRAME_FLAG_CTRL;
+    hdr.frag = 0;
+    hlen = rf_frame_encode(mesh_tx, &hdr);
+    memcpy(mesh_tx + hlen, payload, len);
+    res = rf_frame_xmit(mesh_tx, hlen + len);
+    rf_enter_continous_rx();
+    return res;
+}
+
+static void rf_mesh_send_hello(void)
+{
+    uint8_t p[MESH_HELLO_LEN];
+
+    p[0] = RF_MESH_CMD_HELLO;
+    p[1] = mesh_sink;
+    p[2] = mesh_seq;
+    p[3] = (uint8_t)mesh_cost;
+    p[4] = (uint8_t)(mesh_cost >> 8);
+    if (rf_mesh_xmit(RF_FRAME_ADDR_BROADCAST, p, MESH_HELLO_LEN) == OK) {
+        mesh_stats.hello_tx++;
+    }
+}
+
+static uint8_t rf_mesh_dup(uint8_t origin, uint8_t mseq)
+{
+    uint8_t i;
+
+    for (i = 0; i < mesh_dup_num; i++) {
+        if (mesh_dup[i].origin == origin && mesh_dup[i].mseq == mseq) {
+            return 1;
+        }
+    }
+    mesh_dup[mesh_dup_pos].origin = origin;
+    mesh_dup[mesh_dup_pos].mseq = mseq;
+    mesh_dup_pos = (mesh_dup_pos + 1) % RF_MESH_DUP_CACHE;
+    if (mesh_dup_num < RF_MESH_DUP_CACHE) {
+        mesh_dup_num++;
+    }
+    return 0;
+}
+
+/**
+ * @brief send data to the sink over the current parent
+ * @param[in] <data> data
+ * @param[in] <len> data length, at most RF_MESH_MAX_DATA
+ * @return result, FAIL without a route
+ */
+uint32_t rf_mesh_send(const uint8_t *data, uint8_t len)
+{
+    uint8_t p[RF_FRAME_MAX_PAYLOAD];
+
+    if (len > RF_MESH_MAX_DATA || mesh_is_sink) {
+        return FAIL;
+    }
+    rf_mesh_route();
+    if (mesh_parent == RF_FRAME_ADDR_BROADCAST || mesh_cost == RF_MESH_COST_INF) {
+        mesh_stats.no_route++;
+        return FAIL;
+    }
+    p[0] = RF_MESH_CMD_DATA;
+    p[1] = rf_frame_get_addr();
+    p[2] = mesh_mseq++;
+    p[3] = RF_MESH_TTL;
+    memcpy(p + RF_MESH_DATA_HDR_LEN, data, len);
+    // a copy routed back to us must not go round again
+    rf_mesh_dup(p[1], p[2]);
+    if (rf_mesh_xmit(mesh_parent, p, RF_MESH_DATA_HDR_LEN + len) != OK) {
+        return FAIL;
+    }
+    mesh_stats.data_tx++;
+    return OK;
+}
+
+static void rf_mesh_hello_input(rf_mesh_neighbor_t *nb, const uint8_t *p, uint16_t len)
+{
+    if (len < MESH_HELLO_LEN) {
+        return;
+    }
+    mesh_stats.hello_rx++;
+    if (mesh_is_sink) {
+        return;
+    }
+    if (mesh_sink != p[1]) {
+        // first flood heard, or the sink was replaced: start over
+        mesh_sink = p[1];
+        mesh_seq = p[2];
+        mesh_seq_valid = 0;
+    }
+    nb->seq = p[2];
+    nb->cost = p[3] | (uint16_t)p[4] << 8;
+
+    if (!mesh_seq_valid || (int8_t)(p[2] - mesh_seq) > 0) {
+        // new round, pass it on once after a jitter
+        mesh_seq = p[2];
+        mesh_seq_valid = 1;
+        mesh_hello_pending = 1;
+        mesh_hello_due = HAL_GetTick() + rf_mesh_jitter();
+    }
+    rf_mesh_route();
+}
+
+static void rf_mesh_data_input(const uint8_t *p, uint16_t len)
+{
+    uint8_t i;
+
+    if (len < RF_MESH_DATA_HDR_LEN) {
+        return;
+    }
+    if (rf_mesh_dup(p[1], p[2])) {
+        mesh_stats.dup_drop++;
+        return;
+    }
+    if (mesh_is_sink) {
+        mesh_stats.data_rx++;
+        rf_mesh_rx_event(p[1], (uint8_t *)p + RF_MESH_DATA_HDR_LEN, len - RF_MESH_DATA_HDR_LEN);
+        return;
+    }
+    if (p[3] <= 1) {
+        mesh_stats.ttl_drop++;
+        return;
+    }
+    for (i = 0; i < RF_MESH_FWD_QUEUE; i++) {
+        if (!mesh_fwd[i].used) {
+            memcpy(mesh_fwd[i].payload, p, len);
+            mesh_fwd[i].payload[3]--;
+            mesh_fwd[i].len = len;
+            mesh_fwd[i].due = HAL_GetTick() + rf_mesh_jitter();
+            mesh_fwd[i].used = 1;
+            return;
+        }
+    }
+    mesh_stats.queue_drop++;
+}
+
+/**
+ * @brief feed a received frame with its metadata, updates the link quality of the sender
+ * @param[in] <frame> received frame
+ * @param[in] <len> frame length
+ * @param[in] <rssi_cdb> RSSI in centi-dBm
+ * @param[in] <snr_cdb> SNR in centi-dB
+ * @return 1 when the frame was a mesh frame and is consumed, 0 otherwise;
+ *         call it before rf_adr_input, which takes every CTRL frame addressed to us
+ */
+uint32_t rf_mesh_input(uint8_t *frame, uint16_t len, int16_t rssi_cdb, int16_t snr_cdb)
+{
+    rf_frame_hdr_t hdr;
+    rf_mesh_neighbor_t *nb;
+    uint8_t hlen, cmd;
+
+    hlen = rf_frame_decode(frame, len, &hdr);
+    if (hlen == 0) {
+        return 0;
+    }
+    cmd = (len > hlen) ? frame[hlen] : 0;
+    if (!(hdr.flags & RF_FRAME_FLAG_CTRL) || (cmd != RF_MESH_CMD_HELLO && cmd != RF_MESH_CMD_DATA)) {
+        // any frame is a link sample for a known neighbor
+        nb = rf_mesh_nb_find(hdr.src, 0);
+        if (nb != NULL) {
+            rf_mesh_observe(nb, rssi_cdb, snr_cdb);
+        }
+        return 0;
+    }
+
+    nb = rf_mesh_nb_find(hdr.src, 1);
+    if (nb != NULL) {
+        rf_mesh_observe(nb, rssi_cdb, snr_cdb);
+    }
+    if (cmd == RF_MESH_CMD_HELLO) {
+        if (nb != NULL) {
+            rf_mesh_hello_input(nb, frame + hlen, len - hlen);
+        }
+    } else if (hdr.dst == rf_frame_get_addr()) {
+        rf_mesh_data_input(frame + hlen, len - hlen);
+    }
+    return 1;
+}
+
+/**
+ * @brief send due HELLOs and forwards, call it from the main loop
+ * @param[in] <none>
+ * @return none
+ */
+void rf_mesh_poll(void)
+{
+    uint32_t now = HAL_GetTick();
+    uint8_t i;
+
+    if (mesh_hello_pending && (int32_t)(now - mesh_hello_due) >= 0) {
+        if (mesh_is_sink) {
+            mesh_seq++;
+            mesh_hello_due = now + RF_MESH_HELLO_MS;
+            rf_mesh_send_hello();
+        } else {
+            mesh_hello_pending = 0;
+            rf_mesh_route();
+            if (mesh_cost != RF_MESH_COST_INF) {
+                rf_mesh_send_hello();
+            }
+        }
+    }
+
+    for (i = 0; i < RF_MESH_FWD_QUEUE; i++) {
+        if (!mesh_fwd[i].used || (int32_t)(now - mesh_fwd[i].due) < 0) {
+            continue;
+        }
+        mesh_fwd[i].used = 0;
+        rf_mesh_route();
+        if (mesh_parent == RF_FRAME_ADDR_BROADCAST || mesh_cost == RF_MESH_COST_INF) {
+            mesh_stats.no_route++;
+            continue;
+        }
+        if (rf_mesh_xmit(mesh_parent, mesh_fwd[i].payload, mesh_fwd[i].len) == OK) {
+            mesh_stats.data_fwd++;
+        }
+    }
+}
+
+/**
+ * @brief get the next hop toward the sink
+ * @param[in] <none>
+ * @return parent address, RF_FRAME_ADDR_BROADCAST without a route
+ */
+uint8_t rf_mesh_get_parent(void)
+{
+    return mesh_parent;
+}
+
+/**
+ * @brief get the own cost to the sink
+ * @param[in] <none>
+ * @return cost in 1/16 hop, RF_MESH_COST_INF without a route
+ */
+uint16_t rf_mesh_get_cost(void)
+{
+    return mesh_cost;
+}
+
+/**
+ * @brief get one neighbor table entry
+ * @param[in] <index> 0..RF_MESH_MAX_NEIGHBORS - 1
+ * @return entry, NULL when unused or out of range
+ */
+const rf_mesh_neighbor_t *rf_mesh_get_neighbor(uint8_t index)
+{
+    if (index >= RF_MESH_MAX_NEIGHBORS || !mesh_nb[index].used) {
+        return NULL;
+    }
+    return &mesh_nb[index];
+}
+
+/**
+ * @brief get mesh counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_mesh_stats_t *rf_mesh_get_stats(void)
+{
+    return &mesh_stats;
+}
+
+/**
+ * @brief data delivered at the sink
+ * @param[in] <origin> address of the node that sent it
+ * @param[in] <data> data
+ * @param[in] <len> data length
+ * @return none
+ */
+__weak void rf_mesh_rx_event(uint8_t origin, uint8_t *data, uint8_t len)
+{
+    (void)origin;
+    (void)data;
+    (void)len;
+}
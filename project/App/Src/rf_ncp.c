@@ -0,0 +1,249 @@
+//
+// Network co-processor mode: the radio driven by a host over USART1.
+//
+#include "rf_ncp.h"
+#include "radio.h"
+#include "main.h"
+#include "rf_uart.h"
+#include "string.h"
+
+// largest record the NCP sends, an RX done event with a full payload
+#define NCP_REC_MAX         (2 + 8 + RF_NCP_MAX_PAYLOAD)
+
+extern struct RxDoneMsg RxDoneParams;
+
+static uint8_t ncp_rec[NCP_REC_MAX];
+static rf_ncp_stats_t ncp_stats;
+static uint8_t ncp_tx_busy = 0;
+static uint8_t ncp_tx_seq = 0;
+static uint32_t ncp_tx_deadline = 0;
+
+static uint8_t rf_ncp_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return 4;
+}
+
+static uint32_t rf_ncp_get32(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void rf_ncp_send(uint8_t type, uint16_t len)
+{
+    if (rf_uart_send_record(type, ncp_rec, len) != OK && type == RF_NCP_REC_EVT) {
+        ncp_stats.evt_dropped++;
+    }
+}
+
+static void rf_ncp_event_tick(uint8_t event)
+{
+    ncp_rec[0] = event;
+    rf_ncp_send(RF_NCP_REC_EVT, 1 + rf_ncp_put32(ncp_rec + 1, HAL_GetTick()));
+}
+
+static void rf_ncp_tx_done(uint8_t status)
+{
+    ncp_tx_busy = 0;
+    ncp_rec[0] = RF_NCP_EVT_TX_DONE;
+    ncp_rec[1] = ncp_tx_seq;
+    ncp_rec[2] = status;
+    rf_ncp_send(RF_NCP_REC_EVT, 3 + rf_ncp_put32(ncp_rec + 3, HAL_GetTick()));
+}
+
+// radio flags to events
+static void rf_ncp_radio_poll(void)
+{
+    uint32_t flag = rf_get_recv_flag();
+    int16_t rssi_cdb, snr_cdb;
+    uint16_t size;
+
+    if (flag == RADIO_FLAG_RXDONE) {
+        rf_set_recv_flag(RADIO_FLAG_IDLE);
+        ncp_stats.rx++;
+        rssi_cdb = RF_META_TO_CDB(RxDoneParams.Rssi);
+        snr_cdb = RF_META_TO_CDB(RxDoneParams.Snr);
+        size = (RxDoneParams.Size > RF_NCP_MAX_PAYLOAD) ? RF_NCP_MAX_PAYLOAD : RxDoneParams.Size;
+        ncp_rec[0] = RF_NCP_EVT_RX_DONE;
+        rf_ncp_put32(ncp_rec + 1, HAL_GetTick());
+        ncp_rec[5] = (uint8_t)rssi_cdb;
+        ncp_rec[6] = (uint8_t)((uint16_t)rssi_cdb >> 8);
+        ncp_rec[7] = (uint8_t)snr_cdb;
+        ncp_rec[8] = (uint8_t)((uint16_t)snr_cdb >> 8);
+        memcpy(ncp_rec + 9, RxDoneParams.Payload, size);
+        rf_ncp_send(RF_NCP_REC_EVT, 9 + size);
+    } else if (flag == RADIO_FLAG_RXTIMEOUT) {
+        rf_set_recv_flag(RADIO_FLAG_IDLE);
+        rf_ncp_event_tick(RF_NCP_EVT_RX_TIMEOUT);
+    } else if (flag == RADIO_FLAG_RXERR) {
+        rf_set_recv_flag(RADIO_FLAG_IDLE);
+        ncp_stats.rx_err++;
+        rf_ncp_event_tick(RF_NCP_EVT_RX_ERR);
+    }
+
+    if (ncp_tx_busy) {
+        if (rf_get_transmit_flag() == RADIO_FLAG_TXDONE) {
+            rf_set_transmit_flag(RADIO_FLAG_IDLE);
+            rf_ncp_tx_done(RF_NCP_OK);
+        } else if ((int32_t)(HAL_GetTick() - ncp_tx_deadline) >= 0) {
+            ncp_stats.tx_timeout++;
+            rf_set_mode(PAN3031_MODE_STB3);
+            rf_ncp_tx_done(RF_NCP_ERR_TIMEOUT);
+        }
+    }
+}
+
+// run one command, the reply data goes to ncp_rec + 3, returns its length
+static uint16_t rf_ncp_exec(uint8_t seq, uint8_t cmd, uint8_t *arg, uint16_t len, uint8_t *status)
+{
+    const rf_uart_stats_t *uart;
+    uint8_t *out = ncp_rec + 3;
+    uint32_t res = OK, val;
+
+    *status = RF_NCP_OK;
+    switch (cmd) {
+        case RF_NCP_CMD_PING:
+            out[0] = RF_NCP_VERSION;
+            out[1] = (uint8_t)RF_UART_RX_BUF;
+            out[2] = (uint8_t)(RF_UART_RX_BUF >> 8);
+            out[3] = RF_NCP_MAX_PAYLOAD;
+            return 4;
+        case RF_NCP_CMD_SET_PARA:
+            if (len != 5) {
+                break;
+            }
+            res = rf_set_para((rf_para_type_t)arg[0], rf_ncp_get32(arg + 1));
+            goto done;
+        case RF_NCP_CMD_GET_PARA:
+            if (len != 1) {
+                break;
+            }
+            val = 0;
+            res = rf_get_para((rf_para_type_t)arg[0], &val);
+            if (res != OK) {
+                goto done;
+            }
+            return rf_ncp_put32(out, val);
+        case RF_NCP_CMD_SET_DEFAULT:
+            rf_set_default_para();
+            goto done;
+        case RF_NCP_CMD_TX:
+            if (len == 0 || len > RF_NCP_MAX_PAYLOAD) {
+                break;
+            }
+            rf_set_transmit_flag(RADIO_FLAG_IDLE);
+            res = rf_single_tx_data(arg, (uint8_t)len, &val);
+            if (res != OK) {
+                goto done;
+            }
+            ncp_stats.tx++;
+            ncp_tx_busy = 1;
+            ncp_tx_seq = seq;
+            ncp_tx_deadline = HAL_GetTick() + val + RF_NCP_TX_GUARD_MS;
+            return rf_ncp_put32(out, val);
+        case RF_NCP_CMD_RX:
+            if (len != 4) {
+                break;
+            }
+            val = rf_ncp_get32(arg);
+            res = (val == 0) ? rf_enter_continous_rx() : rf_enter_single_timeout_rx(val);
+            goto done;
+        case RF_NCP_CMD_STANDBY:
+            res = rf_set_mode(PAN3031_MODE_STB3);
+            goto done;
+        case RF_NCP_CMD_SLEEP:
+            res = rf_sleep();
+            goto done;
+        case RF_NCP_CMD_WAKEUP:
+            res = rf_sleep_wakeup();
+            goto done;
+        case RF_NCP_CMD_SET_SYNCWORD:
+            if (len != 1) {
+                break;
+            }
+            res = rf_set_syncword(arg[0]);
+            goto done;
+        case RF_NCP_CMD_SET_PREAMBLE:
+            if (len != 2) {
+                break;
+            }
+            res = rf_set_preamble((uint16_t)(arg[0] | (arg[1] << 8)));
+            goto done;
+        case RF_NCP_CMD_GET_STATS:
+            uart = rf_uart_get_stats();
+            memcpy(out, &ncp_stats, sizeof(ncp_stats));
+            val = sizeof(ncp_stats);
+            val += rf_ncp_put32(out + val, uart->rx_bad);
+            val += rf_ncp_put32(out + val, uart->dropped);
+            return (uint16_t)val;
+        default:
+            *status = RF_NCP_ERR_CMD;
+            return 0;
+    }
+    *status = RF_NCP_ERR_ARG;
+    return 0;
+
+done:
+    *status = (res == OK) ? RF_NCP_OK : RF_NCP_ERR_FAIL;
+    return 0;
+}
+
+/**
+ * @brief start NCP mode: RX DMA on, boot event to the host
+ * @param[in] <none>
+ * @return none
+ */
+void rf_ncp_init(void)
+{
+    memset(&ncp_stats, 0, sizeof(ncp_stats));
+    ncp_tx_busy = 0;
+    rf_uart_rx_start();
+    ncp_rec[0] = RF_NCP_EVT_BOOT;
+    ncp_rec[1] = RF_NCP_VERSION;
+    rf_ncp_send(RF_NCP_REC_EVT, 2);
+}
+
+/**
+ * @brief NCP main loop step: radio events to the host, then host commands until a TX is in flight
+ * @param[in] <none>
+ * @return none
+ */
+void rf_ncp_poll(void)
+{
+    const uint8_t *rec;
+    uint16_t len, out;
+    uint8_t status;
+
+    rf_ncp_radio_poll();
+    // a command is only taken when its reply and an RX done event both fit the UART ring
+    while (!ncp_tx_busy && rf_uart_tx_room() >= 2 * RF_UART_COBS_MAX(NCP_REC_MAX + 3)) {
+        len = rf_uart_read_record(&rec);
+        if (len == 0) {
+            break;
+        }
+        if (rec[0] != RF_NCP_REC_CMD || len < 3) {
+            ncp_stats.bad_cmds++;
+            continue;
+        }
+        ncp_stats.cmds++;
+        // rec stays valid until the next read, the TX payload is sent from it in place
+        out = rf_ncp_exec(rec[1], rec[2], (uint8_t *)rec + 3, len - 3, &status);
+        ncp_rec[0] = rec[1];
+        ncp_rec[1] = rec[2];
+        ncp_rec[2] = status;
+        rf_ncp_send(RF_NCP_REC_RSP, 3 + out);
+    }
+}
+
+/**
+ * @brief get NCP counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_ncp_stats_t *rf_ncp_get_stats(void)
+{
+    return &ncp_stats;
+}
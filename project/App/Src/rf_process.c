@@ -4,6 +4,8 @@
 #include "rf_process.h"
 #include "radio.h"
 #include "main.h"
+#include "rf_uart.h"
+#include "string.h"
 
 extern struct RxDoneMsg RxDoneParams;
 
@@ -13,6 +15,18 @@ uint32_t rx_times = 0;
 uint8_t temp;
 uint8_t n = 0;
 uint32_t time= 0;
+static uint8_t rec_buf[8 + 4 + 255];
+
+// tick(4) index(4), the start of every demo record
+static uint8_t rf_demo_rec_hdr(uint32_t index)
+{
+    uint32_t tick = HAL_GetTick();
+
+    memcpy(rec_buf, &tick, 4);
+    memcpy(rec_buf + 4, &index, 4);
+    return 8;
+}
+
 void rf_tx_demo(void){
 
     tx_times++;
@@ -30,11 +44,9 @@ void rf_tx_demo(void){
     }
 
     //for(int j=1;j<len;j++){
-    printf("msg index %lu send finish.\r\n",tx_times);
-    for (uint8_t i = 0; i < len; i++)
-    {
-        printf(" %x",tx_test_buf[i]);
-    }
+    uint8_t pos = rf_demo_rec_hdr(tx_times);
+    memcpy(rec_buf + pos, tx_test_buf, len);
+    rf_uart_send_record(RF_UART_REC_DEMO_TX, rec_buf, pos + len);
     if (rf_continous_tx_send_data(tx_test_buf, len) == OK)
     {
 
@@ -61,8 +73,8 @@ void rf_rx_demo(void){
     if (rf_get_recv_flag() == RADIO_FLAG_RXDONE)
     {
         rf_set_recv_flag(RADIO_FLAG_IDLE);
-        double Rssi_dBm = RxDoneParams.Rssi;
-        double Snr_value = RxDoneParams.Snr;
+        int16_t rssi_cdb = RF_META_TO_CDB(RxDoneParams.Rssi);
+        int16_t snr_cdb = RF_META_TO_CDB(RxDoneParams.Snr);
         uint16_t rx_len = RxDoneParams.Size;
 
         for (uint8_t i = 0; i < rx_len; i++)
@@ -71,15 +83,15 @@ void rf_rx_demo(void){
         }
 
         // log
-        //printf("RSSI:%.03f\r\n", Rssi_dBm);
-        //printf("SNR:%.03f\r\n", Snr_value);
+        //rf_uart_printf("RSSI:%d\r\n", rssi_cdb);
+        //rf_uart_printf("SNR:%d\r\n", snr_cdb);
         //printf("RX:{");
         rx_times++;
-        printf("msg index %lu recived finish.\r\n",rx_times);
-        for (uint8_t i = 0; i < rx_len; i++)
-        {
-            printf(" %x",rx_buf[i]);
-        }
+        uint8_t pos = rf_demo_rec_hdr(rx_times);
+        memcpy(rec_buf + pos, &rssi_cdb, 2);
+        memcpy(rec_buf + pos + 2, &snr_cdb, 2);
+        memcpy(rec_buf + pos + 4, rx_buf, rx_len);
+        rf_uart_send_record(RF_UART_REC_DEMO_RX, rec_buf, pos + 4 + rx_len);
         //printf("}\r\n");
         LedToggle();
     }
@@ -0,0 +1,340 @@
+//
+// Beacon-synchronized TDMA MAC with drift compensation.
+//
+#include "rf_tdma.h"
+#include "rf_frame.h"
+#include "radio.h"
+#include "main.h"
+#include "string.h"
+
+#define TDMA_GUARD_MS       ((RF_TDMA_GUARD_US + 999) / 1000)
+
+static uint8_t tdma_role = RF_TDMA_ROLE_OFF;
+static uint8_t tdma_state = RF_TDMA_STATE_SCAN;
+static uint8_t tdma_slot;
+static uint8_t tdma_slots;
+static uint16_t tdma_slot_ms;
+static uint16_t tdma_period_ms;
+static uint16_t tdma_beacon_ms;         // beacon slot length
+static uint8_t tdma_bsn;
+
+static uint32_t tdma_beacon_tick;       // start of the current superframe, local ticks
+static uint32_t tdma_window_end;
+static uint32_t tdma_frame_no;          // superframes since sync, advanced by beacons and misses
+static uint8_t tdma_miss;
+static uint8_t tdma_have_ref;
+static uint32_t tdma_ref_tick;          // last beacon actually received
+static uint8_t tdma_ref_bsn;
+
+static uint8_t tdma_tx_buf[RF_FRAME_MAX_LEN];
+static uint8_t tdma_tx_len;
+static uint8_t tdma_tx_pending;
+static uint32_t tdma_tx_frame_no;
+
+static rf_tdma_stats_t tdma_stats;
+
+/*
+ * coordinator time to local time: a clock that runs fast by drift_ppm counts more ticks
+ */
+static uint32_t rf_tdma_scale(uint32_t ms)
+{
+    return ms + (int32_t)ms * tdma_stats.drift_ppm / 1000000;
+}
+
+static uint16_t rf_tdma_ceil_ms(uint32_t us)
+{
+    return (us + 999) / 1000;
+}
+
+static uint32_t rf_tdma_beacon_air_ms(void)
+{
+    return rf_get_airtime_us(RF_FRAME_HDR_LEN + RF_TDMA_BEACON_LEN) / 1000;
+}
+
+/**
+ * @brief data slot length for the current modem parameters: one full frame plus the guard time
+ * @param[in] <none>
+ * @return slot length(ms)
+ */
+uint32_t rf_tdma_slot_ms(void)
+{
+    return rf_tdma_ceil_ms(rf_get_airtime_us(RF_FRAME_MAX_LEN) + RF_TDMA_GUARD_US);
+}
+
+static void rf_tdma_reset(uint8_t role)
+{
+    tdma_role = role;
+    tdma_miss = 0;
+    tdma_have_ref = 0;
+    tdma_frame_no = 0;
+    tdma_tx_pending = 0;
+    memset(&tdma_stats, 0, sizeof(tdma_stats));
+    tdma_beacon_ms = rf_tdma_ceil_ms(rf_get_airtime_us(RF_FRAME_HDR_LEN + RF_TDMA_BEACON_LEN) +
+                                     RF_TDMA_GUARD_US);
+}
+
+/**
+ * @brief become the coordinator, the first beacon goes out on the next rf_tdma_poll
+ * @param[in] <slots> data slots per superframe, 1..RF_TDMA_MAX_SLOTS
+ * @return result
+ */
+uint32_t rf_tdma_start_coordinator(uint8_t slots)
+{
+    if (slots == 0 || slots > RF_TDMA_MAX_SLOTS) {
+        return FAIL;
+    }
+    rf_tdma_reset(RF_TDMA_ROLE_COORDINATOR);
+    tdma_slots = slots;
+    tdma_slot_ms = rf_tdma_slot_ms();
+    tdma_period_ms = tdma_beacon_ms + slots * tdma_slot_ms;
+    tdma_bsn = 0;
+    tdma_beacon_tick = HAL_GetTick() - tdma_period_ms;
+    tdma_state = RF_TDMA_STATE_LISTEN;
+    return rf_enter_continous_rx();
+}
+
+/**
+ * @brief become a node, listen until a beacon is heard
+ * @param[in] <slot> assigned data slot
+ * @return result
+ */
+uint32_t rf_tdma_start_node(uint8_t slot)
+{
+    if (slot >= RF_TDMA_MAX_SLOTS) {
+        return FAIL;
+    }
+    rf_tdma_reset(RF_TDMA_ROLE_NODE);
+    tdma_slot = slot;
+    tdma_state = RF_TDMA_STATE_SCAN;
+    return rf_enter_continous_rx();
+}
+
+/**
+ * @brief leave TDMA mode, the radio is left in continuous RX
+ * @param[in] <none>
+ * @return none
+ */
+void rf_tdma_stop(void)
+{
+    if (tdma_state == RF_TDMA_STATE_SLEEP) {
+        rf_sleep_wakeup();
+    }
+    tdma_role = RF_TDMA_ROLE_OFF;
+    tdma_state = RF_TDMA_STATE_SCAN;
+    rf_enter_continous_rx();
+}
+
+/**
+ * @brief hand one frame to the MAC, it goes out in the next own slot
+ * @param[in] <frame> complete rf_frame
+ * @param[in] <len> frame length
+ * @return OK, or FAIL while the previous frame is still waiting for its slot
+ */
+uint32_t rf_tdma_send(uint8_t *frame, uint8_t len)
+{
+    if (tdma_tx_pending || tdma_role != RF_TDMA_ROLE_NODE) {
+        return FAIL;
+    }
+    memcpy(tdma_tx_buf, frame, len);
+    tdma_tx_len = len;
+    tdma_tx_frame_no = tdma_frame_no - 1;
+    tdma_tx_pending = 1;
+    return OK;
+}
+
+static void rf_tdma_send_beacon(void)
+{
+    rf_frame_hdr_t hdr;
+    uint8_t hlen;
+
+    hdr.dst = RF_FRAME_ADDR_BROADCAST;
+    hdr.src = rf_frame_get_addr();
+    hdr.seq = tdma_bsn;
+    hdr.flags = RF_FRAME_FLAG_CTRL;
+    hdr.frag = 0;
+    hlen = rf_frame_encode(tdma_tx_buf, &hdr);
+    tdma_tx_buf[hlen + 0] = RF_TDMA_CMD_BEACON;
+    tdma_tx_buf[hlen + 1] = tdma_bsn++;
+    tdma_tx_buf[hlen + 2] = tdma_slots;
+    tdma_tx_buf[hlen + 3] = tdma_slot_ms;
+    tdma_tx_buf[hlen + 4] = tdma_slot_ms >> 8;
+    tdma_tx_buf[hlen + 5] = tdma_period_ms;
+    tdma_tx_buf[hlen + 6] = tdma_period_ms >> 8;
+
+    rf_frame_xmit(tdma_tx_buf, hlen + RF_TDMA_BEACON_LEN);
+    rf_enter_continous_rx();
+    tdma_stats.beacons_tx++;
+}
+
+/**
+ * @brief feed a received frame, beacons are consumed
+ * @param[in] <frame> received frame
+ * @param[in] <len> frame length
+ * @param[in] <rx_tick> HAL tick taken at RX done, the beacon start is derived from it
+ * @return 1 when the frame was a beacon, 0 otherwise
+ */
+uint32_t rf_tdma_input(uint8_t *frame, uint16_t len, uint32_t rx_tick)
+{
+    rf_frame_hdr_t hdr;
+    uint8_t hlen, bsn, gap;
+    uint32_t start, local, nominal;
+    int32_t diff, err_ppm;
+    uint8_t *p;
+
+    hlen = rf_frame_decode(frame, len, &hdr);
+    if (hlen == 0 || !(hdr.flags & RF_FRAME_FLAG_CTRL) || len < hlen + RF_TDMA_BEACON_LEN ||
+        frame[hlen] != RF_TDMA_CMD_BEACON) {
+        return 0;
+    }
+    if (tdma_role != RF_TDMA_ROLE_NODE) {
+        return 1;
+    }
+
+    p = frame + hlen;
+    bsn = p[1];
+    tdma_slots = p[2];
+    tdma_slot_ms = p[3] | (p[4] << 8);
+    tdma_period_ms = p[5] | (p[6] << 8);
+    tdma_beacon_ms = tdma_period_ms - tdma_slots * tdma_slot_ms;
+    start = rx_tick - rf_tdma_beacon_air_ms();
+
+    if (tdma_state == RF_TDMA_STATE_BEACON) {
+        tdma_stats.last_error_ms = (int32_t)(start - (tdma_beacon_tick + rf_tdma_scale(tdma_period_ms)));
+    }
+
+    // beacon spacing on the local clock against the coordinator's period gives the drift
+    gap = bsn - tdma_ref_bsn;
+    if (tdma_have_ref && gap != 0 && gap <= RF_TDMA_MAX_MISS + 1) {
+        local = start - tdma_ref_tick;
+        nominal = (uint32_t)gap * tdma_period_ms;
+        diff = (int32_t)(local - nominal);
+        // more than 2% off is a late RX-done report, not clock drift
+        if ((int64_t)diff * 50 < (int32_t)nominal && (int64_t)diff * 50 > -(int32_t)nominal) {
+            // diff * 1000000 wraps 32 bits from diff = 2148 on, a span of 107 s or more
+            err_ppm = (int32_t)((int64_t)diff * 1000000 / (int32_t)nominal);
+            // held to the worst HSI error, which also keeps ms * drift_ppm of rf_tdma_scale in 32 bits
+            if (err_ppm > RF_TDMA_MAX_DRIFT_PPM) {
+                err_ppm = RF_TDMA_MAX_DRIFT_PPM;
+            } else if (err_ppm < -RF_TDMA_MAX_DRIFT_PPM) {
+                err_ppm = -RF_TDMA_MAX_DRIFT_PPM;
+            }
+            if (tdma_stats.beacons_rx == 1) {
+                tdma_stats.drift_ppm = err_ppm;
+            } else {
+                tdma_stats.drift_ppm += (err_ppm - tdma_stats.drift_ppm) / 4;
+            }
+        }
+    }
+
+    tdma_have_ref = 1;
+    tdma_ref_tick = start;
+    tdma_ref_bsn = bsn;
+    tdma_beacon_tick = start;
+    tdma_frame_no++;
+    tdma_miss = 0;
+    tdma_stats.beacons_rx++;
+
+    tdma_state = RF_TDMA_STATE_SLEEP;
+    rf_sleep();
+    return 1;
+}
+
+static void rf_tdma_node_poll(uint32_t now)
+{
+    uint32_t next, slot_start, widen;
+
+    switch (tdma_state) {
+        case RF_TDMA_STATE_SLEEP:
+            if (tdma_tx_pending && tdma_tx_frame_no != tdma_frame_no && tdma_slot < tdma_slots) {
+                slot_start = tdma_beacon_tick +
+                             rf_tdma_scale(tdma_beacon_ms + tdma_slot * tdma_slot_ms + TDMA_GUARD_MS / 2);
+                if ((int32_t)(now - slot_start) > TDMA_GUARD_MS / 2) {
+                    // missed the slot edge, the frame waits for the next superframe
+                    tdma_tx_frame_no = tdma_frame_no;
+                } else if ((int32_t)(now - (slot_start - RF_TDMA_WAKEUP_MS)) >= 0) {
+                    rf_sleep_wakeup();
+                    while ((int32_t)(HAL_GetTick() - slot_start) < 0) {
+                    }
+                    if (rf_frame_xmit(tdma_tx_buf, tdma_tx_len) == OK) {
+                        tdma_tx_pending = 0;
+                        tdma_stats.slots_used++;
+                    }
+                    tdma_tx_frame_no = tdma_frame_no;
+                    rf_sleep();
+                    return;
+                }
+            }
+
+            // window widens with every missed beacon, the drift estimate is not refreshed then
+            next = tdma_beacon_tick + rf_tdma_scale(tdma_period_ms);
+            widen = TDMA_GUARD_MS + (uint32_t)tdma_miss * tdma_period_ms / (1000000 / RF_TDMA_MAX_DRIFT_PPM);
+            if ((int32_t)(now - (next - widen - RF_TDMA_WAKEUP_MS)) >= 0) {
+                rf_sleep_wakeup();
+                rf_enter_single_timeout_rx(rf_tdma_beacon_air_ms() + 2 * widen + RF_TDMA_WAKEUP_MS);
+                tdma_window_end = next + rf_tdma_beacon_air_ms() + widen;
+                tdma_state = RF_TDMA_STATE_BEACON;
+            }
+            break;
+
+        case RF_TDMA_STATE_BEACON:
+            if ((int32_t)(now - tdma_window_end) <= 0) {
+                break;
+            }
+            // no beacon: carry on with the predicted timing
+            tdma_stats.beacons_missed++;
+            tdma_beacon_tick += rf_tdma_scale(tdma_period_ms);
+            tdma_frame_no++;
+            if (++tdma_miss > RF_TDMA_MAX_MISS) {
+                tdma_stats.sync_lost++;
+                tdma_have_ref = 0;
+                tdma_state = RF_TDMA_STATE_SCAN;
+                rf_enter_continous_rx();
+            } else {
+                tdma_state = RF_TDMA_STATE_SLEEP;
+                rf_sleep();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief run the MAC timing, call it from the main loop as often as possible
+ * @param[in] <none>
+ * @return none
+ */
+void rf_tdma_poll(void)
+{
+    uint32_t now = HAL_GetTick();
+
+    if (tdma_role == RF_TDMA_ROLE_COORDINATOR) {
+        if ((int32_t)(now - (tdma_beacon_tick + tdma_period_ms)) >= 0) {
+            tdma_beacon_tick += tdma_period_ms;
+            rf_tdma_send_beacon();
+        }
+    } else if (tdma_role == RF_TDMA_ROLE_NODE) {
+        rf_tdma_node_poll(now);
+    }
+}
+
+/**
+ * @brief get MAC state
+ * @param[in] <none>
+ * @return RF_TDMA_STATE_SCAN / RF_TDMA_STATE_SLEEP / RF_TDMA_STATE_BEACON / RF_TDMA_STATE_LISTEN
+ */
+uint8_t rf_tdma_get_state(void)
+{
+    return tdma_state;
+}
+
+/**
+ * @brief get MAC counters and the drift estimate
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_tdma_stats_t *rf_tdma_get_stats(void)
+{
+    return &tdma_stats;
+}
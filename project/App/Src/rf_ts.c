@@ -0,0 +1,398 @@
+//
+// Time-series encoding for periodic sensor telemetry, see rf_ts.h for the format.
+//
+#include "rf_ts.h"
+#include "string.h"
+
+#define TS_ZIGZAG(v)        (((uint32_t)(v) << 1) ^ (uint32_t)((int32_t)(v) >> 31))
+#define TS_UNZIGZAG(u)      ((int32_t)(((u) >> 1) ^ (0U - ((u) & 1))))
+
+static uint8_t ts_clz32(uint32_t v)
+{
+    uint8_t n = 0;
+
+    if (v == 0) {
+        return 32;
+    }
+    while (!(v & 0x80000000UL)) {
+        v <<= 1;
+        n++;
+    }
+    return n;
+}
+
+static uint8_t ts_ctz32(uint32_t v)
+{
+    uint8_t n = 0;
+
+    if (v == 0) {
+        return 32;
+    }
+    while (!(v & 1)) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * bit writer, returns RF_TS_FAIL once the frame is full. Bits are set and cleared explicitly
+ * so a rolled back sample can be overwritten.
+ */
+static uint32_t ts_put(rf_ts_enc_t *enc, uint32_t val, uint8_t nbits)
+{
+    uint32_t pos = enc->st.bitpos;
+    uint8_t *p, mask;
+
+    if (pos + nbits > (uint32_t)enc->cap * 8) {
+        return RF_TS_FAIL;
+    }
+    while (nbits--) {
+        p = &enc->buf[pos >> 3];
+        mask = 0x80 >> (pos & 7);
+        if ((val >> nbits) & 1) {
+            *p |= mask;
+        } else {
+            *p &= ~mask;
+        }
+        pos++;
+    }
+    enc->st.bitpos = pos;
+    return RF_TS_OK;
+}
+
+static uint32_t ts_get(rf_ts_dec_t *dec, uint8_t nbits, uint32_t *val)
+{
+    uint32_t pos = dec->st.bitpos;
+    uint32_t v = 0;
+
+    if (pos + nbits > (uint32_t)dec->len * 8) {
+        return RF_TS_FAIL;
+    }
+    while (nbits--) {
+        v = (v << 1) | ((dec->buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+        pos++;
+    }
+    dec->st.bitpos = pos;
+    *val = v;
+    return RF_TS_OK;
+}
+
+static uint32_t ts_put_varint(rf_ts_enc_t *enc, uint32_t u)
+{
+    // 3 payload bits per nibble, high bit set when more follow
+    while (u >= 8) {
+        if (ts_put(enc, 0x8 | (u & 7), 4) != RF_TS_OK) {
+            return RF_TS_FAIL;
+        }
+        u >>= 3;
+    }
+    return ts_put(enc, u, 4);
+}
+
+static uint32_t ts_get_varint(rf_ts_dec_t *dec, uint32_t *u)
+{
+    uint32_t nib, v = 0;
+    uint8_t shift = 0;
+
+    do {
+        if (shift > 30 || ts_get(dec, 4, &nib) != RF_TS_OK) {
+            return RF_TS_FAIL;
+        }
+        v |= (nib & 7) << shift;
+        shift += 3;
+    } while (nib & 0x8);
+    *u = v;
+    return RF_TS_OK;
+}
+
+static uint32_t ts_put_dod(rf_ts_enc_t *enc, int32_t dod)
+{
+    uint32_t u = TS_ZIGZAG(dod);
+
+    if (u == 0) {
+        return ts_put(enc, 0x0, 1);
+    }
+    if (u < (1UL << 7)) {
+        return ts_put(enc, (0x2UL << 7) | u, 9);
+    }
+    if (u < (1UL << 9)) {
+        return ts_put(enc, (0x6UL << 9) | u, 12);
+    }
+    if (u < (1UL << 12)) {
+        return ts_put(enc, (0xEUL << 12) | u, 16);
+    }
+    if (ts_put(enc, 0xF, 4) != RF_TS_OK) {
+        return RF_TS_FAIL;
+    }
+    return ts_put(enc, u, 32);
+}
+
+static uint32_t ts_get_dod(rf_ts_dec_t *dec, int32_t *dod)
+{
+    static const uint8_t width[] = { 0, 7, 9, 12, 32 };
+    uint32_t bit, u = 0;
+    uint8_t prefix = 0;
+
+    // count leading ones, up to four
+    while (prefix < 4) {
+        if (ts_get(dec, 1, &bit) != RF_TS_OK) {
+            return RF_TS_FAIL;
+        }
+        if (!bit) {
+            break;
+        }
+        prefix++;
+    }
+    if (width[prefix] && ts_get(dec, width[prefix], &u) != RF_TS_OK) {
+        return RF_TS_FAIL;
+    }
+    *dod = TS_UNZIGZAG(u);
+    return RF_TS_OK;
+}
+
+static uint32_t ts_put_xor(rf_ts_enc_t *enc, uint8_t ch, uint32_t x)
+{
+    rf_ts_state_t *st = &enc->st;
+    uint8_t lead, trail, len;
+
+    if (x == 0) {
+        return ts_put(enc, 0x0, 1);
+    }
+    lead = ts_clz32(x);
+    trail = ts_ctz32(x);
+    // fits in the previous window: reuse its position and length
+    if (st->len[ch] && lead >= st->lead[ch] && trail >= 32 - st->lead[ch] - st->len[ch]) {
+        if (ts_put(enc, 0x2, 2) != RF_TS_OK) {
+            return RF_TS_FAIL;
+        }
+        return ts_put(enc, x >> (32 - st->lead[ch] - st->len[ch]), st->len[ch]);
+    }
+    len = 32 - lead - trail;
+    st->lead[ch] = lead;
+    st->len[ch] = len;
+    if (ts_put(enc, (0x3UL << 10) | ((uint32_t)lead << 5) | (len - 1), 12) != RF_TS_OK) {
+        return RF_TS_FAIL;
+    }
+    return ts_put(enc, x >> trail, len);
+}
+
+static uint32_t ts_get_xor(rf_ts_dec_t *dec, uint8_t ch, uint32_t *x)
+{
+    rf_ts_state_t *st = &dec->st;
+    uint32_t ctl, hdr, v;
+
+    if (ts_get(dec, 1, &ctl) != RF_TS_OK) {
+        return RF_TS_FAIL;
+    }
+    if (ctl == 0) {
+        *x = 0;
+        return RF_TS_OK;
+    }
+    if (ts_get(dec, 1, &ctl) != RF_TS_OK) {
+        return RF_TS_FAIL;
+    }
+    if (ctl) {
+        if (ts_get(dec, 10, &hdr) != RF_TS_OK) {
+            return RF_TS_FAIL;
+        }
+        st->lead[ch] = hdr >> 5;
+        st->len[ch] = (hdr & 0x1F) + 1;
+        if (st->lead[ch] + st->len[ch] > 32) {
+            return RF_TS_FAIL;
+        }
+    } else if (st->len[ch] == 0) {
+        return RF_TS_FAIL;
+    }
+    if (ts_get(dec, st->len[ch], &v) != RF_TS_OK) {
+        return RF_TS_FAIL;
+    }
+    *x = v << (32 - st->lead[ch] - st->len[ch]);
+    return RF_TS_OK;
+}
+
+/**
+ * @brief start a frame
+ * @param[in] <enc> encoder
+ * @param[in] <buf> frame buffer
+ * @param[in] <cap> frame buffer size, at most RF_TS_MAX_FRAME
+ * @param[in] <nch> values per sample, 1..RF_TS_MAX_CHANNELS
+ * @param[in] <float_mask> bit n set when channel n is a float
+ * @return result
+ */
+uint32_t rf_ts_enc_init(rf_ts_enc_t *enc, uint8_t *buf, uint16_t cap, uint8_t nch, uint8_t float_mask)
+{
+    if (nch == 0 || nch > RF_TS_MAX_CHANNELS || cap <= RF_TS_HDR_LEN || cap > RF_TS_MAX_FRAME) {
+        return RF_TS_FAIL;
+    }
+    memset(enc, 0, sizeof(*enc));
+    enc->buf = buf;
+    enc->cap = cap;
+    enc->nch = nch;
+    enc->float_mask = float_mask;
+    enc->st.bitpos = RF_TS_HDR_LEN * 8;
+    return RF_TS_OK;
+}
+
+/**
+ * @brief append one sample
+ * @param[in] <enc> encoder
+ * @param[in] <ts> timestamp(ms)
+ * @param[in] <val> nch values
+ * @return RF_TS_OK, or RF_TS_FAIL when the frame is full; the frame is left as it was before the call
+ */
+uint32_t rf_ts_enc_add(rf_ts_enc_t *enc, uint32_t ts, const rf_ts_value_t *val)
+{
+    rf_ts_state_t saved = enc->st;
+    rf_ts_state_t *st = &enc->st;
+    uint32_t res = RF_TS_OK;
+    int32_t delta;
+    uint8_t ch;
+
+    if (st->count == 0xFF) {
+        return RF_TS_FAIL;
+    }
+
+    if (st->count == 0) {
+        res |= ts_put(enc, ts, 32);
+        delta = 0;
+    } else {
+        delta = (int32_t)(ts - st->ts);
+        res |= ts_put_dod(enc, delta - st->ts_delta);
+    }
+    for (ch = 0; ch < enc->nch && res == RF_TS_OK; ch++) {
+        if (enc->float_mask & (1 << ch)) {
+            if (st->count == 0) {
+                res |= ts_put(enc, val[ch].bits, 32);
+            } else {
+                res |= ts_put_xor(enc, ch, val[ch].bits ^ st->prev[ch].bits);
+            }
+        } else if (st->count == 0) {
+            res |= ts_put_varint(enc, TS_ZIGZAG(val[ch].i));
+        } else if (val[ch].i == st->prev[ch].i) {
+            res |= ts_put(enc, 0x0, 1);
+        } else {
+            res |= ts_put(enc, 0x1, 1);
+            res |= ts_put_varint(enc, TS_ZIGZAG(val[ch].bits - st->prev[ch].bits));
+        }
+        st->prev[ch] = val[ch];
+    }
+
+    if (res != RF_TS_OK) {
+        enc->st = saved;
+        return RF_TS_FAIL;
+    }
+    st->ts = ts;
+    st->ts_delta = delta;
+    st->count++;
+    return RF_TS_OK;
+}
+
+/**
+ * @brief write the frame header
+ * @param[in] <enc> encoder
+ * @return frame length, 0 when no sample was added
+ */
+uint16_t rf_ts_enc_finish(rf_ts_enc_t *enc)
+{
+    uint32_t pad = (8 - (enc->st.bitpos & 7)) & 7;
+
+    if (enc->st.count == 0) {
+        return 0;
+    }
+    // clear the unused tail bits so equal samples give equal frames
+    if (pad) {
+        enc->buf[enc->st.bitpos >> 3] &= (uint8_t)(0xFF << pad);
+    }
+    enc->buf[0] = enc->nch;
+    enc->buf[1] = enc->float_mask;
+    enc->buf[2] = enc->st.count;
+    return (uint16_t)((enc->st.bitpos + 7) >> 3);
+}
+
+/**
+ * @brief start decoding a frame, no state is carried over from earlier frames
+ * @param[in] <dec> decoder
+ * @param[in] <buf> frame
+ * @param[in] <len> frame length
+ * @return result
+ */
+uint32_t rf_ts_dec_init(rf_ts_dec_t *dec, const uint8_t *buf, uint16_t len)
+{
+    if (len <= RF_TS_HDR_LEN || buf[0] == 0 || buf[0] > RF_TS_MAX_CHANNELS) {
+        return RF_TS_FAIL;
+    }
+    memset(dec, 0, sizeof(*dec));
+    dec->buf = buf;
+    dec->len = len;
+    dec->nch = buf[0];
+    dec->float_mask = buf[1];
+    dec->total = buf[2];
+    dec->st.bitpos = RF_TS_HDR_LEN * 8;
+    return RF_TS_OK;
+}
+
+/**
+ * @brief decode the next sample
+ * @param[in] <dec> decoder
+ * @param[out] <ts> timestamp(ms)
+ * @param[out] <val> nch values
+ * @return RF_TS_OK, RF_TS_FAIL after the last sample or on a corrupt frame
+ */
+uint32_t rf_ts_dec_next(rf_ts_dec_t *dec, uint32_t *ts, rf_ts_value_t *val)
+{
+    rf_ts_state_t *st = &dec->st;
+    uint32_t u;
+    int32_t dod;
+    uint8_t ch;
+
+    if (st->count >= dec->total) {
+        return RF_TS_FAIL;
+    }
+
+    if (st->count == 0) {
+        if (ts_get(dec, 32, &st->ts) != RF_TS_OK) {
+            return RF_TS_FAIL;
+        }
+    } else {
+        if (ts_get_dod(dec, &dod) != RF_TS_OK) {
+            return RF_TS_FAIL;
+        }
+        st->ts_delta += dod;
+        st->ts += st->ts_delta;
+    }
+    for (ch = 0; ch < dec->nch; ch++) {
+        if (dec->float_mask & (1 << ch)) {
+            if (st->count == 0) {
+                if (ts_get(dec, 32, &st->prev[ch].bits) != RF_TS_OK) {
+                    return RF_TS_FAIL;
+                }
+            } else {
+                if (ts_get_xor(dec, ch, &u) != RF_TS_OK) {
+                    return RF_TS_FAIL;
+                }
+                st->prev[ch].bits ^= u;
+            }
+        } else if (st->count == 0) {
+            if (ts_get_varint(dec, &u) != RF_TS_OK) {
+                return RF_TS_FAIL;
+            }
+            st->prev[ch].i = TS_UNZIGZAG(u);
+        } else {
+            if (ts_get(dec, 1, &u) != RF_TS_OK) {
+                return RF_TS_FAIL;
+            }
+            if (u) {
+                if (ts_get_varint(dec, &u) != RF_TS_OK) {
+                    return RF_TS_FAIL;
+                }
+                st->prev[ch].bits += (uint32_t)TS_UNZIGZAG(u);
+            }
+        }
+        val[ch] = st->prev[ch];
+    }
+
+    *ts = st->ts;
+    st->count++;
+    return RF_TS_OK;
+}
@@ -0,0 +1,420 @@
+//
+// Non-blocking USART1 output: TX ring buffer drained by DMA, COBS framed binary records.
+// Host records come in through a circular RX DMA ring.
+//
+#include "rf_uart.h"
+#include "radio.h"
+#include "main.h"
+#include "usart.h"
+#include "stdarg.h"
+
+static uint8_t uart_ring[RF_UART_TX_BUF];
+static uint16_t uart_head = 0;              // next write, main loop only
+static volatile uint16_t uart_tail = 0;     // next byte to send, moved by the DMA IRQ
+static volatile uint16_t uart_dma_len = 0;
+static volatile uint8_t uart_busy = 0;
+static uint8_t uart_text = 0;               // text written since the last delimiter
+static rf_uart_stats_t uart_stats;
+
+static uint8_t uart_rx_ring[RF_UART_RX_BUF];
+static uint16_t uart_rx_tail = 0;
+static uint8_t uart_rx_frame[RF_UART_COBS_MAX(RF_UART_MAX_RX_RECORD + 3)];
+static uint16_t uart_rx_len = 0;            // encoded bytes collected since the last 0x00
+static uint8_t uart_rx_skip = 0;            // drop everything up to the next 0x00
+
+static uint16_t rf_uart_used(void)
+{
+    return (uint16_t)((uart_head + RF_UART_TX_BUF - uart_tail) % RF_UART_TX_BUF);
+}
+
+static void rf_uart_kick(void)
+{
+    uint16_t tail = uart_tail;
+    uint16_t n;
+
+    if (uart_busy || uart_head == tail) {
+        return;
+    }
+    // one contiguous run per transfer, the wrapped part follows from the TX complete callback
+    n = (uart_head > tail) ? uart_head - tail : RF_UART_TX_BUF - tail;
+    uart_busy = 1;
+    uart_dma_len = n;
+    if (HAL_UART_Transmit_DMA(&huart1, &uart_ring[tail], n) != HAL_OK) {
+        uart_busy = 0;
+        return;
+    }
+    uart_stats.dma_starts++;
+}
+
+static void rf_uart_commit(uint16_t head)
+{
+    uint16_t used;
+
+    uart_head = head;
+    used = rf_uart_used();
+    if (used > uart_stats.high_water) {
+        uart_stats.high_water = used;
+    }
+    __disable_irq();
+    rf_uart_kick();
+    __enable_irq();
+}
+
+/**
+ * @brief queue one text byte, __io_putchar ends up here
+ * @param[in] <ch> byte
+ * @return none
+ */
+void rf_uart_putc(uint8_t ch)
+{
+    rf_uart_write(&ch, 1);
+    uart_text = 1;
+}
+
+/**
+ * @brief queue raw bytes, nothing is sent when they do not all fit
+ * @param[in] <data> bytes
+ * @param[in] <len> length
+ * @return result
+ */
+uint32_t rf_uart_write(const uint8_t *data, uint16_t len)
+{
+    uint16_t head = uart_head;
+    uint16_t i;
+
+    if (len > RF_UART_TX_BUF - 1 - rf_uart_used()) {
+        uart_stats.dropped++;
+        return FAIL;
+    }
+    for (i = 0; i < len; i++) {
+        uart_ring[head] = data[i];
+        head = (head + 1) % RF_UART_TX_BUF;
+    }
+    uart_stats.bytes += len;
+    rf_uart_commit(head);
+    return OK;
+}
+
+static uint16_t rf_uart_fmt_num(char *out, unsigned long v, uint8_t base, uint8_t upper)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[22];
+    uint16_t n = 0, i;
+
+    do {
+        tmp[n++] = digits[v % base];
+        v /= base;
+    } while (v != 0);
+    for (i = 0; i < n; i++) {
+        out[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+/**
+ * @brief integer-only printf into the ring as text, so newlib's printf can stay out of the image
+ *        supports %d %i %u %x %X %c %s %%, the flags - and 0, a field width and the l modifier
+ * @param[in] <fmt> format
+ * @return result, FAIL when the text did not fit the ring (nothing is queued)
+ */
+uint32_t rf_uart_printf(const char *fmt, ...)
+{
+    char out[RF_UART_FMT_MAX];
+    char num[24];
+    const char *str;
+    uint16_t pos = 0, len, width, pad;
+    uint8_t left, zero, is_long;
+    unsigned long v;
+    long sv;
+    va_list ap;
+    uint32_t res;
+
+    va_start(ap, fmt);
+    while (*fmt != 0 && pos < sizeof(out)) {
+        if (*fmt != '%') {
+            out[pos++] = *fmt++;
+            continue;
+        }
+        fmt++;
+        left = zero = is_long = 0;
+        width = 0;
+        for (; *fmt == '-' || *fmt == '0'; fmt++) {
+            left |= (*fmt == '-');
+            zero |= (*fmt == '0');
+        }
+        for (; *fmt >= '0' && *fmt <= '9'; fmt++) {
+            width = width * 10 + (*fmt - '0');
+        }
+        if (*fmt == 'l') {
+            is_long = 1;
+            fmt++;
+        }
+        if (*fmt == 0) {
+            break;
+        }
+
+        str = num;
+        len = 0;
+        switch (*fmt) {
+            case 'd':
+            case 'i':
+                sv = is_long ? va_arg(ap, long) : va_arg(ap, int);
+                if (sv < 0) {
+                    num[len++] = '-';
+                    v = 0UL - (unsigned long)sv;
+                } else {
+                    v = (unsigned long)sv;
+                }
+                len += rf_uart_fmt_num(num + len, v, 10, 0);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+                v = is_long ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int);
+                len = rf_uart_fmt_num(num, v, (*fmt == 'u') ? 10 : 16, *fmt == 'X');
+                break;
+            case 'c':
+                num[len++] = (char)va_arg(ap, int);
+                break;
+            case 's':
+                str = va_arg(ap, const char *);
+                while (str[len] != 0) {
+                    len++;
+                }
+                break;
+            default:
+                // %% and unknown conversions are copied as is
+                num[len++] = *fmt;
+                break;
+        }
+        fmt++;
+
+        pad = (width > len) ? width - len : 0;
+        if (!left && zero && str == num && num[0] == '-' && pos < sizeof(out)) {
+            // the sign goes before the zeros
+            out[pos++] = *str++;
+            len--;
+        }
+        while (!left && pad != 0 && pos < sizeof(out)) {
+            out[pos++] = zero ? '0' : ' ';
+            pad--;
+        }
+        while (len != 0 && pos < sizeof(out)) {
+            out[pos++] = *str++;
+            len--;
+        }
+        while (pad != 0 && pos < sizeof(out)) {
+            out[pos++] = ' ';
+            pad--;
+        }
+    }
+    va_end(ap);
+
+    res = rf_uart_write((const uint8_t *)out, pos);
+    uart_text = 1;
+    return res;
+}
+
+/**
+ * @brief queue one COBS framed record, see rf_uart.h
+ * @param[in] <type> record type
+ * @param[in] <data> record body
+ * @param[in] <len> body length, at most RF_UART_MAX_RECORD
+ * @return result, FAIL when the ring is too full (the record is dropped, never cut)
+ */
+uint32_t rf_uart_send_record(uint8_t type, const uint8_t *data, uint16_t len)
+{
+    RadioCrc_t crc;
+    uint16_t head = uart_head, code_pos, start;
+    uint16_t i, n = len + 3;
+    uint8_t code = 1, b;
+
+    if (len > RF_UART_MAX_RECORD) {
+        return FAIL;
+    }
+    if (RF_UART_COBS_MAX(n) > RF_UART_TX_BUF - 1 - rf_uart_used()) {
+        uart_stats.dropped++;
+        return FAIL;
+    }
+
+    RadioCrcInit(&crc, CRC_TYPE_CCITT);
+    RadioCrcUpdateByte(&crc, type);
+    RadioCrcUpdate(&crc, data, len);
+
+    start = head;
+    if (uart_text) {
+        uart_ring[head] = 0;
+        head = (head + 1) % RF_UART_TX_BUF;
+        uart_text = 0;
+    }
+    // COBS encode straight into the ring, each code byte is patched once its run is known
+    code_pos = head;
+    head = (head + 1) % RF_UART_TX_BUF;
+    for (i = 0; i < n; i++) {
+        if (i == 0) {
+            b = type;
+        } else if (i <= len) {
+            b = data[i - 1];
+        } else if (i == len + 1) {
+            b = (uint8_t)RadioCrcFinal(&crc);
+        } else {
+            b = (uint8_t)(RadioCrcFinal(&crc) >> 8);
+        }
+        if (b != 0) {
+            uart_ring[head] = b;
+            head = (head + 1) % RF_UART_TX_BUF;
+            code++;
+        }
+        if (b == 0 || code == 0xFF) {
+            uart_ring[code_pos] = code;
+            code_pos = head;
+            head = (head + 1) % RF_UART_TX_BUF;
+            code = 1;
+        }
+    }
+    uart_ring[code_pos] = code;
+    uart_ring[head] = 0;
+    head = (head + 1) % RF_UART_TX_BUF;
+
+    uart_stats.records++;
+    uart_stats.bytes += (uint16_t)((head + RF_UART_TX_BUF - start) % RF_UART_TX_BUF);
+    rf_uart_commit(head);
+    return OK;
+}
+
+/**
+ * @brief wait until everything queued is on the wire
+ * @param[in] <timeout_ms> longest wait
+ * @return result, FAIL on timeout
+ */
+uint32_t rf_uart_flush(uint32_t timeout_ms)
+{
+    uint32_t start = HAL_GetTick();
+
+    while (uart_busy || uart_head != uart_tail) {
+        if (HAL_GetTick() - start >= timeout_ms) {
+            return FAIL;
+        }
+    }
+    return OK;
+}
+
+/**
+ * @brief free space in the TX ring
+ * @param[in] <none>
+ * @return bytes that can be queued now, framing included
+ */
+uint16_t rf_uart_tx_room(void)
+{
+    return (uint16_t)(RF_UART_TX_BUF - 1 - rf_uart_used());
+}
+
+/**
+ * @brief start the circular RX DMA, the ring then fills without any CPU work
+ * @param[in] <none>
+ * @return none
+ */
+void rf_uart_rx_start(void)
+{
+    uart_rx_tail = 0;
+    uart_rx_len = 0;
+    uart_rx_skip = 0;
+    HAL_UART_Receive_DMA(&huart1, uart_rx_ring, RF_UART_RX_BUF);
+}
+
+// COBS decode in place, 0 when malformed
+static uint16_t rf_uart_cobs_decode(uint8_t *buf, uint16_t len)
+{
+    uint16_t in = 0, out = 0;
+    uint8_t code, i;
+
+    while (in < len) {
+        code = buf[in++];
+        if (in + code - 1 > len) {
+            return 0;
+        }
+        for (i = 1; i < code; i++) {
+            buf[out++] = buf[in++];
+        }
+        if (code != 0xFF && in < len) {
+            buf[out++] = 0;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief take the next complete record the host sent, see rf_uart.h for the framing
+ * @param[in] <rec> set to the record, type first, valid until the next call
+ * @return record length with its type, 0 when none is complete yet
+ */
+uint16_t rf_uart_read_record(const uint8_t **rec)
+{
+    uint16_t head, len;
+    uint8_t b;
+
+    if (huart1.RxState != HAL_UART_STATE_BUSY_RX) {
+        // an overrun or framing error aborts the DMA, the record it hit fails its CRC
+        uart_stats.rx_restarts++;
+        rf_uart_rx_start();
+        uart_rx_skip = 1;
+        return 0;
+    }
+    head = (uint16_t)((RF_UART_RX_BUF - __HAL_DMA_GET_COUNTER(huart1.hdmarx)) % RF_UART_RX_BUF);
+    while (uart_rx_tail != head) {
+        b = uart_rx_ring[uart_rx_tail];
+        uart_rx_tail = (uart_rx_tail + 1) % RF_UART_RX_BUF;
+        uart_stats.rx_bytes++;
+        if (b != 0) {
+            if (uart_rx_len < sizeof(uart_rx_frame)) {
+                uart_rx_frame[uart_rx_len++] = b;
+            } else {
+                uart_rx_skip = 1;
+            }
+            continue;
+        }
+
+        len = uart_rx_len;
+        uart_rx_len = 0;
+        if (uart_rx_skip || len == 0) {
+            uart_stats.rx_bad += uart_rx_skip;
+            uart_rx_skip = 0;
+            continue;
+        }
+        len = rf_uart_cobs_decode(uart_rx_frame, len);
+        if (len < 3 || RadioComputeCRC(uart_rx_frame, len - 2, CRC_TYPE_CCITT) !=
+                       (uart_rx_frame[len - 2] | (uart_rx_frame[len - 1] << 8))) {
+            uart_stats.rx_bad++;
+            continue;
+        }
+        uart_stats.rx_records++;
+        *rec = uart_rx_frame;
+        return len - 2;
+    }
+    return 0;
+}
+
+/**
+ * @brief get UART counters
+ * @param[in] <none>
+ * @return counters
+ */
+const rf_uart_stats_t *rf_uart_get_stats(void)
+{
+    return &uart_stats;
+}
+
+/**
+ * @brief DMA transfer done and the last byte shifted out, send what was queued meanwhile
+ * @param[in] <huart> UART handle
+ * @return none
+ */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (huart != &huart1) {
+        return;
+    }
+    uart_tail = (uint16_t)((uart_tail + uart_dma_len) % RF_UART_TX_BUF);
+    uart_busy = 0;
+    rf_uart_kick();
+}
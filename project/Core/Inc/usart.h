@@ -35,6 +35,10 @@ extern "C" {
 extern UART_HandleTypeDef huart1;
 
 /* USER CODE BEGIN Private defines */
+/* PCLK1 = 48 MHz with 16x oversampling allows up to 3 Mbaud */
+#ifndef USART1_BAUDRATE
+#define USART1_BAUDRATE 115200
+#endif
 
 /* USER CODE END Private defines */
 
@@ -18,6 +18,7 @@
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "dma.h"
 #include "spi.h"
 #include "usart.h"
 #include "gpio.h"
@@ -27,6 +28,10 @@
 #include <stdio.h>
 #include "radio.h"
 #include "rf_process.h"
+#include "rf_bench.h"
+#include "rf_gw.h"
+#include "rf_ncp.h"
+#include "rf_uart.h"
 
 /* USER CODE END Includes */
 
@@ -93,11 +98,12 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_SPI2_Init();
   MX_USART1_UART_Init();
   /* USER CODE BEGIN 2 */
   while(rf_init() != OK){
-      printf("init fail.\r\n");
+      rf_uart_printf("init fail.\r\n");
       HAL_Delay(1000);
   }
 
@@ -110,6 +116,16 @@ int main(void)
     rf_enter_continous_rx();
   #endif
 
+  #ifdef WORK_MODE_GATEWAY
+    rf_gw_init();
+    rf_enter_continous_rx();
+  #endif
+
+  #ifdef WORK_MODE_NCP
+    // the host configures the radio, nothing runs until it asks
+    rf_ncp_init();
+  #endif
+
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -119,6 +135,17 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+    #ifdef WORK_MODE_GATEWAY
+      // no delay, frames arrive back to back at full air rate
+      rf_gw_poll();
+      continue;
+    #endif
+
+    #ifdef WORK_MODE_NCP
+      rf_ncp_poll();
+      continue;
+    #endif
+
       HAL_Delay(1000);
 
     #ifdef WORK_MODE_TX
@@ -128,6 +155,10 @@ int main(void)
     #ifdef WROK_MODE_RX
       rf_rx_demo();
     #endif
+
+    #ifdef WORK_MODE_BENCH
+      rf_bench_run();
+    #endif
   }
   /* USER CODE END 3 */
 }
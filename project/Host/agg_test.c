@@ -0,0 +1,164 @@
+//
+// rf_agg (App/Src/rf_agg.c) on the virtual PAN3031: messages are queued, the aggregates caught on
+// the air are fed back into the receiver and split again. Covers the flush when the next message
+// does not fit, the deadline flush, a message due right away, a truncated aggregate and the fill
+// ratio past 2^32 / 1000 payload bytes. Exits 1 on a mismatch.
+//
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_agg.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_ADDR 0x21
+#define TEST_PEER 0x42
+#define TEST_MSGS 64
+
+static vpan_t radio;
+static uint8_t air[4][RF_FRAME_MAX_LEN];
+static uint8_t air_len[4];
+static uint32_t air_num;
+static uint8_t got[TEST_MSGS][RF_AGG_MAX_MSG];
+static uint8_t got_len[TEST_MSGS];
+static uint32_t got_num;
+static int failures;
+
+static void on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)start_ns;
+	(void)airtime_us;
+	(void)ctx;
+	if (air_num < 4)
+	{
+		memcpy(air[air_num], payload, len);
+		air_len[air_num] = len;
+	}
+	air_num++;
+}
+
+void rf_agg_rx_event(uint8_t src, uint8_t *msg, uint8_t len)
+{
+	(void)src;
+	if (got_num < TEST_MSGS)
+	{
+		memcpy(got[got_num], msg, len);
+		got_len[got_num++] = len;
+	}
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+static void fill(uint8_t *msg, uint8_t len, uint32_t n)
+{
+	uint8_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		msg[i] = (uint8_t)(n * 31 + i);
+	}
+}
+
+// the messages received are n messages of len bytes, numbered from first
+static int got_is(uint32_t first, uint32_t n, uint8_t len)
+{
+	uint8_t want[RF_AGG_MAX_MSG];
+	uint32_t i;
+
+	if (got_num != n)
+	{
+		return 0;
+	}
+	for (i = 0; i < n; i++)
+	{
+		fill(want, len, first + i);
+		if (got_len[i] != len || memcmp(got[i], want, len) != 0)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void wait_ms(uint32_t ms)
+{
+	vhal_run_until(vhal_now_ns() + ms * 1000000ULL);
+}
+
+int main(void)
+{
+	const rf_agg_stats_t *st = rf_agg_get_stats();
+	uint8_t msg[RF_AGG_MAX_MSG];
+	uint32_t i, n, frames;
+
+	vpan_init(&radio);
+	vpan_set_tx_hook(&radio, on_air, NULL);
+	vhal_init(&radio);
+	check(rf_init() == OK, "rf_init");
+	rf_set_default_para();
+	rf_frame_init(TEST_ADDR);
+	rf_agg_init();
+
+	// 10-byte messages share one frame until the next one does not fit
+	n = (RF_FRAME_MAX_PAYLOAD) / 11;
+	for (i = 0; i <= n; i++)
+	{
+		fill(msg, 10, i);
+		check(rf_agg_send(TEST_PEER, msg, 10, 60000) == OK, "rf_agg_send");
+		check(air_num == (i == n), i == n ? "full frame sent" : "held while it fits");
+	}
+	check(air_len[0] == RF_FRAME_HDR_LEN + n * 11, "frame filled");
+	rf_frame_init(TEST_PEER);
+	rf_agg_input(air[0], air_len[0]);
+	check(got_is(0, n, 10), "aggregate split into its messages");
+	check(st->frames == 1 && st->msgs == n && st->airtime_us < st->airtime_single_us, "stats of the full frame");
+
+	// the message left over goes out at its deadline, not before
+	got_num = 0;
+	rf_agg_poll();
+	check(air_num == 1, "nothing sent before the deadline");
+	wait_ms(60001);
+	rf_agg_poll();
+	check(air_num == 2 && st->deadline_flush == 1, "sent at the deadline");
+	rf_agg_input(air[1], air_len[1]);
+	check(got_is(n, 1, 10), "message sent at the deadline");
+
+	// a message that may not wait takes the ones held for the same peer along
+	got_num = 0;
+	fill(msg, 20, 100);
+	rf_agg_send(TEST_PEER, msg, 20, 5000);
+	fill(msg, 20, 101);
+	rf_agg_send(TEST_PEER, msg, 20, 0);
+	check(air_num == 3, "sent right away");
+	rf_agg_input(air[2], air_len[2]);
+	check(got_is(100, 2, 20), "held message sent with the one due now");
+
+	// the length of the last message runs past the frame end: the ones before are kept
+	got_num = 0;
+	air[2][air_len[2] - 21]++;
+	rf_agg_input(air[2], air_len[2]);
+	check(got_is(100, 1, 20) && st->rx_bad == 1, "truncated aggregate");
+
+	// full frames until the payload bytes times 1000 no longer fit in 32 bits, waiting for TX done
+	// skips ahead instead of polling through the airtime
+	vhal_set_poll(VHAL_POLL_IDLE);
+	rf_agg_init();
+	frames = (uint32_t)(0x100000000ULL / 1000 / RF_FRAME_MAX_PAYLOAD) + 1;
+	for (i = 0; i < frames; i++)
+	{
+		check(rf_agg_send(TEST_PEER, msg, RF_AGG_MAX_MSG, 0) == OK, "full frame");
+	}
+	check(st->frames == frames, "every full frame sent");
+	check(rf_agg_get_fill() == 1000, "fill of full frames");
+	printf("agg,%u msgs per frame at 10 bytes,fill %u permille over %u frames\n", n, rf_agg_get_fill(), frames);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+//
+// rf_arq (App/Src/rf_arq.c) sessions on the virtual PAN3031. DATA frames of a scripted sender are
+// fed to the receiver and the ACKs it puts on the air are checked: a lost first frame, a sender
+// that reboots, a repeated SYN. Then the node's own sender runs against its own receiver with the
+// first frame of every burst dropped. Exits 1 on a mismatch.
+//
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_arq.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_ADDR 0x21
+#define TEST_PEER 0x42
+#define TEST_MSGS 12
+
+static vpan_t radio;
+static uint8_t air[RF_FRAME_MAX_LEN];
+static uint8_t air_len;
+static uint32_t air_num;
+// frames sent since queue_num was last cleared
+static uint8_t queue[2 * RF_ARQ_WINDOW + 2][RF_FRAME_MAX_LEN];
+static uint8_t queue_len[2 * RF_ARQ_WINDOW + 2];
+static uint32_t queue_num;
+static uint8_t got[64];
+static uint32_t got_num;
+static uint32_t failed;
+static int failures;
+
+static void on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)start_ns;
+	(void)airtime_us;
+	(void)ctx;
+	memcpy(air, payload, len);
+	air_len = len;
+	air_num++;
+	if (queue_num < sizeof(queue_len))
+	{
+		memcpy(queue[queue_num], payload, len);
+		queue_len[queue_num++] = len;
+	}
+}
+
+void rf_arq_rx_event(uint8_t src, uint8_t *data, uint8_t len)
+{
+	(void)src;
+	if (got_num < sizeof(got) && len == 1)
+	{
+		got[got_num++] = data[0];
+	}
+}
+
+void rf_arq_fail_event(uint8_t dst, uint32_t lost)
+{
+	(void)dst;
+	failed += lost;
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// one DATA frame of the scripted sender, datagram = its sequence
+static void data(uint8_t seq, uint8_t base, uint8_t syn, uint8_t areq)
+{
+	uint8_t frame[RF_FRAME_HDR_LEN + RF_ARQ_CTL_LEN + 1];
+	rf_frame_hdr_t hdr = {TEST_ADDR, TEST_PEER, seq, RF_FRAME_FLAG_ARQ | (areq ? RF_FRAME_FLAG_AREQ : 0), 0};
+	uint8_t hlen = rf_frame_encode(frame, &hdr);
+
+	frame[hlen] = (uint8_t)(seq - base) | (syn ? RF_ARQ_CTL_SYN : 0);
+	frame[hlen + 1] = seq;
+	rf_arq_input(frame, hlen + RF_ARQ_CTL_LEN + 1);
+}
+
+// the cumulative sequence of the ACK just sent, -1 when none was sent
+static int ack(uint32_t *seen)
+{
+	rf_frame_hdr_t hdr;
+
+	if (air_num == *seen || rf_frame_decode(air, air_len, &hdr) == 0 || !(hdr.flags & RF_FRAME_FLAG_ACK))
+	{
+		return -1;
+	}
+	*seen = air_num;
+	return hdr.seq;
+}
+
+static int got_is(const uint8_t *want, uint32_t n)
+{
+	return got_num == n && memcmp(got, want, n) == 0;
+}
+
+static void receiver(void)
+{
+	static const uint8_t first[] = {0, 1, 2, 3};
+	static const uint8_t rebooted[] = {0, 1, 2, 3, 4, 5, 0};
+	uint32_t seen = air_num;
+
+	// the first frame of the session is lost: nothing is delivered or acked past it
+	data(1, 0, 1, 0);
+	data(2, 0, 1, 0);
+	data(3, 0, 1, 1);
+	check(got_num == 0, "nothing delivered behind a lost first frame");
+	check(ack(&seen) == 0, "ack stays at the lost first frame");
+	data(0, 0, 1, 1);
+	check(got_is(first, 4), "in order once the first frame arrives");
+	check(ack(&seen) == 4, "ack after the gap is filled");
+
+	// the same SYN burst again, its ACK was lost: duplicates only
+	data(0, 0, 1, 0);
+	data(3, 0, 1, 1);
+	check(got_is(first, 4), "repeated SYN burst not delivered twice");
+	check(ack(&seen) == 4, "repeated SYN burst acked");
+
+	// acked, the sender goes on without SYN
+	data(4, 4, 0, 0);
+	data(5, 4, 0, 1);
+	check(ack(&seen) == 6, "plain frames acked");
+
+	// the sender reboots and starts over at 0: a new session, not a duplicate of sequence 0
+	data(0, 0, 1, 1);
+	check(got_is(rebooted, 7), "rebooted sender delivered");
+	check(ack(&seen) == 1, "rebooted sender acked from its base");
+
+	// a base far behind the window without SYN cannot belong to this session either
+	data(200, 200, 0, 1);
+	check(got_num == 8 && got[7] == 200, "base outside the window restarts the session");
+	check(ack(&seen) == 201, "acked from the new base");
+}
+
+// the node's sender against its own receiver, the first frame of a burst is dropped the first
+// time its sequence is sent
+static void loopback(void)
+{
+	uint8_t want[TEST_MSGS], dropped[256] = {0};
+	uint32_t i, start = HAL_GetTick();
+	rf_frame_hdr_t hdr;
+	uint8_t sent = 0, msg;
+
+	got_num = 0;
+	failed = 0;
+	for (i = 0; i < TEST_MSGS; i++)
+	{
+		want[i] = (uint8_t)(100 + i);
+	}
+	while ((sent < TEST_MSGS || rf_arq_pending() != 0) && HAL_GetTick() - start < 60000)
+	{
+		while (sent < TEST_MSGS && rf_arq_pending() < RF_ARQ_WINDOW)
+		{
+			msg = want[sent++];
+			check(rf_arq_send(TEST_ADDR, &msg, 1) == OK, "rf_arq_send");
+		}
+		queue_num = 0;
+		rf_arq_poll();
+		// ACKs the receiver sends are queued behind the burst and handed back in turn
+		for (i = 0; i < queue_num; i++)
+		{
+			rf_frame_decode(queue[i], queue_len[i], &hdr);
+			if (i == 0 && (hdr.flags & RF_FRAME_FLAG_ARQ) && !dropped[hdr.seq])
+			{
+				dropped[hdr.seq] = 1;
+				continue;
+			}
+			rf_arq_input(queue[i], queue_len[i]);
+		}
+		vhal_run_until(vhal_now_ns() + 1000000ULL);
+	}
+	check(got_is(want, TEST_MSGS), "every datagram once and in order");
+	check(failed == 0 && rf_arq_pending() == 0, "sender done without a dropped window");
+	printf("loopback,%u datagrams,%u retransmits\n", TEST_MSGS, rf_arq_get_stats()->retransmits);
+}
+
+int main(void)
+{
+	vpan_init(&radio);
+	vpan_set_tx_hook(&radio, on_air, NULL);
+	vhal_init(&radio);
+	check(rf_init() == OK, "rf_init");
+	rf_set_default_para();
+	rf_frame_init(TEST_ADDR);
+	rf_arq_init();
+
+	receiver();
+	loopback();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+//
+// Host benchmark of the CRC engines in Radio/src/crc.c.
+// Prints one line per engine and length: name,crc type,length,ns per byte,cycles per byte
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "crc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#endif
+
+typedef uint16_t (*crc_fn_t)( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType );
+
+static const struct
+{
+	const char *name;
+	crc_fn_t fn;
+} engines[] = {
+	{ "bitwise", ComputeCrcBitwise },
+	{ "nibble", ComputeCrcNibble },
+	{ "table", ComputeCrcTable },
+	{ "slice4", ComputeCrcSlice4 },
+	{ "slice8", ComputeCrcSlice8 },
+};
+
+#define ENGINE_NUM (sizeof(engines) / sizeof(engines[0]))
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef BENCH_HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t lengths[] = { 16, 64, 255, 4096 };
+	uint32_t total = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : (16u << 20);
+	uint8_t *buf = malloc(4096);
+	volatile uint16_t sink = 0;
+	uint32_t i, e, l, t;
+
+	if (buf == NULL)
+	{
+		return 1;
+	}
+	srand(3031);
+	for (i = 0; i < 4096; i++)
+	{
+		buf[i] = (uint8_t)rand();
+	}
+
+	/* every engine has to agree with the bitwise reference before it is timed */
+	for (t = CRC_TYPE_CCITT; t <= CRC_TYPE_IBM; t++)
+	{
+		for (l = 0; l <= 300; l++)
+		{
+			uint16_t ref = ComputeCrcBitwise(0x1D0F, buf, l, t);
+			for (e = 1; e < ENGINE_NUM; e++)
+			{
+				if (engines[e].fn(0x1D0F, buf, l, t) != ref)
+				{
+					fprintf(stderr, "%s mismatch, type %u len %u\n", engines[e].name, t, l);
+					return 1;
+				}
+			}
+		}
+	}
+
+	printf("engine,type,length,ns_per_byte,cycles_per_byte\n");
+	for (t = CRC_TYPE_CCITT; t <= CRC_TYPE_IBM; t++)
+	{
+		for (e = 0; e < ENGINE_NUM; e++)
+		{
+			for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+			{
+				uint32_t rounds = total / lengths[l];
+				uint64_t ns, cyc;
+
+				ns = now_ns();
+				cyc = now_cycles();
+				for (i = 0; i < rounds; i++)
+				{
+					sink ^= engines[e].fn(CRC_CCITT_SEED, buf, lengths[l], t);
+				}
+				cyc = now_cycles() - cyc;
+				ns = now_ns() - ns;
+				printf("%s,%s,%u,%.3f,%.2f\n", engines[e].name, (t == CRC_TYPE_IBM) ? "ibm" : "ccitt",
+				       lengths[l], (double)ns / ((double)rounds * lengths[l]),
+				       (double)cyc / ((double)rounds * lengths[l]));
+			}
+		}
+	}
+
+	free(buf);
+	return (int)(sink & 0);
+}
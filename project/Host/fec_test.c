@@ -0,0 +1,173 @@
+//
+// rf_fec (App/Src/rf_fec.c) on the virtual PAN3031: a group is sent, its frames are caught on the
+// air and fed back into the receiver with some of them erased. Every single erasure and every
+// erasure of up to RF_FEC_M frames must give back the datagrams byte for byte; with RF_FEC_M + 1
+// erasures the missing datagrams must be counted lost and nothing wrong delivered.
+// Exits 1 on a mismatch.
+//
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_fec.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_ADDR 0x21
+#define TEST_N (RF_FEC_K + RF_FEC_M)
+
+static vpan_t radio;
+static uint8_t air[TEST_N][RF_FRAME_MAX_LEN];
+static uint8_t air_len[TEST_N];
+static uint32_t air_num;
+static uint8_t msg[RF_FEC_K][RF_FEC_MAX_LEN];
+static uint8_t msg_len[RF_FEC_K];
+static uint8_t got[2 * RF_FEC_K][RF_FEC_MAX_LEN];
+static uint8_t got_len[2 * RF_FEC_K];
+static uint32_t got_num;
+static int failures;
+
+static void on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)start_ns;
+	(void)airtime_us;
+	(void)ctx;
+	if (air_num < TEST_N)
+	{
+		memcpy(air[air_num], payload, len);
+		air_len[air_num++] = len;
+	}
+}
+
+void rf_fec_rx_event(uint8_t src, uint8_t *data, uint8_t len)
+{
+	(void)src;
+	if (got_num < 2 * RF_FEC_K)
+	{
+		memcpy(got[got_num], data, len);
+		got_len[got_num++] = len;
+	}
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// how often datagram i was delivered with the bytes it was sent with
+static uint32_t delivered(uint32_t i)
+{
+	uint32_t j, n = 0;
+
+	for (j = 0; j < got_num; j++)
+	{
+		if (got_len[j] == msg_len[i] && memcmp(got[j], msg[i], msg_len[i]) == 0)
+		{
+			n++;
+		}
+	}
+	return n;
+}
+
+// the captured group with the frames of the erased mask left out, on a fresh receiver
+static void receive(uint32_t erased)
+{
+	uint32_t i;
+
+	rf_fec_init();
+	got_num = 0;
+	for (i = 0; i < air_num; i++)
+	{
+		if (!(erased & (1UL << i)))
+		{
+			check(rf_fec_input(air[i], air_len[i]) == 1, "FEC frame consumed");
+		}
+	}
+}
+
+static uint32_t bits(uint32_t v)
+{
+	uint32_t n = 0;
+
+	for (; v; v &= v - 1)
+	{
+		n++;
+	}
+	return n;
+}
+
+int main(void)
+{
+	char what[64];
+	uint32_t i, b, erased, runs = 0, exact = 0, failed = 0, missing;
+
+	vpan_init(&radio);
+	vpan_set_tx_hook(&radio, on_air, NULL);
+	vhal_init(&radio);
+	check(rf_init() == OK, "rf_init");
+	rf_set_default_para();
+	rf_frame_init(TEST_ADDR);
+	rf_fec_init();
+
+	// different lengths, so the padding to the symbol size is covered too
+	for (i = 0; i < RF_FEC_K; i++)
+	{
+		msg_len[i] = (uint8_t)(i == 0 ? RF_FEC_MAX_LEN : 1 + (i * 23) % RF_FEC_MAX_LEN);
+		memset(msg[i], 0, sizeof(msg[i]));
+		for (b = 0; b < msg_len[i]; b++)
+		{
+			msg[i][b] = (uint8_t)(i * 59 + b * 13 + 7);
+		}
+		check(rf_fec_send(RF_FRAME_ADDR_BROADCAST, msg[i], msg_len[i]) == OK, "rf_fec_send");
+	}
+	check(air_num == TEST_N, "K data and M repair frames on air");
+
+	// every erasure pattern of the group
+	for (erased = 0; erased < (1UL << TEST_N); erased++)
+	{
+		receive(erased);
+		missing = 0;
+		for (i = 0; i < RF_FEC_K; i++)
+		{
+			if (delivered(i) != 1)
+			{
+				missing++;
+			}
+		}
+		if (bits(erased) <= RF_FEC_M)
+		{
+			snprintf(what, sizeof(what), "erasures 0x%02x recovered byte-exact", (unsigned)erased);
+			check(missing == 0 && got_num == RF_FEC_K, what);
+			exact++;
+		}
+		else
+		{
+			// data frames that did arrive are still delivered, nothing else is
+			uint32_t data_lost = bits(erased & ((1UL << RF_FEC_K) - 1));
+
+			snprintf(what, sizeof(what), "erasures 0x%02x not recoverable", (unsigned)erased);
+			check(missing == data_lost && got_num == RF_FEC_K - data_lost, what);
+			failed++;
+		}
+		runs++;
+	}
+
+	// past the repair capacity the datagrams of the group are counted lost once newer groups push
+	// it out of the receiver
+	receive((1UL << (RF_FEC_M + 1)) - 1);
+	check(rf_fec_get_stats()->recovered == 0, "nothing recovered past RF_FEC_M erasures");
+	for (i = 0; i < RF_FEC_DEPTH + 1; i++)
+	{
+		air[RF_FEC_K][2]++;
+		check(rf_fec_input(air[RF_FEC_K], air_len[RF_FEC_K]) == 1, "repair frame of a newer group");
+	}
+	check(rf_fec_get_stats()->lost == RF_FEC_M + 1, "unrecoverable datagrams counted lost");
+
+	printf("fec,k %u,m %u,%u patterns,%u recovered exactly,%u past capacity\n", RF_FEC_K, RF_FEC_M, runs, exact, failed);
+	return failures ? 1 : 0;
+}
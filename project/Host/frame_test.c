@@ -0,0 +1,188 @@
+//
+// rf_frame (App/Src/rf_frame.c) on the virtual PAN3031: messages are sent, the fragments caught on
+// the air are fed back into the receiver and the reassembled message is compared with what was sent.
+// Covers the largest message the receiver can take, one byte more, the message CRC computed in the
+// FIFO transfers, a corrupted fragment and fragments out of order. Exits 1 on a mismatch.
+// Built a second time as frame_test_lz with RF_LZ_STAGE, where every packet carries the stage header
+// and the message CRC is computed in software.
+//
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_frame.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_ADDR 0x21
+#define TEST_PEER 0x42
+#define WAIT_MS 5000
+#define OTHER 0xff
+#define AIR_MAX_LEN 255
+
+extern struct RxDoneMsg RxDoneParams;
+
+static vpan_t radio;
+static uint8_t air[RF_FRAME_MAX_FRAGS + 1][AIR_MAX_LEN];
+static uint8_t air_len[RF_FRAME_MAX_FRAGS + 1];
+static uint32_t air_num;
+static uint8_t msg[RF_FRAME_MAX_MSG + 1];
+static uint8_t got[RF_FRAME_MAX_MSG];
+static uint32_t got_len;
+static uint32_t got_num;
+static int failures;
+
+static void on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)start_ns;
+	(void)airtime_us;
+	(void)ctx;
+	if (air_num <= RF_FRAME_MAX_FRAGS)
+	{
+		memcpy(air[air_num], payload, len);
+		air_len[air_num++] = len;
+	}
+}
+
+void rf_frame_rx_event(const rf_frame_hdr_t *hdr, uint8_t *data, uint32_t len)
+{
+	(void)hdr;
+	memcpy(got, data, len);
+	got_len = len;
+	got_num++;
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// through the RX done interrupt, so the FIFO read feeds the message CRC as on the board
+static void deliver(const uint8_t *frame, uint8_t len)
+{
+	uint32_t start;
+
+	rf_set_recv_flag(RADIO_FLAG_IDLE);
+	vhal_run_until(vhal_now_ns() + 1000000ULL);
+	check(vpan_rx_packet(&radio, frame, len, -9000, 750, 1, vhal_now_ns()) == 1, "packet heard");
+	start = HAL_GetTick();
+	while (rf_get_recv_flag() != RADIO_FLAG_RXDONE && HAL_GetTick() - start <= WAIT_MS)
+	{
+	}
+	check(rf_get_recv_flag() == RADIO_FLAG_RXDONE, "rx done");
+	rf_frame_input(RxDoneParams.Payload, RxDoneParams.Size);
+}
+
+static uint32_t send(uint32_t len)
+{
+	uint32_t res;
+
+	air_num = 0;
+	res = rf_frame_send(TEST_PEER, msg, len);
+	check(rf_enter_continous_rx() == OK, "rf_enter_continous_rx");
+	return res;
+}
+
+// feed count captured fragments in the order given, OTHER is a frame for another node
+static void receive(const uint32_t *order, uint32_t count)
+{
+#if RF_LZ_STAGE
+	static const uint8_t other[] = {0x00, 0x99, 0x77, 0x00, 0x00, 1, 2, 3, 4, 5, 6, 7, 8};
+#else
+	static const uint8_t other[] = {0x99, 0x77, 0x00, 0x00, 1, 2, 3, 4, 5, 6, 7, 8};
+#endif
+	uint32_t i;
+
+	got_num = 0;
+	rf_frame_init(TEST_PEER);
+	for (i = 0; i < count; i++)
+	{
+		if (order[i] == OTHER)
+		{
+			deliver(other, sizeof(other));
+		}
+		else
+		{
+			deliver(air[order[i]], air_len[order[i]]);
+		}
+	}
+}
+
+static uint32_t in_order(uint32_t *order)
+{
+	uint32_t i;
+
+	for (i = 0; i < air_num; i++)
+	{
+		order[i] = i;
+	}
+	return air_num;
+}
+
+int main(void)
+{
+	uint32_t order[RF_FRAME_MAX_FRAGS + 1];
+	const rf_frame_stats_t *st = rf_frame_get_stats();
+	uint32_t i, n;
+
+	vpan_init(&radio);
+	vpan_set_tx_hook(&radio, on_air, NULL);
+	vhal_init(&radio);
+	for (i = 0; i < sizeof(msg); i++)
+	{
+		msg[i] = (uint8_t)(i * 37 + (i >> 8) + 1);
+	}
+	check(rf_init() == OK, "rf_init");
+	rf_set_default_para();
+	rf_frame_init(TEST_ADDR);
+
+	// the largest message, every fragment full but the last
+	check(send(RF_FRAME_MAX_MSG) == OK, "send at the limit");
+	n = (RF_FRAME_MAX_MSG + RF_FRAME_CRC_LEN + RF_FRAME_FRAG_PAYLOAD - 1) / RF_FRAME_FRAG_PAYLOAD;
+	check(air_num == n, "fragment count at the limit");
+	receive(order, in_order(order));
+	check(got_num == 1 && got_len == RF_FRAME_MAX_MSG && memcmp(got, msg, got_len) == 0, "message at the limit");
+	check(st->rx_crc_err == 0 && st->reasm_overflow == 0, "no error at the limit");
+	printf("limit,%u,%u frames\n", RF_FRAME_MAX_MSG, air_num);
+
+	// one byte over is refused before anything is sent
+	check(send(RF_FRAME_MAX_MSG + 1) == FAIL, "send over the limit");
+	check(air_num == 0, "nothing on air over the limit");
+
+	// the CRC straddling two fragments
+	n = 2 * RF_FRAME_FRAG_PAYLOAD - 1;
+	check(send(n) == OK && air_num == 3, "send with split CRC");
+	receive(order, in_order(order));
+	check(got_num == 1 && got_len == n && memcmp(got, msg, n) == 0, "message with split CRC");
+
+	// a frame for another node read between two fragments, then the fragments reversed
+	check(send(1000) == OK && air_num == 5, "send 1000");
+	for (i = 0, n = 0; i < air_num; i++)
+	{
+		if (i == 2)
+		{
+			order[n++] = OTHER;
+		}
+		order[n++] = i;
+	}
+	receive(order, n);
+	check(got_num == 1 && got_len == 1000 && memcmp(got, msg, 1000) == 0, "frame between fragments");
+	for (i = 0; i < air_num; i++)
+	{
+		order[i] = air_num - 1 - i;
+	}
+	receive(order, air_num);
+	check(got_num == 1 && got_len == 1000 && memcmp(got, msg, 1000) == 0, "fragments reversed");
+
+	// one payload byte changed in the middle fragment, the radio's packet CRC being fine
+	air[2][RF_FRAME_FRAG_HDR_LEN + 10] ^= 0x01;
+	receive(order, in_order(order));
+	check(got_num == 0 && st->rx_crc_err == 1, "corrupted fragment dropped");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+//
+// rf_gw (App/Src/rf_gw.c) on the virtual PAN3031 and USART1. RF_GW_MAX_NODES addresses fill the
+// table, the oldest half expires and the rest must still be found behind the backward shifts.
+// Frames of one node are fed with a gap, a duplicate and a restart and its RX records checked.
+// The periodic dump of a full table must put every node on the UART once, paced by the TX ring,
+// without a dropped record. Exits 1 on a mismatch.
+//
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_frame.h"
+#include "rf_gw.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_NODE 0x42
+#define TEST_HALF (RF_GW_MAX_NODES / 2)
+
+static vpan_t radio;
+static uint8_t rec[RF_GW_REC_RX_HDR_LEN + RF_FRAME_MAX_LEN];
+static uint16_t rec_len;
+static uint32_t rec_num;
+static uint8_t dumped[0x10000];
+static uint32_t dumped_num;
+static int failures;
+
+// the default export, with every record the UART ring took kept
+void rf_gw_export_event(const uint8_t *r, uint16_t len)
+{
+	if (rf_uart_send_record(r[0], r + 1, len - 1) != OK)
+	{
+		return;
+	}
+	memcpy(rec, r, len);
+	rec_len = len;
+	rec_num++;
+	if (r[0] == RF_GW_REC_NODE)
+	{
+		dumped[r[5] | r[6] << 8]++;
+		dumped_num++;
+	}
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// spread over the 16-bit address space, never RF_GW_ADDR_NONE
+static uint16_t addr(uint32_t i)
+{
+	return (uint16_t)(i * 211 + 0x100);
+}
+
+static void wait_s(uint32_t s)
+{
+	vhal_run_until(vhal_now_ns() + s * 1000000000ULL);
+}
+
+static void frame(uint8_t seq, int16_t rssi_cdb)
+{
+	uint8_t f[RF_FRAME_HDR_LEN + 3] = {0};
+	rf_frame_hdr_t hdr = {RF_FRAME_ADDR_BROADCAST, TEST_NODE, seq, 0, 0};
+
+	rf_frame_encode(f, &hdr);
+	f[RF_FRAME_HDR_LEN + 2] = seq;
+	rf_gw_input(f, sizeof(f), rssi_cdb, 750);
+}
+
+static uint16_t u16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+int main(void)
+{
+	const rf_gw_stats_t *st = rf_gw_get_stats();
+	const rf_gw_node_t *node;
+	uint32_t i, found, start, polls = 0;
+
+	vpan_init(&radio);
+	vhal_init(&radio);
+	vhal_set_poll(VHAL_POLL_IDLE);
+	check(rf_init() == OK, "rf_init");
+	rf_set_default_para();
+	rf_gw_init();
+
+	// two batches 2000 s apart fill the table, one more does not fit
+	for (i = 0; i < RF_GW_MAX_NODES; i++)
+	{
+		if (i == TEST_HALF)
+		{
+			wait_s(2000);
+		}
+		check(rf_gw_lookup(addr(i), 1) != NULL, "node added");
+	}
+	check(rf_gw_lookup(addr(RF_GW_MAX_NODES), 1) == NULL && st->table_full == 1, "table full");
+	for (i = 0, found = 0; i < RF_GW_MAX_NODES; i++)
+	{
+		found += rf_gw_lookup(addr(i), 0) != NULL;
+	}
+	check(found == RF_GW_MAX_NODES, "every node found in a full table");
+	printf("table,%u nodes,%u slots,%u bytes\n", RF_GW_MAX_NODES, RF_GW_TABLE_SIZE, (uint32_t)sizeof(rf_gw_node_t) * RF_GW_TABLE_SIZE);
+
+	// the first batch is now past RF_GW_EXPIRE_MS, the second is not
+	wait_s(2000);
+	rf_gw_expire();
+	check(st->expired == TEST_HALF && st->nodes == RF_GW_MAX_NODES - TEST_HALF, "first batch expired");
+	for (i = 0, found = 0; i < RF_GW_MAX_NODES; i++)
+	{
+		found += (rf_gw_lookup(addr(i), 0) != NULL) == (i >= TEST_HALF);
+	}
+	check(found == RF_GW_MAX_NODES, "second batch found after the backward shifts");
+
+	// a gap of one, a duplicate and a restart of the node
+	frame(10, -9000);
+	frame(11, -9000);
+	frame(13, -9800);
+	check(rec[0] == RF_GW_REC_RX && u16(rec + 5) == TEST_NODE && rec[7] == 13 && u16(rec + 12) == 1
+		  && rec[14] == RF_FRAME_HDR_LEN + 3 && rec_len == RF_GW_REC_RX_HDR_LEN + RF_FRAME_HDR_LEN + 3
+		  && rec[rec_len - 1] == 13, "RX record after a gap");
+	frame(13, -9000);
+	frame(5, -9000);
+	node = rf_gw_lookup(TEST_NODE, 0);
+	check(node != NULL && node->rx == 5 && node->lost == 1 && node->seq == 5 && st->dup == 1, "node counters");
+	check(node != NULL && node->rssi_cdb < -9000 && node->rssi_cdb > -9800, "RSSI EWMA");
+
+	// fill up again, then the periodic dump of the whole table through the UART
+	for (i = RF_GW_MAX_NODES; st->nodes < RF_GW_MAX_NODES; i++)
+	{
+		rf_gw_lookup(addr(i), 1);
+	}
+	wait_s(RF_GW_DUMP_MS / 1000);
+	rec_num = 0;
+	start = HAL_GetTick();
+	while (dumped_num < RF_GW_MAX_NODES && HAL_GetTick() - start < 5000)
+	{
+		rf_gw_poll();
+		polls += rec_num != 0;
+		rec_num = 0;
+		vhal_run_until(vhal_now_ns() + 1000000ULL);
+	}
+	for (i = 0, found = 0; i < 0x10000; i++)
+	{
+		found += dumped[i] == 1;
+	}
+	check(dumped_num == RF_GW_MAX_NODES && found == RF_GW_MAX_NODES, "every node dumped once");
+	check(polls > 1, "dump spread over several polls");
+	check(rf_uart_get_stats()->dropped == 0, "no record dropped");
+	printf("dump,%u records over %u polls in %u ms\n", dumped_num, polls, HAL_GetTick() - start);
+	return failures ? 1 : 0;
+}
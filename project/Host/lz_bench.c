@@ -0,0 +1,206 @@
+//
+// Host benchmark of the payload codec in Radio/src/lz.c on representative telemetry.
+// Prints one line per data set, without and with a preset dictionary (one sample packet of the
+// set, like rf_set_lz_dict): name,dict length,packets,bytes in,bytes on air,ratio,compressed share,
+// ns per input byte to compress,ns per input byte to decompress
+// Bytes on air include the one byte stage header and the raw fallback, like radio.c.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "lz.h"
+
+#define PACKETS 4096
+#define MAX_PAYLOAD 254
+#define DICT_MAX 64
+
+typedef uint32_t (*gen_fn_t)(uint8_t *buf, uint32_t n);
+
+static int32_t walk(int32_t *v, int32_t step, int32_t lo, int32_t hi)
+{
+	*v += (rand() % (2 * step + 1)) - step;
+	if (*v < lo)
+	{
+		*v = lo;
+	}
+	if (*v > hi)
+	{
+		*v = hi;
+	}
+	return *v;
+}
+
+/* one "key=value" sensor report as the demo firmware prints it */
+static uint32_t gen_kv(uint8_t *buf, uint32_t n)
+{
+	static int32_t t = 2340, h = 452, p = 10132, bat = 3310;
+
+	return (uint32_t)snprintf((char *)buf, MAX_PAYLOAD, "id=17,seq=%u,t=%d.%02d,h=%d.%d,p=%d.%d,bat=%d",
+	                          n, walk(&t, 5, 0, 4000) / 100, t % 100, walk(&h, 3, 0, 1000) / 10, h % 10,
+	                          walk(&p, 2, 9000, 11000) / 10, p % 10, walk(&bat, 1, 2800, 3400));
+}
+
+/* JSON report of the kind a gateway forwards */
+static uint32_t gen_json(uint8_t *buf, uint32_t n)
+{
+	static int32_t t = 2340, h = 452, p = 10132, bat = 3310;
+
+	return (uint32_t)snprintf((char *)buf, MAX_PAYLOAD,
+	                          "{\"dev\":\"node17\",\"seq\":%u,\"temp\":%d.%02d,\"hum\":%d.%d,\"press\":%d.%d,\"bat\":%d}",
+	                          n, walk(&t, 5, 0, 4000) / 100, t % 100, walk(&h, 3, 0, 1000) / 10, h % 10,
+	                          walk(&p, 2, 9000, 11000) / 10, p % 10, walk(&bat, 1, 2800, 3400));
+}
+
+/* eight key=value reports batched into one packet */
+static uint32_t gen_batch(uint8_t *buf, uint32_t n)
+{
+	uint32_t len = 0, i, l;
+	uint8_t rec[MAX_PAYLOAD];
+
+	for (i = 0; i < 8; i++)
+	{
+		l = gen_kv(rec, n * 8 + i);
+		if (len + l + 1 > MAX_PAYLOAD)
+		{
+			break;
+		}
+		memcpy(buf + len, rec, l);
+		len += l;
+		buf[len++] = '\n';
+	}
+	return len;
+}
+
+/* 16 little endian int16 accelerometer samples, slowly varying */
+static uint32_t gen_accel(uint8_t *buf, uint32_t n)
+{
+	static int32_t a = 0;
+	uint32_t i;
+
+	(void)n;
+	for (i = 0; i < 16; i++)
+	{
+		int16_t v = (int16_t)walk(&a, 40, -2048, 2047);
+		buf[2 * i] = (uint8_t)v;
+		buf[2 * i + 1] = (uint8_t)(v >> 8);
+	}
+	return 32;
+}
+
+/* incompressible, the stage must fall back to raw */
+static uint32_t gen_random(uint8_t *buf, uint32_t n)
+{
+	uint32_t i;
+
+	(void)n;
+	for (i = 0; i < 64; i++)
+	{
+		buf[i] = (uint8_t)rand();
+	}
+	return 64;
+}
+
+static const struct
+{
+	const char *name;
+	gen_fn_t gen;
+} sets[] = {
+	{ "kv", gen_kv },
+	{ "json", gen_json },
+	{ "kv_batch", gen_batch },
+	{ "accel_i16", gen_accel },
+	{ "random", gen_random },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int run_set(uint32_t s, uint32_t dict_len)
+{
+	static uint8_t in[PACKETS][DICT_MAX + MAX_PAYLOAD];
+	static uint32_t in_len[PACKETS];
+	static uint8_t out[PACKETS][MAX_PAYLOAD];
+	static uint32_t out_len[PACKETS];
+	uint8_t dict[DICT_MAX + MAX_PAYLOAD];
+	uint8_t dec[DICT_MAX + MAX_PAYLOAD];
+	uint32_t i, sample, total_in = 0, total_air = 0, compressed = 0;
+	uint64_t ns_c, ns_d;
+
+	srand(3031 + s);
+	/* the dictionary is a sample packet that is not part of the measured traffic */
+	sample = sets[s].gen(dict, 0);
+	if (sample < dict_len)
+	{
+		dict_len = sample;
+	}
+	memcpy(dec, dict, dict_len);
+	for (i = 0; i < PACKETS; i++)
+	{
+		memcpy(in[i], dict, dict_len);
+		in_len[i] = sets[s].gen(in[i] + dict_len, i + 1);
+		total_in += in_len[i];
+	}
+
+	ns_c = now_ns();
+	for (i = 0; i < PACKETS; i++)
+	{
+		out_len[i] = LzCompress(in[i], dict_len, in_len[i], out[i], in_len[i] - 1);
+	}
+	ns_c = now_ns() - ns_c;
+
+	ns_d = now_ns();
+	for (i = 0; i < PACKETS; i++)
+	{
+		if (out_len[i] != 0 && LzDecompress(out[i], out_len[i], dec, dict_len, sizeof(dec)) != in_len[i])
+		{
+			fprintf(stderr, "%s: packet %u length mismatch\n", sets[s].name, i);
+			return 1;
+		}
+	}
+	ns_d = now_ns() - ns_d;
+
+	/* round trip check outside the timed loop */
+	for (i = 0; i < PACKETS; i++)
+	{
+		if (out_len[i] == 0)
+		{
+			total_air += 1 + in_len[i];
+			continue;
+		}
+		LzDecompress(out[i], out_len[i], dec, dict_len, sizeof(dec));
+		if (memcmp(dec + dict_len, in[i] + dict_len, in_len[i]) != 0)
+		{
+			fprintf(stderr, "%s: packet %u corrupted\n", sets[s].name, i);
+			return 1;
+		}
+		total_air += 1 + out_len[i];
+		compressed++;
+	}
+
+	printf("%s,%u,%u,%u,%u,%.3f,%.3f,%.2f,%.2f\n", sets[s].name, dict_len, PACKETS, total_in, total_air,
+	       (double)total_air / total_in, (double)compressed / PACKETS,
+	       (double)ns_c / total_in, (double)ns_d / total_in);
+	return 0;
+}
+
+int main(void)
+{
+	uint32_t s;
+
+	printf("set,dict,packets,bytes_in,bytes_air,ratio,compressed_share,ns_per_byte_compress,ns_per_byte_decompress\n");
+	for (s = 0; s < sizeof(sets) / sizeof(sets[0]); s++)
+	{
+		if (run_set(s, 0) != 0 || run_set(s, DICT_MAX) != 0)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,166 @@
+//
+// rf_mesh (App/Src/rf_mesh.c) on the virtual PAN3031: HELLO and DATA frames of scripted neighbors
+// are fed to the node and the frames it puts on the air are checked. Covers the parent picked from
+// the first flood, the HELLO passed on with the own cost, the switch to a cheaper route once the
+// SNR of the parent link drops, forwarding with the TTL counted down, duplicate and TTL drops and
+// the delivery at the sink. Exits 1 on a mismatch.
+//
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_mesh.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_ADDR 0x21
+#define TEST_SINK 0x01
+#define TEST_RELAY 0x05
+#define TEST_CHILD 0x30
+#define TEST_GOOD_CDB 800
+#define TEST_BAD_CDB (-1500)
+
+static vpan_t radio;
+static uint8_t air[RF_FRAME_MAX_LEN];
+static uint8_t air_len;
+static uint32_t air_num;
+static uint8_t got[RF_MESH_MAX_DATA];
+static uint8_t got_len;
+static uint8_t got_origin;
+static uint32_t got_num;
+static int failures;
+
+static void on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)start_ns;
+	(void)airtime_us;
+	(void)ctx;
+	memcpy(air, payload, len);
+	air_len = len;
+	air_num++;
+}
+
+void rf_mesh_rx_event(uint8_t origin, uint8_t *data, uint8_t len)
+{
+	got_origin = origin;
+	memcpy(got, data, len);
+	got_len = len;
+	got_num++;
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// one CTRL frame from src to dst with the given mesh payload, heard at snr_cdb
+static uint32_t hear(uint8_t src, uint8_t dst, const uint8_t *p, uint8_t len, int16_t snr_cdb)
+{
+	static uint8_t fseq;
+	uint8_t frame[RF_FRAME_MAX_LEN];
+	rf_frame_hdr_t hdr = {dst, src, fseq++, RF_FRAME_FLAG_CTRL, 0};
+	uint8_t hlen = rf_frame_encode(frame, &hdr);
+
+	memcpy(frame + hlen, p, len);
+	return rf_mesh_input(frame, hlen + len, -9000, snr_cdb);
+}
+
+static void hello(uint8_t src, uint8_t seq, uint16_t cost, int16_t snr_cdb)
+{
+	uint8_t p[] = {RF_MESH_CMD_HELLO, TEST_SINK, seq, (uint8_t)cost, (uint8_t)(cost >> 8)};
+
+	check(hear(src, RF_FRAME_ADDR_BROADCAST, p, sizeof(p), snr_cdb) == 1, "HELLO consumed");
+}
+
+static void data(uint8_t src, uint8_t origin, uint8_t mseq, uint8_t ttl)
+{
+	uint8_t p[RF_MESH_DATA_HDR_LEN + 3] = {RF_MESH_CMD_DATA, origin, mseq, ttl, 0xA1, 0xB2, mseq};
+
+	check(hear(src, rf_frame_get_addr(), p, sizeof(p), TEST_GOOD_CDB) == 1, "DATA consumed");
+}
+
+// poll through the longest jitter, the mesh payload of the frame sent on the way or NULL
+static const uint8_t *sent(rf_frame_hdr_t *hdr)
+{
+	uint32_t seen = air_num, start = HAL_GetTick();
+	uint8_t hlen;
+
+	while (air_num == seen && HAL_GetTick() - start <= RF_MESH_JITTER_MS + 1)
+	{
+		rf_mesh_poll();
+		vhal_run_until(vhal_now_ns() + 1000000ULL);
+	}
+	hlen = rf_frame_decode(air, air_len, hdr);
+	return (air_num != seen && hlen != 0) ? air + hlen : NULL;
+}
+
+int main(void)
+{
+	const rf_mesh_stats_t *st = rf_mesh_get_stats();
+	static const uint8_t msg[] = {1, 2, 3, 4, 5};
+	const uint8_t *p;
+	rf_frame_hdr_t hdr;
+	uint32_t i;
+
+	vpan_init(&radio);
+	vpan_set_tx_hook(&radio, on_air, NULL);
+	vhal_init(&radio);
+	vhal_set_poll(VHAL_POLL_IDLE);
+	check(rf_init() == OK, "rf_init");
+	rf_set_default_para();
+	rf_frame_init(TEST_ADDR);
+	rf_mesh_init(0);
+
+	check(rf_mesh_send(msg, sizeof(msg)) == FAIL && st->no_route == 1, "no route before the first flood");
+
+	// the sink heard directly: it becomes the parent and the flood goes on with one hop more
+	hello(TEST_SINK, 1, 0, TEST_GOOD_CDB);
+	check(rf_mesh_get_parent() == TEST_SINK && rf_mesh_get_cost() == RF_MESH_HOP_COST, "sink as parent");
+	p = sent(&hdr);
+	check(p != NULL && hdr.dst == RF_FRAME_ADDR_BROADCAST && p[0] == RF_MESH_CMD_HELLO && p[1] == TEST_SINK
+		  && p[2] == 1 && (p[3] | p[4] << 8) == RF_MESH_HOP_COST, "HELLO passed on with the own cost");
+
+	// a relay one hop further is no better
+	hello(TEST_RELAY, 1, RF_MESH_HOP_COST, TEST_GOOD_CDB);
+	check(rf_mesh_get_parent() == TEST_SINK, "parent kept against a longer route");
+
+	// the sink link fades: other frames of the sink are link samples too, until the relay wins
+	for (i = 0; i < 32; i++)
+	{
+		uint8_t other[] = {0x7F};
+
+		check(hear(TEST_SINK, TEST_ADDR, other, sizeof(other), TEST_BAD_CDB) == 0, "other CTRL frame passed on");
+	}
+	check(rf_mesh_send(msg, sizeof(msg)) == OK, "rf_mesh_send");
+	check(rf_mesh_get_parent() == TEST_RELAY && st->parent_changes == 2, "switched to the relay");
+	check(rf_mesh_get_cost() == 2 * RF_MESH_HOP_COST, "cost over the relay");
+	p = air + rf_frame_decode(air, air_len, &hdr);
+	check(hdr.dst == TEST_RELAY && p[0] == RF_MESH_CMD_DATA && p[1] == TEST_ADDR && p[3] == RF_MESH_TTL
+		  && memcmp(p + RF_MESH_DATA_HDR_LEN, msg, sizeof(msg)) == 0, "own DATA to the parent");
+
+	// a child's frame is forwarded once, with the TTL counted down
+	data(TEST_CHILD, TEST_CHILD, 7, 5);
+	p = sent(&hdr);
+	check(p != NULL && hdr.dst == TEST_RELAY && p[1] == TEST_CHILD && p[2] == 7 && p[3] == 4 && st->data_fwd == 1,
+		  "child's DATA forwarded");
+	data(TEST_RELAY, TEST_CHILD, 7, 5);
+	check(st->dup_drop == 1, "copy from another relay dropped");
+	data(TEST_CHILD, TEST_CHILD, 8, 1);
+	check(st->ttl_drop == 1 && sent(&hdr) == NULL, "TTL run out");
+	printf("mesh,%u parent changes,%u forwarded,%u dropped\n", st->parent_changes, st->data_fwd, st->dup_drop + st->ttl_drop);
+
+	// at the sink the data is delivered with its origin
+	rf_frame_init(TEST_SINK);
+	rf_mesh_init(1);
+	p = sent(&hdr);
+	check(p != NULL && p[0] == RF_MESH_CMD_HELLO && (p[3] | p[4] << 8) == 0, "sink floods");
+	data(TEST_ADDR, TEST_CHILD, 9, 3);
+	check(got_num == 1 && got_origin == TEST_CHILD && got_len == 3 && got[2] == 9 && st->data_rx == 1,
+		  "delivered at the sink");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+//
+// The NCP firmware mode (App/Src/rf_ncp.c) on the virtual PAN3031, with USART1 on a tty, so the
+// host tools (rf_ncp, NcpClient) can be run against it without the board.
+//   ncp_sim [-t seconds] <device>     one end of a pty pair, e.g. made by socat
+//   ncp_sim [-t seconds] -l <link>    opens a pty itself and links its slave to <link>
+// The virtual clock follows the wall clock and the bytes from the tty are fed to the RX DMA ring
+// at the UART's baud rate, so a host that sends more than the ring holds overwrites commands as
+// on the board. The NCP and UART counters go to stdout when the time is up or on SIGTERM.
+//
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_ncp.h"
+#include "rf_uart.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define SIM_STEP_NS 100000ULL		// least the virtual clock moves per round
+#define SIM_BYTE_NS (10000000000ULL / VHAL_UART_BAUD)
+
+static vpan_t radio;
+static volatile sig_atomic_t stop;
+static int tty = -1;
+static uint32_t tty_dropped;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static uint64_t wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// USART1 TX, nothing is lost unless the other end is gone
+static void on_uart(const uint8_t *data, uint16_t len, void *ctx)
+{
+	(void)ctx;
+	while (len > 0)
+	{
+		ssize_t n = write(tty, data, len);
+		if (n < 0 && errno != EINTR && errno != EAGAIN)
+		{
+			tty_dropped += len;
+			return;
+		}
+		data += (n > 0) ? n : 0;
+		len -= (n > 0) ? (uint16_t)n : 0;
+	}
+}
+
+static void raw(int fd)
+{
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+}
+
+// a new pty, the slave kept open (and raw) so the master never sees a hangup between clients
+static int open_pty(const char *link)
+{
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	const char *name;
+
+	if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || (name = ptsname(fd)) == NULL)
+	{
+		return -1;
+	}
+	raw(open(name, O_RDWR | O_NOCTTY));
+	unlink(link);
+	if (symlink(name, link) != 0)
+	{
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t buf[4096];
+	const rf_ncp_stats_t *st = rf_ncp_get_stats();
+	const rf_uart_stats_t *ust = rf_uart_get_stats();
+	const char *link = NULL;
+	uint32_t head = 0, tail = 0, seconds = 0;
+	uint64_t start, fed_ns = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:t:")) != -1)
+	{
+		if (opt == 'l')
+		{
+			link = optarg;
+		}
+		else if (opt == 't')
+		{
+			seconds = (uint32_t)strtoul(optarg, NULL, 0);
+		}
+		else
+		{
+			fprintf(stderr, "usage: ncp_sim [-t seconds] <device> | -l <link>\n");
+			return 2;
+		}
+	}
+	if ((link == NULL) == (optind >= argc))
+	{
+		fprintf(stderr, "usage: ncp_sim [-t seconds] <device> | -l <link>\n");
+		return 2;
+	}
+	if (link != NULL)
+	{
+		tty = open_pty(link);
+	}
+	else if ((tty = open(argv[optind], O_RDWR | O_NOCTTY)) >= 0)
+	{
+		raw(tty);
+	}
+	if (tty < 0)
+	{
+		perror(link != NULL ? link : argv[optind]);
+		return 1;
+	}
+	signal(SIGTERM, on_signal);
+	signal(SIGINT, on_signal);
+
+	vpan_init(&radio);
+	vhal_init(&radio);
+	vhal_set_poll(VHAL_POLL_IDLE);
+	vhal_set_uart(VHAL_UART_BAUD, on_uart, NULL);
+	if (rf_init() != OK)
+	{
+		fprintf(stderr, "rf_init failed\n");
+		return 1;
+	}
+	rf_set_default_para();
+	rf_ncp_init();
+
+	start = wall_ns();
+	while (!stop && (seconds == 0 || wall_ns() - start < seconds * 1000000000ULL))
+	{
+		struct pollfd pfd = {tty, POLLIN, 0};
+		uint64_t now;
+
+		// the main loop of WORK_MODE_NCP, a step of the virtual clock per round
+		if (poll(&pfd, 1, (head == tail) ? 1 : 0) > 0 && (pfd.revents & POLLIN) && tail - head < sizeof(buf))
+		{
+			uint32_t room = sizeof(buf) - (tail - head);
+			uint32_t at = tail % sizeof(buf);
+			ssize_t n = read(tty, buf + at, (room < sizeof(buf) - at) ? room : sizeof(buf) - at);
+
+			tail += (n > 0) ? (uint32_t)n : 0;
+		}
+		// bytes go into the ring at the baud rate, never faster
+		if (head == tail)
+		{
+			fed_ns = vhal_now_ns();
+		}
+		while (head != tail && fed_ns + SIM_BYTE_NS <= vhal_now_ns())
+		{
+			vhal_uart_rx(&buf[head++ % sizeof(buf)], 1);
+			fed_ns += SIM_BYTE_NS;
+		}
+		rf_ncp_poll();
+		now = wall_ns() - start;
+		vhal_run_until((now > vhal_now_ns()) ? now : vhal_now_ns() + SIM_STEP_NS);
+	}
+
+	printf("cmds %u bad_cmds %u tx %u rx %u tx_timeout %u evt_dropped %u\n", st->cmds, st->bad_cmds, st->tx,
+		   st->rx, st->tx_timeout, st->evt_dropped);
+	printf("uart_rx_bad %u uart_dropped %u rx_bytes %llu tty_dropped %u\n", ust->rx_bad, ust->dropped,
+		   (unsigned long long)vhal_get_stats()->uart_rx_bytes, tty_dropped);
+	if (link != NULL)
+	{
+		unlink(link);
+	}
+	return 0;
+}
@@ -0,0 +1,150 @@
+//
+// Drives Radio/ on the virtual PAN3031 (sim/vpan.h) and prints what each driver operation costs:
+// op,virtual us,SPI bytes,SPI transactions,page switches,register reads,register writes
+// The packet sent is looped back into the receiver, payload, RSSI and SNR are checked on the way,
+// as are the TX airtime and the RX timeout against the virtual clock. Exits 1 on a mismatch.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "main.h"
+#include "radio.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_LEN 32
+#define TEST_RSSI_CDB (-9000)
+#define TEST_SNR_CDB 750
+#define TEST_TIMEOUT_MS 50
+#define WAIT_MS 5000
+
+extern struct RxDoneMsg RxDoneParams;
+
+static vpan_t radio;
+static uint8_t air[VPAN_FIFO];
+static uint8_t air_len;
+static uint32_t air_us;
+static int failures;
+
+typedef struct
+{
+	uint64_t ns;
+	vpan_stats_t spi;
+} mark_t;
+
+static void on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)start_ns;
+	(void)ctx;
+	memcpy(air, payload, len);
+	air_len = len;
+	air_us = airtime_us;
+}
+
+static mark_t mark(void)
+{
+	mark_t m = {vhal_now_ns(), radio.stats};
+
+	return m;
+}
+
+static void report(const char *op, const mark_t *m)
+{
+	printf("%s,%llu,%llu,%u,%u,%u,%u\n", op, (unsigned long long)((vhal_now_ns() - m->ns) / 1000),
+		   (unsigned long long)(radio.stats.spi_bytes - m->spi.spi_bytes), radio.stats.transactions - m->spi.transactions,
+		   radio.stats.page_switches - m->spi.page_switches, radio.stats.reg_reads - m->spi.reg_reads,
+		   radio.stats.reg_writes - m->spi.reg_writes);
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+static uint32_t wait_flag(uint32_t (*get)(void), uint32_t want)
+{
+	uint32_t start = HAL_GetTick();
+
+	while (get() != want)
+	{
+		if (HAL_GetTick() - start > WAIT_MS)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(void)
+{
+	uint8_t payload[TEST_LEN];
+	uint32_t tx_time = 0, i;
+	uint64_t t0;
+	mark_t m;
+
+	vpan_init(&radio);
+	vpan_set_tx_hook(&radio, on_air, NULL);
+	vhal_init(&radio);
+	for (i = 0; i < TEST_LEN; i++)
+	{
+		payload[i] = (uint8_t)(i * 37 + 1);
+	}
+	printf("op,us,spi_bytes,transactions,page_switches,reg_reads,reg_writes\n");
+
+	m = mark();
+	check(rf_init() == OK, "rf_init");
+	report("init", &m);
+
+	m = mark();
+	rf_set_default_para();
+	report("default_para", &m);
+
+	m = mark();
+	check(rf_set_para(RF_PARA_TYPE_SF, SF_7) == OK && rf_set_para(RF_PARA_TYPE_SF, DEFAULT_SF) == OK, "set sf");
+	report("set_sf_x2", &m);
+
+	m = mark();
+	rf_set_transmit_flag(RADIO_FLAG_IDLE);
+	check(rf_single_tx_data(payload, TEST_LEN, &tx_time) == OK, "rf_single_tx_data");
+	report("tx_start", &m);
+	t0 = vhal_now_ns();
+	check(wait_flag(rf_get_transmit_flag, RADIO_FLAG_TXDONE), "tx done");
+	report("tx_done", &m);
+	check(air_len == TEST_LEN && memcmp(air, payload, TEST_LEN) == 0, "payload on air");
+	check(air_us == rf_get_airtime_us(TEST_LEN), "airtime matches rf_get_airtime_us");
+	check(vhal_now_ns() - t0 <= (uint64_t)tx_time * 1000000ULL, "tx done within rf_get_tx_time");
+
+	m = mark();
+	rf_set_recv_flag(RADIO_FLAG_IDLE);
+	check(rf_enter_continous_rx() == OK, "rf_enter_continous_rx");
+	report("rx_start", &m);
+	vhal_run_until(vhal_now_ns() + 10000000ULL);
+	m = mark();
+	check(vpan_rx_packet(&radio, air, air_len, TEST_RSSI_CDB, TEST_SNR_CDB, 1, vhal_now_ns()) == 1, "packet heard");
+	check(wait_flag(rf_get_recv_flag, RADIO_FLAG_RXDONE), "rx done");
+	report("rx_done", &m);
+	check(RxDoneParams.Size == TEST_LEN && memcmp(RxDoneParams.Payload, payload, TEST_LEN) == 0, "payload received");
+	check(abs(RF_META_TO_CDB(RxDoneParams.Snr) - TEST_SNR_CDB) <= 10, "snr");
+	check(abs(RF_META_TO_CDB(RxDoneParams.Rssi) - TEST_RSSI_CDB) <= 100, "rssi");
+
+	m = mark();
+	rf_set_recv_flag(RADIO_FLAG_IDLE);
+	check(rf_enter_single_timeout_rx(TEST_TIMEOUT_MS) == OK, "rf_enter_single_timeout_rx");
+	t0 = vhal_now_ns();
+	check(wait_flag(rf_get_recv_flag, RADIO_FLAG_RXTIMEOUT), "rx timeout");
+	report("rx_timeout", &m);
+	check((vhal_now_ns() - t0) / 1000000ULL == TEST_TIMEOUT_MS, "timeout length");
+
+	m = mark();
+	check(rf_sleep() == OK && rf_sleep_wakeup() == OK, "sleep and wakeup");
+	report("sleep_wakeup", &m);
+
+	printf("# virtual %llu us, spi %llu bytes, %u rf irqs, %u deferred\n", (unsigned long long)(vhal_now_ns() / 1000),
+		   (unsigned long long)radio.stats.spi_bytes, vhal_get_stats()->rf_irqs, vhal_get_stats()->rf_irqs_deferred);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,516 @@
+//
+// Host decoder for the firmware's UART record stream (App/Inc/rf_uart.h).
+// Reads a serial device or a capture file, splits the COBS frames, checks their CRC-16 and writes
+// the packet records to pcap and/or a columnar file. -r keeps the raw stream, so a session can be
+// replayed through the decoder later.
+//   rf_capture [-b baud] [-p out.pcap] [-c out.col] [-r raw.bin] [-v] <device|file>
+// A reader thread fills a lock-free single producer / single consumer ring and the main thread
+// decodes from it, so slow output never stalls the serial port and decoding never waits in read().
+//
+// pcap: LINKTYPE_USER0 (147), every packet is this pseudo-header, little endian, then the frame
+//   version(1) type(1) hdr_len(2) tick_ms(4) addr(2) seq(1) pad(1) rssi_cdb(2) snr_cdb(2) lost(2)
+// columnar: "RFCOL1\0\0", then blocks of up to COL_BLOCK packets, every field little endian
+//   count(4) payload_bytes(4) tick[count](4) addr[count](2) seq[count](1) type[count](1)
+//   rssi_cdb[count](2) snr_cdb[count](2) lost[count](2) len[count](2) payloads
+// Records with no packet (node tables, TX demo) are counted and shown with -v only.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "rf_gw.h"
+#include "rf_record.h"
+#include "rf_serial.h"
+
+namespace
+{
+
+constexpr uint32_t PCAP_LINKTYPE_USER0 = 147;
+constexpr uint8_t PSEUDO_VERSION = 1;
+constexpr uint16_t PSEUDO_LEN = 18;
+constexpr size_t COL_BLOCK = 4096;
+constexpr size_t RING_SIZE = 1u << 22;
+constexpr size_t MAX_FRAME = RF_UART_COBS_MAX(RF_UART_MAX_RECORD + 3);
+
+// single producer / single consumer byte ring, head only written by the producer, tail by the consumer
+class ByteRing
+{
+public:
+	explicit ByteRing(size_t size) : buf_(size), mask_(size - 1) {}
+
+	size_t write(const uint8_t *data, size_t len)
+	{
+		size_t head = head_.load(std::memory_order_relaxed);
+		size_t tail = tail_.load(std::memory_order_acquire);
+		size_t n = std::min(len, buf_.size() - (head - tail));
+
+		for (size_t i = 0; i < n; i++)
+		{
+			buf_[(head + i) & mask_] = data[i];
+		}
+		head_.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+	size_t read(uint8_t *data, size_t len)
+	{
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		size_t head = head_.load(std::memory_order_acquire);
+		size_t n = std::min(len, head - tail);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			data[i] = buf_[(tail + i) & mask_];
+		}
+		tail_.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+private:
+	std::vector<uint8_t> buf_;
+	size_t mask_;
+	alignas(64) std::atomic<size_t> head_{0};
+	alignas(64) std::atomic<size_t> tail_{0};
+};
+
+struct Packet
+{
+	uint8_t type;
+	uint32_t tick;
+	uint16_t addr;
+	uint8_t seq;
+	int16_t rssi_cdb;
+	int16_t snr_cdb;
+	uint16_t lost;
+	const uint8_t *data;
+	uint16_t len;
+};
+
+struct Stats
+{
+	uint64_t bytes = 0;
+	uint64_t frames = 0;
+	uint64_t crc_err = 0;
+	uint64_t bad_cobs = 0;
+	uint64_t oversize = 0;
+	uint64_t short_rec = 0;
+	uint64_t packets = 0;
+	uint64_t other = 0;
+};
+
+void put16(std::vector<uint8_t> &v, uint16_t x)
+{
+	v.push_back(static_cast<uint8_t>(x));
+	v.push_back(static_cast<uint8_t>(x >> 8));
+}
+
+void put32(std::vector<uint8_t> &v, uint32_t x)
+{
+	put16(v, static_cast<uint16_t>(x));
+	put16(v, static_cast<uint16_t>(x >> 16));
+}
+
+uint16_t get16(const uint8_t *p)
+{
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const uint8_t *p)
+{
+	return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16);
+}
+
+class PcapWriter
+{
+public:
+	bool open(const char *path)
+	{
+		std::vector<uint8_t> hdr;
+
+		f_ = std::fopen(path, "wb");
+		if (f_ == nullptr)
+		{
+			return false;
+		}
+		put32(hdr, 0xa1b2c3d4);
+		put16(hdr, 2);
+		put16(hdr, 4);
+		put32(hdr, 0);
+		put32(hdr, 0);
+		put32(hdr, 65535);
+		put32(hdr, PCAP_LINKTYPE_USER0);
+		return std::fwrite(hdr.data(), 1, hdr.size(), f_) == hdr.size();
+	}
+
+	void write(const Packet &p)
+	{
+		auto now = std::chrono::system_clock::now().time_since_epoch();
+		auto us = std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+		uint32_t caplen = PSEUDO_LEN + p.len;
+
+		rec_.clear();
+		put32(rec_, static_cast<uint32_t>(us / 1000000));
+		put32(rec_, static_cast<uint32_t>(us % 1000000));
+		put32(rec_, caplen);
+		put32(rec_, caplen);
+		rec_.push_back(PSEUDO_VERSION);
+		rec_.push_back(p.type);
+		put16(rec_, PSEUDO_LEN);
+		put32(rec_, p.tick);
+		put16(rec_, p.addr);
+		rec_.push_back(p.seq);
+		rec_.push_back(0);
+		put16(rec_, static_cast<uint16_t>(p.rssi_cdb));
+		put16(rec_, static_cast<uint16_t>(p.snr_cdb));
+		put16(rec_, p.lost);
+		rec_.insert(rec_.end(), p.data, p.data + p.len);
+		std::fwrite(rec_.data(), 1, rec_.size(), f_);
+	}
+
+	~PcapWriter()
+	{
+		if (f_ != nullptr)
+		{
+			std::fclose(f_);
+		}
+	}
+
+private:
+	std::FILE *f_ = nullptr;
+	std::vector<uint8_t> rec_;
+};
+
+class ColumnWriter
+{
+public:
+	bool open(const char *path)
+	{
+		f_ = std::fopen(path, "wb");
+		return f_ != nullptr && std::fwrite("RFCOL1\0\0", 1, 8, f_) == 8;
+	}
+
+	void write(const Packet &p)
+	{
+		tick_.push_back(p.tick);
+		addr_.push_back(p.addr);
+		seq_.push_back(p.seq);
+		type_.push_back(p.type);
+		rssi_.push_back(p.rssi_cdb);
+		snr_.push_back(p.snr_cdb);
+		lost_.push_back(p.lost);
+		len_.push_back(p.len);
+		payload_.insert(payload_.end(), p.data, p.data + p.len);
+		if (tick_.size() == COL_BLOCK)
+		{
+			flush();
+		}
+	}
+
+	void flush()
+	{
+		std::vector<uint8_t> out;
+
+		if (f_ == nullptr || tick_.empty())
+		{
+			return;
+		}
+		put32(out, static_cast<uint32_t>(tick_.size()));
+		put32(out, static_cast<uint32_t>(payload_.size()));
+		for (auto v : tick_)
+		{
+			put32(out, v);
+		}
+		for (auto v : addr_)
+		{
+			put16(out, v);
+		}
+		out.insert(out.end(), seq_.begin(), seq_.end());
+		out.insert(out.end(), type_.begin(), type_.end());
+		for (auto v : rssi_)
+		{
+			put16(out, static_cast<uint16_t>(v));
+		}
+		for (auto v : snr_)
+		{
+			put16(out, static_cast<uint16_t>(v));
+		}
+		for (auto v : lost_)
+		{
+			put16(out, v);
+		}
+		for (auto v : len_)
+		{
+			put16(out, v);
+		}
+		out.insert(out.end(), payload_.begin(), payload_.end());
+		std::fwrite(out.data(), 1, out.size(), f_);
+
+		tick_.clear();
+		addr_.clear();
+		seq_.clear();
+		type_.clear();
+		rssi_.clear();
+		snr_.clear();
+		lost_.clear();
+		len_.clear();
+		payload_.clear();
+	}
+
+	~ColumnWriter()
+	{
+		flush();
+		if (f_ != nullptr)
+		{
+			std::fclose(f_);
+		}
+	}
+
+private:
+	std::FILE *f_ = nullptr;
+	std::vector<uint32_t> tick_;
+	std::vector<uint16_t> addr_;
+	std::vector<uint8_t> seq_;
+	std::vector<uint8_t> type_;
+	std::vector<int16_t> rssi_;
+	std::vector<int16_t> snr_;
+	std::vector<uint16_t> lost_;
+	std::vector<uint16_t> len_;
+	std::vector<uint8_t> payload_;
+};
+
+bool parse_packet(const uint8_t *rec, size_t len, Packet &p)
+{
+	p.type = rec[0];
+	if (p.type == RF_GW_REC_RX)
+	{
+		if (len < RF_GW_REC_RX_HDR_LEN || len < RF_GW_REC_RX_HDR_LEN + static_cast<size_t>(rec[14]))
+		{
+			return false;
+		}
+		p.tick = get32(rec + 1);
+		p.addr = get16(rec + 5);
+		p.seq = rec[7];
+		p.rssi_cdb = static_cast<int16_t>(get16(rec + 8));
+		p.snr_cdb = static_cast<int16_t>(get16(rec + 10));
+		p.lost = get16(rec + 12);
+		p.len = rec[14];
+		p.data = rec + RF_GW_REC_RX_HDR_LEN;
+		return true;
+	}
+	if (p.type == RF_UART_REC_DEMO_RX)
+	{
+		if (len < 13)
+		{
+			return false;
+		}
+		p.tick = get32(rec + 1);
+		p.seq = static_cast<uint8_t>(get32(rec + 5));
+		p.addr = RF_GW_ADDR_NONE;
+		p.rssi_cdb = static_cast<int16_t>(get16(rec + 9));
+		p.snr_cdb = static_cast<int16_t>(get16(rec + 11));
+		p.lost = 0;
+		p.len = static_cast<uint16_t>(len - 13);
+		p.data = rec + 13;
+		return true;
+	}
+	return false;
+}
+
+void usage(void)
+{
+	std::fprintf(stderr, "usage: rf_capture [-b baud] [-p out.pcap] [-c out.col] [-r raw.bin] [-v] <device|file>\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const char *pcap_path = nullptr, *col_path = nullptr, *raw_path = nullptr;
+	long baud = 115200;
+	bool verbose = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:p:c:r:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b': baud = std::strtol(optarg, nullptr, 0); break;
+			case 'p': pcap_path = optarg; break;
+			case 'c': col_path = optarg; break;
+			case 'r': raw_path = optarg; break;
+			case 'v': verbose = true; break;
+			default: usage(); return 2;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		usage();
+		return 2;
+	}
+
+	int fd = rf_serial_open(argv[optind], baud, O_RDONLY);
+	if (fd < 0)
+	{
+		std::perror(argv[optind]);
+		return 1;
+	}
+	PcapWriter pcap;
+	ColumnWriter col;
+	std::FILE *raw = nullptr;
+	if ((pcap_path != nullptr && !pcap.open(pcap_path)) || (col_path != nullptr && !col.open(col_path)) ||
+		(raw_path != nullptr && (raw = std::fopen(raw_path, "wb")) == nullptr))
+	{
+		std::perror("output");
+		return 1;
+	}
+
+	ByteRing ring(RING_SIZE);
+	std::atomic<bool> eof{false};
+	std::thread reader([&]()
+	{
+		std::vector<uint8_t> chunk(1 << 16);
+		ssize_t n;
+
+		while ((n = ::read(fd, chunk.data(), chunk.size())) > 0)
+		{
+			size_t done = 0;
+			while (done < static_cast<size_t>(n))
+			{
+				size_t w = ring.write(chunk.data() + done, n - done);
+				if (w == 0)
+				{
+					std::this_thread::yield();
+				}
+				done += w;
+			}
+		}
+		eof.store(true, std::memory_order_release);
+	});
+
+	Stats st;
+	std::vector<uint8_t> chunk(1 << 16);
+	std::vector<uint8_t> frame;
+	bool overflow = false;
+	auto t0 = std::chrono::steady_clock::now();
+
+	frame.reserve(MAX_FRAME);
+	while (true)
+	{
+		size_t n = ring.read(chunk.data(), chunk.size());
+		if (n == 0)
+		{
+			if (eof.load(std::memory_order_acquire) && (n = ring.read(chunk.data(), chunk.size())) == 0)
+			{
+				break;
+			}
+			if (n == 0)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				continue;
+			}
+		}
+		st.bytes += n;
+		if (raw != nullptr)
+		{
+			std::fwrite(chunk.data(), 1, n, raw);
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			uint8_t b = chunk[i];
+			if (b != 0)
+			{
+				if (frame.size() < MAX_FRAME)
+				{
+					frame.push_back(b);
+				}
+				else
+				{
+					overflow = true;
+				}
+				continue;
+			}
+			if (frame.empty())
+			{
+				continue;
+			}
+			if (overflow)
+			{
+				// text or a run of noise, not a record
+				st.oversize++;
+				frame.clear();
+				overflow = false;
+				continue;
+			}
+
+			st.frames++;
+			size_t len = rf_cobs_decode(frame.data(), frame.size());
+			if (len == 0)
+			{
+				st.bad_cobs++;
+			}
+			else if ((len = rf_record_check(frame.data(), len)) == 0)
+			{
+				st.crc_err++;
+			}
+			else
+			{
+				Packet p;
+				if (parse_packet(frame.data(), len, p))
+				{
+					st.packets++;
+					if (pcap_path != nullptr)
+					{
+						pcap.write(p);
+					}
+					if (col_path != nullptr)
+					{
+						col.write(p);
+					}
+					if (verbose)
+					{
+						std::printf("rx type %02x tick %u addr %04x seq %u rssi %d snr %d lost %u len %u\n",
+									p.type, p.tick, p.addr, p.seq, p.rssi_cdb, p.snr_cdb, p.lost, p.len);
+					}
+				}
+				else if (frame[0] == RF_GW_REC_RX || frame[0] == RF_UART_REC_DEMO_RX)
+				{
+					st.short_rec++;
+				}
+				else
+				{
+					st.other++;
+					if (verbose)
+					{
+						std::printf("rec type %02x len %zu\n", frame[0], len - 1);
+					}
+				}
+			}
+			frame.clear();
+		}
+	}
+	reader.join();
+	::close(fd);
+	if (raw != nullptr)
+	{
+		std::fclose(raw);
+	}
+
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	std::fprintf(stderr, "bytes %llu frames %llu packets %llu other %llu crc_err %llu bad_cobs %llu "
+				 "short %llu oversize %llu, %.1f MB/s\n",
+				 (unsigned long long)st.bytes, (unsigned long long)st.frames, (unsigned long long)st.packets,
+				 (unsigned long long)st.other, (unsigned long long)st.crc_err, (unsigned long long)st.bad_cobs,
+				 (unsigned long long)st.short_rec, (unsigned long long)st.oversize,
+				 s > 0 ? st.bytes / s / 1e6 : 0.0);
+	return 0;
+}
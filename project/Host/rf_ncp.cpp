@@ -0,0 +1,229 @@
+//
+// Command line front end for the NCP firmware mode, built on NcpClient.
+//   rf_ncp [-b baud] <device> ping
+//   rf_ncp [-b baud] <device> get <freq|cr|bw|sf|power|crc>
+//   rf_ncp [-b baud] <device> set <freq|cr|bw|sf|power|crc> <value>
+//   rf_ncp [-b baud] <device> listen [seconds]     continuous RX, one line per RX event
+//   rf_ncp [-b baud] <device> tx <hex> [count]      count pipelined TX, then the packet rate
+//   rf_ncp [-b baud] <device> stats
+//
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "rf_ncp_client.h"
+
+namespace
+{
+
+struct ParaName
+{
+	const char *name;
+	rf_para_type_t para;
+};
+
+const ParaName paras[] = {
+	{"freq", RF_PARA_TYPE_FREQ}, {"cr", RF_PARA_TYPE_CR},		{"bw", RF_PARA_TYPE_BW},
+	{"sf", RF_PARA_TYPE_SF},	 {"power", RF_PARA_TYPE_TXPOWER}, {"crc", RF_PARA_TYPE_CRC},
+};
+
+bool find_para(const char *name, rf_para_type_t &para)
+{
+	for (const auto &p : paras)
+	{
+		if (std::strcmp(p.name, name) == 0)
+		{
+			para = p.para;
+			return true;
+		}
+	}
+	std::fprintf(stderr, "unknown parameter %s\n", name);
+	return false;
+}
+
+int16_t get16(const uint8_t *p)
+{
+	return static_cast<int16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+int report(const NcpClient::Reply &r)
+{
+	if (r.status != RF_NCP_OK)
+	{
+		std::fprintf(stderr, "seq %u cmd %02x failed, status %02x\n", r.seq, r.cmd, r.status);
+		return 1;
+	}
+	return 0;
+}
+
+void usage(void)
+{
+	std::fprintf(stderr, "usage: rf_ncp [-b baud] <device> ping | get <para> | set <para> <value> | "
+						 "listen [seconds] | tx <hex> [count] | stats\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	long baud = 115200;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:")) != -1)
+	{
+		if (opt != 'b')
+		{
+			usage();
+			return 2;
+		}
+		baud = std::strtol(optarg, nullptr, 0);
+	}
+	if (argc - optind < 2)
+	{
+		usage();
+		return 2;
+	}
+	const char *dev = argv[optind];
+	std::string cmd = argv[optind + 1];
+	char **args = argv + optind + 2;
+	int nargs = argc - optind - 2;
+
+	NcpClient ncp;
+	std::atomic<uint32_t> tx_done{0}, tx_fail{0};
+	ncp.on_event([&](const NcpClient::Event &e) {
+		if (e.event == RF_NCP_EVT_RX_DONE && e.data.size() >= 8)
+		{
+			std::printf("rx tick %u rssi %d snr %d len %zu:", get32(e.data.data()), get16(&e.data[4]),
+						get16(&e.data[6]), e.data.size() - 8);
+			for (size_t i = 8; i < e.data.size(); i++)
+			{
+				std::printf(" %02x", e.data[i]);
+			}
+			std::printf("\n");
+		}
+		else if (e.event == RF_NCP_EVT_TX_DONE && e.data.size() >= 2)
+		{
+			(e.data[1] == RF_NCP_OK) ? tx_done++ : tx_fail++;
+		}
+		else if (e.event == RF_NCP_EVT_BOOT)
+		{
+			std::fprintf(stderr, "ncp boot\n");
+		}
+	});
+	if (!ncp.open(dev, baud))
+	{
+		std::perror(dev);
+		return 1;
+	}
+
+	NcpClient::Reply r = ncp.ping();
+	if (report(r) != 0 || r.data.size() < 4)
+	{
+		return 1;
+	}
+	if (cmd == "ping")
+	{
+		std::printf("ncp version %u rx_buf %u max_payload %u\n", r.data[0], r.data[1] | (r.data[2] << 8),
+					r.data[3]);
+		return 0;
+	}
+
+	rf_para_type_t para;
+	if (cmd == "get" && nargs == 1 && find_para(args[0], para))
+	{
+		uint32_t value = 0;
+		if (report(ncp.get_para(para, value)) != 0)
+		{
+			return 1;
+		}
+		std::printf("%s %u\n", args[0], value);
+		return 0;
+	}
+	if (cmd == "set" && nargs == 2 && find_para(args[0], para))
+	{
+		return report(ncp.set_para(para, std::strtoul(args[1], nullptr, 0)));
+	}
+	if (cmd == "listen")
+	{
+		if (report(ncp.rx(0)) != 0)
+		{
+			return 1;
+		}
+		std::this_thread::sleep_for(std::chrono::seconds(nargs > 0 ? std::atoi(args[0]) : 10));
+		return 0;
+	}
+	if (cmd == "tx" && nargs >= 1)
+	{
+		std::vector<uint8_t> payload;
+		unsigned count = (nargs > 1) ? std::strtoul(args[1], nullptr, 0) : 1;
+		std::vector<std::future<NcpClient::Reply>> replies;
+		uint64_t airtime = 0;
+		int failed = 0;
+
+		for (const char *h = args[0]; h[0] != 0 && h[1] != 0; h += 2)
+		{
+			payload.push_back(static_cast<uint8_t>(std::strtoul(std::string(h, 2).c_str(), nullptr, 16)));
+		}
+		if (payload.empty() || payload.size() > RF_NCP_MAX_PAYLOAD)
+		{
+			std::fprintf(stderr, "payload must be 1..%d bytes\n", RF_NCP_MAX_PAYLOAD);
+			return 2;
+		}
+		auto t0 = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < count; i++)
+		{
+			replies.push_back(ncp.tx(payload.data(), payload.size()));
+		}
+		for (auto &f : replies)
+		{
+			NcpClient::Reply tr = f.get();
+			if (tr.status == RF_NCP_OK && tr.data.size() == 4)
+			{
+				airtime += get32(tr.data.data());
+			}
+			else
+			{
+				failed += report(tr);
+			}
+		}
+		// the last TX done comes after the last reply
+		while (tx_done + tx_fail + failed < count &&
+			   std::chrono::steady_clock::now() - t0 < std::chrono::seconds(10) + std::chrono::milliseconds(airtime))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		std::printf("tx %u done %u failed %u, airtime %llu ms, %.1f packets/s\n", count, tx_done.load(),
+					tx_fail.load() + failed, (unsigned long long)airtime, tx_done / s);
+		return (tx_done == count) ? 0 : 1;
+	}
+	if (cmd == "stats")
+	{
+		r = ncp.call(RF_NCP_CMD_GET_STATS);
+		if (report(r) != 0 || r.data.size() < sizeof(rf_ncp_stats_t) + 8)
+		{
+			return 1;
+		}
+		const char *names[] = {"cmds", "bad_cmds", "tx", "rx", "rx_err", "tx_timeout", "evt_dropped", "uart_rx_bad",
+							   "uart_dropped"};
+		for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		{
+			std::printf("%s %u\n", names[i], get32(&r.data[4 * i]));
+		}
+		return 0;
+	}
+	usage();
+	return 2;
+}
@@ -0,0 +1,310 @@
+//
+// Host client for the NCP firmware mode, see rf_ncp_client.h
+//
+#include "rf_ncp_client.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "rf_record.h"
+#include "rf_serial.h"
+
+namespace
+{
+
+void put32(std::vector<uint8_t> &v, uint32_t x)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		v.push_back(static_cast<uint8_t>(x >> (8 * i)));
+	}
+}
+
+} // namespace
+
+NcpClient::~NcpClient()
+{
+	close();
+}
+
+bool NcpClient::open(const std::string &path, long baud)
+{
+	int fd = rf_serial_open(path.c_str(), baud, O_RDWR);
+
+	return fd >= 0 && attach(fd);
+}
+
+// takes over an open descriptor, a serial port or one end of a pty or socket pair
+bool NcpClient::attach(int fd)
+{
+	if (fd_ >= 0)
+	{
+		return false;
+	}
+	fd_ = fd;
+	stop_ = false;
+	reader_ = std::thread(&NcpClient::reader, this);
+	return true;
+}
+
+void NcpClient::close()
+{
+	if (fd_ < 0)
+	{
+		return;
+	}
+	stop_ = true;
+	reader_.join();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		::close(fd_);
+		fd_ = -1;
+	}
+	fail_pending();
+}
+
+void NcpClient::on_event(EventHandler handler)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	handler_ = std::move(handler);
+}
+
+// sends one command, blocks only while the NCP could not buffer it
+std::future<NcpClient::Reply> NcpClient::request(uint8_t cmd, const uint8_t *args, size_t len)
+{
+	std::lock_guard<std::mutex> order(write_mutex_);
+	std::vector<uint8_t> body, frame;
+	std::unique_lock<std::mutex> lock(mutex_);
+	Pending p;
+	int fd;
+
+	body.push_back(next_seq_);
+	body.push_back(cmd);
+	if (len != 0)
+	{
+		body.insert(body.end(), args, args + len);
+	}
+	rf_record_encode(frame, RF_NCP_REC_CMD, body.data(), body.size());
+
+	// counted in encoded bytes, as they sit in the NCP's RX DMA ring until the command runs
+	p.seq = next_seq_++;
+	p.bytes = frame.size();
+	space_.wait(lock, [&] { return fd_ < 0 || inflight_ == 0 || inflight_ + p.bytes <= window_; });
+	auto future = p.promise.get_future();
+	if (fd_ < 0)
+	{
+		p.promise.set_value(Reply());
+		return future;
+	}
+	inflight_ += p.bytes;
+	pending_.push_back(std::move(p));
+	stats_.requests++;
+	fd = fd_;
+	// the reader keeps dispatching while this blocks, write_mutex_ keeps the pending order
+	lock.unlock();
+
+	for (size_t done = 0; done < frame.size();)
+	{
+		ssize_t n = ::write(fd, frame.data() + done, frame.size() - done);
+		if (n < 0 && errno != EINTR)
+		{
+			break;
+		}
+		done += (n > 0) ? n : 0;
+	}
+	return future;
+}
+
+NcpClient::Reply NcpClient::call(uint8_t cmd, const uint8_t *args, size_t len, std::chrono::milliseconds timeout)
+{
+	auto future = request(cmd, args, len);
+
+	if (future.wait_for(timeout) != std::future_status::ready)
+	{
+		return Reply();
+	}
+	return future.get();
+}
+
+// gives up on every outstanding request, for a host that timed out or saw the NCP reboot
+void NcpClient::reset()
+{
+	fail_pending();
+}
+
+NcpClient::Reply NcpClient::ping()
+{
+	Reply r = call(RF_NCP_CMD_PING);
+
+	if (r.status == RF_NCP_OK && r.data.size() >= 3)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		// a full ring reads as empty, one byte stays free
+		window_ = (r.data[1] | (r.data[2] << 8)) - 1;
+	}
+	return r;
+}
+
+NcpClient::Reply NcpClient::set_para(rf_para_type_t para, uint32_t value)
+{
+	std::vector<uint8_t> args{static_cast<uint8_t>(para)};
+
+	put32(args, value);
+	return call(RF_NCP_CMD_SET_PARA, args.data(), args.size());
+}
+
+NcpClient::Reply NcpClient::get_para(rf_para_type_t para, uint32_t &value)
+{
+	uint8_t arg = static_cast<uint8_t>(para);
+	Reply r = call(RF_NCP_CMD_GET_PARA, &arg, 1);
+
+	if (r.status == RF_NCP_OK && r.data.size() == 4)
+	{
+		value = r.data[0] | (r.data[1] << 8) | (r.data[2] << 16) | (static_cast<uint32_t>(r.data[3]) << 24);
+	}
+	return r;
+}
+
+NcpClient::Reply NcpClient::rx(uint32_t timeout)
+{
+	std::vector<uint8_t> args;
+
+	put32(args, timeout);
+	return call(RF_NCP_CMD_RX, args.data(), args.size());
+}
+
+// the reply carries the airtime, RF_NCP_EVT_TX_DONE with the reply's seq follows
+std::future<NcpClient::Reply> NcpClient::tx(const uint8_t *data, size_t len)
+{
+	return request(RF_NCP_CMD_TX, data, len);
+}
+
+NcpClient::Stats NcpClient::stats() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+void NcpClient::fail_pending()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto &p : pending_)
+	{
+		Reply r;
+		r.seq = p.seq;
+		p.promise.set_value(r);
+		stats_.lost++;
+	}
+	pending_.clear();
+	inflight_ = 0;
+	space_.notify_all();
+}
+
+void NcpClient::dispatch(const uint8_t *rec, size_t len)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	if (rec[0] == RF_NCP_REC_RSP && len >= 4)
+	{
+		Reply r;
+		r.seq = rec[1];
+		r.cmd = rec[2];
+		r.status = rec[3];
+		r.data.assign(rec + 4, rec + len);
+		stats_.replies++;
+		// replies come in command order, anything older than this one was lost
+		while (!pending_.empty())
+		{
+			Pending p = std::move(pending_.front());
+			pending_.pop_front();
+			inflight_ -= p.bytes;
+			if (p.seq == r.seq)
+			{
+				p.promise.set_value(std::move(r));
+				break;
+			}
+			Reply lost;
+			lost.seq = p.seq;
+			p.promise.set_value(lost);
+			stats_.lost++;
+		}
+		space_.notify_all();
+		return;
+	}
+	if (rec[0] == RF_NCP_REC_EVT && len >= 2)
+	{
+		Event e;
+		e.event = rec[1];
+		e.data.assign(rec + 2, rec + len);
+		stats_.events++;
+		EventHandler handler = handler_;
+		lock.unlock();
+		if (e.event == RF_NCP_EVT_BOOT)
+		{
+			// a reboot drops whatever the NCP had queued
+			fail_pending();
+		}
+		if (handler)
+		{
+			handler(e);
+		}
+		return;
+	}
+	stats_.bad_frames++;
+}
+
+void NcpClient::reader()
+{
+	std::vector<uint8_t> buf(4096), frame;
+	struct pollfd pfd = {fd_, POLLIN, 0};
+
+	while (!stop_)
+	{
+		if (poll(&pfd, 1, 100) <= 0)
+		{
+			continue;
+		}
+		ssize_t n = ::read(fd_, buf.data(), buf.size());
+		if (n <= 0)
+		{
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		for (ssize_t i = 0; i < n; i++)
+		{
+			if (buf[i] != 0)
+			{
+				if (frame.size() < RF_UART_COBS_MAX(RF_UART_MAX_RECORD + 3))
+				{
+					frame.push_back(buf[i]);
+				}
+				continue;
+			}
+			if (frame.empty())
+			{
+				continue;
+			}
+			size_t len = rf_cobs_decode(frame.data(), frame.size());
+			if (len != 0 && (len = rf_record_check(frame.data(), len)) != 0)
+			{
+				dispatch(frame.data(), len);
+			}
+			else
+			{
+				// printf text from the firmware ends up here too
+				std::lock_guard<std::mutex> lock(mutex_);
+				stats_.bad_frames++;
+			}
+			frame.clear();
+		}
+	}
+	// a closed port fails everything that is still waiting
+	fail_pending();
+}
@@ -0,0 +1,108 @@
+//
+// Host client for the NCP firmware mode (App/Inc/rf_ncp.h), the board used as a radio modem.
+// Requests are pipelined: request() returns at once with a future for the reply, and only blocks
+// while the NCP's RX ring would overflow. Events (RX done, TX done, ...) go to the event handler,
+// which runs on the reader thread.
+//
+#ifndef HOST_RF_NCP_CLIENT_H
+#define HOST_RF_NCP_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include "radio.h"
+#include "rf_ncp.h"
+}
+
+class NcpClient
+{
+public:
+	// status of a request whose reply never came, the NCP rebooted or dropped it
+	static constexpr uint8_t STATUS_LOST = 0xFF;
+
+	struct Reply
+	{
+		uint8_t seq = 0;
+		uint8_t cmd = 0;
+		uint8_t status = STATUS_LOST;
+		std::vector<uint8_t> data;
+	};
+
+	struct Event
+	{
+		uint8_t event = 0;
+		std::vector<uint8_t> data;
+	};
+
+	struct Stats
+	{
+		uint64_t requests = 0;
+		uint64_t replies = 0;
+		uint64_t events = 0;
+		uint64_t lost = 0;
+		uint64_t bad_frames = 0;
+	};
+
+	using EventHandler = std::function<void(const Event &)>;
+
+	NcpClient() = default;
+	~NcpClient();
+	NcpClient(const NcpClient &) = delete;
+	NcpClient &operator=(const NcpClient &) = delete;
+
+	bool open(const std::string &path, long baud);
+	bool attach(int fd);
+	void close();
+	void on_event(EventHandler handler);
+
+	std::future<Reply> request(uint8_t cmd, const uint8_t *args = nullptr, size_t len = 0);
+	Reply call(uint8_t cmd, const uint8_t *args = nullptr, size_t len = 0,
+			   std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+	void reset();
+
+	Reply ping();
+	Reply set_para(rf_para_type_t para, uint32_t value);
+	Reply get_para(rf_para_type_t para, uint32_t &value);
+	Reply rx(uint32_t timeout);
+	std::future<Reply> tx(const uint8_t *data, size_t len);
+
+	Stats stats() const;
+
+private:
+	struct Pending
+	{
+		uint8_t seq;
+		size_t bytes;
+		std::promise<Reply> promise;
+	};
+
+	void reader();
+	void dispatch(const uint8_t *rec, size_t len);
+	void fail_pending();
+
+	int fd_ = -1;
+	std::thread reader_;
+	std::atomic<bool> stop_{false};
+	EventHandler handler_;
+	std::mutex write_mutex_;
+	mutable std::mutex mutex_;
+	std::condition_variable space_;
+	std::deque<Pending> pending_;
+	size_t inflight_ = 0;
+	size_t window_ = RF_UART_RX_BUF - 1;
+	uint8_t next_seq_ = 0;
+	Stats stats_;
+};
+
+#endif // HOST_RF_NCP_CLIENT_H
@@ -0,0 +1,195 @@
+//
+// Parameter sweeps of the network simulator on all cores (sim/sweep.h).
+//   rf_netsweep [-j threads] [-r replicas] [-s seed] [-d seconds] [-l librf_node.so]
+//               -v name=v1,v2,... [-v ...] <template>
+// prints one CSV row per run: the variables, the seed, then the rf_netsim columns. The rows come
+// in the same order and with the same values whatever -j is.
+//   rf_netsweep -B [-j max threads] ... <template>
+// runs the whole sweep with 1, 2, 4, ... up to max threads and prints the scaling instead:
+// threads,wall_s,runs_per_s,speedup,efficiency,identical
+// where identical says whether every row matched the single thread run.
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "sweep.h"
+
+#ifndef RF_NODE_LIB
+#define RF_NODE_LIB "librf_node.so"
+#endif
+
+namespace
+{
+
+void usage()
+{
+	std::fprintf(stderr, "usage: rf_netsweep [-B] [-j threads] [-r replicas] [-s seed] [-d seconds] [-l librf_node.so]\n"
+						 "                   -v name=v1,v2,... [-v ...] <template>\n");
+}
+
+bool parse_var(const char *arg, netsim::SweepVar &var)
+{
+	std::string s(arg), value;
+	size_t eq = s.find('=');
+
+	if (eq == 0 || eq == std::string::npos)
+	{
+		return false;
+	}
+	var.name = s.substr(0, eq);
+	std::istringstream in(s.substr(eq + 1));
+	while (std::getline(in, value, ','))
+	{
+		if (!value.empty())
+		{
+			var.values.push_back(value);
+		}
+	}
+	return !var.values.empty();
+}
+
+// the run without its wall time, which is the only column allowed to differ between thread counts
+std::string row_key(const netsim::SweepRow &row)
+{
+	std::string csv = row.error.empty() ? row.res.csv() : row.error;
+
+	return std::to_string(row.seed) + "," + csv.substr(0, csv.rfind(','));
+}
+
+double run_timed(const netsim::Sweep &sweep, unsigned threads, std::vector<netsim::SweepRow> &rows)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	rows = sweep.run(threads);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	std::vector<netsim::SweepVar> vars;
+	std::string lib = RF_NODE_LIB;
+	unsigned threads = std::thread::hardware_concurrency(), replicas = 1;
+	const char *seed = nullptr, *duration = nullptr;
+	bool bench = false;
+	int c;
+
+	while ((c = getopt(argc, argv, "j:r:s:d:l:v:B")) != -1)
+	{
+		netsim::SweepVar var;
+
+		switch (c)
+		{
+		case 'j':
+			threads = static_cast<unsigned>(std::strtoul(optarg, nullptr, 0));
+			break;
+		case 'r':
+			replicas = static_cast<unsigned>(std::strtoul(optarg, nullptr, 0));
+			break;
+		case 's':
+			seed = optarg;
+			break;
+		case 'd':
+			duration = optarg;
+			break;
+		case 'l':
+			lib = optarg;
+			break;
+		case 'v':
+			if (!parse_var(optarg, var))
+			{
+				std::fprintf(stderr, "bad variable %s\n", optarg);
+				return 2;
+			}
+			vars.push_back(var);
+			break;
+		case 'B':
+			bench = true;
+			break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind != argc - 1 || threads == 0 || replicas == 0)
+	{
+		usage();
+		return 2;
+	}
+	std::ifstream in(argv[optind]);
+	std::stringstream tmpl;
+	if (!(tmpl << in.rdbuf()))
+	{
+		std::fprintf(stderr, "cannot read %s\n", argv[optind]);
+		return 1;
+	}
+
+	netsim::Sweep sweep(tmpl.str(), vars, replicas, lib);
+	if (seed != nullptr)
+	{
+		sweep.set_seed(static_cast<uint32_t>(std::strtoul(seed, nullptr, 0)));
+	}
+	if (duration != nullptr)
+	{
+		sweep.set_duration(std::strtod(duration, nullptr));
+	}
+
+	std::vector<netsim::SweepRow> rows;
+	int failed = 0;
+
+	if (bench)
+	{
+		std::vector<netsim::SweepRow> base;
+		double base_s = run_timed(sweep, 1, base);
+
+		std::printf("threads,wall_s,runs_per_s,speedup,efficiency,identical\n");
+		std::printf("1,%.2f,%.2f,1.00,1.00,1\n", base_s, base.size() / base_s);
+		for (unsigned t = 2; t / 2 < threads; t *= 2)
+		{
+			unsigned n = (t < threads) ? t : threads;
+			double s = run_timed(sweep, n, rows);
+			bool same = true;
+
+			for (size_t i = 0; i < rows.size(); i++)
+			{
+				same = same && row_key(rows[i]) == row_key(base[i]);
+			}
+			std::printf("%u,%.2f,%.2f,%.2f,%.2f,%d\n", n, s, rows.size() / s, base_s / s, base_s / s / n, same);
+			std::fflush(stdout);
+			failed |= !same;
+		}
+		return failed;
+	}
+
+	run_timed(sweep, threads, rows);
+	for (const auto &v : vars)
+	{
+		std::printf("%s,", v.name.c_str());
+	}
+	std::printf("seed,%s\n", netsim::Results::csv_header());
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		for (const auto &v : sweep.jobs()[i].values)
+		{
+			std::printf("%s,", v.c_str());
+		}
+		if (!rows[i].error.empty())
+		{
+			std::fprintf(stderr, "run %zu: %s\n", i, rows[i].error.c_str());
+			failed = 1;
+			std::printf("%u\n", rows[i].seed);
+			continue;
+		}
+		std::printf("%u,%s\n", rows[i].seed, rows[i].res.csv().c_str());
+	}
+	return failed;
+}
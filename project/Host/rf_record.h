@@ -0,0 +1,88 @@
+//
+// Host side of the rf_uart record framing (App/Inc/rf_uart.h): COBS(type data crc16) 0x00
+//
+#ifndef HOST_RF_RECORD_H
+#define HOST_RF_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C"
+{
+#include "crc.h"
+}
+
+// COBS decode in place, returns the decoded length or 0 when the frame is malformed
+inline size_t rf_cobs_decode(uint8_t *buf, size_t len)
+{
+	size_t in = 0, out = 0;
+
+	while (in < len)
+	{
+		uint8_t code = buf[in++];
+
+		if (code == 0 || in + code - 1 > len)
+		{
+			return 0;
+		}
+		for (uint8_t i = 1; i < code; i++)
+		{
+			buf[out++] = buf[in++];
+		}
+		if (code != 0xFF && in < len)
+		{
+			buf[out++] = 0;
+		}
+	}
+	return out;
+}
+
+// checks and strips the CRC of a decoded record, returns the length of type and data or 0
+inline size_t rf_record_check(const uint8_t *rec, size_t len)
+{
+	if (len < 3 ||
+		RadioComputeCRC(const_cast<uint8_t *>(rec), len - 2, CRC_TYPE_CCITT) != (rec[len - 2] | (rec[len - 1] << 8)))
+	{
+		return 0;
+	}
+	return len - 2;
+}
+
+// appends one framed record, a leading 0x00 included so the receiver resyncs on it
+inline void rf_record_encode(std::vector<uint8_t> &out, uint8_t type, const uint8_t *data, size_t len)
+{
+	RadioCrc_t crc;
+	size_t code_pos;
+	uint8_t code = 1;
+
+	RadioCrcInit(&crc, CRC_TYPE_CCITT);
+	RadioCrcUpdateByte(&crc, type);
+	RadioCrcUpdate(&crc, data, len);
+	uint16_t sum = RadioCrcFinal(&crc);
+
+	out.push_back(0);
+	code_pos = out.size();
+	out.push_back(0);
+	for (size_t i = 0; i < len + 3; i++)
+	{
+		uint8_t b = (i == 0) ? type : (i <= len) ? data[i - 1] : (i == len + 1) ? (uint8_t)sum : (uint8_t)(sum >> 8);
+
+		if (b != 0)
+		{
+			out.push_back(b);
+			code++;
+		}
+		if (b == 0 || code == 0xFF)
+		{
+			out[code_pos] = code;
+			code_pos = out.size();
+			out.push_back(0);
+			code = 1;
+		}
+	}
+	out[code_pos] = code;
+	out.push_back(0);
+}
+
+#endif // HOST_RF_RECORD_H
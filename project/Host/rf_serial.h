@@ -0,0 +1,57 @@
+//
+// Raw termios setup for the board's USART1 on Linux, capture files and pipes pass through as is
+//
+#ifndef HOST_RF_SERIAL_H
+#define HOST_RF_SERIAL_H
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+inline speed_t rf_baud_to_speed(long baud)
+{
+	switch (baud)
+	{
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+		case 1000000: return B1000000;
+		case 1500000: return B1500000;
+		case 2000000: return B2000000;
+		case 2500000: return B2500000;
+		case 3000000: return B3000000;
+		case 4000000: return B4000000;
+		default: return B0;
+	}
+}
+
+// flags as for open(2), returns the descriptor or -1
+inline int rf_serial_open(const char *path, long baud, int flags)
+{
+	struct termios tio;
+	int fd = ::open(path, flags | O_NOCTTY);
+
+	if (fd < 0 || !isatty(fd))
+	{
+		return fd;
+	}
+	if (tcgetattr(fd, &tio) != 0 || rf_baud_to_speed(baud) == B0)
+	{
+		std::fprintf(stderr, "cannot set %ld baud on %s\n", baud, path);
+		::close(fd);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, rf_baud_to_speed(baud));
+	cfsetospeed(&tio, rf_baud_to_speed(baud));
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+#endif // HOST_RF_SERIAL_H
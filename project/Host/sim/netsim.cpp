@@ -0,0 +1,1054 @@
+//
+// Network simulator, see netsim.h
+//
+#include "netsim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include "pan3031.h"
+#include "radio.h"
+}
+
+namespace netsim
+{
+
+namespace
+{
+
+enum : uint8_t
+{
+	EVENT_END,
+	EVENT_START,
+	EVENT_ACTION,
+};
+
+enum : uint8_t
+{
+	LOSS_NONE,
+	LOSS_NOT_LISTENING,
+	LOSS_WEAK,
+	LOSS_BUSY,
+	LOSS_COLLISION,
+};
+
+const uint64_t NO_PACKET = UINT64_MAX;
+
+uint64_t to_ns(double s)
+{
+	return static_cast<uint64_t>(std::llround(s * 1e9));
+}
+
+double to_mw(double dbm)
+{
+	return std::pow(10.0, dbm / 10.0);
+}
+
+// splitmix64, one independent seed per node from the run's seed
+uint32_t derive_seed(uint32_t seed, uint32_t index)
+{
+	uint64_t z = (static_cast<uint64_t>(seed) << 32 | index) + 0x9E3779B97F4A7C15ULL;
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return static_cast<uint32_t>(z) | 1;
+}
+
+std::vector<std::string> tokens(const std::string &line)
+{
+	std::istringstream in(line.substr(0, line.find('#')));
+	std::vector<std::string> t;
+	std::string s;
+
+	while (in >> s)
+	{
+		t.push_back(s);
+	}
+	return t;
+}
+
+bool number(const std::string &s, double &v)
+{
+	char *end = nullptr;
+
+	v = std::strtod(s.c_str(), &end);
+	if (end == s.c_str() || *end != '\0')
+	{
+		// power codes are usually written in hex
+		v = static_cast<double>(std::strtoul(s.c_str(), &end, 0));
+		return end != s.c_str() && *end == '\0';
+	}
+	return true;
+}
+
+// node keys, shared by "defaults" and "node" lines
+bool node_key(NodeSpec &spec, const std::vector<std::string> &t, size_t &i, std::string &error)
+{
+	rf_node_cfg_t &c = spec.cfg;
+	const std::string &key = t[i];
+	double v[3] = {0, 0, 0};
+	size_t args = 1, have = 0;
+
+	if (key == "role" || key == "mac")
+	{
+		if (i + 1 >= t.size())
+		{
+			error = key + " needs a value";
+			return false;
+		}
+		const std::string &s = t[++i];
+		if (key == "role" && (s == "sink" || s == "sensor"))
+		{
+			c.role = (s == "sink") ? RF_NODE_SINK : RF_NODE_SENSOR;
+		}
+		else if (key == "mac" && (s == "aloha" || s == "lbt"))
+		{
+			c.mac = (s == "lbt") ? RF_NODE_MAC_LBT : RF_NODE_MAC_ALOHA;
+		}
+		else
+		{
+			error = "bad " + key + " " + s;
+			return false;
+		}
+		return true;
+	}
+	if (key == "pos" || key == "disc" || key == "grid")
+	{
+		args = 3;
+	}
+	while (have < args && i + 1 + have < t.size() && number(t[i + 1 + have], v[have]))
+	{
+		have++;
+	}
+	if (have == 0 || (key == "pos" && have < 2))
+	{
+		error = key + " needs a number";
+		return false;
+	}
+	i += have;
+
+	if (key == "pos" || key == "disc")
+	{
+		// disc r [cx cy]
+		spec.place = key[0];
+		spec.r = (key == "disc") ? v[0] : 0;
+		spec.x = (key == "disc") ? v[1] : v[0];
+		spec.y = (key == "disc") ? v[2] : v[1];
+	}
+	else if (key == "grid")
+	{
+		// grid spacing [cols], the columns default to a square
+		spec.place = 'g';
+		spec.r = v[0];
+		spec.cols = static_cast<uint32_t>(v[1]);
+	}
+	else if (key == "addr")
+	{
+		c.addr = static_cast<uint8_t>(v[0]);
+	}
+	else if (key == "dst")
+	{
+		c.dst = static_cast<uint8_t>(v[0]);
+	}
+	else if (key == "arq" || key == "adr" || key == "listen")
+	{
+		(key == "arq" ? c.arq : key == "adr" ? c.adr : c.listen) = v[0] != 0;
+	}
+	else if (key == "traffic")
+	{
+		c.traffic = v[0] != 0;
+	}
+	else if (key == "sf")
+	{
+		if (v[0] < SF_7 || v[0] > SF_9)
+		{
+			error = "sf must be 7..9";
+			return false;
+		}
+		c.sf = static_cast<uint8_t>(v[0]);
+	}
+	else if (key == "bw")
+	{
+		if (v[0] != 125 && v[0] != 250 && v[0] != 500)
+		{
+			error = "bw must be 125, 250 or 500";
+			return false;
+		}
+		c.bw = (v[0] == 125) ? BW_125K : (v[0] == 250) ? BW_250K : BW_500K;
+	}
+	else if (key == "cr")
+	{
+		// 4/5..4/8 written as 5..8
+		if (v[0] < 5 || v[0] > 8)
+		{
+			error = "cr must be 5..8";
+			return false;
+		}
+		c.cr = static_cast<uint8_t>(v[0] - 5 + CODE_RATE_45);
+	}
+	else if (key == "power")
+	{
+		c.power = static_cast<uint8_t>(v[0]);
+	}
+	else if (key == "len")
+	{
+		c.len = static_cast<uint8_t>(std::min(v[0], static_cast<double>(RF_FRAME_MAX_PAYLOAD)));
+	}
+	else if (key == "freq")
+	{
+		c.freq = static_cast<uint32_t>(v[0]);
+	}
+	else if (key == "period" || key == "jitter" || key == "start")
+	{
+		uint32_t ms = static_cast<uint32_t>(std::llround(v[0] * 1000));
+		(key == "period" ? c.period_ms : key == "jitter" ? c.jitter_ms : c.start_ms) = ms;
+	}
+	else if (key == "backoff")
+	{
+		c.lbt_backoff_ms = static_cast<uint32_t>(v[0]);
+	}
+	else if (key == "tries")
+	{
+		c.lbt_tries = static_cast<uint8_t>(v[0]);
+	}
+	else if (key == "duty")
+	{
+		c.duty_permille = static_cast<uint16_t>(v[0]);
+	}
+	else if (key == "poll")
+	{
+		c.poll_ms = static_cast<uint32_t>(v[0]);
+	}
+	else
+	{
+		error = "unknown node key " + key;
+		return false;
+	}
+	return true;
+}
+
+bool parse_selector(const std::string &s, Action &a)
+{
+	unsigned lo = 0, hi = 0;
+	char dash = 0;
+
+	if (s == "all")
+	{
+		a.addr_lo = 0;
+		a.addr_hi = 0xFF;
+		return true;
+	}
+	std::istringstream in(s);
+	if (!(in >> lo))
+	{
+		return false;
+	}
+	hi = lo;
+	if (in >> dash && (dash != '-' || !(in >> hi)))
+	{
+		return false;
+	}
+	a.addr_lo = static_cast<uint8_t>(lo);
+	a.addr_hi = static_cast<uint8_t>(hi);
+	return lo <= hi && hi <= 0xFF;
+}
+
+uint8_t mode_index(const std::string &s)
+{
+	static const char *const names[] = {"deep_sleep", "sleep", "stb1", "stb2", "stb3", "tx", "rx"};
+
+	for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		if (s == names[i])
+		{
+			return i;
+		}
+	}
+	return 0xFF;
+}
+
+} // namespace
+
+bool Scenario::load(const std::string &path, std::string &error)
+{
+	std::ifstream in(path);
+
+	if (!in)
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+	return parse(in, error);
+}
+
+bool Scenario::parse(std::istream &in, std::string &error)
+{
+	NodeSpec defaults;
+	std::string line;
+	unsigned line_no = 0;
+	unsigned next_addr = 1;
+
+	defaults.cfg.role = RF_NODE_SENSOR;
+	defaults.cfg.dst = 1;
+	defaults.cfg.sf = DEFAULT_SF;
+	defaults.cfg.bw = DEFAULT_BW;
+	defaults.cfg.cr = DEFAULT_CR;
+	defaults.cfg.power = 0x7F;
+	defaults.cfg.len = 16;
+	defaults.cfg.freq = DEFAULT_FREQ;
+	defaults.cfg.period_ms = 60000;
+	defaults.cfg.jitter_ms = 5000;
+	defaults.cfg.lbt_backoff_ms = 200;
+	defaults.cfg.lbt_tries = 5;
+	defaults.cfg.poll_ms = 10;
+	defaults.cfg.traffic = 1;
+
+	while (std::getline(in, line))
+	{
+		std::vector<std::string> t = tokens(line);
+		double v = 0;
+
+		line_no++;
+		if (t.empty())
+		{
+			continue;
+		}
+		auto fail = [&](const std::string &what) {
+			error = "line " + std::to_string(line_no) + ": " + what;
+			return false;
+		};
+		const std::string &cmd = t[0];
+		if (cmd == "defaults" || cmd == "node")
+		{
+			NodeSpec spec = defaults;
+			double count = 1;
+			size_t i = 1;
+
+			if (cmd == "node" && (t.size() < 2 || !number(t[1], count) || count < 1))
+			{
+				return fail("node <count> key value ...");
+			}
+			spec.cfg.addr = static_cast<uint8_t>(next_addr);
+			for (i = (cmd == "node") ? 2 : 1; i < t.size(); i++)
+			{
+				std::string what;
+				if (!node_key(spec, t, i, what))
+				{
+					return fail(what);
+				}
+			}
+			if (cmd == "defaults")
+			{
+				defaults = spec;
+				continue;
+			}
+			if (spec.place == 'g' && spec.cols == 0)
+			{
+				spec.cols = static_cast<uint32_t>(std::ceil(std::sqrt(count)));
+			}
+			for (uint32_t k = 0; k < static_cast<uint32_t>(count); k++)
+			{
+				NodeSpec n = spec;
+				unsigned addr = spec.cfg.addr + k;
+
+				if (addr == 0 || addr >= RF_FRAME_ADDR_BROADCAST)
+				{
+					return fail("node addresses must stay within 1..254");
+				}
+				n.cfg.addr = static_cast<uint8_t>(addr);
+				n.index = k;
+				nodes.push_back(n);
+				next_addr = addr + 1;
+			}
+		}
+		else if (cmd == "at")
+		{
+			Action a;
+			double s = 0;
+
+			if (t.size() < 5 || !number(t[1], s) || !parse_selector(t[2], a) || !number(t[4], a.value) ||
+				(t[3] == "pos" && (t.size() < 6 || !number(t[5], a.value2))))
+			{
+				return fail("at <s> <all|addr|lo-hi> <traffic|period|jitter|len|pos> <value> [y]");
+			}
+			if (t[3] != "traffic" && t[3] != "period" && t[3] != "jitter" && t[3] != "len" && t[3] != "pos")
+			{
+				return fail("unknown action " + t[3]);
+			}
+			a.at_ns = to_ns(s);
+			a.key = t[3];
+			actions.push_back(a);
+		}
+		else if (cmd == "current")
+		{
+			uint8_t m = (t.size() == 3) ? mode_index(t[1]) : 0xFF;
+
+			if (m == 0xFF || !number(t[2], v))
+			{
+				return fail("current <deep_sleep|sleep|stb1|stb2|stb3|tx|rx> <mA>");
+			}
+			current_ma[m] = v;
+		}
+		else if (cmd == "pathloss")
+		{
+			if (t.size() < 2 || !number(t[1], pathloss_exp) || (t.size() > 2 && !number(t[2], pathloss_ref_db)))
+			{
+				return fail("pathloss <exponent> [loss at 1 m in dB]");
+			}
+		}
+		else
+		{
+			struct
+			{
+				const char *name;
+				double *value;
+			} scalars[] = {
+				{"duration", &duration_s},	 {"shadowing", &shadowing_db}, {"noise_figure", &noise_figure_db},
+				{"capture", &capture_db},	 {"sf_isolation", &sf_isolation_db}, {"voltage", &voltage},
+			};
+			bool found = false;
+
+			if (cmd == "seed" && t.size() == 2 && number(t[1], v))
+			{
+				seed = static_cast<uint32_t>(v);
+				continue;
+			}
+			for (auto &s : scalars)
+			{
+				if (cmd == s.name && t.size() == 2 && number(t[1], *s.value))
+				{
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				return fail("unknown or malformed " + cmd);
+			}
+		}
+	}
+	if (nodes.empty())
+	{
+		error = "no nodes";
+		return false;
+	}
+	return true;
+}
+
+const char *Results::csv_header()
+{
+	return "nodes,sim_s,generated,delivered,per,throughput_bps,latency_mean_ms,latency_p50_ms,latency_p95_ms,"
+		   "latency_max_ms,energy_mj,uj_per_bit,packets,rx_ok,lost_collision,lost_weak,lost_not_listening,lost_busy,"
+		   "cad_busy,wall_s";
+}
+
+std::string Results::csv() const
+{
+	char row[512];
+
+	std::snprintf(row, sizeof(row),
+				  "%u,%.0f,%llu,%llu,%.4f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.2f", nodes,
+				  sim_s, static_cast<unsigned long long>(generated), static_cast<unsigned long long>(delivered), per,
+				  throughput_bps, latency_mean_ms, latency_p50_ms, latency_p95_ms, latency_max_ms, energy_mj, uj_per_bit,
+				  static_cast<unsigned long long>(packets), static_cast<unsigned long long>(rx_ok),
+				  static_cast<unsigned long long>(lost_collision), static_cast<unsigned long long>(lost_weak),
+				  static_cast<unsigned long long>(lost_not_listening), static_cast<unsigned long long>(lost_busy),
+				  static_cast<unsigned long long>(cad_busy), wall_s);
+	return row;
+}
+
+void Results::print_csv(FILE *out) const
+{
+	std::fprintf(out, "%s\n", csv().c_str());
+}
+
+void Results::print_nodes_csv(FILE *out) const
+{
+	std::fprintf(out, "addr,role,x,y,generated,delivered,tx_packets,rx_ok,rx_bad,send_fail,cad_busy,lbt_gave_up,"
+					  "retransmits,adr_switches,tx_ms,rx_ms,sleep_ms,energy_mj\n");
+	for (const NodeResult &n : per_node)
+	{
+		const uint64_t *t = n.fw.radio.mode_ns;
+
+		std::fprintf(out, "%u,%s,%.1f,%.1f,%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%u,%u,%.1f,%.1f,%.1f,%.3f\n", n.addr,
+					 n.role == RF_NODE_SINK ? "sink" : "sensor", n.x, n.y, static_cast<unsigned long long>(n.generated),
+					 static_cast<unsigned long long>(n.delivered), static_cast<unsigned long long>(n.tx_packets),
+					 static_cast<unsigned long long>(n.rx_ok), static_cast<unsigned long long>(n.rx_bad),
+					 n.fw.send_fail, n.fw.cad_busy, n.fw.lbt_gave_up, n.fw.arq.retransmits, n.fw.adr_switches,
+					 t[PAN3031_MODE_TX] / 1e6, t[PAN3031_MODE_RX] / 1e6,
+					 (t[PAN3031_MODE_DEEP_SLEEP] + t[PAN3031_MODE_SLEEP]) / 1e6, n.energy_mj);
+	}
+}
+
+Network::Network(const Scenario &scenario) : sc_(scenario), by_addr_(256)
+{
+	std::mt19937_64 rng(scenario.seed);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	size_t count = scenario.nodes.size();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const NodeSpec &spec = scenario.nodes[i];
+		auto n = std::make_unique<Node>();
+
+		n->net = this;
+		n->index = static_cast<int>(i);
+		n->cfg = spec.cfg;
+		n->cfg.seed = derive_seed(scenario.seed, static_cast<uint32_t>(i));
+		if (spec.place == 'd')
+		{
+			double r = spec.r * std::sqrt(unit(rng)), a = 2 * M_PI * unit(rng);
+			n->x = spec.x + r * std::cos(a);
+			n->y = spec.y + r * std::sin(a);
+		}
+		else if (spec.place == 'g')
+		{
+			n->x = spec.x + spec.r * (spec.index % spec.cols);
+			n->y = spec.y + spec.r * (spec.index / spec.cols);
+		}
+		else
+		{
+			n->x = spec.x;
+			n->y = spec.y;
+		}
+		n->env = {n.get(), env_tx, env_cad, env_generated, env_delivered};
+		by_addr_[n->cfg.addr].push_back(n->index);
+		nodes_.push_back(std::move(n));
+	}
+	if (scenario.shadowing_db > 0)
+	{
+		std::normal_distribution<float> normal(0.0f, static_cast<float>(scenario.shadowing_db));
+
+		shadow_.assign(count * count, 0.0f);
+		for (size_t i = 0; i < count; i++)
+		{
+			for (size_t j = i + 1; j < count; j++)
+			{
+				shadow_[i * count + j] = shadow_[j * count + i] = normal(rng);
+			}
+		}
+	}
+}
+
+Network::~Network()
+{
+	for (auto &n : nodes_)
+	{
+		if (n->api != nullptr)
+		{
+			n->api->stop();
+		}
+		if (n->handle != nullptr)
+		{
+			dlclose(n->handle);
+		}
+		if (n->fd >= 0)
+		{
+			close(n->fd);
+		}
+	}
+}
+
+// dlopen hands out the same copy for the same path, so every node gets the library from its own
+// memfd, kept open while the node lives so no two paths are alike, and with it its own globals
+bool Network::load(const std::string &lib, std::string &error)
+{
+	std::ifstream in(lib, std::ios::binary);
+	std::vector<char> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	struct rlimit files;
+
+	if (image.empty())
+	{
+		error = "cannot read " + lib;
+		return false;
+	}
+	if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+	{
+		files.rlim_cur = files.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &files);
+	}
+	for (auto &n : nodes_)
+	{
+		n->fd = memfd_create("rf_node", MFD_CLOEXEC);
+		if (n->fd < 0 || write(n->fd, image.data(), image.size()) != static_cast<ssize_t>(image.size()))
+		{
+			error = "memfd for node " + std::to_string(n->cfg.addr) + " failed";
+			return false;
+		}
+		n->handle = dlopen(("/proc/self/fd/" + std::to_string(n->fd)).c_str(), RTLD_NOW | RTLD_LOCAL);
+		if (n->handle == nullptr)
+		{
+			error = dlerror();
+			return false;
+		}
+		auto entry = reinterpret_cast<const rf_node_api_t *(*)()>(dlsym(n->handle, RF_NODE_API_SYM));
+		if (entry == nullptr || (n->api = entry()) == nullptr || n->api->start(&n->cfg, &n->env) != OK)
+		{
+			n->api = nullptr;
+			error = "node " + std::to_string(n->cfg.addr) + " did not start";
+			return false;
+		}
+	}
+	return true;
+}
+
+void Network::env_tx(void *ctx, const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us)
+{
+	Node *n = static_cast<Node *>(ctx);
+	n->net->on_tx(*n, payload, len, start_ns, airtime_us);
+}
+
+uint8_t Network::env_cad(void *ctx, uint64_t now_ns)
+{
+	Node *n = static_cast<Node *>(ctx);
+	return n->net->on_cad(*n, now_ns);
+}
+
+void Network::env_generated(void *ctx, uint32_t seq, uint64_t now_ns)
+{
+	Node *n = static_cast<Node *>(ctx);
+
+	n->res.generated++;
+	n->net->pending_[static_cast<uint64_t>(n->index) << 32 | seq] = now_ns;
+}
+
+// addresses may repeat in separate clusters, the sender is the nearest node with that address
+void Network::env_delivered(void *ctx, uint8_t src, uint32_t seq, uint8_t len, uint64_t now_ns)
+{
+	Node *n = static_cast<Node *>(ctx);
+	Network *net = n->net;
+	int from = net->find_addr(src, n->index);
+	std::unordered_map<uint64_t, uint64_t>::iterator it;
+
+	if (from < 0 || net->nodes_[from]->cfg.dst != n->cfg.addr)
+	{
+		return;
+	}
+	// ARQ duplicates do not count
+	it = net->pending_.find(static_cast<uint64_t>(from) << 32 | seq);
+	if (it == net->pending_.end())
+	{
+		return;
+	}
+	net->latencies_ms_.push_back((now_ns - it->second) / 1e6);
+	net->pending_.erase(it);
+	net->res_.delivered++;
+	net->res_.delivered_bytes += len;
+	net->nodes_[from]->res.delivered++;
+}
+
+double Network::loss_db(int from, int to, uint32_t freq_hz) const
+{
+	const Node &a = *nodes_[from], &b = *nodes_[to];
+	double d = std::max(1.0, std::hypot(a.x - b.x, a.y - b.y));
+	double ref = (sc_.pathloss_ref_db >= 0) ? sc_.pathloss_ref_db : 20 * std::log10(freq_hz) - 147.55;
+	double loss = ref + 10 * sc_.pathloss_exp * std::log10(d);
+
+	if (!shadow_.empty())
+	{
+		loss += shadow_[static_cast<size_t>(from) * nodes_.size() + to];
+	}
+	return loss;
+}
+
+double Network::rx_dbm(const Packet &p, int to) const
+{
+	return p.modem.power_cdbm / 100.0 - loss_db(p.src, to, p.modem.freq_hz);
+}
+
+double Network::noise_dbm(uint32_t bw_hz) const
+{
+	return -174 + 10 * std::log10(bw_hz) + sc_.noise_figure_db;
+}
+
+// demodulation floor, 2.5 dB per SF step
+double Network::snr_floor_db(uint8_t sf)
+{
+	return -7.5 - 2.5 * (sf - SF_7);
+}
+
+int Network::find_addr(uint8_t addr, int near) const
+{
+	int best = -1;
+	double best_d = 0;
+
+	for (int i : by_addr_[addr])
+	{
+		double d = std::hypot(nodes_[i]->x - nodes_[near]->x, nodes_[i]->y - nodes_[near]->y);
+		if (i != near && (best < 0 || d < best_d))
+		{
+			best = i;
+			best_d = d;
+		}
+	}
+	return best;
+}
+
+Network::Packet *Network::packet(uint64_t id)
+{
+	return (id >= air_base_ && id - air_base_ < air_.size()) ? &air_[id - air_base_] : nullptr;
+}
+
+// a finished packet is still interference for anything on air that started before it ended
+void Network::prune_packets()
+{
+	uint64_t oldest = UINT64_MAX;
+
+	for (const Packet &p : air_)
+	{
+		if (!p.done)
+		{
+			oldest = std::min(oldest, p.start);
+		}
+	}
+	while (!air_.empty() && air_.front().done && air_.front().end <= oldest)
+	{
+		air_.pop_front();
+		air_base_++;
+	}
+}
+
+void Network::schedule(uint64_t t, uint8_t kind, uint64_t id)
+{
+	events_.push({t, event_seq_++, kind, id});
+}
+
+void Network::set_want(int index, uint64_t want_ns)
+{
+	Node &n = *nodes_[index];
+
+	if (index == running_ || want_ns >= n.want)
+	{
+		return;
+	}
+	ready_.erase({n.want, index});
+	n.want = want_ns;
+	ready_.insert({n.want, index});
+}
+
+void Network::on_tx(Node &n, const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us)
+{
+	uint64_t id = air_base_ + air_.size();
+	Packet p;
+	uint8_t mode = 0;
+	uint32_t epoch = 0;
+
+	p.src = n.index;
+	p.start = start_ns;
+	p.end = start_ns + static_cast<uint64_t>(airtime_us) * 1000;
+	n.api->modem(start_ns, &p.modem, &mode, &epoch);
+	p.payload.assign(payload, payload + len);
+	if (RF_LZ_STAGE == 0 && len > 0 && payload[0] != RF_FRAME_ADDR_BROADCAST)
+	{
+		p.dst = find_addr(payload[0], n.index);
+	}
+	n.res.tx_packets++;
+	air_.push_back(std::move(p));
+	schedule(start_ns, EVENT_START, id);
+	schedule(air_.back().end, EVENT_END, id);
+	n.api->set_limit(air_.back().end);
+}
+
+// every node is at or past the preamble now, so no earlier packet can still show up
+void Network::on_packet_start(uint64_t id)
+{
+	Packet &p = *packet(id);
+
+	for (auto &r : nodes_)
+	{
+		vpan_modem_t m;
+		uint8_t mode = 0, why = LOSS_NONE;
+		uint32_t epoch = 0;
+		const Packet *busy;
+
+		if (r->index == p.src)
+		{
+			continue;
+		}
+		busy = (r->lock != NO_PACKET) ? packet(r->lock) : nullptr;
+		if (!r->api->modem(p.start, &m, &mode, &epoch) || mode != PAN3031_MODE_RX || m.sf != p.modem.sf ||
+			m.bw_hz != p.modem.bw_hz || std::llabs(static_cast<long long>(m.freq_hz) - p.modem.freq_hz) > m.bw_hz / 4)
+		{
+			why = LOSS_NOT_LISTENING;
+		}
+		else if (rx_dbm(p, r->index) - noise_dbm(m.bw_hz) < snr_floor_db(m.sf))
+		{
+			why = LOSS_WEAK;
+		}
+		else if (busy != nullptr && !busy->done)
+		{
+			why = LOSS_BUSY;
+		}
+		else
+		{
+			r->lock = id;
+			r->lock_epoch = epoch;
+			p.receivers.push_back(r->index);
+		}
+		if (r->index == p.dst)
+		{
+			p.dst_loss = why;
+		}
+	}
+}
+
+uint8_t Network::on_cad(Node &n, uint64_t now_ns)
+{
+	vpan_modem_t m;
+	uint8_t mode = 0;
+	uint32_t epoch = 0;
+
+	n.api->modem(now_ns, &m, &mode, &epoch);
+	if (!m.cad || mode != PAN3031_MODE_RX)
+	{
+		return 0;
+	}
+	for (const Packet &q : air_)
+	{
+		if (q.done || q.src == n.index || q.start > now_ns || q.modem.sf != m.sf || q.modem.bw_hz != m.bw_hz ||
+			std::llabs(static_cast<long long>(q.modem.freq_hz) - m.freq_hz) > m.bw_hz / 4)
+		{
+			continue;
+		}
+		if (rx_dbm(q, n.index) - noise_dbm(m.bw_hz) >= snr_floor_db(m.sf))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void Network::on_packet_end(uint64_t id, uint64_t now_ns)
+{
+	Packet &p = *packet(id);
+	uint8_t dst_outcome = p.dst_loss;
+
+	p.done = true;
+	for (int r : p.receivers)
+	{
+		Node &rn = *nodes_[r];
+		vpan_modem_t m;
+		uint8_t mode = 0;
+		uint32_t epoch = 0;
+		double s, interference = 0, sinr, sir;
+		bool ok;
+
+		if (rn.lock != id)
+		{
+			continue;
+		}
+		rn.lock = NO_PACKET;
+		rn.api->modem(now_ns, &m, &mode, &epoch);
+		if (epoch != rn.lock_epoch)
+		{
+			// left RX (to transmit, sleep, or restart RX) before the packet ended
+			if (r == p.dst)
+			{
+				dst_outcome = LOSS_NOT_LISTENING;
+			}
+			continue;
+		}
+		for (const Packet &q : air_)
+		{
+			double overlap;
+
+			if (&q == &p || q.src == r || q.end <= p.start || q.start >= p.end)
+			{
+				continue;
+			}
+			overlap = std::min(q.modem.freq_hz + q.modem.bw_hz / 2.0, p.modem.freq_hz + p.modem.bw_hz / 2.0) -
+					  std::max(q.modem.freq_hz - q.modem.bw_hz / 2.0, p.modem.freq_hz - p.modem.bw_hz / 2.0);
+			if (overlap <= 0)
+			{
+				continue;
+			}
+			interference += to_mw(rx_dbm(q, r)) * std::min(1.0, overlap / p.modem.bw_hz) *
+							((q.modem.sf == p.modem.sf) ? 1.0 : to_mw(-sc_.sf_isolation_db));
+		}
+		s = rx_dbm(p, r);
+		sinr = s - 10 * std::log10(to_mw(noise_dbm(p.modem.bw_hz)) + interference);
+		sir = (interference > 0) ? s - 10 * std::log10(interference) : INFINITY;
+		ok = sinr >= snr_floor_db(p.modem.sf) && sir >= sc_.capture_db;
+		if (rn.api->rx(p.payload.data(), static_cast<uint8_t>(p.payload.size()),
+					   static_cast<int16_t>(std::clamp(s * 100, -32000.0, 3000.0)),
+					   static_cast<int16_t>(std::clamp(sinr * 100, -3000.0, 3000.0)), ok, now_ns))
+		{
+			set_want(r, now_ns);
+			(ok ? rn.res.rx_ok : rn.res.rx_bad)++;
+		}
+		if (r == p.dst)
+		{
+			dst_outcome = ok ? LOSS_NONE : LOSS_COLLISION;
+		}
+	}
+	if (p.dst >= 0)
+	{
+		res_.packets++;
+		switch (dst_outcome)
+		{
+		case LOSS_NONE:
+			res_.rx_ok++;
+			break;
+		case LOSS_NOT_LISTENING:
+			res_.lost_not_listening++;
+			break;
+		case LOSS_WEAK:
+			res_.lost_weak++;
+			break;
+		case LOSS_BUSY:
+			res_.lost_busy++;
+			break;
+		case LOSS_COLLISION:
+			res_.lost_collision++;
+			break;
+		}
+	}
+	prune_packets();
+}
+
+void Network::on_action(const Action &a)
+{
+	for (auto &n : nodes_)
+	{
+		rf_node_cfg_t &c = n->cfg;
+
+		if (c.addr < a.addr_lo || c.addr > a.addr_hi)
+		{
+			continue;
+		}
+		if (a.key == "traffic")
+		{
+			c.traffic = a.value != 0;
+		}
+		else if (a.key == "period")
+		{
+			c.period_ms = static_cast<uint32_t>(std::llround(a.value * 1000));
+		}
+		else if (a.key == "jitter")
+		{
+			c.jitter_ms = static_cast<uint32_t>(std::llround(a.value * 1000));
+		}
+		else if (a.key == "len")
+		{
+			c.len = static_cast<uint8_t>(std::min(a.value, static_cast<double>(RF_FRAME_MAX_PAYLOAD)));
+		}
+		else if (a.key == "pos")
+		{
+			n->x = a.value;
+			n->y = a.value2;
+		}
+	}
+}
+
+Results Network::run()
+{
+	auto wall = std::chrono::steady_clock::now();
+	uint64_t end = to_ns(sc_.duration_s);
+
+	for (size_t i = 0; i < sc_.actions.size(); i++)
+	{
+		schedule(sc_.actions[i].at_ns, EVENT_ACTION, i);
+	}
+	for (auto &n : nodes_)
+	{
+		n->want = 0;
+		ready_.insert({0, n->index});
+	}
+
+	// earliest first, channel events before nodes at the same time; a node runs until the next
+	// event, or the lookahead past the next node, and a packet it sends cuts its run short at the
+	// packet's end
+	for (;;)
+	{
+		uint64_t node_t = ready_.empty() ? VPAN_NEVER : ready_.begin()->first;
+		uint64_t event_t = events_.empty() ? VPAN_NEVER : events_.top().t;
+		uint64_t limit;
+		int i;
+
+		if (event_t <= node_t && event_t < end)
+		{
+			Event e = events_.top();
+			events_.pop();
+			if (e.kind == EVENT_END)
+			{
+				on_packet_end(e.id, e.t);
+			}
+			else if (e.kind == EVENT_START)
+			{
+				on_packet_start(e.id);
+			}
+			else
+			{
+				on_action(sc_.actions[e.id]);
+			}
+			continue;
+		}
+		if (node_t >= end)
+		{
+			break;
+		}
+		i = ready_.begin()->second;
+		ready_.erase(ready_.begin());
+		limit = std::min(end, event_t);
+		if (!ready_.empty() && ready_.begin()->first < end)
+		{
+			limit = std::min(limit, ready_.begin()->first + lookahead_ns_);
+		}
+		running_ = i;
+		nodes_[i]->want = nodes_[i]->api->run(limit);
+		running_ = -1;
+		ready_.insert({nodes_[i]->want, i});
+	}
+
+	res_.nodes = static_cast<uint32_t>(nodes_.size());
+	res_.sim_s = sc_.duration_s;
+	for (auto &n : nodes_)
+	{
+		NodeResult &r = n->res;
+
+		r.addr = n->cfg.addr;
+		r.role = n->cfg.role;
+		r.x = n->x;
+		r.y = n->y;
+		n->api->stats(&r.fw, end);
+		for (int m = 0; m < 8; m++)
+		{
+			r.energy_mj += r.fw.radio.mode_ns[m] * 1e-9 * sc_.current_ma[m] * sc_.voltage;
+		}
+		res_.generated += r.generated;
+		res_.energy_mj += r.energy_mj;
+		res_.cad_busy += r.fw.cad_busy;
+		res_.per_node.push_back(r);
+	}
+	res_.per = res_.generated ? 1.0 - static_cast<double>(res_.delivered) / res_.generated : 0;
+	res_.throughput_bps = res_.delivered_bytes * 8 / sc_.duration_s;
+	res_.uj_per_bit = res_.delivered_bytes ? res_.energy_mj * 1000 / (res_.delivered_bytes * 8.0) : 0;
+	if (!latencies_ms_.empty())
+	{
+		std::vector<double> l = latencies_ms_;
+
+		std::sort(l.begin(), l.end());
+		for (double v : l)
+		{
+			res_.latency_mean_ms += v / l.size();
+		}
+		res_.latency_p50_ms = l[l.size() / 2];
+		res_.latency_p95_ms = l[std::min(l.size() - 1, l.size() * 95 / 100)];
+		res_.latency_max_ms = l.back();
+	}
+	res_.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+	return res_;
+}
+
+} // namespace netsim
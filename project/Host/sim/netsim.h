@@ -0,0 +1,227 @@
+//
+// Network simulator: many firmware nodes (rf_node.h) on one virtual RF channel.
+//
+// Every node is its own copy of librf_node.so, so Radio/ and App/ run unmodified with their own
+// globals. The scheduler always resumes the node or channel event with the earliest time. A node
+// may run ahead of all others by the shortest airtime there is, since nothing another node does
+// can reach it sooner: a packet only arrives at its end, and which receivers lock onto it is
+// decided at its start from each radio's mode history, once every node has got that far. CAD is
+// answered only when all other nodes caught up. The result is what a sequential execution in
+// global time order would give, and the same for the same seed.
+//
+// The channel: log-distance path loss with optional per-link log-normal shadowing, thermal noise
+// plus a noise figure, per-SF demodulation floors, and interference summed over everything on air
+// that overlaps in time and frequency (other SFs attenuated by sf_isolation_db). A receiver locks
+// onto the first decodable packet while in RX on its SF/BW; the packet arrives with a CRC error
+// when its SINR misses the floor or its SIR the capture threshold. CAD reports busy while a
+// decodable packet with the receiver's SF/BW is on air. Radio energy is the time in each
+// PAN3031 mode times the current table.
+//
+#ifndef HOST_SIM_NETSIM_H
+#define HOST_SIM_NETSIM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <queue>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rf_node.h"
+
+namespace netsim
+{
+
+struct NodeSpec
+{
+	rf_node_cfg_t cfg{};
+	// placement, resolved with the run's seed: 'p' at (x, y), 'd' uniform in the disc of radius r
+	// around (x, y), 'g' point index of a grid with spacing r and cols columns starting at (x, y)
+	char place = 'p';
+	double x = 0;
+	double y = 0;
+	double r = 0;
+	uint32_t index = 0;
+	uint32_t cols = 1;
+};
+
+// "at <s> <selector> <key> <value>" in a scenario, applied to nodes addr_lo..addr_hi
+struct Action
+{
+	uint64_t at_ns = 0;
+	uint8_t addr_lo = 0;
+	uint8_t addr_hi = 0;
+	std::string key;
+	double value = 0;
+	double value2 = 0;
+};
+
+struct Scenario
+{
+	uint32_t seed = 1;
+	double duration_s = 3600;
+	double pathloss_exp = 2.7;
+	double pathloss_ref_db = -1;	// loss at 1 m, negative for free space at the carrier
+	double shadowing_db = 0;
+	double noise_figure_db = 6;
+	double capture_db = 6;
+	double sf_isolation_db = 16;
+	double voltage = 3.3;
+	// mA per PAN3031_MODE_*: deep sleep, sleep, STB1, STB2, STB3, TX, RX
+	double current_ma[8] = {0.0004, 0.0012, 0.5, 0.9, 1.3, 90, 5.5, 0};
+	std::vector<NodeSpec> nodes;
+	std::vector<Action> actions;
+
+	bool load(const std::string &path, std::string &error);
+	bool parse(std::istream &in, std::string &error);
+};
+
+struct NodeResult
+{
+	uint8_t addr = 0;
+	uint8_t role = 0;
+	double x = 0;
+	double y = 0;
+	uint64_t generated = 0;
+	uint64_t delivered = 0;			// its messages that reached their destination
+	uint64_t tx_packets = 0;
+	uint64_t rx_ok = 0;
+	uint64_t rx_bad = 0;			// locked but lost to interference
+	double energy_mj = 0;
+	rf_node_stats_t fw{};
+};
+
+struct Results
+{
+	uint32_t nodes = 0;
+	double sim_s = 0;
+	double wall_s = 0;
+	uint64_t generated = 0;
+	uint64_t delivered = 0;
+	uint64_t delivered_bytes = 0;
+	double per = 0;
+	double throughput_bps = 0;
+	double latency_mean_ms = 0;
+	double latency_p50_ms = 0;
+	double latency_p95_ms = 0;
+	double latency_max_ms = 0;
+	double energy_mj = 0;			// radio energy of all nodes
+	double uj_per_bit = 0;			// per delivered payload bit
+	// every unicast packet once, by what happened at its destination
+	uint64_t packets = 0;
+	uint64_t rx_ok = 0;
+	uint64_t lost_collision = 0;
+	uint64_t lost_weak = 0;			// below the destination's sensitivity
+	uint64_t lost_not_listening = 0;	// destination not in RX on that SF/BW/frequency
+	uint64_t lost_busy = 0;			// destination locked onto another packet
+	uint64_t cad_busy = 0;
+	std::vector<NodeResult> per_node;
+
+	static const char *csv_header();
+	std::string csv() const;			// one row without the newline, wall_s last
+	void print_csv(FILE *out) const;
+	void print_nodes_csv(FILE *out) const;
+};
+
+// one run; a Network belongs to the thread that runs it, several may run side by side
+class Network
+{
+public:
+	explicit Network(const Scenario &scenario);
+	~Network();
+	Network(const Network &) = delete;
+	Network &operator=(const Network &) = delete;
+
+	// one copy of the node library per node
+	bool load(const std::string &lib, std::string &error);
+	Results run();
+
+private:
+	struct Node
+	{
+		Network *net = nullptr;
+		int index = 0;
+		int fd = -1;				// memfd holding its copy of the library
+		void *handle = nullptr;
+		const rf_node_api_t *api = nullptr;
+		rf_node_cfg_t cfg{};
+		rf_node_env_t env{};
+		double x = 0;
+		double y = 0;
+		uint64_t want = 0;
+		uint64_t lock = UINT64_MAX;		// packet id it demodulates
+		uint32_t lock_epoch = 0;
+		NodeResult res;
+	};
+
+	// a packet on air, and the receivers that locked onto it
+	struct Packet
+	{
+		int src = 0;
+		uint64_t start = 0;
+		uint64_t end = 0;
+		vpan_modem_t modem{};
+		std::vector<uint8_t> payload;
+		std::vector<int> receivers;	// decided at its start
+		int dst = -1;				// addressed node, -1 for broadcast or unknown
+		uint8_t dst_loss = 0;		// why dst did not lock, LOSS_*
+		bool done = false;
+	};
+	struct Event
+	{
+		uint64_t t;
+		uint64_t seq;
+		uint8_t kind;
+		uint64_t id;
+
+		// at the same time packets end before others start
+		bool operator>(const Event &o) const
+		{
+			return t != o.t ? t > o.t : kind != o.kind ? kind > o.kind : seq > o.seq;
+		}
+	};
+
+	static void env_tx(void *ctx, const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us);
+	static uint8_t env_cad(void *ctx, uint64_t now_ns);
+	static void env_generated(void *ctx, uint32_t seq, uint64_t now_ns);
+	static void env_delivered(void *ctx, uint8_t src, uint32_t seq, uint8_t len, uint64_t now_ns);
+
+	void on_tx(Node &n, const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us);
+	uint8_t on_cad(Node &n, uint64_t now_ns);
+	void on_packet_start(uint64_t id);
+	void on_packet_end(uint64_t id, uint64_t now_ns);
+	void on_action(const Action &a);
+	void schedule(uint64_t t, uint8_t kind, uint64_t id);
+	void set_want(int index, uint64_t want_ns);
+
+	double loss_db(int from, int to, uint32_t freq_hz) const;
+	double noise_dbm(uint32_t bw_hz) const;
+	static double snr_floor_db(uint8_t sf);
+	int find_addr(uint8_t addr, int near) const;
+	double rx_dbm(const Packet &p, int to) const;
+	Packet *packet(uint64_t id);
+	void prune_packets();
+
+	const Scenario &sc_;
+	std::vector<std::unique_ptr<Node>> nodes_;
+	std::vector<std::vector<int>> by_addr_;
+	std::vector<float> shadow_;
+	std::deque<Packet> air_;
+	uint64_t air_base_ = 0;
+	std::set<std::pair<uint64_t, int>> ready_;
+	std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+	uint64_t event_seq_ = 0;
+	int running_ = -1;
+	uint64_t lookahead_ns_ = VPAN_MIN_AIRTIME_US * 1000ULL;
+	std::unordered_map<uint64_t, uint64_t> pending_;		// (node, seq) -> generated at
+	std::vector<double> latencies_ms_;
+	Results res_;
+};
+
+} // namespace netsim
+
+#endif // HOST_SIM_NETSIM_H
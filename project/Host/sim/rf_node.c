@@ -0,0 +1,370 @@
+//
+// Node side of the network simulator, see rf_node.h. Built into librf_node.so together with the
+// firmware, vpan.c and vhal.c; everything static here exists once per loaded copy.
+//
+#include "rf_node.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "main.h"
+#include "radio.h"
+#include "rf_adr.h"
+#include "rf_duty.h"
+#include "vhal.h"
+
+#define NODE_STACK (256 * 1024)
+#define NODE_CAD_SYMBOLS 2
+
+extern struct RxDoneMsg RxDoneParams;
+
+static const rf_node_cfg_t *node_cfg;
+static rf_node_env_t node_env;
+static vpan_t node_radio;
+static rf_node_stats_t node_stats;
+static ucontext_t node_host_ctx, node_ctx;
+static uint8_t *node_stack;
+static uint64_t node_limit, node_want, node_kick = VPAN_NEVER;
+static uint8_t node_done;
+static uint32_t node_rand_state;
+static uint32_t node_seq;
+static uint8_t node_msg[RF_FRAME_MAX_PAYLOAD];
+
+static uint32_t node_rand(void)
+{
+	// xorshift32, seeded per node so runs repeat
+	node_rand_state ^= node_rand_state << 13;
+	node_rand_state ^= node_rand_state >> 17;
+	node_rand_state ^= node_rand_state << 5;
+	return node_rand_state;
+}
+
+static uint64_t node_ms(uint32_t ms)
+{
+	return (uint64_t)ms * 1000000ULL;
+}
+
+// the clock only passes the limit after the simulator resumed us with a later one, and stops
+// early at a packet that was pushed into the radio meanwhile
+static uint64_t node_wait(uint64_t want_ns, void *ctx)
+{
+	uint64_t granted;
+
+	(void)ctx;
+	if (want_ns > node_limit)
+	{
+		node_want = want_ns;
+		swapcontext(&node_ctx, &node_host_ctx);
+	}
+	granted = (want_ns < node_limit) ? want_ns : node_limit;
+	if (node_kick < granted)
+	{
+		granted = node_kick;
+	}
+	node_kick = VPAN_NEVER;
+	return (granted > vhal_now_ns()) ? granted : vhal_now_ns();
+}
+
+// hands control back until every other node got as far, for questions about the channel now
+static void node_sync(void)
+{
+	node_want = vhal_now_ns();
+	swapcontext(&node_ctx, &node_host_ctx);
+}
+
+static void node_on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)ctx;
+	node_env.tx(node_env.ctx, payload, len, start_ns, airtime_us);
+}
+
+static void node_deliver(uint8_t src, const uint8_t *msg, uint32_t len)
+{
+	if (len < RF_NODE_MSG_HDR)
+	{
+		return;
+	}
+	node_stats.received++;
+	node_env.delivered(node_env.ctx, src, msg[0] | (msg[1] << 8) | (msg[2] << 16) | ((uint32_t)msg[3] << 24),
+					   (uint8_t)len, vhal_now_ns());
+}
+
+void rf_frame_rx_event(const rf_frame_hdr_t *hdr, uint8_t *msg, uint32_t len)
+{
+	node_deliver(hdr->src, msg, len);
+}
+
+void rf_arq_rx_event(uint8_t src, uint8_t *data, uint8_t len)
+{
+	node_deliver(src, data, len);
+}
+
+void rf_arq_fail_event(uint8_t dst, uint32_t lost)
+{
+	(void)dst;
+	node_stats.arq_failed += lost;
+}
+
+void rf_adr_switch_event(uint8_t peer, const rf_adr_rate_t *rate)
+{
+	(void)peer;
+	(void)rate;
+	node_stats.adr_switches++;
+}
+
+// the same RX chain as the firmware modes: ADR control first, then ARQ, which passes plain frames on
+static void node_rx(void)
+{
+	uint32_t flag = rf_get_recv_flag();
+
+	if (flag == RADIO_FLAG_IDLE)
+	{
+		return;
+	}
+	rf_set_recv_flag(RADIO_FLAG_IDLE);
+	if (flag != RADIO_FLAG_RXDONE)
+	{
+		return;
+	}
+	if (node_cfg->adr && rf_adr_input(RxDoneParams.Payload, RxDoneParams.Size, RF_META_TO_CDB(RxDoneParams.Rssi),
+									  RF_META_TO_CDB(RxDoneParams.Snr)))
+	{
+		return;
+	}
+	rf_arq_input(RxDoneParams.Payload, RxDoneParams.Size);
+}
+
+static uint8_t node_listens(void)
+{
+	return node_cfg->role == RF_NODE_SINK || node_cfg->listen || node_cfg->arq || node_cfg->adr;
+}
+
+// CAD over a couple of symbols, then backoff while the channel is busy
+static uint32_t node_lbt(void)
+{
+	const struct RfModemCfg *m = rf_get_modem_cfg();
+	uint64_t cad_ns = NODE_CAD_SYMBOLS * (1000000000ULL << m->Sf) / (125000UL << (m->Bw - BW_125K));
+	uint8_t i;
+
+	for (i = 0; i < node_cfg->lbt_tries; i++)
+	{
+		rf_enter_continous_rx();
+		vhal_run_until(vhal_now_ns() + cad_ns);
+		node_sync();
+		if (!node_env.cad(node_env.ctx, vhal_now_ns()))
+		{
+			return OK;
+		}
+		node_stats.cad_busy++;
+		vhal_run_until(vhal_now_ns() + node_ms(1 + node_rand() % (node_cfg->lbt_backoff_ms + 1)));
+	}
+	node_stats.lbt_gave_up++;
+	return FAIL;
+}
+
+static void node_send(void)
+{
+	uint8_t len = (node_cfg->len < RF_NODE_MSG_HDR) ? RF_NODE_MSG_HDR : node_cfg->len;
+	uint32_t seq = node_seq++, res = FAIL, i;
+
+	node_msg[0] = (uint8_t)seq;
+	node_msg[1] = (uint8_t)(seq >> 8);
+	node_msg[2] = (uint8_t)(seq >> 16);
+	node_msg[3] = (uint8_t)(seq >> 24);
+	for (i = RF_NODE_MSG_HDR; i < len; i++)
+	{
+		node_msg[i] = (uint8_t)(node_rand() >> 24);
+	}
+	node_stats.generated++;
+	node_env.generated(node_env.ctx, seq, vhal_now_ns());
+
+	if (!node_listens())
+	{
+		rf_sleep_wakeup();
+	}
+	if (node_cfg->mac != RF_NODE_MAC_LBT || node_lbt() == OK)
+	{
+		res = node_cfg->arq ? rf_arq_send(node_cfg->dst, node_msg, len) : rf_frame_send(node_cfg->dst, node_msg, len);
+	}
+	if (res != OK)
+	{
+		node_stats.send_fail++;
+	}
+	if (node_listens())
+	{
+		rf_enter_continous_rx();
+	}
+	else
+	{
+		rf_sleep();
+	}
+}
+
+static void node_setup(void)
+{
+	const rf_node_cfg_t *c = node_cfg;
+
+	vhal_init(&node_radio);
+	vhal_set_wait_hook(node_wait, NULL);
+	vhal_set_poll(VHAL_POLL_IDLE);
+	vpan_set_tx_hook(&node_radio, node_on_air, NULL);
+	while (rf_init() != OK)
+	{
+		HAL_Delay(10);
+	}
+	rf_set_default_para();
+	rf_set_para(RF_PARA_TYPE_FREQ, c->freq);
+	rf_set_para(RF_PARA_TYPE_SF, c->sf);
+	rf_set_para(RF_PARA_TYPE_BW, c->bw);
+	rf_set_para(RF_PARA_TYPE_CR, c->cr);
+	rf_set_para(RF_PARA_TYPE_TXPOWER, c->power);
+	rf_frame_init(c->addr);
+	rf_arq_init();
+	rf_duty_init();
+	if (c->duty_permille != 0)
+	{
+		rf_duty_add_band(c->freq - 1000000, c->freq + 1000000, c->duty_permille, 3600000);
+	}
+	if (c->adr)
+	{
+		rf_adr_init();
+	}
+	if (c->mac == RF_NODE_MAC_LBT)
+	{
+		rf_set_cad();
+	}
+	if (node_listens())
+	{
+		rf_enter_continous_rx();
+	}
+	else
+	{
+		rf_sleep();
+	}
+}
+
+static void node_main(void)
+{
+	const rf_node_cfg_t *c = node_cfg;
+	uint64_t next, wake;
+
+	node_setup();
+	next = node_ms(c->start_ms + (c->jitter_ms ? node_rand() % c->jitter_ms : 0));
+	for (;;)
+	{
+		node_rx();
+		rf_frame_poll();
+		if (c->arq)
+		{
+			rf_arq_poll();
+		}
+		if (c->adr)
+		{
+			rf_adr_poll();
+		}
+		if (c->role == RF_NODE_SENSOR && vhal_now_ns() >= next)
+		{
+			if (c->traffic)
+			{
+				node_send();
+			}
+			next += node_ms(c->period_ms + (c->jitter_ms ? node_rand() % c->jitter_ms : 0));
+		}
+		wake = vhal_now_ns() + node_ms(c->poll_ms);
+		if (c->role == RF_NODE_SENSOR && (next < wake || !node_listens()))
+		{
+			wake = (next > vhal_now_ns()) ? next : vhal_now_ns() + 1;
+		}
+		vhal_sleep_until(wake);
+	}
+}
+
+static uint32_t node_start(const rf_node_cfg_t *cfg, const rf_node_env_t *env)
+{
+	node_cfg = cfg;
+	node_env = *env;
+	node_rand_state = cfg->seed ? cfg->seed : 1;
+	node_limit = 0;
+	node_want = 0;
+	node_kick = VPAN_NEVER;
+	node_done = 0;
+	node_stack = malloc(NODE_STACK);
+	if (node_stack == NULL || getcontext(&node_ctx) != 0)
+	{
+		return FAIL;
+	}
+	node_ctx.uc_stack.ss_sp = node_stack;
+	node_ctx.uc_stack.ss_size = NODE_STACK;
+	node_ctx.uc_link = NULL;
+	makecontext(&node_ctx, node_main, 0);
+	return OK;
+}
+
+// resumes the node until it waits past limit_ns, returns the time it waits for
+static uint64_t node_run(uint64_t limit_ns)
+{
+	if (node_done)
+	{
+		return VPAN_NEVER;
+	}
+	node_limit = limit_ns;
+	swapcontext(&node_host_ctx, &node_ctx);
+	return node_want;
+}
+
+// a packet it sent may wake another node before the limit it was resumed with
+static void node_set_limit(uint64_t limit_ns)
+{
+	if (limit_ns < node_limit)
+	{
+		node_limit = limit_ns;
+	}
+}
+
+static uint64_t node_now(void)
+{
+	return vhal_now_ns();
+}
+
+static uint8_t node_modem(uint64_t at_ns, vpan_modem_t *m, uint8_t *mode, uint32_t *rx_epoch)
+{
+	vpan_get_modem(&node_radio, m);
+	return vpan_mode_at(&node_radio, at_ns, mode, rx_epoch);
+}
+
+static uint32_t node_rx_packet(const uint8_t *payload, uint8_t len, int16_t rssi_cdb, int16_t snr_cdb, uint8_t crc_ok,
+							   uint64_t now_ns)
+{
+	if (!vpan_rx_packet(&node_radio, payload, len, rssi_cdb, snr_cdb, crc_ok, now_ns))
+	{
+		return 0;
+	}
+	node_kick = now_ns;
+	return 1;
+}
+
+static void node_get_stats(rf_node_stats_t *s, uint64_t now_ns)
+{
+	vpan_sync_mode_time(&node_radio, now_ns);
+	node_stats.frame = *rf_frame_get_stats();
+	node_stats.arq = *rf_arq_get_stats();
+	node_stats.radio = node_radio.stats;
+	*s = node_stats;
+}
+
+static void node_stop(void)
+{
+	node_done = 1;
+	free(node_stack);
+	node_stack = NULL;
+}
+
+static const rf_node_api_t node_api = {
+	node_start, node_run, node_set_limit, node_now, node_modem, node_rx_packet, node_get_stats, node_stop,
+};
+
+const rf_node_api_t *rf_node_api(void)
+{
+	return &node_api;
+}
@@ -0,0 +1,105 @@
+//
+// One firmware node of the network simulator: Radio/ and App/ on a virtual PAN3031 (vpan.h) and a
+// virtual clock (vhal.h), running a small node program (sink or periodic sensor) on its own stack.
+//
+// The simulator loads librf_node.so once per node, every copy with its own firmware globals, and
+// talks to it through rf_node_api(). A node only moves its clock as far as the limit it was given;
+// when it needs to go further run() returns the time it is waiting for, so the simulator can
+// interleave all nodes in time order. Before a CAD query it also returns, with its own time, so
+// the simulator can bring the other nodes up to it first. Radio activity goes out through rf_node_env_t: every packet
+// that leaves the antenna, CAD queries and the application's messages for the statistics.
+//
+#ifndef HOST_SIM_RF_NODE_H
+#define HOST_SIM_RF_NODE_H
+
+#include <stdint.h>
+
+#include "rf_arq.h"
+#include "rf_frame.h"
+#include "vpan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RF_NODE_API_SYM "rf_node_api"
+
+#define RF_NODE_SINK 0
+#define RF_NODE_SENSOR 1
+
+#define RF_NODE_MAC_ALOHA 0
+#define RF_NODE_MAC_LBT 1		// CAD before every frame, random backoff while busy
+
+// application message header: seq(4), the rest is filler
+#define RF_NODE_MSG_HDR 4
+
+typedef struct
+{
+	uint8_t role;
+	uint8_t addr;
+	uint8_t dst;				// sensor: where messages go
+	uint8_t mac;
+	uint8_t arq;				// rf_arq instead of plain rf_frame_send
+	uint8_t adr;				// rf_adr on the link to dst
+	uint8_t listen;				// sensor: RX between messages, else sleep (ARQ and ADR imply it)
+	uint8_t sf;
+	uint8_t bw;
+	uint8_t cr;
+	uint8_t power;				// rf_set_para(RF_PARA_TYPE_TXPOWER) code
+	uint8_t len;				// message length, at least RF_NODE_MSG_HDR
+	uint32_t freq;
+	uint32_t period_ms;
+	uint32_t jitter_ms;			// uniform extra delay per message
+	uint32_t start_ms;
+	uint32_t lbt_backoff_ms;	// upper bound of the random backoff
+	uint8_t lbt_tries;
+	uint16_t duty_permille;		// rf_duty budget over one hour, 0 for none
+	uint32_t poll_ms;			// main loop period while nothing happens
+	uint32_t seed;
+	volatile uint8_t traffic;	// the simulator may switch this between runs
+} rf_node_cfg_t;
+
+typedef struct
+{
+	void *ctx;
+	void (*tx)(void *ctx, const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us);
+	uint8_t (*cad)(void *ctx, uint64_t now_ns);
+	void (*generated)(void *ctx, uint32_t seq, uint64_t now_ns);
+	void (*delivered)(void *ctx, uint8_t src, uint32_t seq, uint8_t len, uint64_t now_ns);
+} rf_node_env_t;
+
+typedef struct
+{
+	uint32_t generated;
+	uint32_t send_fail;			// refused by rf_frame/rf_arq (duty cycle, window full, TX timeout)
+	uint32_t cad_busy;
+	uint32_t lbt_gave_up;
+	uint32_t received;			// messages handed to the application
+	uint32_t arq_failed;
+	uint32_t adr_switches;
+	rf_frame_stats_t frame;
+	rf_arq_stats_t arq;
+	vpan_stats_t radio;
+} rf_node_stats_t;
+
+typedef struct
+{
+	uint32_t (*start)(const rf_node_cfg_t *cfg, const rf_node_env_t *env);
+	uint64_t (*run)(uint64_t limit_ns);
+	void (*set_limit)(uint64_t limit_ns);
+	uint64_t (*now)(void);
+	// current modem settings and the mode at_ns, 0 when at_ns is further back than the radio remembers
+	uint8_t (*modem)(uint64_t at_ns, vpan_modem_t *m, uint8_t *mode, uint32_t *rx_epoch);
+	uint32_t (*rx)(const uint8_t *payload, uint8_t len, int16_t rssi_cdb, int16_t snr_cdb, uint8_t crc_ok,
+				   uint64_t now_ns);
+	void (*stats)(rf_node_stats_t *s, uint64_t now_ns);
+	void (*stop)(void);
+} rf_node_api_t;
+
+const rf_node_api_t *rf_node_api(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_SIM_RF_NODE_H
@@ -0,0 +1,9 @@
+//
+// Host stand-in for the STM32F0 device header, see stm32f0xx_hal.h
+//
+#ifndef HOST_SIM_STM32F0XX_H
+#define HOST_SIM_STM32F0XX_H
+
+#include "stm32f0xx_hal.h"
+
+#endif // HOST_SIM_STM32F0XX_H
@@ -0,0 +1,120 @@
+//
+// Host stand-in for the STM32F0 HAL, just what Radio/, App/ and Core/Inc use.
+// Time, SPI and UART are virtual, see vhal.h.
+//
+#ifndef HOST_SIM_STM32F0XX_HAL_H
+#define HOST_SIM_STM32F0XX_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __weak
+#define __weak __attribute__((weak))
+#endif
+
+typedef enum
+{
+	HAL_OK = 0x00U,
+	HAL_ERROR = 0x01U,
+	HAL_BUSY = 0x02U,
+	HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+	GPIO_PIN_RESET = 0U,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+enum
+{
+	RESET = 0U,
+	SET = 1U
+};
+
+typedef struct
+{
+	uint32_t id;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef vhal_gpioa, vhal_gpiob;
+#define GPIOA (&vhal_gpioa)
+#define GPIOB (&vhal_gpiob)
+
+#define GPIO_PIN_0 ((uint16_t)0x0001U)
+#define GPIO_PIN_1 ((uint16_t)0x0002U)
+#define GPIO_PIN_12 ((uint16_t)0x1000U)
+#define GPIO_PIN_15 ((uint16_t)0x8000U)
+
+typedef enum
+{
+	EXTI0_1_IRQn = 5
+} IRQn_Type;
+
+typedef struct
+{
+	volatile uint32_t CNDTR;
+} DMA_Channel_TypeDef;
+
+typedef struct
+{
+	DMA_Channel_TypeDef *Instance;
+} DMA_HandleTypeDef;
+
+#define __HAL_DMA_GET_COUNTER(h) ((h)->Instance->CNDTR)
+
+typedef enum
+{
+	HAL_UART_STATE_RESET = 0x00U,
+	HAL_UART_STATE_READY = 0x20U,
+	HAL_UART_STATE_BUSY_RX = 0x22U
+} HAL_UART_StateTypeDef;
+
+typedef struct
+{
+	volatile HAL_UART_StateTypeDef RxState;
+	DMA_HandleTypeDef *hdmarx;
+} UART_HandleTypeDef;
+
+typedef struct
+{
+	uint32_t id;
+} SPI_HandleTypeDef;
+
+typedef struct
+{
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+} SysTick_Type;
+
+extern SysTick_Type vhal_systick;
+#define SysTick (&vhal_systick)
+
+void __disable_irq(void);
+void __enable_irq(void);
+
+// only EXTI0_1 (the RF IRQ) can be masked, EXTI latches nothing the NVIC does not
+#define __HAL_GPIO_EXTI_CLEAR_IT(pin) ((void)(pin))
+void HAL_NVIC_EnableIRQ(IRQn_Type irq);
+void HAL_NVIC_DisableIRQ(IRQn_Type irq);
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type irq);
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t delay);
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *tx, uint8_t *rx, uint16_t size,
+										  uint32_t timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_SIM_STM32F0XX_HAL_H
@@ -0,0 +1,169 @@
+//
+// Parameter sweeps, see sweep.h
+//
+#include "sweep.h"
+
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace netsim
+{
+
+namespace
+{
+
+// one worker's share, the owner takes from the front, thieves from the back
+struct JobQueue
+{
+	std::mutex mutex;
+	std::deque<size_t> jobs;
+};
+
+bool take(std::vector<JobQueue> &queues, unsigned self, size_t &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(queues[self].mutex);
+		if (!queues[self].jobs.empty())
+		{
+			job = queues[self].jobs.front();
+			queues[self].jobs.pop_front();
+			return true;
+		}
+	}
+	// nothing is ever added, so one empty round means the sweep is done
+	for (size_t i = 1; i < queues.size(); i++)
+	{
+		JobQueue &victim = queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		if (!victim.jobs.empty())
+		{
+			job = victim.jobs.back();
+			victim.jobs.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+Sweep::Sweep(std::string tmpl, std::vector<SweepVar> vars, uint32_t replicas, std::string lib)
+	: tmpl_(std::move(tmpl)), vars_(std::move(vars)), lib_(std::move(lib))
+{
+	std::vector<size_t> at(vars_.size(), 0);
+
+	// the last variable counts fastest, replicas of one combination stay next to each other
+	for (;;)
+	{
+		SweepJob job;
+		size_t v;
+
+		for (size_t i = 0; i < vars_.size(); i++)
+		{
+			job.values.push_back(vars_[i].values[at[i]]);
+		}
+		for (uint32_t r = 0; r < replicas; r++)
+		{
+			job.replica = r;
+			jobs_.push_back(job);
+		}
+		for (v = vars_.size(); v > 0; v--)
+		{
+			if (++at[v - 1] < vars_[v - 1].values.size())
+			{
+				break;
+			}
+			at[v - 1] = 0;
+		}
+		if (v == 0)
+		{
+			break;
+		}
+	}
+}
+
+void Sweep::set_seed(uint32_t seed)
+{
+	seed_set_ = true;
+	seed_ = seed;
+}
+
+void Sweep::set_duration(double seconds)
+{
+	duration_s_ = seconds;
+}
+
+std::string Sweep::expand(const SweepJob &job) const
+{
+	std::string out = tmpl_;
+
+	for (size_t i = 0; i < vars_.size(); i++)
+	{
+		std::string key = "${" + vars_[i].name + "}";
+
+		for (size_t pos = out.find(key); pos != std::string::npos; pos = out.find(key, pos))
+		{
+			out.replace(pos, key.size(), job.values[i]);
+			pos += job.values[i].size();
+		}
+	}
+	return out;
+}
+
+SweepRow Sweep::run_one(const SweepJob &job) const
+{
+	std::istringstream in(expand(job));
+	Scenario sc;
+	SweepRow row;
+
+	if (!sc.parse(in, row.error))
+	{
+		return row;
+	}
+	sc.seed = (seed_set_ ? seed_ : sc.seed) + job.replica;
+	if (duration_s_ > 0)
+	{
+		sc.duration_s = duration_s_;
+	}
+	row.seed = sc.seed;
+
+	Network net(sc);
+	if (net.load(lib_, row.error))
+	{
+		row.res = net.run();
+	}
+	return row;
+}
+
+std::vector<SweepRow> Sweep::run(unsigned threads) const
+{
+	std::vector<SweepRow> rows(jobs_.size());
+	std::vector<JobQueue> queues(threads ? threads : 1);
+	std::vector<std::thread> workers;
+
+	for (size_t i = 0; i < jobs_.size(); i++)
+	{
+		queues[i * queues.size() / jobs_.size()].jobs.push_back(i);
+	}
+	for (unsigned w = 0; w < queues.size(); w++)
+	{
+		workers.emplace_back([this, &queues, &rows, w] {
+			size_t job;
+
+			while (take(queues, w, job))
+			{
+				rows[job] = run_one(jobs_[job]);
+			}
+		});
+	}
+	for (auto &t : workers)
+	{
+		t.join();
+	}
+	return rows;
+}
+
+} // namespace netsim
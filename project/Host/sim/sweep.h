@@ -0,0 +1,77 @@
+//
+// Parameter sweeps over network simulator scenarios (netsim.h) on all cores.
+//
+// The scenario is a template: ${name} is replaced by the swept variable's value. Every
+// combination of values, times every replica (seed, seed + 1, ...), is one independent run.
+// Runs are dealt out to the worker threads in contiguous blocks and a worker whose block ran dry
+// steals from the far end of another's, so a few expensive dense configurations do not leave the
+// other cores idle. Rows come back in job order and every run only depends on its own scenario
+// and seed, so the output is the same for any thread count.
+//
+#ifndef HOST_SIM_SWEEP_H
+#define HOST_SIM_SWEEP_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "netsim.h"
+
+namespace netsim
+{
+
+struct SweepVar
+{
+	std::string name;
+	std::vector<std::string> values;
+};
+
+struct SweepJob
+{
+	std::vector<std::string> values;	// one per SweepVar
+	uint32_t replica = 0;
+};
+
+struct SweepRow
+{
+	uint32_t seed = 0;
+	Results res;
+	std::string error;				// empty when the run went through
+};
+
+class Sweep
+{
+public:
+	Sweep(std::string tmpl, std::vector<SweepVar> vars, uint32_t replicas, std::string lib);
+
+	// seed of replica 0 instead of the scenario's, and the duration instead of the scenario's
+	void set_seed(uint32_t seed);
+	void set_duration(double seconds);
+
+	const std::vector<SweepVar> &vars() const
+	{
+		return vars_;
+	}
+	const std::vector<SweepJob> &jobs() const
+	{
+		return jobs_;
+	}
+
+	std::string expand(const SweepJob &job) const;
+	SweepRow run_one(const SweepJob &job) const;
+	std::vector<SweepRow> run(unsigned threads) const;
+
+private:
+	std::string tmpl_;
+	std::vector<SweepVar> vars_;
+	std::string lib_;
+	std::vector<SweepJob> jobs_;
+	bool seed_set_ = false;
+	uint32_t seed_ = 0;
+	double duration_s_ = 0;
+};
+
+} // namespace netsim
+
+#endif // HOST_SIM_SWEEP_H
@@ -0,0 +1,363 @@
+//
+// Virtual clock and HAL, see vhal.h
+//
+#include "vhal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "radio.h"
+#include "spi.h"
+#include "usart.h"
+
+#define VHAL_IRQ_RF 0x01
+#define VHAL_IRQ_UART_TX 0x02
+
+GPIO_TypeDef vhal_gpioa = {0}, vhal_gpiob = {1};
+SysTick_Type vhal_systick;
+SPI_HandleTypeDef hspi2;
+UART_HandleTypeDef huart1;
+
+static DMA_Channel_TypeDef vhal_dma_ch3;
+static DMA_HandleTypeDef hdma_usart1_rx = {&vhal_dma_ch3};
+
+static struct
+{
+	uint64_t now_ns;
+	vpan_t *radio;
+	uint64_t poll_ns;
+	uint32_t spi_byte_ns;
+	uint32_t uart_byte_ns;
+	vhal_wait_hook_t wait_hook;
+	void *wait_ctx;
+	vhal_uart_sink_t uart_sink;
+	void *uart_ctx;
+	uint64_t uart_done_ns;
+	uint8_t *uart_rx_buf;
+	uint16_t uart_rx_size;
+	uint8_t irq_line;
+	uint8_t irq_pending;
+	uint8_t primask;
+	uint8_t rf_masked;			// EXTI0_1 disabled in the NVIC
+	uint8_t in_isr;
+	uint8_t woken;
+	uint8_t spinning;			// nothing but HAL_GetTick since the last HAL_GetTick
+	vhal_stats_t stats;
+} vhal;
+
+static void vhal_set_now(uint64_t ns)
+{
+	uint64_t cycles = (ns % 1000000ULL) * (VHAL_CPU_HZ / 1000000UL) / 1000ULL;
+
+	vhal.now_ns = ns;
+	vhal_systick.VAL = vhal_systick.LOAD - (uint32_t)cycles;
+}
+
+// EXTI on the rising edge of the RF IRQ pin
+static void vhal_sample_irq(void)
+{
+	uint8_t line;
+
+	if (vhal.radio == NULL)
+	{
+		return;
+	}
+	line = vpan_irq_line(vhal.radio);
+	if (line && !vhal.irq_line)
+	{
+		vhal.irq_pending |= VHAL_IRQ_RF;
+		if (vhal.primask || vhal.rf_masked || vhal.in_isr || vhal.radio->cs_low)
+		{
+			vhal.stats.rf_irqs_deferred++;
+		}
+	}
+	vhal.irq_line = line;
+}
+
+// runs what the NVIC would run now
+static void vhal_dispatch(void)
+{
+	vhal_sample_irq();
+	while (vhal.irq_pending != 0 && !vhal.primask && !vhal.in_isr)
+	{
+		if (vhal.irq_pending & VHAL_IRQ_UART_TX)
+		{
+			vhal.irq_pending &= ~VHAL_IRQ_UART_TX;
+			vhal.in_isr = 1;
+			HAL_UART_TxCpltCallback(&huart1);
+		}
+		else if ((vhal.irq_pending & VHAL_IRQ_RF) && !vhal.rf_masked && !vhal.radio->cs_low)
+		{
+			vhal.irq_pending &= ~VHAL_IRQ_RF;
+			vhal.stats.rf_irqs++;
+			vhal.in_isr = 1;
+			rf_irq_handler();
+		}
+		else
+		{
+			break;
+		}
+		vhal.in_isr = 0;
+		vhal.woken = 1;
+		vhal.spinning = 0;
+		vhal_sample_irq();
+	}
+}
+
+static void vhal_advance(uint64_t ns, uint8_t wfi)
+{
+	vhal.woken = 0;
+	while (ns > vhal.now_ns && !(wfi && vhal.woken))
+	{
+		uint64_t next = ns;
+
+		if (vhal.radio != NULL && vpan_next_event(vhal.radio) < next)
+		{
+			next = vpan_next_event(vhal.radio);
+		}
+		if (vhal.uart_done_ns < next)
+		{
+			next = vhal.uart_done_ns;
+		}
+		if (vhal.wait_hook != NULL)
+		{
+			next = vhal.wait_hook(next, vhal.wait_ctx);
+		}
+		vhal_set_now(next > vhal.now_ns ? next : vhal.now_ns);
+		if (vhal.radio != NULL)
+		{
+			vpan_advance(vhal.radio, vhal.now_ns);
+		}
+		if (vhal.uart_done_ns <= vhal.now_ns)
+		{
+			vhal.uart_done_ns = VPAN_NEVER;
+			vhal.irq_pending |= VHAL_IRQ_UART_TX;
+		}
+		vhal_dispatch();
+	}
+}
+
+void vhal_run_until(uint64_t ns)
+{
+	vhal_advance(ns, 0);
+}
+
+void vhal_sleep_until(uint64_t ns)
+{
+	vhal.spinning = 0;
+	vhal_advance(ns, 1);
+}
+
+void vhal_init(vpan_t *radio)
+{
+	memset(&vhal, 0, sizeof(vhal));
+	vhal.radio = radio;
+	vpan_select(radio);
+	vhal.uart_done_ns = VPAN_NEVER;
+	vhal.poll_ns = VHAL_POLL_NS;
+	vhal_set_spi_hz(VHAL_SPI_HZ);
+	vhal_set_uart(VHAL_UART_BAUD, NULL, NULL);
+	huart1.RxState = HAL_UART_STATE_READY;
+	huart1.hdmarx = &hdma_usart1_rx;
+	vhal_dma_ch3.CNDTR = 0;
+	vhal_systick.LOAD = VHAL_CPU_HZ / 1000 - 1;
+	vhal_set_now(0);
+}
+
+void vhal_set_poll(uint64_t ns)
+{
+	vhal.poll_ns = ns;
+}
+
+void vhal_set_spi_hz(uint32_t hz)
+{
+	vhal.spi_byte_ns = (uint32_t)(8000000000ULL / hz);
+}
+
+void vhal_set_uart(uint32_t baud, vhal_uart_sink_t sink, void *ctx)
+{
+	vhal.uart_byte_ns = (uint32_t)(10000000000ULL / baud);
+	vhal.uart_sink = sink;
+	vhal.uart_ctx = ctx;
+}
+
+void vhal_set_wait_hook(vhal_wait_hook_t hook, void *ctx)
+{
+	vhal.wait_hook = hook;
+	vhal.wait_ctx = ctx;
+}
+
+uint64_t vhal_now_ns(void)
+{
+	return vhal.now_ns;
+}
+
+const vhal_stats_t *vhal_get_stats(void)
+{
+	return &vhal.stats;
+}
+
+// bytes arriving on USART1 RX, written where the circular DMA would put them
+uint32_t vhal_uart_rx(const uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	if (huart1.RxState != HAL_UART_STATE_BUSY_RX || vhal.uart_rx_buf == NULL)
+	{
+		vhal.stats.uart_rx_dropped += len;
+		return 0;
+	}
+	for (i = 0; i < len; i++)
+	{
+		vhal.uart_rx_buf[vhal.uart_rx_size - vhal_dma_ch3.CNDTR] = data[i];
+		vhal_dma_ch3.CNDTR = (vhal_dma_ch3.CNDTR > 1) ? vhal_dma_ch3.CNDTR - 1 : vhal.uart_rx_size;
+	}
+	vhal.stats.uart_rx_bytes += len;
+	return len;
+}
+
+void __disable_irq(void)
+{
+	vhal.primask = 1;
+}
+
+void __enable_irq(void)
+{
+	vhal.primask = 0;
+	vhal_dispatch();
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq)
+{
+	if (irq == EXTI0_1_IRQn)
+	{
+		vhal.rf_masked = 0;
+		vhal_dispatch();
+	}
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type irq)
+{
+	if (irq == EXTI0_1_IRQn)
+	{
+		vhal.rf_masked = 1;
+	}
+}
+
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+	if (irq == EXTI0_1_IRQn)
+	{
+		vhal.irq_pending &= ~VHAL_IRQ_RF;
+	}
+}
+
+uint32_t HAL_GetTick(void)
+{
+	uint64_t start = vhal.now_ns;
+
+	if (vhal.poll_ns == VHAL_POLL_IDLE && vhal.spinning)
+	{
+		vhal_advance((vhal.now_ns / 1000000ULL + 1) * 1000000ULL, 1);
+	}
+	else
+	{
+		vhal_advance(vhal.now_ns + (vhal.poll_ns ? vhal.poll_ns : VHAL_POLL_NS), 0);
+	}
+	vhal.spinning = 1;
+	vhal.stats.poll_ns += vhal.now_ns - start;
+	return (uint32_t)(vhal.now_ns / 1000000ULL);
+}
+
+// returns on the (delay + 1)th tick boundary, as the HAL's wait loop does
+void HAL_Delay(uint32_t delay)
+{
+	uint64_t start = vhal.now_ns;
+
+	vhal.spinning = 0;
+	vhal_run_until((vhal.now_ns / 1000000ULL + delay + 1) * 1000000ULL);
+	vhal.stats.delay_ns += vhal.now_ns - start;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+	vhal.spinning = 0;
+	if (port == RF_NSS_GPIO_Port && pin == RF_NSS_Pin)
+	{
+		vpan_cs(state == GPIO_PIN_SET, vhal.now_ns);
+		vhal_dispatch();
+	}
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin)
+{
+	vhal.spinning = 0;
+	if (port == RF_IRQ_GPIO_Port && pin == RF_IRQ_Pin && vhal.radio != NULL)
+	{
+		return vpan_irq_line(vhal.radio) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+	}
+	return GPIO_PIN_RESET;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *tx, uint8_t *rx, uint16_t size,
+										  uint32_t timeout)
+{
+	uint16_t i;
+
+	(void)hspi;
+	(void)timeout;
+	vhal.spinning = 0;
+	for (i = 0; i < size; i++)
+	{
+		vhal_run_until(vhal.now_ns + vhal.spi_byte_ns);
+		vhal.stats.spi_ns += vhal.spi_byte_ns;
+		rx[i] = vpan_spi_xfer(tx[i], vhal.now_ns);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size)
+{
+	if (huart != &huart1 || vhal.uart_done_ns != VPAN_NEVER || size == 0)
+	{
+		return HAL_BUSY;
+	}
+	if (vhal.uart_sink != NULL)
+	{
+		vhal.uart_sink(data, size, vhal.uart_ctx);
+	}
+	vhal.stats.uart_tx_dmas++;
+	vhal.stats.uart_tx_bytes += size;
+	vhal.uart_done_ns = vhal.now_ns + (uint64_t)size * vhal.uart_byte_ns;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size)
+{
+	if (huart != &huart1 || size == 0)
+	{
+		return HAL_ERROR;
+	}
+	vhal.uart_rx_buf = data;
+	vhal.uart_rx_size = size;
+	vhal_dma_ch3.CNDTR = size;
+	huart1.RxState = HAL_UART_STATE_BUSY_RX;
+	return HAL_OK;
+}
+
+__weak void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	(void)huart;
+}
+
+void LedToggle(void)
+{
+}
+
+void Error_Handler(void)
+{
+	fprintf(stderr, "Error_Handler at %llu ns\n", (unsigned long long)vhal.now_ns);
+	abort();
+}
@@ -0,0 +1,74 @@
+//
+// Virtual clock and HAL for the host simulation build.
+//
+// Time only moves when the firmware waits: HAL_GetTick costs one poll step (so busy-wait loops
+// terminate), HAL_Delay jumps to the tick the real HAL would return on, every SPI byte costs its
+// bit time at the configured clock and a UART DMA transfer completes after its bit time at the
+// configured baud rate. Radio events of the selected vpan_t fire at their exact time.
+// Interrupts behave like on the M0: the RF IRQ pin is edge triggered into rf_irq_handler, the UART
+// TX complete into HAL_UART_TxCpltCallback, both held off by __disable_irq, while another handler
+// runs and (for the RF IRQ) while the SPI chip select is low, since that is the driver's own bus.
+// A busy-wait loop can only see the tick change or an interrupt's side effects, so with
+// vhal_set_poll(VHAL_POLL_IDLE) a HAL_GetTick that follows another one with no other HAL call in
+// between skips straight to whichever comes first; that keeps waiting cheap for the network
+// simulator but makes SysTick->VAL based cycle counts meaningless.
+// vhal_sleep_until is the __WFI of a main loop that has nothing to do until the next interrupt.
+// With a wait hook installed the clock only moves as far as the hook allows, which is how the
+// network simulator (rf_node.h) keeps many firmware instances in step.
+//
+#ifndef HOST_SIM_VHAL_H
+#define HOST_SIM_VHAL_H
+
+#include <stdint.h>
+
+#include "vpan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VHAL_SPI_HZ 6000000UL		// SPI2 at PCLK / 8
+#define VHAL_UART_BAUD 115200UL
+#define VHAL_POLL_NS 1000ULL		// cost of one HAL_GetTick call
+#define VHAL_POLL_IDLE 0			// a spinning HAL_GetTick sleeps to the next tick or interrupt instead
+#define VHAL_CPU_HZ 48000000UL		// SysTick reload follows from it
+
+// lets a scheduler hold the clock back, returns the time the firmware may advance to (at most want_ns)
+typedef uint64_t (*vhal_wait_hook_t)(uint64_t want_ns, void *ctx);
+
+// bytes the firmware puts on USART1
+typedef void (*vhal_uart_sink_t)(const uint8_t *data, uint16_t len, void *ctx);
+
+typedef struct
+{
+	uint32_t rf_irqs;
+	uint32_t rf_irqs_deferred;	// edge seen while masked, in a handler or with CS low
+	uint32_t uart_tx_dmas;
+	uint64_t uart_tx_bytes;
+	uint64_t uart_rx_bytes;
+	uint32_t uart_rx_dropped;	// fed while RX DMA was not running
+	uint64_t delay_ns;			// time spent in HAL_Delay
+	uint64_t poll_ns;			// time spent in HAL_GetTick
+	uint64_t spi_ns;			// time spent on the SPI bus
+} vhal_stats_t;
+
+void vhal_init(vpan_t *radio);
+void vhal_set_spi_hz(uint32_t hz);
+void vhal_set_uart(uint32_t baud, vhal_uart_sink_t sink, void *ctx);
+
+void vhal_set_wait_hook(vhal_wait_hook_t hook, void *ctx);
+void vhal_set_poll(uint64_t ns);
+
+uint64_t vhal_now_ns(void);
+void vhal_run_until(uint64_t ns);
+void vhal_sleep_until(uint64_t ns);
+
+uint32_t vhal_uart_rx(const uint8_t *data, uint32_t len);
+
+const vhal_stats_t *vhal_get_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_SIM_VHAL_H
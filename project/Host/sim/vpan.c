@@ -0,0 +1,358 @@
+//
+// Virtual PAN3031, see vpan.h
+//
+#include "vpan.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "pan3031.h"
+
+#define VPAN_REG_IRQ 0x6C		 // page 0, IRQ status
+#define VPAN_REG_MODE_CFG 0x06	 // page 3, bit 2 TX mode, bits 1:0 RX mode
+#define VPAN_REG_TIMEOUT_L 0x07	 // page 3, RX timeout in ms
+#define VPAN_REG_TIMEOUT_H 0x08
+#define VPAN_REG_BW_CR 0x0d		 // page 3, bits 7:4 BW, bits 3:1 CR
+#define VPAN_REG_SF_CRC 0x0e	 // page 3, bits 7:4 SF, bit 3 CRC
+#define VPAN_REG_SIG_POW 0x74	 // page 1, 24 bits
+#define VPAN_REG_SF_RX 0x7c		 // page 1, bits 7:4 SF of the last packet
+#define VPAN_REG_RX_LEN 0x7d	 // page 1
+#define VPAN_REG_RSSI 0x7e		 // page 1, dBm + 256
+#define VPAN_REG_NOISE_POW 0x71	 // page 2, 24 bits
+#define VPAN_REG_GPIO_OE_H 0x66	 // page 0, GPIO 8..15 output enable
+#define VPAN_REG_CAD 0x0f		 // page 1, 0x15 with CAD on
+#define VPAN_REG_FREQ 0x09		 // page 3, 32 bits in Hz
+#define VPAN_REG_TX_POWER 0x63	 // page 1, bits 2:0 first PA stage, bits 7:4 second
+
+static vpan_t *vpan_cur = NULL;
+
+static uint8_t *vpan_reg(vpan_t *v, uint8_t addr)
+{
+	uint8_t page = (addr < VPAN_GLOBAL_REGS) ? 0 : (v->regs[0][REG_SYS_CTL] & 0x03);
+
+	return &v->regs[page][addr & (VPAN_REGS - 1)];
+}
+
+void vpan_init(vpan_t *v)
+{
+	memset(v, 0, sizeof(*v));
+	v->mode = PAN3031_MODE_DEEP_SLEEP;
+	v->history[0].mode = v->mode;
+	v->regs[0][REG_OP_MODE] = v->mode;
+	v->tx_done_ns = VPAN_NEVER;
+	v->rx_timeout_ns = VPAN_NEVER;
+}
+
+// every mode change goes through here so the time per mode adds up
+static void vpan_enter(vpan_t *v, uint8_t mode, uint64_t now_ns)
+{
+	vpan_mode_rec_t *rec = &v->history[++v->history_n % VPAN_HISTORY];
+
+	vpan_sync_mode_time(v, now_ns);
+	v->mode = mode;
+	v->regs[0][REG_OP_MODE] = mode;
+	rec->since_ns = now_ns;
+	rec->mode = mode;
+	rec->rx_epoch = v->rx_epoch;
+}
+
+// returns 0 when at_ns is older than the history reaches
+uint8_t vpan_mode_at(const vpan_t *v, uint64_t at_ns, uint8_t *mode, uint32_t *rx_epoch)
+{
+	uint32_t i;
+
+	for (i = 0; i < VPAN_HISTORY && i <= v->history_n; i++)
+	{
+		const vpan_mode_rec_t *rec = &v->history[(v->history_n - i) % VPAN_HISTORY];
+
+		if (rec->since_ns <= at_ns)
+		{
+			*mode = rec->mode;
+			*rx_epoch = rec->rx_epoch;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void vpan_sync_mode_time(vpan_t *v, uint64_t now_ns)
+{
+	if (now_ns > v->mode_since_ns)
+	{
+		v->stats.mode_ns[v->mode & 7] += now_ns - v->mode_since_ns;
+		v->mode_since_ns = now_ns;
+	}
+}
+
+void vpan_select(vpan_t *v)
+{
+	vpan_cur = v;
+}
+
+vpan_t *vpan_current(void)
+{
+	return vpan_cur;
+}
+
+uint8_t vpan_get_reg(const vpan_t *v, uint8_t page, uint8_t addr)
+{
+	return (addr < VPAN_GLOBAL_REGS) ? v->regs[0][addr] : v->regs[page & 3][addr & (VPAN_REGS - 1)];
+}
+
+void vpan_set_tx_hook(vpan_t *v, vpan_tx_hook_t hook, void *ctx)
+{
+	v->tx_hook = hook;
+	v->tx_ctx = ctx;
+}
+
+// same symbol count as PAN3031_calculate_tx_time, without its 5 ms guard
+uint32_t vpan_airtime_us(const vpan_t *v, uint8_t len)
+{
+	uint8_t bw_cr = v->regs[3][VPAN_REG_BW_CR];
+	uint8_t sf_crc = v->regs[3][VPAN_REG_SF_CRC];
+	uint32_t sf = sf_crc >> 4, crc = (sf_crc >> 3) & 1, cr = (bw_cr >> 1) & 7;
+	uint32_t bw_hz = 125000, b = 0;
+	int32_t a;
+
+	switch (bw_cr >> 4)
+	{
+		case 6: bw_hz = 62500; break;
+		case 8: bw_hz = 250000; break;
+		case 9: bw_hz = 500000; break;
+		default: break;
+	}
+	if (sf < 5)
+	{
+		sf = 5;
+	}
+	a = 8 * len - 4 * (int32_t)sf + 28 + 16 * crc;
+	if (a > 0)
+	{
+		b = (a + 4 * sf - 1) / (4 * sf);
+	}
+	return (uint32_t)((2025ULL + 100ULL * b * (cr + 4)) * (1ULL << sf) * 10000ULL / bw_hz);
+}
+
+static void vpan_set_mode(vpan_t *v, uint8_t mode, uint64_t now_ns)
+{
+	uint32_t timeout_ms;
+
+	// any mode write ends what the radio was doing
+	v->tx_done_ns = VPAN_NEVER;
+	v->rx_timeout_ns = VPAN_NEVER;
+	v->rx_epoch++;
+	vpan_enter(v, mode, now_ns);
+	if (mode == PAN3031_MODE_TX)
+	{
+		v->tx_fill = 0;
+	}
+	if (mode == PAN3031_MODE_RX && (v->regs[3][VPAN_REG_MODE_CFG] & 0x03) == PAN3031_RX_SINGLE_TIMEOUT)
+	{
+		timeout_ms = v->regs[3][VPAN_REG_TIMEOUT_L] | (v->regs[3][VPAN_REG_TIMEOUT_H] << 8);
+		v->rx_timeout_ns = now_ns + timeout_ms * 1000000ULL;
+	}
+}
+
+static void vpan_start_tx(vpan_t *v, uint64_t now_ns)
+{
+	uint8_t len = v->regs[1][REG_PAYLOAD_LEN];
+	uint32_t airtime = vpan_airtime_us(v, len);
+
+	v->tx_done_ns = now_ns + airtime * 1000ULL;
+	v->stats.tx_packets++;
+	if (v->tx_hook != NULL)
+	{
+		v->tx_hook(v->tx_fifo, len, now_ns, airtime, v->tx_ctx);
+	}
+	v->tx_fill = 0;
+}
+
+static void vpan_write(vpan_t *v, uint8_t addr, uint8_t value, uint64_t now_ns)
+{
+	uint8_t *reg = vpan_reg(v, addr);
+
+	v->stats.reg_writes++;
+	if (addr == REG_SYS_CTL && ((*reg ^ value) & 0x03) != 0)
+	{
+		v->stats.page_switches++;
+	}
+	if (addr == REG_OP_MODE)
+	{
+		vpan_set_mode(v, value, now_ns);
+		return;
+	}
+	if (addr >= VPAN_GLOBAL_REGS && (v->regs[0][REG_SYS_CTL] & 0x03) == 0 && addr == VPAN_REG_IRQ)
+	{
+		*reg &= ~value;
+		return;
+	}
+	*reg = value;
+}
+
+uint8_t vpan_spi_xfer(uint8_t mosi, uint64_t now_ns)
+{
+	vpan_t *v = vpan_cur;
+	uint8_t miso = 0;
+
+	if (v == NULL || !v->cs_low)
+	{
+		return 0xFF;
+	}
+	v->stats.spi_bytes++;
+	if (v->bytes++ == 0)
+	{
+		v->addr = mosi >> 1;
+		v->write = mosi & 1;
+		return 0;
+	}
+	if (v->addr == REG_FIFO_ACC_ADDR)
+	{
+		v->stats.fifo_bytes++;
+		if (v->write)
+		{
+			if (v->tx_fill < VPAN_FIFO)
+			{
+				v->tx_fifo[v->tx_fill++] = mosi;
+			}
+			v->fifo_written = 1;
+		}
+		else if (v->rx_pos < v->rx_len)
+		{
+			miso = v->rx_fifo[v->rx_pos++];
+		}
+		return miso;
+	}
+	// one register per transaction, further bytes go to the same register
+	if (v->write)
+	{
+		vpan_write(v, v->addr, mosi, now_ns);
+		return 0;
+	}
+	v->stats.reg_reads++;
+	return *vpan_reg(v, v->addr);
+}
+
+void vpan_cs(uint8_t high, uint64_t now_ns)
+{
+	vpan_t *v = vpan_cur;
+
+	if (v == NULL || high == !v->cs_low)
+	{
+		return;
+	}
+	if (!high)
+	{
+		v->cs_low = 1;
+		v->bytes = 0;
+		v->fifo_written = 0;
+		v->stats.transactions++;
+		return;
+	}
+	v->cs_low = 0;
+	// the packet goes out once the FIFO holds the payload length
+	if (v->fifo_written && v->mode == PAN3031_MODE_TX && v->tx_done_ns == VPAN_NEVER &&
+		v->tx_fill >= v->regs[1][REG_PAYLOAD_LEN])
+	{
+		vpan_start_tx(v, now_ns);
+	}
+}
+
+uint64_t vpan_next_event(const vpan_t *v)
+{
+	return (v->tx_done_ns < v->rx_timeout_ns) ? v->tx_done_ns : v->rx_timeout_ns;
+}
+
+void vpan_advance(vpan_t *v, uint64_t now_ns)
+{
+	if (v->tx_done_ns <= now_ns)
+	{
+		v->tx_done_ns = VPAN_NEVER;
+		v->regs[0][VPAN_REG_IRQ] |= REG_IRQ_TX_DONE;
+		// continuous TX waits in TX for the next payload
+		if (((v->regs[3][VPAN_REG_MODE_CFG] >> 2) & 1) == PAN3031_TX_SINGLE)
+		{
+			vpan_enter(v, PAN3031_MODE_STB3, now_ns);
+		}
+	}
+	if (v->rx_timeout_ns <= now_ns)
+	{
+		v->rx_timeout_ns = VPAN_NEVER;
+		v->regs[0][VPAN_REG_IRQ] |= REG_IRQ_RX_TIMEOUT;
+		vpan_enter(v, PAN3031_MODE_STB3, now_ns);
+	}
+}
+
+uint8_t vpan_irq_line(const vpan_t *v)
+{
+	return (v->regs[0][VPAN_REG_IRQ] & 0x1F) != 0;
+}
+
+static void vpan_put24(uint8_t *reg, uint32_t value)
+{
+	reg[0] = (uint8_t)value;
+	reg[1] = (uint8_t)(value >> 8);
+	reg[2] = (uint8_t)(value >> 16);
+}
+
+// a packet from the air, the caller decides whether it was heard at all
+uint32_t vpan_rx_packet(vpan_t *v, const uint8_t *payload, uint8_t len, int16_t rssi_cdb, int16_t snr_cdb,
+						uint8_t crc_ok, uint64_t now_ns)
+{
+	uint32_t sf = v->regs[3][VPAN_REG_SF_CRC] >> 4;
+	double ratio = pow(10.0, snr_cdb / 1000.0) * (double)(1UL << sf);
+	uint32_t noise = 1UL << 12, sig;
+	long rssi_dbm = lround(rssi_cdb / 100.0) + 256;
+
+	if (v->mode != PAN3031_MODE_RX || (v->regs[0][VPAN_REG_IRQ] & (REG_IRQ_RX_DONE | REG_IRQ_CRC_ERR)) != 0)
+	{
+		v->stats.rx_dropped++;
+		return 0;
+	}
+	v->stats.rx_packets++;
+	memcpy(v->rx_fifo, payload, len);
+	v->rx_len = len;
+	v->rx_pos = 0;
+	v->regs[1][VPAN_REG_RX_LEN] = len;
+
+	// sig / 2^sf / noise gives the SNR, both powers have to fit 24 bits
+	while (noise > 1 && ratio * noise >= (double)(1UL << 24))
+	{
+		noise >>= 1;
+	}
+	sig = (uint32_t)(ratio * noise + 0.5);
+	vpan_put24(&v->regs[1][VPAN_REG_SIG_POW], sig < (1UL << 24) ? sig : (1UL << 24) - 1);
+	vpan_put24(&v->regs[2][VPAN_REG_NOISE_POW], noise);
+	v->regs[1][VPAN_REG_SF_RX] = (uint8_t)((sf << 4) | (v->regs[1][VPAN_REG_SF_RX] & 0x0F));
+	v->regs[1][VPAN_REG_RSSI] = (uint8_t)(rssi_dbm < 0 ? 0 : rssi_dbm > 255 ? 255 : rssi_dbm);
+
+	v->regs[0][VPAN_REG_IRQ] |= crc_ok ? REG_IRQ_RX_DONE : REG_IRQ_CRC_ERR;
+	if ((v->regs[3][VPAN_REG_MODE_CFG] & 0x03) != PAN3031_RX_CONTINOUS)
+	{
+		v->rx_timeout_ns = VPAN_NEVER;
+		vpan_enter(v, PAN3031_MODE_STB3, now_ns);
+	}
+	return 1;
+}
+
+// the TX power code to dBm is approximate: the first PA stage in 2 dB steps up to the second
+// stage, which adds 1 dB per step up to 20 dBm at 0x7F
+void vpan_get_modem(const vpan_t *v, vpan_modem_t *m)
+{
+	const uint8_t *p3 = v->regs[3];
+	uint8_t pa = v->regs[1][VPAN_REG_TX_POWER];
+
+	m->freq_hz = p3[VPAN_REG_FREQ] | (p3[VPAN_REG_FREQ + 1] << 8) | (p3[VPAN_REG_FREQ + 2] << 16) |
+				 ((uint32_t)p3[VPAN_REG_FREQ + 3] << 24);
+	switch (p3[VPAN_REG_BW_CR] >> 4)
+	{
+		case 6: m->bw_hz = 62500; break;
+		case 8: m->bw_hz = 250000; break;
+		case 9: m->bw_hz = 500000; break;
+		default: m->bw_hz = 125000; break;
+	}
+	m->sf = p3[VPAN_REG_SF_CRC] >> 4;
+	m->cr = (p3[VPAN_REG_BW_CR] >> 1) & 7;
+	m->crc = (p3[VPAN_REG_SF_CRC] >> 3) & 1;
+	m->cad = v->regs[1][VPAN_REG_CAD] == 0x15 && (v->regs[0][VPAN_REG_GPIO_OE_H] & (1 << (MODULE_GPIO_CAD_IRQ - 8)));
+	m->power_cdbm = ((pa & 7) < 7) ? (int16_t)(-400 + 200 * (pa & 7)) : (int16_t)(500 + 100 * (pa >> 4));
+}
@@ -0,0 +1,120 @@
+//
+// Virtual PAN3031: a register-level model of the radio behind rf_port's SPI bus.
+//
+// Models the four register pages (page select in REG_SYS_CTL, 0x00..0x04 shared by all pages),
+// the mode register and its transitions, the TX and RX FIFO behind REG_FIFO_ACC_ADDR, the IRQ
+// status register 0x6C (write 1 to clear) and timed events: TX done after the LoRa airtime of the
+// configured SF/BW/CR/CRC, RX timeout after the page 3 timeout. Received packets are pushed in
+// with vpan_rx_packet, the SNR and RSSI registers are set so the driver reads the given values back
+// (below 6 dB SNR the driver derives RSSI from SNR, as on the chip).
+// The last few mode changes are kept, so a simulator that let this radio's clock run ahead can
+// still ask what it was doing a moment ago (vpan_mode_at).
+// One vpan_t per simulated radio, vpan_select picks the one the SPI bus talks to.
+//
+#ifndef HOST_SIM_VPAN_H
+#define HOST_SIM_VPAN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VPAN_PAGES 4
+#define VPAN_REGS 128
+#define VPAN_GLOBAL_REGS 5
+#define VPAN_FIFO 256
+#define VPAN_NEVER UINT64_MAX
+#define VPAN_HISTORY 8
+// shortest packet vpan_airtime_us gives for the driver's settings: no payload, SF7, 500 kHz, CR 4/5
+#define VPAN_MIN_AIRTIME_US 5184
+
+typedef struct
+{
+	uint64_t spi_bytes;
+	uint32_t transactions;		// CS low to CS high
+	uint32_t page_switches;		// REG_SYS_CTL writes that changed the page
+	uint32_t reg_reads;
+	uint32_t reg_writes;
+	uint32_t fifo_bytes;
+	uint32_t tx_packets;
+	uint32_t rx_packets;
+	uint32_t rx_dropped;		// not in RX, or the last packet not read yet
+	uint64_t mode_ns[8];		// time spent in each PAN3031_MODE_*, up to the last mode change
+} vpan_stats_t;
+
+// modem settings as the registers hold them
+typedef struct
+{
+	uint32_t freq_hz;
+	uint32_t bw_hz;
+	uint8_t sf;
+	uint8_t cr;					// CODE_RATE_45..CODE_RATE_48
+	uint8_t crc;
+	uint8_t cad;				// CAD output on GPIO11 enabled
+	int16_t power_cdbm;
+} vpan_modem_t;
+
+// one mode change, and the rx_epoch from then on
+typedef struct
+{
+	uint64_t since_ns;
+	uint8_t mode;
+	uint32_t rx_epoch;
+} vpan_mode_rec_t;
+
+// called when a packet leaves the antenna, before its TX done
+typedef void (*vpan_tx_hook_t)(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx);
+
+typedef struct
+{
+	uint8_t regs[VPAN_PAGES][VPAN_REGS];
+	uint8_t mode;
+	uint64_t mode_since_ns;
+	uint32_t rx_epoch;			// bumped by every mode write, a reception in progress needs it unchanged
+	vpan_mode_rec_t history[VPAN_HISTORY];	// the last mode changes, ring indexed by history_n
+	uint32_t history_n;
+	uint8_t tx_fifo[VPAN_FIFO];
+	uint16_t tx_fill;
+	uint8_t rx_fifo[VPAN_FIFO];
+	uint16_t rx_len;
+	uint16_t rx_pos;
+	// SPI transaction in progress
+	uint8_t cs_low;
+	uint8_t addr;
+	uint8_t write;
+	uint16_t bytes;
+	uint8_t fifo_written;
+	// pending events, VPAN_NEVER when none
+	uint64_t tx_done_ns;
+	uint64_t rx_timeout_ns;
+	vpan_tx_hook_t tx_hook;
+	void *tx_ctx;
+	vpan_stats_t stats;
+} vpan_t;
+
+void vpan_init(vpan_t *v);
+void vpan_select(vpan_t *v);
+vpan_t *vpan_current(void);
+
+uint8_t vpan_spi_xfer(uint8_t mosi, uint64_t now_ns);
+void vpan_cs(uint8_t high, uint64_t now_ns);
+
+void vpan_advance(vpan_t *v, uint64_t now_ns);
+uint64_t vpan_next_event(const vpan_t *v);
+uint8_t vpan_irq_line(const vpan_t *v);
+
+uint32_t vpan_rx_packet(vpan_t *v, const uint8_t *payload, uint8_t len, int16_t rssi_cdb, int16_t snr_cdb,
+						uint8_t crc_ok, uint64_t now_ns);
+uint32_t vpan_airtime_us(const vpan_t *v, uint8_t len);
+uint8_t vpan_get_reg(const vpan_t *v, uint8_t page, uint8_t addr);
+void vpan_set_tx_hook(vpan_t *v, vpan_tx_hook_t hook, void *ctx);
+void vpan_get_modem(const vpan_t *v, vpan_modem_t *m);
+void vpan_sync_mode_time(vpan_t *v, uint64_t now_ns);
+uint8_t vpan_mode_at(const vpan_t *v, uint64_t at_ns, uint8_t *mode, uint32_t *rx_epoch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_SIM_VPAN_H
@@ -0,0 +1,342 @@
+//
+// Regression benchmark of the driver's SPI traffic. Radio/ runs on the virtual PAN3031
+// (sim/vpan.h) behind a recording rf_port_t: the port's SPI, chip select and delay hooks are
+// wrapped, so every operation is measured where the driver meets the bus.
+// Prints op,spi_bytes,cs_toggles,page_switches,delay_us,est_us
+// est_us is the SPI bytes at the configured clock plus the delays the driver asked the port for.
+//   spi_bench [-n tx_len] [-c spi_hz] [-b baseline.csv [-w]] [-t percent]
+// With -b every column is checked against the baseline and a value more than percent (default 0)
+// above it fails the run with exit code 1; -w writes the current numbers as the new baseline.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include "main.h"
+#include "pan3031_port.h"
+#include "radio.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define BENCH_RX_LEN 255
+#define BENCH_WAIT_MS 5000
+#define BENCH_MAX_OPS 16
+#define BENCH_COLS 5
+
+typedef struct
+{
+	char op[24];
+	uint64_t v[BENCH_COLS];	// spi_bytes, cs_toggles, page_switches, delay_us, est_us
+} bench_row_t;
+
+static const char *const bench_cols[BENCH_COLS] = {"spi_bytes", "cs_toggles", "page_switches", "delay_us", "est_us"};
+
+static vpan_t radio;
+static rf_port_t real_port;
+static uint32_t spi_hz = VHAL_SPI_HZ;
+
+// what the recording port saw
+static uint64_t rec_bytes;
+static uint32_t rec_toggles;
+static uint32_t rec_pages;
+static uint64_t rec_delay_us;
+static uint32_t rec_pos;
+static uint8_t rec_cmd;
+static uint8_t rec_page;
+
+static bench_row_t rows[BENCH_MAX_OPS];
+static uint32_t row_num;
+static int failures;
+
+// a write of REG_SYS_CTL that changes bits 1:0 is a page switch
+static uint8_t rec_spi_readwrite(uint8_t tx)
+{
+	rec_bytes++;
+	if (rec_pos == 0)
+	{
+		rec_cmd = tx;
+	}
+	else if (rec_pos == 1 && rec_cmd == ((REG_SYS_CTL << 1) | 0x01) && (tx & 0x03) != rec_page)
+	{
+		rec_page = tx & 0x03;
+		rec_pages++;
+	}
+	rec_pos++;
+	return real_port.spi_readwrite(tx);
+}
+
+static void rec_cs_low(void)
+{
+	rec_toggles++;
+	rec_pos = 0;
+	real_port.spi_cs_low();
+}
+
+static void rec_cs_high(void)
+{
+	rec_toggles++;
+	real_port.spi_cs_high();
+}
+
+static void rec_delay_ms(uint32_t ms)
+{
+	rec_delay_us += (uint64_t)ms * 1000;
+	real_port.delayms(ms);
+}
+
+static void rec_delay_us_fn(uint32_t us)
+{
+	rec_delay_us += us;
+	real_port.delayus(us);
+}
+
+static void begin(void)
+{
+	rec_bytes = 0;
+	rec_toggles = 0;
+	rec_pages = 0;
+	rec_delay_us = 0;
+}
+
+static void end(const char *op)
+{
+	bench_row_t *r = &rows[row_num++];
+
+	snprintf(r->op, sizeof(r->op), "%s", op);
+	r->v[0] = rec_bytes;
+	r->v[1] = rec_toggles;
+	r->v[2] = rec_pages;
+	r->v[3] = rec_delay_us;
+	r->v[4] = rec_bytes * 8000000ULL / spi_hz + rec_delay_us;
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+static uint32_t wait_flag(uint32_t (*get)(void), uint32_t want)
+{
+	uint32_t start = HAL_GetTick();
+
+	while (get() != want)
+	{
+		if (HAL_GetTick() - start > BENCH_WAIT_MS)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void run_ops(uint8_t tx_len)
+{
+	uint8_t payload[BENCH_RX_LEN];
+	uint32_t tx_time = 0, i;
+	char op[24];
+
+	for (i = 0; i < BENCH_RX_LEN; i++)
+	{
+		payload[i] = (uint8_t)(i * 37 + 1);
+	}
+
+	begin();
+	check(rf_init() == OK, "rf_init");
+	end("init");
+
+	begin();
+	rf_set_default_para();
+	end("default_para");
+
+	begin();
+	check(rf_enter_continous_rx() == OK, "rf_enter_continous_rx");
+	end("continuous_rx");
+
+	// from the call to the TX done interrupt handled
+	rf_set_transmit_flag(RADIO_FLAG_IDLE);
+	begin();
+	check(rf_single_tx_data(payload, tx_len, &tx_time) == OK, "rf_single_tx_data");
+	check(wait_flag(rf_get_transmit_flag, RADIO_FLAG_TXDONE), "tx done");
+	snprintf(op, sizeof(op), "tx_%u", tx_len);
+	end(op);
+
+	// only the RX done interrupt, the receiver is already listening
+	rf_set_recv_flag(RADIO_FLAG_IDLE);
+	check(rf_enter_continous_rx() == OK, "rx restart");
+	vhal_run_until(vhal_now_ns() + 1000000ULL);
+	begin();
+	check(vpan_rx_packet(&radio, payload, BENCH_RX_LEN, -9000, 750, 1, vhal_now_ns()) == 1, "packet heard");
+	check(wait_flag(rf_get_recv_flag, RADIO_FLAG_RXDONE), "rx done");
+	snprintf(op, sizeof(op), "rx_irq_%u", BENCH_RX_LEN);
+	end(op);
+
+	begin();
+	check(rf_sleep() == OK && rf_sleep_wakeup() == OK, "sleep and wakeup");
+	end("sleep_wakeup");
+
+	// an ADR step, rf_adr_apply without the RX restart
+	begin();
+	check(rf_set_rate(SF_8, BW_250K, CODE_RATE_45) == OK, "rf_set_rate");
+	end("set_rate");
+	check(rf_get_modem_cfg()->Sf == SF_8 && PAN3031_get_sf() == SF_8 && PAN3031_get_bw() == BW_250K
+		  && PAN3031_get_code_rate() == CODE_RATE_45, "rate written");
+	check(rf_enter_continous_rx() == OK, "rx before a refused rate");
+	check(rf_set_rate(SF_9 + 1, BW_250K, CODE_RATE_45) == FAIL && rf_set_rate(SF_8, BW_500K + 1, CODE_RATE_45) == FAIL
+		  && rf_set_rate(SF_8, BW_250K, CODE_RATE_48 + 1) == FAIL, "rate out of range refused");
+	check(PAN3031_get_mode() == PAN3031_MODE_RX, "still in rx after a refused rate");
+	check(rf_get_modem_cfg()->Sf == SF_8 && PAN3031_get_sf() == SF_8 && PAN3031_get_bw() == BW_250K
+		  && PAN3031_get_code_rate() == CODE_RATE_45, "rate kept");
+}
+
+static uint32_t load_baseline(const char *path, bench_row_t *base, uint32_t max)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+	uint32_t n = 0;
+
+	if (f == NULL)
+	{
+		return 0;
+	}
+	while (n < max && fgets(line, sizeof(line), f) != NULL)
+	{
+		bench_row_t *r = &base[n];
+
+		if (sscanf(line, "%23[^,],%" SCNu64 ",%" SCNu64 ",%" SCNu64 ",%" SCNu64 ",%" SCNu64, r->op, &r->v[0], &r->v[1], &r->v[2], &r->v[3], &r->v[4]) == 6)
+		{
+			n++;
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+static void print_rows(FILE *f)
+{
+	uint32_t i, c;
+
+	fprintf(f, "op");
+	for (c = 0; c < BENCH_COLS; c++)
+	{
+		fprintf(f, ",%s", bench_cols[c]);
+	}
+	fprintf(f, "\n");
+	for (i = 0; i < row_num; i++)
+	{
+		fprintf(f, "%s", rows[i].op);
+		for (c = 0; c < BENCH_COLS; c++)
+		{
+			fprintf(f, ",%" PRIu64, rows[i].v[c]);
+		}
+		fprintf(f, "\n");
+	}
+}
+
+// every op and column against the baseline, returns the number of regressions
+static uint32_t compare(const bench_row_t *base, uint32_t base_num, double percent)
+{
+	uint32_t regressions = 0, i, j, c;
+
+	for (i = 0; i < row_num; i++)
+	{
+		for (j = 0; j < base_num && strcmp(base[j].op, rows[i].op) != 0; j++)
+		{
+		}
+		if (j == base_num)
+		{
+			fprintf(stderr, "%s: not in the baseline\n", rows[i].op);
+			continue;
+		}
+		for (c = 0; c < BENCH_COLS; c++)
+		{
+			uint64_t was = base[j].v[c], now = rows[i].v[c];
+
+			if ((double)now > (double)was * (1.0 + percent / 100.0))
+			{
+				fprintf(stderr, "REGRESSION %s %s: %" PRIu64 " -> %" PRIu64 "\n", rows[i].op, bench_cols[c], was, now);
+				regressions++;
+			}
+			else if (now < was)
+			{
+				fprintf(stderr, "improved %s %s: %" PRIu64 " -> %" PRIu64 "\n", rows[i].op, bench_cols[c], was, now);
+			}
+		}
+	}
+	return regressions;
+}
+
+int main(int argc, char **argv)
+{
+	bench_row_t base[BENCH_MAX_OPS];
+	const char *baseline = NULL;
+	uint32_t tx_len = 32, base_num;
+	double percent = 0;
+	int write = 0, c;
+
+	while ((c = getopt(argc, argv, "n:c:b:wt:")) != -1)
+	{
+		switch (c)
+		{
+			case 'n': tx_len = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'c': spi_hz = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'b': baseline = optarg; break;
+			case 'w': write = 1; break;
+			case 't': percent = strtod(optarg, NULL); break;
+			default:
+				fprintf(stderr, "usage: spi_bench [-n tx_len] [-c spi_hz] [-b baseline.csv [-w]] [-t percent]\n");
+				return 2;
+		}
+	}
+	if (tx_len == 0 || tx_len > BENCH_RX_LEN || spi_hz == 0 || (write && baseline == NULL))
+	{
+		fprintf(stderr, "tx_len must be 1..%u, spi_hz above 0, -w needs -b\n", BENCH_RX_LEN);
+		return 2;
+	}
+
+	vpan_init(&radio);
+	vhal_init(&radio);
+	vhal_set_spi_hz(spi_hz);
+	real_port = rf_port;
+	rf_port.spi_readwrite = rec_spi_readwrite;
+	rf_port.spi_cs_low = rec_cs_low;
+	rf_port.spi_cs_high = rec_cs_high;
+	rf_port.delayms = rec_delay_ms;
+	rf_port.delayus = rec_delay_us_fn;
+
+	run_ops((uint8_t)tx_len);
+	print_rows(stdout);
+	if (failures)
+	{
+		return 1;
+	}
+	if (baseline == NULL)
+	{
+		return 0;
+	}
+	if (write)
+	{
+		FILE *f = fopen(baseline, "w");
+
+		if (f == NULL)
+		{
+			perror(baseline);
+			return 1;
+		}
+		print_rows(f);
+		fclose(f);
+		return 0;
+	}
+	base_num = load_baseline(baseline, base, BENCH_MAX_OPS);
+	if (base_num == 0)
+	{
+		fprintf(stderr, "%s: no baseline rows\n", baseline);
+		return 1;
+	}
+	return compare(base, base_num, percent) ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+//
+// rf_tdma (App/Src/rf_tdma.c) node on the virtual PAN3031: beacons of a scripted coordinator are
+// fed to the node with the RX-done tick of a clock that runs off by a known amount. The drift
+// estimate must match it over one period and across missed beacons, stay within
+// RF_TDMA_MAX_DRIFT_PPM, and the frame handed to the MAC must go out inside the node's slot.
+// Exits 1 on a mismatch.
+//
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "main.h"
+#include "radio.h"
+#include "rf_frame.h"
+#include "rf_tdma.h"
+#include "vhal.h"
+#include "vpan.h"
+
+#define TEST_ADDR 0x21
+#define TEST_COORD 0x01
+#define TEST_SLOT 2
+
+static vpan_t radio;
+static uint64_t air_ns;
+static uint32_t air_num;
+static int failures;
+
+static void on_air(const uint8_t *payload, uint8_t len, uint64_t start_ns, uint32_t airtime_us, void *ctx)
+{
+	(void)payload;
+	(void)len;
+	(void)airtime_us;
+	(void)ctx;
+	air_ns = start_ns;
+	air_num++;
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// the beacon bsn of a coordinator with the given slots, heard at rx_tick of the node's clock
+static void beacon(uint8_t bsn, uint8_t slots, uint16_t slot_ms, uint16_t period_ms, uint32_t rx_tick)
+{
+	uint8_t frame[RF_FRAME_HDR_LEN + RF_TDMA_BEACON_LEN];
+	rf_frame_hdr_t hdr = {RF_FRAME_ADDR_BROADCAST, TEST_COORD, bsn, RF_FRAME_FLAG_CTRL, 0};
+	uint8_t hlen = rf_frame_encode(frame, &hdr);
+
+	frame[hlen + 0] = RF_TDMA_CMD_BEACON;
+	frame[hlen + 1] = bsn;
+	frame[hlen + 2] = slots;
+	frame[hlen + 3] = (uint8_t)slot_ms;
+	frame[hlen + 4] = (uint8_t)(slot_ms >> 8);
+	frame[hlen + 5] = (uint8_t)period_ms;
+	frame[hlen + 6] = (uint8_t)(period_ms >> 8);
+	check(rf_tdma_input(frame, hlen + RF_TDMA_BEACON_LEN, rx_tick) == 1, "beacon consumed");
+}
+
+// beacon 0 and beacon gap of a superframe of period_ms on a clock off by ppm, the drift estimated
+static int32_t drift(int32_t ppm, uint8_t gap, uint16_t period_ms)
+{
+	uint32_t t0 = 1000;
+	uint64_t span = (uint64_t)gap * period_ms;
+
+	rf_tdma_start_node(TEST_SLOT);
+	beacon(0, 8, period_ms / 9, period_ms, t0);
+	beacon(gap, 8, period_ms / 9, period_ms, t0 + (uint32_t)(span + (int64_t)span * ppm / 1000000));
+	return rf_tdma_get_stats()->drift_ppm;
+}
+
+int main(void)
+{
+	const rf_tdma_stats_t *st = rf_tdma_get_stats();
+	uint8_t frame[RF_FRAME_HDR_LEN + 4] = {0};
+	rf_frame_hdr_t hdr = {TEST_COORD, TEST_ADDR, 0, 0, 0};
+	uint32_t slot_ms, beacon_ms, period_ms, start, begin, end;
+	int32_t d;
+
+	vpan_init(&radio);
+	vpan_set_tx_hook(&radio, on_air, NULL);
+	vhal_init(&radio);
+	check(rf_init() == OK, "rf_init");
+	rf_set_default_para();
+	rf_frame_init(TEST_ADDR);
+
+	// one short superframe, then spans where diff * 1000000 passed 2^31: the longest period with
+	// RF_TDMA_MAX_MISS beacons missed at the worst drift, and two periods at 1.9%
+	d = drift(3000, 1, 2000);
+	check(abs(d - 3000) <= 500, "drift over one period");
+	d = drift(-RF_TDMA_MAX_DRIFT_PPM, RF_TDMA_MAX_MISS + 1, 65535);
+	check(abs(d + RF_TDMA_MAX_DRIFT_PPM) <= 5, "drift across missed beacons");
+	printf("drift,%d ppm over %u periods of 65535 ms\n", d, RF_TDMA_MAX_MISS + 1);
+	d = drift(19000, 2, 65535);
+	check(d == RF_TDMA_MAX_DRIFT_PPM, "fast drift held to the limit");
+	d = drift(-19000, 2, 65535);
+	check(d == -RF_TDMA_MAX_DRIFT_PPM, "slow drift held to the limit");
+	d = drift(30000, 1, 65535);
+	check(d == 0 && st->beacons_rx == 2, "late RX-done is no drift");
+
+	// synced on the real clock, a frame handed to the MAC goes out in the next own slot
+	vhal_set_poll(VHAL_POLL_IDLE);
+	slot_ms = rf_tdma_slot_ms();
+	beacon_ms = 200;
+	period_ms = beacon_ms + 4 * slot_ms;
+	rf_tdma_start_node(TEST_SLOT);
+	start = HAL_GetTick();
+	beacon(0, 4, (uint16_t)slot_ms, (uint16_t)period_ms, start + rf_get_airtime_us(RF_FRAME_HDR_LEN + RF_TDMA_BEACON_LEN) / 1000);
+	check(rf_tdma_get_state() == RF_TDMA_STATE_SLEEP, "asleep after the beacon");
+	rf_frame_encode(frame, &hdr);
+	check(rf_tdma_send(frame, sizeof(frame)) == OK, "rf_tdma_send");
+	air_num = 0;
+	while (air_num == 0 && HAL_GetTick() - start < period_ms)
+	{
+		rf_tdma_poll();
+		vhal_run_until(vhal_now_ns() + 1000000ULL);
+	}
+	begin = start + beacon_ms + TEST_SLOT * slot_ms;
+	end = begin + slot_ms - rf_get_airtime_us(RF_FRAME_HDR_LEN + 4) / 1000;
+	check(air_num == 1 && st->slots_used == 1, "sent in the superframe");
+	check(air_ns >= begin * 1000000ULL && air_ns <= end * 1000000ULL, "sent inside the slot");
+	printf("slot,%u ms into slot %u of %u ms\n", (uint32_t)(air_ns / 1000000) - begin, TEST_SLOT, slot_ms);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# rf_ncp against the NCP firmware mode on the virtual PAN3031 (ncp_sim) over a pty pair.
+#   ncp_test.sh <ncp_sim> <rf_ncp> <scratch dir>
+# The pair comes from socat when it is installed, otherwise ncp_sim opens the pty itself.
+# Each call must get the reply with its own seq; the pipelined TX burst is several times the
+# NCP's RX ring, so it only gets through without a lost reply or a damaged command when rf_ncp
+# holds back at the window the PING reported.
+set -e
+NCP_SIM=$1
+RF_NCP=$2
+DIR=$3/ncp_test
+COUNT=24
+PAYLOAD=$(printf '%02x' $(seq 1 64))
+
+rm -rf "$DIR"
+mkdir -p "$DIR"
+if command -v socat > /dev/null; then
+    socat pty,raw,echo=0,link="$DIR/host" pty,raw,echo=0,link="$DIR/ncp" &
+    SOCAT=$!
+    while [ ! -e "$DIR/ncp" ] || [ ! -e "$DIR/host" ]; do sleep 0.1; done
+    "$NCP_SIM" -t 60 "$DIR/ncp" > "$DIR/sim.txt" &
+else
+    SOCAT=
+    "$NCP_SIM" -t 60 -l "$DIR/host" > "$DIR/sim.txt" &
+    while [ ! -e "$DIR/host" ]; do sleep 0.1; done
+fi
+SIM=$!
+trap 'kill $SIM $SOCAT 2> /dev/null || true' EXIT
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+"$RF_NCP" "$DIR/host" ping > "$DIR/ping.txt" || fail "ping"
+grep -q "^ncp version 1 rx_buf 512 " "$DIR/ping.txt" || fail "ping reply: $(cat "$DIR/ping.txt")"
+"$RF_NCP" "$DIR/host" set sf 7 || fail "set sf"
+[ "$("$RF_NCP" "$DIR/host" get sf)" = "sf 7" ] || fail "get sf after set"
+
+# 24 records of 70 bytes against a window of 511; every call pings first, 32 commands in all
+"$RF_NCP" "$DIR/host" tx "$PAYLOAD" $COUNT > "$DIR/tx.txt" || fail "tx burst: $(cat "$DIR/tx.txt")"
+grep -q "^tx $COUNT done $COUNT failed 0," "$DIR/tx.txt" || fail "tx burst: $(cat "$DIR/tx.txt")"
+"$RF_NCP" "$DIR/host" stats > "$DIR/stats.txt" || fail "stats"
+cat "$DIR/tx.txt"
+for want in "cmds 32" "bad_cmds 0" "tx $COUNT" "evt_dropped 0" "uart_rx_bad 0" "uart_dropped 0"; do
+    grep -qx "$want" "$DIR/stats.txt" || fail "want $want in $(cat "$DIR/stats.txt")"
+done
+
+kill $SIM
+wait $SIM || true
+cat "$DIR/sim.txt"
@@ -0,0 +1,213 @@
+//
+// Host round trip and size comparison of the telemetry encoder in App/Src/rf_ts.c.
+// Generates a day of periodic sensor samples, packs them into 255 byte frames and prints
+// one line per encoding: name,samples,frames,bytes on air,bytes per sample,reduction vs raw
+//   raw       timestamp and values as little endian 32-bit words, 12 samples per frame
+//   raw+lz    the raw frames through Radio/src/lz.c
+//   ts        rf_ts with float temperature and humidity
+//   ts_int    rf_ts with the same readings scaled to integers (centi-degree, per mille)
+//   ts_random rf_ts on random data, exercises the wide encodings
+// Every rf_ts frame is decoded again, on its own, and compared with the input.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "rf_ts.h"
+#include "lz.h"
+
+#define SAMPLES 8640    /* one day every 10 s */
+#define PERIOD_MS 10000
+#define NCH 4
+
+typedef struct
+{
+	uint32_t ts;
+	rf_ts_value_t val[NCH];
+} sample_t;
+
+static sample_t float_set[SAMPLES];
+static sample_t int_set[SAMPLES];
+static sample_t random_set[SAMPLES];
+
+static int32_t walk(int32_t *v, int32_t step, int32_t lo, int32_t hi)
+{
+	*v += (rand() % (2 * step + 1)) - step;
+	if (*v < lo)
+	{
+		*v = lo;
+	}
+	if (*v > hi)
+	{
+		*v = hi;
+	}
+	return *v;
+}
+
+static void generate(void)
+{
+	int32_t t = 2340, h = 452, p = 101320, bat = 3310;
+	uint32_t ts = 1000, i;
+
+	srand(3031);
+	for (i = 0; i < SAMPLES; i++)
+	{
+		/* the timer fires on the period with a few ms of jitter */
+		ts += PERIOD_MS + (rand() % 7) - 3;
+		walk(&t, 2, -4000, 8500);
+		walk(&h, 2, 0, 1000);
+		walk(&p, 3, 90000, 110000);
+		if (rand() % 64 == 0)
+		{
+			walk(&bat, 1, 2800, 3400);
+		}
+
+		float_set[i].ts = ts;
+		float_set[i].val[0].f = t / 100.0f;
+		float_set[i].val[1].f = h / 10.0f;
+		float_set[i].val[2].i = p;
+		float_set[i].val[3].i = bat;
+
+		int_set[i].ts = ts;
+		int_set[i].val[0].i = t;
+		int_set[i].val[1].i = h;
+		int_set[i].val[2].i = p;
+		int_set[i].val[3].i = bat;
+
+		/* worst case for every code path, checks the round trip only */
+		random_set[i].ts = (i % 3) ? random_set[i - 1].ts + (uint32_t)rand() * 7 : (uint32_t)rand() * 3;
+		random_set[i].val[0].bits = (uint32_t)rand() << 8;
+		random_set[i].val[1].bits = (i % 5) ? random_set[i - 1].val[1].bits ^ (1u << (rand() % 32)) : 0;
+		random_set[i].val[2].i = rand() - RAND_MAX / 2;
+		random_set[i].val[3].bits = (uint32_t)rand() * 2;
+	}
+}
+
+static void report(const char *name, uint32_t frames, uint32_t bytes, uint32_t raw_bytes)
+{
+	printf("%s,%u,%u,%u,%.2f,%.2f\n", name, SAMPLES, frames, bytes, (double)bytes / SAMPLES,
+	       (double)raw_bytes / bytes);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t run_raw(int lz, uint32_t *frames)
+{
+	const uint32_t per_frame = 254 / ((NCH + 1) * 4);
+	uint8_t frame[254], out[254];
+	uint32_t i, n, ch, len, bytes = 0;
+
+	*frames = 0;
+	for (i = 0; i < SAMPLES; i += n)
+	{
+		len = 0;
+		for (n = 0; n < per_frame && i + n < SAMPLES; n++)
+		{
+			put32(frame + len, float_set[i + n].ts);
+			len += 4;
+			for (ch = 0; ch < NCH; ch++)
+			{
+				put32(frame + len, float_set[i + n].val[ch].bits);
+				len += 4;
+			}
+		}
+		if (lz)
+		{
+			/* one stage header byte, raw fallback like radio.c */
+			uint32_t c = LzCompress(frame, 0, len, out, len - 1);
+			len = 1 + (c ? c : len);
+		}
+		bytes += len;
+		(*frames)++;
+	}
+	return bytes;
+}
+
+static int run_ts(const sample_t *set, uint8_t float_mask, uint32_t *frames, uint32_t *bytes)
+{
+	uint8_t frame[RF_TS_MAX_FRAME];
+	rf_ts_enc_t enc;
+	rf_ts_dec_t dec;
+	rf_ts_value_t val[NCH];
+	uint32_t i = 0, first, ts;
+	uint16_t len;
+
+	*frames = 0;
+	*bytes = 0;
+	while (i < SAMPLES)
+	{
+		first = i;
+		rf_ts_enc_init(&enc, frame, sizeof(frame), NCH, float_mask);
+		while (i < SAMPLES && rf_ts_enc_add(&enc, set[i].ts, set[i].val) == RF_TS_OK)
+		{
+			i++;
+		}
+		len = rf_ts_enc_finish(&enc);
+		if (len == 0)
+		{
+			fprintf(stderr, "sample %u does not fit in a frame\n", i);
+			return 1;
+		}
+
+		/* stateless: the decoder sees nothing but this frame */
+		if (rf_ts_dec_init(&dec, frame, len) != RF_TS_OK)
+		{
+			fprintf(stderr, "frame %u: bad header\n", *frames);
+			return 1;
+		}
+		for (; first < i; first++)
+		{
+			if (rf_ts_dec_next(&dec, &ts, val) != RF_TS_OK || ts != set[first].ts ||
+			    memcmp(val, set[first].val, sizeof(val)) != 0)
+			{
+				fprintf(stderr, "frame %u: sample %u does not round trip\n", *frames, first);
+				return 1;
+			}
+		}
+		if (rf_ts_dec_next(&dec, &ts, val) == RF_TS_OK)
+		{
+			fprintf(stderr, "frame %u: extra sample\n", *frames);
+			return 1;
+		}
+
+		*bytes += len;
+		(*frames)++;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	uint32_t raw, bytes, frames;
+
+	generate();
+	printf("encoding,samples,frames,bytes_air,bytes_per_sample,reduction\n");
+
+	raw = run_raw(0, &frames);
+	report("raw", frames, raw, raw);
+	bytes = run_raw(1, &frames);
+	report("raw+lz", frames, bytes, raw);
+
+	if (run_ts(float_set, 0x03, &frames, &bytes) != 0)
+	{
+		return 1;
+	}
+	report("ts", frames, bytes, raw);
+	if (run_ts(int_set, 0x00, &frames, &bytes) != 0)
+	{
+		return 1;
+	}
+	report("ts_int", frames, bytes, raw);
+	if (run_ts(random_set, 0x03, &frames, &bytes) != 0)
+	{
+		return 1;
+	}
+	report("ts_random", frames, bytes, raw);
+	return 0;
+}
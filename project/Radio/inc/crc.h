@@ -14,11 +14,41 @@
 #define CRC_IBM_SEED 0xFFFF
 #define CRC_CCITT_SEED 0x1D0F
 
+// CRC engines, all of them give the same result
+#define CRC_IMPL_BITWISE 0 // no table, 8 shifts per byte
+#define CRC_IMPL_NIBBLE 1  // 16 entry table per polynomial, 32 bytes of flash
+#define CRC_IMPL_TABLE 2   // 256 entry table per polynomial, 512 bytes of flash
+#define CRC_IMPL_SLICE4 3  // 4 x 256 entry tables per polynomial, host tools
+#define CRC_IMPL_SLICE8 4  // 8 x 256 entry tables per polynomial, host tools
+
+// Engine used by RadioComputeCRC, unused tables are dropped by -gc-sections
+#ifndef CRC_IMPL
+#define CRC_IMPL CRC_IMPL_TABLE
+#endif
+
+// Streaming CRC state, for data that is not in one contiguous buffer
+typedef struct
+{
+  uint16_t Crc;
+  uint8_t Type;
+  uint32_t Length;
+}RadioCrc_t;
+
 
-uint16_t RadioComputeCRC( uint8_t *buffer, uint8_t length, uint8_t crcType );
+uint16_t RadioComputeCRC( uint8_t *buffer, uint32_t length, uint8_t crcType );
 uint16_t ComputeCrc( uint16_t crc, uint8_t dataByte, uint16_t polynomial );
 
+uint16_t ComputeCrcBitwise( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType );
+uint16_t ComputeCrcNibble( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType );
+uint16_t ComputeCrcTable( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType );
+uint16_t ComputeCrcSlice4( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType );
+uint16_t ComputeCrcSlice8( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType );
+
+void RadioCrcInit( RadioCrc_t *ctx, uint8_t crcType );
+void RadioCrcUpdate( RadioCrc_t *ctx, const uint8_t *buffer, uint32_t length );
+void RadioCrcUpdateByte( RadioCrc_t *ctx, uint8_t dataByte );
+uint16_t RadioCrcFinal( const RadioCrc_t *ctx );
 
 
-#endif
 
+#endif
@@ -0,0 +1,34 @@
+#ifndef _LZ_H_
+#define _LZ_H_
+
+#include <stdint.h>
+
+/*
+ * Small-window LZSS for radio payloads.
+ *
+ * Tokens come in groups of 8 behind a control byte, bit n (LSB first) tells token n apart:
+ *   0: literal, one byte
+ *   1: match, two bytes: distance - 1, length - LZ_MIN_MATCH
+ * Matches reach back at most LZ_WINDOW bytes into the data already produced, so the decoder
+ * needs no window of its own, only the output buffer.
+ * The encoder keeps hash chains over the last LZ_WINDOW positions, about 768 bytes of RAM.
+ *
+ * Short packets rarely repeat themselves, so both calls accept history that precedes the data:
+ * a preset dictionary of the field names and formatting the application sends, known to both ends.
+ */
+#define LZ_WINDOW 256
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH ( LZ_MIN_MATCH + 255 )
+
+// Longest input LzCompress accepts
+#define LZ_MAX_INPUT 0xFFFE
+
+// Chain links followed per position, trades ratio for speed
+#ifndef LZ_MAX_CHAIN
+#define LZ_MAX_CHAIN 16
+#endif
+
+uint32_t LzCompress( const uint8_t *src, uint32_t histLen, uint32_t srcLen, uint8_t *dst, uint32_t dstMax );
+uint32_t LzDecompress( const uint8_t *src, uint32_t srcLen, uint8_t *dst, uint32_t histLen, uint32_t dstMax );
+
+#endif
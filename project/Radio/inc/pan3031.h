@@ -11,11 +11,24 @@
 
 #include "stdio.h"
 #include "pan3031_port.h"
+#include "crc.h"
  		
 
 /* result */
 #define OK                              0
 #define FAIL                            1
+/* RX metadata: 1 = RSSI/SNR as centi-dB integers, no float math in the driver,
+   0 = RSSI/SNR as double dB (needs math.h and soft-float) */
+#ifndef RF_INT_METADATA
+#define RF_INT_METADATA                 1
+#endif
+#if RF_INT_METADATA
+typedef int16_t RfMeta_t;
+#define RF_META_TO_CDB(v)               (v)
+#else
+typedef double RfMeta_t;
+#define RF_META_TO_CDB(v)               ((int16_t)((v) * 100))
+#endif
 /* 3031B mode define*/
 #define PAN3031_MODE_DEEP_SLEEP         0
 #define PAN3031_MODE_SLEEP              1
@@ -89,6 +102,24 @@
 
 #define REG_PAYLOAD_LEN                 0x0C
 
+/* 1: FIFO reads and writes can feed a streaming CRC, see PAN3031_set_fifo_crc */
+#ifndef PAN3031_FIFO_CRC
+#define PAN3031_FIFO_CRC                1
+#endif
+/* FIFO directions of PAN3031_set_fifo_crc, each has its own CRC */
+#define PAN3031_FIFO_TX                 0
+#define PAN3031_FIFO_RX                 1
+
+/* 1: the SPI primitives are exported for the on-target benchmarks (App/Src/rf_bench.c) */
+#ifndef PAN3031_BENCH
+#define PAN3031_BENCH                   0
+#endif
+#if PAN3031_BENCH
+#define PAN3031_LOCAL
+#else
+#define PAN3031_LOCAL                   static
+#endif
+
 /*IRQ BIT MASK*/
 #define REG_IRQ_RX_PLHD_DONE            0x10
 #define REG_IRQ_RX_DONE                 0x8
@@ -99,6 +130,25 @@
 enum REF_CLK_SEL {REF_CLK_32M,REF_CLK_16M};		
 enum PAGE_SEL {PAGE0_SEL,PAGE1_SEL,PAGE2_SEL, PAGE3_SEL};
 
+/* one register field of a precomputed register image, see pan3031_config.hpp */
+typedef struct
+{
+	uint8_t page;
+	uint8_t addr;
+	uint8_t mask;	/* bits written, the others keep their value; 0xff writes the whole register */
+	uint8_t value;
+}PAN3031_RegField_t;
+
+/* the modem fields PAN3031_calculate_tx_time needs, read in one pass */
+typedef struct
+{
+	uint8_t PayloadLen;
+	uint8_t Sf;
+	uint8_t Bw;
+	uint8_t Cr;
+	uint8_t Crc;
+}PAN3031_ModemFields_t;
+
 uint32_t PAN3031_rst(void);
 uint32_t PAN3031_agc_enable(uint32_t state);
 uint32_t PAN3031_agc_config(void);
@@ -125,8 +175,12 @@ uint8_t PAN3031_get_mode(void);
 uint32_t PAN3031_set_tx_mode(uint8_t mode);
 uint32_t PAN3031_set_rx_mode(uint8_t mode);
 uint32_t PAN3031_set_timeout(uint32_t timeout);
+#if !RF_INT_METADATA
 float PAN3031_get_snr(void);
 float PAN3031_get_rssi(void);
+#endif
+int16_t PAN3031_get_snr_cdb(void);
+int16_t PAN3031_get_rssi_cdb(void);
 uint32_t PAN3031_set_tx_power(uint8_t tx_power);
 uint32_t PAN3031_get_tx_power(void);
 uint32_t PAN3031_set_preamble(uint16_t reg);
@@ -152,4 +206,19 @@ uint32_t PAN3031_set_dcdc_mode(uint32_t dcdc_val);
 uint32_t PAN3031_set_ldr(uint32_t mode);
 void PAN3031_irq_handler(void);
 uint32_t PAN3031_set_carrier_wave_test_mode(void);
+uint32_t PAN3031_apply_image(const PAN3031_RegField_t *image, uint32_t count);
+uint32_t PAN3031_read_image(PAN3031_RegField_t *image, uint32_t count);
+/* pan3031_regs.cpp */
+uint32_t PAN3031_set_rate(uint8_t sf, uint8_t bw, uint8_t code_rate);
+uint32_t PAN3031_get_modem_fields(PAN3031_ModemFields_t *fields);
+#if PAN3031_FIFO_CRC
+void PAN3031_set_fifo_crc(uint8_t dir, RadioCrc_t *crc, uint8_t skip);
+#endif
+#if PAN3031_BENCH
+uint8_t PAN3031_read_reg(uint8_t addr);
+uint32_t PAN3031_write_reg(uint8_t addr,uint8_t value);
+void PAN3031_write_fifo(uint8_t addr,uint8_t *buffer,int size);
+void PAN3031_read_fifo(uint8_t addr,uint8_t *buffer,int size);
+uint32_t PAN3031_switch_page(enum PAGE_SEL page);
+#endif
 #endif
@@ -0,0 +1,99 @@
+//
+// Modem configuration computed at compile time, for images whose radio parameters are fixed.
+//
+// pan3031::ModemConfig<freq, sf, bw, cr, power, crc, ldr, dcdc>::image holds the register fields
+// PAN3031_set_freq, set_code_rate, set_bw, set_sf, set_tx_power, set_crc, set_dcdc_mode and
+// set_ldr would write, built with pan3031::image (pan3031_regs.hpp): in page and address order,
+// fields sharing a register merged into one write.
+// PAN3031_apply_image writes it with one page switch per page and no configuration math left to
+// run; parameters the PAN3031 does not support fail to compile.
+//
+//   using Cfg = pan3031::ModemConfig<433000000, SF_9, BW_125K, CODE_RATE_48>;
+//   rf_apply_modem_image(Cfg::image.data(), Cfg::size, &Cfg::modem);
+//
+#ifndef PAN3031_CONFIG_HPP
+#define PAN3031_CONFIG_HPP
+
+#include <cstdint>
+
+#include "pan3031_regs.hpp"
+
+extern "C"
+{
+#include "radio.h"
+}
+
+namespace pan3031
+{
+
+// the bands PAN3031_set_freq accepts
+constexpr bool in_band(uint32_t freq)
+{
+	return (freq >= freq_336000000 && freq <= freq_510000000) || (freq >= freq_800000000 && freq <= freq_920000000);
+}
+
+constexpr bool low_band(uint32_t freq)
+{
+	return freq <= freq_510000000;
+}
+
+// synthesizer words of PAN3031_set_freq: integer part, then the fraction
+constexpr int synth_fb(uint32_t freq)
+{
+	uint32_t lo = freq * (low_band(freq) ? 4 : 2);
+	int fb = static_cast<int>(lo / 16000000) - 20;
+	int fc = static_cast<int>((lo % 16000000) / (10000 * 2 * (low_band(freq) ? 2 : 1)));
+
+	return (fc < 0xff) ? fb - 1 : fb;
+}
+
+constexpr int synth_fc(uint32_t freq)
+{
+	uint32_t lo = freq * (low_band(freq) ? 4 : 2);
+	int fc = static_cast<int>((lo % 16000000) / (10000 * 2 * (low_band(freq) ? 2 : 1)));
+
+	return (fc < 0xff) ? fc + 400 : fc;
+}
+
+// register 0x63 of page 1 as PAN3031_set_tx_power writes it
+constexpr uint8_t tx_power_reg(uint8_t power)
+{
+	uint8_t pa_1st = (power >> 4) & 0x07;
+	uint8_t pa_2nd = (pa_1st < 0x07) ? 0 : (power & 0x0f);
+
+	return static_cast<uint8_t>((pa_2nd << 4) | pa_1st);
+}
+
+template <uint32_t Freq, uint8_t Sf, uint8_t Bw, uint8_t Cr, uint8_t Power = 0x7F, uint8_t Crc = CRC_ON,
+		  uint8_t Ldr = LDR_OFF, uint8_t Dcdc = DCDC_OFF>
+struct ModemConfig
+{
+	static_assert(in_band(Freq), "frequency outside 336-510 MHz and 800-920 MHz");
+	static_assert(Sf >= SF_7 && Sf <= SF_9, "PAN3031 only supports SF7-SF9");
+	static_assert(Bw >= BW_125K && Bw <= BW_500K, "PAN3031 only supports BW_125K, BW_250K and BW_500K");
+	static_assert(Cr >= CODE_RATE_45 && Cr <= CODE_RATE_48, "code rate is CODE_RATE_45..CODE_RATE_48");
+	static_assert(Power <= 0x7F, "TX power code is 3 bits first PA stage, 4 bits second");
+	static_assert(Crc == CRC_OFF || Crc == CRC_ON, "CRC is CRC_OFF or CRC_ON");
+	static_assert(Ldr == LDR_OFF || Ldr == LDR_ON, "LDR is LDR_OFF or LDR_ON");
+	static_assert(Dcdc == DCDC_OFF || Dcdc == DCDC_ON, "DCDC is DCDC_OFF or DCDC_ON");
+
+	static constexpr bool low = low_band(Freq);
+	static constexpr int fb = synth_fb(Freq);
+	static constexpr int fc = synth_fc(Freq);
+
+	static constexpr auto image =
+		pan3031::image<reg::LoSel, reg::LoBand, reg::TxPower, reg::Freq0, reg::Freq1, reg::Freq2, reg::Freq3, reg::Bw,
+					   reg::Cr, reg::Sf, reg::Crc, reg::Ldr, reg::SynthInt, reg::SynthFrac0, reg::SynthFrac1,
+					   reg::RfBand, reg::Dcdc>(low ? 0x02 : 0x01, (Freq > freq_470000000 && low) ? 0xae : 0x8e,
+											   tx_power_reg(Power), Freq, Freq >> 8, Freq >> 16, Freq >> 24, Bw, Cr,
+											   Sf, Crc, Ldr, fb & 0x7f, fc & 0xff, (fc >> 8) & 0x0f,
+											   low ? 0x07 : 0x04, Dcdc);
+	static constexpr uint32_t size = image.size();
+
+	// what rf_get_modem_cfg reports once the image is written
+	static constexpr RfModemCfg modem = {Freq, Sf, Bw, Cr, Crc, Power};
+};
+
+} // namespace pan3031
+
+#endif // PAN3031_CONFIG_HPP
@@ -0,0 +1,235 @@
+//
+// Typed access to PAN3031 register fields.
+//
+// A field is a type carrying its page, address and mask; the shift follows from the mask. An
+// access names the fields it touches, and the registers they live in are worked out at compile
+// time, sorted by page and address, each register once however many of its fields are named:
+//
+//   pan3031::write<reg::Sf, reg::Bw, reg::Cr>(sf, bw, cr);	// one page switch, two registers
+//   pan3031::read<reg::Sf, reg::Crc>(sf, crc);					// one page switch, one register
+//
+// PAN3031_apply_image / PAN3031_read_image then switch the page only where it changes and skip
+// the read of a register whose fields cover all of it. image() does the same with constant
+// values and yields a register image for PAN3031_apply_image without any code at run time.
+//
+#ifndef PAN3031_REGS_HPP
+#define PAN3031_REGS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+extern "C"
+{
+#include "pan3031.h"
+}
+
+namespace pan3031
+{
+
+template <PAGE_SEL Page, uint8_t Addr, uint8_t Mask>
+struct Field
+{
+	static_assert(Mask != 0, "a field has at least one bit");
+
+	static constexpr PAGE_SEL page = Page;
+	static constexpr uint8_t addr = Addr;
+	static constexpr uint8_t mask = Mask;
+	static constexpr uint8_t shift = (Mask & 0x0f) ? ((Mask & 0x03) ? ((Mask & 0x01) ? 0 : 1) : ((Mask & 0x04) ? 2 : 3))
+												  : ((Mask & 0x30) ? ((Mask & 0x10) ? 4 : 5) : ((Mask & 0x40) ? 6 : 7));
+	static constexpr uint8_t max = Mask >> shift;
+
+	static_assert((max & (max + 1)) == 0, "field bits must be contiguous");
+
+	static constexpr uint8_t bits(uint32_t value)
+	{
+		return static_cast<uint8_t>((value << shift) & Mask);
+	}
+	static constexpr uint8_t get(uint8_t reg)
+	{
+		return static_cast<uint8_t>((reg & Mask) >> shift);
+	}
+};
+
+namespace reg
+{
+
+// page 0
+using LoSel = Field<PAGE0_SEL, 0x45, 0x03>;		// 0x02 LO_400M, 0x01 LO_800M
+using LoBand = Field<PAGE0_SEL, 0x4a, 0xff>;		// 0xae for 470-510 MHz, 0x8e otherwise
+using Irq = Field<PAGE0_SEL, 0x6c, 0x1f>;			// REG_IRQ_*, write 1 to clear
+// page 1
+using PayloadLen = Field<PAGE1_SEL, REG_PAYLOAD_LEN, 0xff>;
+using TxPower = Field<PAGE1_SEL, 0x63, 0xff>;		// second PA stage in 7:4, first in 2:0
+// page 3
+using Freq0 = Field<PAGE3_SEL, 0x09, 0xff>;		// carrier in Hz, low byte first
+using Freq1 = Field<PAGE3_SEL, 0x0a, 0xff>;
+using Freq2 = Field<PAGE3_SEL, 0x0b, 0xff>;
+using Freq3 = Field<PAGE3_SEL, 0x0c, 0xff>;
+using Bw = Field<PAGE3_SEL, 0x0d, 0xf0>;			// BW_125K / BW_250K / BW_500K
+using Cr = Field<PAGE3_SEL, 0x0d, 0x0e>;			// CODE_RATE_45 .. CODE_RATE_48
+using Sf = Field<PAGE3_SEL, 0x0e, 0xf0>;			// SF_7 .. SF_9
+using Crc = Field<PAGE3_SEL, 0x0e, 0x08>;
+using Ldr = Field<PAGE3_SEL, 0x12, 0x08>;
+using Preamble0 = Field<PAGE3_SEL, 0x13, 0xff>;
+using Preamble1 = Field<PAGE3_SEL, 0x14, 0xff>;
+using SynthInt = Field<PAGE3_SEL, 0x15, 0xff>;		// PLL integer word, 7 bits used
+using SynthFrac0 = Field<PAGE3_SEL, 0x16, 0xff>;	// PLL fraction, 12 bits
+using SynthFrac1 = Field<PAGE3_SEL, 0x17, 0xff>;
+using RfBand = Field<PAGE3_SEL, 0x18, 0x0e>;		// 0x04 | 0x03 in the low band
+using Dcdc = Field<PAGE3_SEL, 0x1e, 0x01>;
+
+} // namespace reg
+
+namespace detail
+{
+
+constexpr bool same_reg(const PAN3031_RegField_t &a, const PAN3031_RegField_t &b)
+{
+	return a.page == b.page && a.addr == b.addr;
+}
+
+constexpr bool before(const PAN3031_RegField_t &a, const PAN3031_RegField_t &b)
+{
+	return a.page < b.page || (a.page == b.page && a.addr < b.addr);
+}
+
+template <size_t N>
+constexpr size_t count_regs(const PAN3031_RegField_t (&fields)[N])
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < N; i++)
+	{
+		size_t j = 0;
+
+		while (j < i && !same_reg(fields[j], fields[i]))
+		{
+			j++;
+		}
+		n += (j == i);
+	}
+	return n;
+}
+
+template <size_t N>
+constexpr bool disjoint(const PAN3031_RegField_t (&fields)[N])
+{
+	for (size_t i = 0; i < N; i++)
+	{
+		for (size_t j = i + 1; j < N; j++)
+		{
+			if (same_reg(fields[i], fields[j]) && (fields[i].mask & fields[j].mask) != 0)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// masks merged per register, insertion sorted by page then address
+template <size_t M, size_t N>
+constexpr std::array<PAN3031_RegField_t, M> merge(const PAN3031_RegField_t (&fields)[N])
+{
+	std::array<PAN3031_RegField_t, M> regs{};
+	size_t n = 0;
+
+	for (size_t i = 0; i < N; i++)
+	{
+		size_t j = 0;
+
+		while (j < n && !same_reg(regs[j], fields[i]))
+		{
+			j++;
+		}
+		if (j < n)
+		{
+			regs[j].mask |= fields[i].mask;
+			continue;
+		}
+		for (j = n++; j > 0 && before(fields[i], regs[j - 1]); j--)
+		{
+			regs[j] = regs[j - 1];
+		}
+		regs[j] = fields[i];
+	}
+	return regs;
+}
+
+// where each field's register ended up
+template <size_t M, size_t N>
+constexpr std::array<size_t, N> slots(const std::array<PAN3031_RegField_t, M> &regs, const PAN3031_RegField_t (&fields)[N])
+{
+	std::array<size_t, N> at{};
+
+	for (size_t i = 0; i < N; i++)
+	{
+		while (!same_reg(regs[at[i]], fields[i]))
+		{
+			at[i]++;
+		}
+	}
+	return at;
+}
+
+} // namespace detail
+
+// the registers an access touches, each once, in page and address order
+template <class... Fs>
+struct Plan
+{
+	static_assert(sizeof...(Fs) > 0, "an access names at least one field");
+
+	static constexpr PAN3031_RegField_t fields[] = {{static_cast<uint8_t>(Fs::page), Fs::addr, Fs::mask, 0}...};
+
+	static_assert(detail::disjoint(fields), "two fields of one access share bits");
+
+	static constexpr size_t size = detail::count_regs(fields);
+
+	using Regs = std::array<PAN3031_RegField_t, size>;
+
+	static constexpr Regs regs = detail::merge<size>(fields);
+	static constexpr std::array<size_t, sizeof...(Fs)> slots = detail::slots(regs, fields);
+};
+
+// constant values as a register image for PAN3031_apply_image
+template <class... Fs, class... Vs>
+constexpr typename Plan<Fs...>::Regs image(Vs... values)
+{
+	static_assert(sizeof...(Fs) == sizeof...(Vs), "one value per field");
+
+	typename Plan<Fs...>::Regs regs = Plan<Fs...>::regs;
+	size_t i = 0;
+
+	((regs[Plan<Fs...>::slots[i++]].value |= Fs::bits(values)), ...);
+	return regs;
+}
+
+template <class... Fs, class... Vs>
+inline uint32_t write(Vs... values)
+{
+	typename Plan<Fs...>::Regs regs = image<Fs...>(values...);
+
+	return PAN3031_apply_image(regs.data(), static_cast<uint32_t>(regs.size()));
+}
+
+template <class... Fs, class... Vs>
+inline uint32_t read(Vs &... values)
+{
+	static_assert(sizeof...(Fs) == sizeof...(Vs), "one value per field");
+
+	typename Plan<Fs...>::Regs regs = Plan<Fs...>::regs;
+	size_t i = 0;
+
+	if (PAN3031_read_image(regs.data(), static_cast<uint32_t>(regs.size())) != OK)
+	{
+		return FAIL;
+	}
+	((values = static_cast<Vs>(Fs::get(regs[Plan<Fs...>::slots[i++]].value))), ...);
+	return OK;
+}
+
+} // namespace pan3031
+
+#endif // PAN3031_REGS_HPP
@@ -23,14 +23,67 @@
 #define RADIO_FLAG_RXERR        4
 #define RADIO_FLAG_PLHDRXDONE   5
 
+#define RF_PLHD_FILTER_MAX      4
+#define RF_PLHD_FILTER_LEN      16
+
+/*
+ * rf_set_default_para writes the defaults above as one register image computed at compile time
+ * (radio_image.cpp, pan3031_config.hpp) instead of going through rf_set_para
+*/
+#ifndef RF_MODEM_IMAGE
+#define RF_MODEM_IMAGE          1
+#endif
+
+/*
+ * payload compression stage, see lz.h. Every packet then carries one header byte,
+ * RF_LZ_HDR_COMPRESSED set when the rest is LZ data, clear when it is sent raw.
+ * Both ends must agree on it.
+*/
+#ifndef RF_LZ_STAGE
+#define RF_LZ_STAGE             0
+#endif
+#define RF_LZ_HDR_COMPRESSED    0x80
+/* the header takes one of the 255 bytes of a packet, rf_frame keeps its frames to the rest */
+#define RF_LZ_MAX_PAYLOAD       254
+#ifndef RF_LZ_DICT_MAX
+#define RF_LZ_DICT_MAX          64
+#endif
+
 struct RxDoneMsg
 {
 	uint8_t *Payload;
 	uint8_t *PlhdPayload;
 	uint16_t PlhdSize;
 	uint16_t Size;
-	double Rssi;
-	double Snr;
+	RfMeta_t Rssi;	/* centi-dBm with RF_INT_METADATA, else dBm, read with RF_META_TO_CDB */
+	RfMeta_t Snr;	/* centi-dB with RF_INT_METADATA, else dB */
+};
+
+struct RfPlhdFilter
+{
+	uint8_t Value[RF_PLHD_FILTER_LEN];
+	uint8_t Mask[RF_PLHD_FILTER_LEN];
+	uint8_t Len;
+};
+
+struct RfLzStats
+{
+	uint32_t TxPackets;
+	uint32_t TxCompressed;
+	uint32_t TxInBytes;
+	uint32_t TxOutBytes;
+	uint32_t RxCompressed;
+	uint32_t RxErr;
+};
+
+struct RfModemCfg
+{
+	uint32_t Freq;
+	uint8_t Sf;
+	uint8_t Bw;
+	uint8_t Cr;
+	uint8_t Crc;
+	uint8_t TxPower;
 };
 
 typedef enum{
@@ -53,13 +106,20 @@ uint32_t rf_sleep_wakeup(void);
 uint32_t rf_sleep(void);
 
 uint32_t rf_get_tx_time(void);
+uint32_t rf_calc_airtime_us(uint8_t sf, uint8_t bw, uint8_t cr, uint8_t crc, uint8_t len);
+uint32_t rf_get_airtime_us(uint8_t len);
+const struct RfModemCfg *rf_get_modem_cfg(void);
 uint32_t rf_set_mode(uint8_t mode);
 uint8_t rf_get_mode(void);
 uint32_t rf_set_tx_mode(uint8_t mode);
 uint32_t rf_set_rx_mode(uint8_t mode);
 uint32_t rf_set_rx_single_timeout(uint32_t timeout);
+#if !RF_INT_METADATA
 float rf_get_snr(void);
 float rf_get_rssi(void);
+#endif
+int16_t rf_get_snr_cdb(void);
+int16_t rf_get_rssi_cdb(void);
 uint32_t rf_set_preamble(uint16_t pream);
 uint32_t rf_set_cad(void);
 uint32_t rf_set_syncword(uint8_t sync);
@@ -69,9 +129,14 @@ void rf_set_plhd_rx_on(uint8_t addr,uint8_t len);
 void rf_set_plhd_rx_off(void);
 uint32_t rf_receive(uint8_t *buf);
 uint32_t rf_plhd_receive(uint8_t *buf,uint8_t len);
+uint32_t rf_set_plhd_filter(uint8_t index, const uint8_t *value, const uint8_t *mask, uint8_t len);
+void rf_clr_plhd_filter(void);
+uint32_t rf_plhd_filter_match(const uint8_t *payload, uint16_t size);
+uint32_t rf_plhd_abort_rx(void);
+uint32_t rf_get_plhd_reject_count(void);
 
 void rf_rx_plhddone_event( uint8_t *payload, uint16_t size );
-void rf_rx_done_event( uint8_t *payload, uint16_t size, double rssi, double snr );
+void rf_rx_done_event( uint8_t *payload, uint16_t size, RfMeta_t rssi, RfMeta_t snr );
 void rf_rx_err_event(void);
 void rf_rx_timeout_event(void);
 void rf_tx_done_event(void);
@@ -84,10 +149,22 @@ uint32_t rf_continous_tx_send_data(uint8_t *buf, uint8_t size);
 
 uint32_t rf_set_agc(uint32_t state);
 uint32_t rf_set_para(rf_para_type_t para_type, uint32_t para_val);
+uint32_t rf_set_rate(uint8_t sf, uint8_t bw, uint8_t cr);
 uint32_t rf_get_para(rf_para_type_t para_type, uint32_t *para_val);
 void rf_set_default_para(void);
+uint32_t rf_apply_modem_image(const PAN3031_RegField_t *image, uint32_t count, const struct RfModemCfg *cfg);
+#if RF_MODEM_IMAGE
+uint32_t rf_apply_default_image(void);
+#endif
 
 uint32_t rf_set_dcdc_mode(uint32_t dcdc_val);
 uint32_t rf_set_ldr(uint32_t mode);
+#if RF_LZ_STAGE
+uint32_t rf_set_lz_dict(const uint8_t *dict, uint8_t len);
+const struct RfLzStats *rf_get_lz_stats(void);
+#endif
+#if PAN3031_FIFO_CRC
+void rf_set_fifo_crc(uint8_t dir, RadioCrc_t *crc, uint8_t skip);
+#endif
 #endif
 
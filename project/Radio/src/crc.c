@@ -1,5 +1,97 @@
 #include "crc.h"
 
+/*
+ * The lookup tables below are built by the preprocessor from the polynomials, no generator
+ * script and no runtime init. A CRC without final xor is linear, so every table entry is the
+ * xor of the entries of its set bits and only 8 basis values per table have to be computed.
+ * Table Tk holds the CRC of one byte followed by k zero bytes, T0 is the classic byte table.
+ */
+#define CRC_STEP( c, p )  ( ( ( c ) << 1 ) ^ ( ( ( c ) & 0x8000 ) ? ( p ) : 0 ) )
+#define CRC_STEP2( c, p ) CRC_STEP( CRC_STEP( c, p ), p )
+#define CRC_STEP4( c, p ) ( CRC_STEP2( CRC_STEP2( c, p ), p ) & 0xFFFF )
+#define CRC_STEP8( c, p ) CRC_STEP4( CRC_STEP4( c, p ), p )
+
+#define CRC_BASIS( T, S, p ) \
+  T##_B0 = CRC_STEP8( S##_B0, p ), T##_B1 = CRC_STEP8( S##_B1, p ), \
+  T##_B2 = CRC_STEP8( S##_B2, p ), T##_B3 = CRC_STEP8( S##_B3, p ), \
+  T##_B4 = CRC_STEP8( S##_B4, p ), T##_B5 = CRC_STEP8( S##_B5, p ), \
+  T##_B6 = CRC_STEP8( S##_B6, p ), T##_B7 = CRC_STEP8( S##_B7, p )
+
+#define CRC_ENTRY( T, n ) \
+  ( ( ( ( n ) & 0x01 ) ? T##_B0 : 0 ) ^ ( ( ( n ) & 0x02 ) ? T##_B1 : 0 ) ^ \
+    ( ( ( n ) & 0x04 ) ? T##_B2 : 0 ) ^ ( ( ( n ) & 0x08 ) ? T##_B3 : 0 ) ^ \
+    ( ( ( n ) & 0x10 ) ? T##_B4 : 0 ) ^ ( ( ( n ) & 0x20 ) ? T##_B5 : 0 ) ^ \
+    ( ( ( n ) & 0x40 ) ? T##_B6 : 0 ) ^ ( ( ( n ) & 0x80 ) ? T##_B7 : 0 ) )
+
+#define CRC_E4( T, n ) \
+  CRC_ENTRY( T, n ), CRC_ENTRY( T, n + 1 ), CRC_ENTRY( T, n + 2 ), CRC_ENTRY( T, n + 3 )
+#define CRC_E16( T, n ) \
+  CRC_E4( T, n ), CRC_E4( T, n + 4 ), CRC_E4( T, n + 8 ), CRC_E4( T, n + 12 )
+#define CRC_E256( T ) \
+  CRC_E16( T, 0x00 ), CRC_E16( T, 0x10 ), CRC_E16( T, 0x20 ), CRC_E16( T, 0x30 ), \
+  CRC_E16( T, 0x40 ), CRC_E16( T, 0x50 ), CRC_E16( T, 0x60 ), CRC_E16( T, 0x70 ), \
+  CRC_E16( T, 0x80 ), CRC_E16( T, 0x90 ), CRC_E16( T, 0xA0 ), CRC_E16( T, 0xB0 ), \
+  CRC_E16( T, 0xC0 ), CRC_E16( T, 0xD0 ), CRC_E16( T, 0xE0 ), CRC_E16( T, 0xF0 )
+
+// Nibble tables: CRC of 4 bits, the 4 basis values are the top nibble bits stepped 4 times
+#define CRC_NIBBLE_BASIS( T, p ) \
+  T##_B0 = CRC_STEP4( 0x1000, p ), T##_B1 = CRC_STEP4( 0x2000, p ), \
+  T##_B2 = CRC_STEP4( 0x4000, p ), T##_B3 = CRC_STEP4( 0x8000, p )
+#define CRC_NIBBLE_ENTRY( T, n ) \
+  ( ( ( ( n ) & 0x1 ) ? T##_B0 : 0 ) ^ ( ( ( n ) & 0x2 ) ? T##_B1 : 0 ) ^ \
+    ( ( ( n ) & 0x4 ) ? T##_B2 : 0 ) ^ ( ( ( n ) & 0x8 ) ? T##_B3 : 0 ) )
+#define CRC_N4( T, n ) \
+  CRC_NIBBLE_ENTRY( T, n ), CRC_NIBBLE_ENTRY( T, n + 1 ), \
+  CRC_NIBBLE_ENTRY( T, n + 2 ), CRC_NIBBLE_ENTRY( T, n + 3 )
+#define CRC_N16( T ) CRC_N4( T, 0 ), CRC_N4( T, 4 ), CRC_N4( T, 8 ), CRC_N4( T, 12 )
+
+enum
+{
+  CRC_BYTE_B0 = 0x0100, CRC_BYTE_B1 = 0x0200, CRC_BYTE_B2 = 0x0400, CRC_BYTE_B3 = 0x0800,
+  CRC_BYTE_B4 = 0x1000, CRC_BYTE_B5 = 0x2000, CRC_BYTE_B6 = 0x4000, CRC_BYTE_B7 = 0x8000,
+
+  CRC_NIBBLE_BASIS( CRC_CCITT_N, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T0, CRC_BYTE, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T1, CRC_CCITT_T0, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T2, CRC_CCITT_T1, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T3, CRC_CCITT_T2, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T4, CRC_CCITT_T3, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T5, CRC_CCITT_T4, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T6, CRC_CCITT_T5, POLYNOMIAL_CCITT ),
+  CRC_BASIS( CRC_CCITT_T7, CRC_CCITT_T6, POLYNOMIAL_CCITT ),
+
+  CRC_NIBBLE_BASIS( CRC_IBM_N, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T0, CRC_BYTE, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T1, CRC_IBM_T0, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T2, CRC_IBM_T1, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T3, CRC_IBM_T2, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T4, CRC_IBM_T3, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T5, CRC_IBM_T4, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T6, CRC_IBM_T5, POLYNOMIAL_IBM ),
+  CRC_BASIS( CRC_IBM_T7, CRC_IBM_T6, POLYNOMIAL_IBM ),
+};
+
+static const uint16_t CrcCcittNibble[16] = { CRC_N16( CRC_CCITT_N ) };
+static const uint16_t CrcIbmNibble[16] = { CRC_N16( CRC_IBM_N ) };
+
+static const uint16_t CrcCcittT0[256] = { CRC_E256( CRC_CCITT_T0 ) };
+static const uint16_t CrcCcittT1[256] = { CRC_E256( CRC_CCITT_T1 ) };
+static const uint16_t CrcCcittT2[256] = { CRC_E256( CRC_CCITT_T2 ) };
+static const uint16_t CrcCcittT3[256] = { CRC_E256( CRC_CCITT_T3 ) };
+static const uint16_t CrcCcittT4[256] = { CRC_E256( CRC_CCITT_T4 ) };
+static const uint16_t CrcCcittT5[256] = { CRC_E256( CRC_CCITT_T5 ) };
+static const uint16_t CrcCcittT6[256] = { CRC_E256( CRC_CCITT_T6 ) };
+static const uint16_t CrcCcittT7[256] = { CRC_E256( CRC_CCITT_T7 ) };
+
+static const uint16_t CrcIbmT0[256] = { CRC_E256( CRC_IBM_T0 ) };
+static const uint16_t CrcIbmT1[256] = { CRC_E256( CRC_IBM_T1 ) };
+static const uint16_t CrcIbmT2[256] = { CRC_E256( CRC_IBM_T2 ) };
+static const uint16_t CrcIbmT3[256] = { CRC_E256( CRC_IBM_T3 ) };
+static const uint16_t CrcIbmT4[256] = { CRC_E256( CRC_IBM_T4 ) };
+static const uint16_t CrcIbmT5[256] = { CRC_E256( CRC_IBM_T5 ) };
+static const uint16_t CrcIbmT6[256] = { CRC_E256( CRC_IBM_T6 ) };
+static const uint16_t CrcIbmT7[256] = { CRC_E256( CRC_IBM_T7 ) };
+
 
 uint16_t ComputeCrc( uint16_t crc, uint8_t dataByte, uint16_t polynomial )
 {
@@ -22,26 +114,147 @@ uint16_t ComputeCrc( uint16_t crc, uint8_t dataByte, uint16_t polynomial )
 }
 
 
-uint16_t RadioComputeCRC( uint8_t *buffer, uint8_t length, uint8_t crcType )
+uint16_t ComputeCrcBitwise( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType )
 {
-  uint8_t i = 0;
-  uint16_t crc = 0;
-  uint16_t polynomial = 0;
-  
-  polynomial = ( crcType == CRC_TYPE_IBM ) ? POLYNOMIAL_IBM : POLYNOMIAL_CCITT;
-  crc = ( crcType == CRC_TYPE_IBM ) ? CRC_IBM_SEED : CRC_CCITT_SEED;
-  for( i = 0; i < length; i++ )
+  uint16_t polynomial = ( crcType == CRC_TYPE_IBM ) ? POLYNOMIAL_IBM : POLYNOMIAL_CCITT;
+
+  while( length-- )
   {
-   crc = ComputeCrc( crc, buffer[i], polynomial );
+   crc = ComputeCrc( crc, *buffer++, polynomial );
   }
-  if( crcType == CRC_TYPE_IBM )
+  return crc;
+}
+
+
+uint16_t ComputeCrcNibble( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType )
+{
+  const uint16_t *t = ( crcType == CRC_TYPE_IBM ) ? CrcIbmNibble : CrcCcittNibble;
+
+  while( length-- )
   {
-   return crc;
+   crc = ( uint16_t )( crc << 4 ) ^ t[( crc >> 12 ) ^ ( *buffer >> 4 )];
+   crc = ( uint16_t )( crc << 4 ) ^ t[( crc >> 12 ) ^ ( *buffer & 0x0F )];
+   buffer++;
+  }
+  return crc;
+}
+
+
+uint16_t ComputeCrcTable( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType )
+{
+  const uint16_t *t0 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT0 : CrcCcittT0;
+
+  while( length-- )
+  {
+   crc = ( uint16_t )( crc << 8 ) ^ t0[( crc >> 8 ) ^ *buffer++];
+  }
+  return crc;
+}
+
+
+uint16_t ComputeCrcSlice4( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType )
+{
+  const uint16_t *t0 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT0 : CrcCcittT0;
+  const uint16_t *t1 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT1 : CrcCcittT1;
+  const uint16_t *t2 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT2 : CrcCcittT2;
+  const uint16_t *t3 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT3 : CrcCcittT3;
+
+  // the 16 bit state folds into the first two bytes of every block
+  while( length >= 4 )
+  {
+   crc = t3[( crc >> 8 ) ^ buffer[0]] ^ t2[( crc & 0xFF ) ^ buffer[1]] ^
+         t1[buffer[2]] ^ t0[buffer[3]];
+   buffer += 4;
+   length -= 4;
+  }
+  return ComputeCrcTable( crc, buffer, length, crcType );
+}
+
+
+uint16_t ComputeCrcSlice8( uint16_t crc, const uint8_t *buffer, uint32_t length, uint8_t crcType )
+{
+  const uint16_t *t0 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT0 : CrcCcittT0;
+  const uint16_t *t1 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT1 : CrcCcittT1;
+  const uint16_t *t2 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT2 : CrcCcittT2;
+  const uint16_t *t3 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT3 : CrcCcittT3;
+  const uint16_t *t4 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT4 : CrcCcittT4;
+  const uint16_t *t5 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT5 : CrcCcittT5;
+  const uint16_t *t6 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT6 : CrcCcittT6;
+  const uint16_t *t7 = ( crcType == CRC_TYPE_IBM ) ? CrcIbmT7 : CrcCcittT7;
+
+  while( length >= 8 )
+  {
+   crc = t7[( crc >> 8 ) ^ buffer[0]] ^ t6[( crc & 0xFF ) ^ buffer[1]] ^
+         t5[buffer[2]] ^ t4[buffer[3]] ^ t3[buffer[4]] ^ t2[buffer[5]] ^
+         t1[buffer[6]] ^ t0[buffer[7]];
+   buffer += 8;
+   length -= 8;
+  }
+  return ComputeCrcTable( crc, buffer, length, crcType );
+}
+
+
+// Engine behind RadioComputeCRC and RadioCrcUpdate
+#if CRC_IMPL == CRC_IMPL_BITWISE
+#define CRC_ENGINE ComputeCrcBitwise
+#elif CRC_IMPL == CRC_IMPL_NIBBLE
+#define CRC_ENGINE ComputeCrcNibble
+#elif CRC_IMPL == CRC_IMPL_SLICE4
+#define CRC_ENGINE ComputeCrcSlice4
+#elif CRC_IMPL == CRC_IMPL_SLICE8
+#define CRC_ENGINE ComputeCrcSlice8
+#else
+#define CRC_ENGINE ComputeCrcTable
+#endif
+
+
+void RadioCrcInit( RadioCrc_t *ctx, uint8_t crcType )
+{
+  ctx->Type = crcType;
+  ctx->Crc = ( crcType == CRC_TYPE_IBM ) ? CRC_IBM_SEED : CRC_CCITT_SEED;
+  ctx->Length = 0;
+}
+
+
+void RadioCrcUpdate( RadioCrc_t *ctx, const uint8_t *buffer, uint32_t length )
+{
+  ctx->Crc = CRC_ENGINE( ctx->Crc, buffer, length, ctx->Type );
+  ctx->Length += length;
+}
+
+
+// One byte at a time, used while the byte is on the SPI bus
+void RadioCrcUpdateByte( RadioCrc_t *ctx, uint8_t dataByte )
+{
+#if CRC_IMPL == CRC_IMPL_BITWISE || CRC_IMPL == CRC_IMPL_NIBBLE
+  ctx->Crc = CRC_ENGINE( ctx->Crc, &dataByte, 1, ctx->Type );
+#else
+  const uint16_t *t0 = ( ctx->Type == CRC_TYPE_IBM ) ? CrcIbmT0 : CrcCcittT0;
+
+  ctx->Crc = ( uint16_t )( ctx->Crc << 8 ) ^ t0[( ctx->Crc >> 8 ) ^ dataByte];
+#endif
+  ctx->Length++;
+}
+
+
+uint16_t RadioCrcFinal( const RadioCrc_t *ctx )
+{
+  if( ctx->Type == CRC_TYPE_IBM )
+  {
+   return ctx->Crc;
   }
   else
   {
-   return( ( uint16_t ) ( ~crc ));
-   }
+   return( ( uint16_t ) ( ~ctx->Crc ));
+  }
 }
 
 
+uint16_t RadioComputeCRC( uint8_t *buffer, uint32_t length, uint8_t crcType )
+{
+  RadioCrc_t ctx;
+
+  RadioCrcInit( &ctx, crcType );
+  RadioCrcUpdate( &ctx, buffer, length );
+  return RadioCrcFinal( &ctx );
+}
@@ -0,0 +1,187 @@
+#include "lz.h"
+
+#define LZ_HASH_BITS 7
+#define LZ_HASH_SIZE ( 1 << LZ_HASH_BITS )
+#define LZ_NIL 0xFFFF
+
+#define LZ_HASH( p ) \
+  ( ( ( ( uint32_t )( p )[0] << 6 ) ^ ( ( uint32_t )( p )[1] << 3 ) ^ ( p )[2] ) & ( LZ_HASH_SIZE - 1 ) )
+
+// Encoder state, not reentrant
+static uint16_t LzHead[LZ_HASH_SIZE];
+static uint16_t LzPrev[LZ_WINDOW];
+
+
+static void LzInsert( const uint8_t *src, uint32_t pos )
+{
+  uint32_t h = LZ_HASH( src + pos );
+
+  LzPrev[pos & ( LZ_WINDOW - 1 )] = LzHead[h];
+  LzHead[h] = ( uint16_t )pos;
+}
+
+
+/**
+ * @brief compress a buffer, optionally behind history both ends share (a preset dictionary)
+ * @param[in] <src> history followed by the input
+ * @param[in] <histLen> history length, 0 for none
+ * @param[in] <srcLen> input length, histLen + srcLen at most LZ_MAX_INPUT
+ * @param[out] <dst> output
+ * @param[in] <dstMax> output size, pass srcLen - 1 to only accept output that is smaller
+ * @return compressed length, 0 when it does not fit in dstMax
+ */
+uint32_t LzCompress( const uint8_t *src, uint32_t histLen, uint32_t srcLen, uint8_t *dst, uint32_t dstMax )
+{
+  uint32_t pos = histLen, out = 0, ctrl = 0;
+  uint32_t cand, dist, len, maxLen, bestLen, bestDist, chain, i;
+  uint8_t bit = 8;
+
+  if( srcLen == 0 || histLen + srcLen > LZ_MAX_INPUT )
+  {
+    return 0;
+  }
+  srcLen += histLen;
+  for( i = 0; i < LZ_HASH_SIZE; i++ )
+  {
+    LzHead[i] = LZ_NIL;
+  }
+  for( i = ( histLen > LZ_WINDOW ) ? histLen - LZ_WINDOW : 0; i + LZ_MIN_MATCH <= histLen; i++ )
+  {
+    LzInsert( src, i );
+  }
+
+  while( pos < srcLen )
+  {
+    if( bit == 8 )
+    {
+      if( out >= dstMax )
+      {
+        return 0;
+      }
+      ctrl = out++;
+      dst[ctrl] = 0;
+      bit = 0;
+    }
+
+    bestLen = 0;
+    bestDist = 0;
+    if( pos + LZ_MIN_MATCH <= srcLen )
+    {
+      maxLen = srcLen - pos;
+      if( maxLen > LZ_MAX_MATCH )
+      {
+        maxLen = LZ_MAX_MATCH;
+      }
+      cand = LzHead[LZ_HASH( src + pos )];
+      for( chain = 0; chain < LZ_MAX_CHAIN && cand != LZ_NIL && cand < pos; chain++ )
+      {
+        dist = pos - cand;
+        if( dist > LZ_WINDOW )
+        {
+          break;
+        }
+        for( len = 0; len < maxLen && src[cand + len] == src[pos + len]; len++ )
+        {
+        }
+        if( len > bestLen )
+        {
+          bestLen = len;
+          bestDist = dist;
+          if( len == maxLen )
+          {
+            break;
+          }
+        }
+        // a slot overwritten by a newer position links forward, which ends the chain
+        i = LzPrev[cand & ( LZ_WINDOW - 1 )];
+        if( i >= cand )
+        {
+          break;
+        }
+        cand = i;
+      }
+      LzInsert( src, pos );
+    }
+
+    if( bestLen >= LZ_MIN_MATCH )
+    {
+      if( out + 2 > dstMax )
+      {
+        return 0;
+      }
+      dst[ctrl] |= 1 << bit;
+      dst[out++] = ( uint8_t )( bestDist - 1 );
+      dst[out++] = ( uint8_t )( bestLen - LZ_MIN_MATCH );
+      for( i = pos + 1; i < pos + bestLen && i + LZ_MIN_MATCH <= srcLen; i++ )
+      {
+        LzInsert( src, i );
+      }
+      pos += bestLen;
+    }
+    else
+    {
+      if( out >= dstMax )
+      {
+        return 0;
+      }
+      dst[out++] = src[pos++];
+    }
+    bit++;
+  }
+
+  return out;
+}
+
+
+/**
+ * @brief decompress a buffer produced by LzCompress
+ * @param[in] <src> compressed input
+ * @param[in] <srcLen> compressed length
+ * @param[in/out] <dst> the history given to LzCompress, followed by the output
+ * @param[in] <histLen> history length, 0 for none
+ * @param[in] <dstMax> size of dst, history included
+ * @return decompressed length without the history, 0 when the input is corrupt or does not fit
+ */
+uint32_t LzDecompress( const uint8_t *src, uint32_t srcLen, uint8_t *dst, uint32_t histLen, uint32_t dstMax )
+{
+  uint32_t in = 0, out = histLen, dist, len;
+  uint8_t ctrl, bit;
+
+  while( in < srcLen )
+  {
+    ctrl = src[in++];
+    for( bit = 0; bit < 8 && in < srcLen; bit++ )
+    {
+      if( ctrl & ( 1 << bit ) )
+      {
+        if( in + 2 > srcLen )
+        {
+          return 0;
+        }
+        dist = src[in] + 1;
+        len = src[in + 1] + LZ_MIN_MATCH;
+        in += 2;
+        if( dist > out || out + len > dstMax )
+        {
+          return 0;
+        }
+        // byte by byte, matches may overlap their own output
+        for( ; len > 0; len-- )
+        {
+          dst[out] = dst[out - dist];
+          out++;
+        }
+      }
+      else
+      {
+        if( out >= dstMax )
+        {
+          return 0;
+        }
+        dst[out++] = src[in++];
+      }
+    }
+  }
+
+  return out - histLen;
+}
@@ -8,19 +8,29 @@
 *******************************************************************************/
 #include "stdio.h"
 #include "stm32f0xx_hal.h"
-#include "math.h"
 #include "pan3031_port.h"
 #include "pan3031.h" 
 #include "radio.h" 
+/* after pan3031.h, which defines RF_INT_METADATA */
+#if !RF_INT_METADATA
+#include "math.h"
+#endif
 uint8_t RadioRxPayload[255];
 uint8_t plhd_buf[16];
 
+#if PAN3031_FIFO_CRC
+/* CRCs fed by the FIFO accessors while bytes cross the SPI bus, one per direction, NULL when unused */
+static RadioCrc_t *volatile fifo_crc[2] = {NULL, NULL};
+/* leading bytes of each FIFO transfer left out of the CRC, e.g. a frame header */
+static volatile uint8_t fifo_crc_skip[2] = {0, 0};
+#endif
+
 /**
  * @brief read one byte from register in current page
  * @param[in] <addr> register address to write
  * @return value read from register
  */
-static uint8_t PAN3031_read_reg(uint8_t addr)
+PAN3031_LOCAL uint8_t PAN3031_read_reg(uint8_t addr)
 { 
 	uint8_t temreg = 0x00;  
 	
@@ -37,7 +47,7 @@ static uint8_t PAN3031_read_reg(uint8_t addr)
  * @param[in] <value> address value to write to rgister
  * @return result
  */
-static uint32_t PAN3031_write_reg(uint8_t addr,uint8_t value)
+PAN3031_LOCAL uint32_t PAN3031_write_reg(uint8_t addr,uint8_t value)
 { 
 	uint16_t tmpreg = 0;  
 	uint16_t addr_w = (0x01 | (addr << 1));	
@@ -64,13 +74,28 @@ static uint32_t PAN3031_write_reg(uint8_t addr,uint8_t value)
  * @param[in] <size> send data size
  * @return none
  */
-static void PAN3031_write_fifo(uint8_t addr,uint8_t *buffer,int size)
+PAN3031_LOCAL void PAN3031_write_fifo(uint8_t addr,uint8_t *buffer,int size)
 { 
 	int i;
 	uint8_t addr_w = (0x01 | (addr << 1));
 	
 	rf_port.spi_cs_low();	
 	rf_port.spi_readwrite(addr_w);
+#if PAN3031_FIFO_CRC
+	if(fifo_crc[PAN3031_FIFO_TX] != NULL)
+	{
+		for(i =0;i<size;i++)
+		{
+			rf_port.spi_readwrite(buffer[i]);
+			if(i >= fifo_crc_skip[PAN3031_FIFO_TX])
+			{
+				RadioCrcUpdateByte(fifo_crc[PAN3031_FIFO_TX], buffer[i]);
+			}
+		}
+		rf_port.spi_cs_high();
+		return;
+	}
+#endif
 	for(i =0;i<size;i++)
 	{
 		rf_port.spi_readwrite(buffer[i]);
@@ -85,13 +110,28 @@ static void PAN3031_write_fifo(uint8_t addr,uint8_t *buffer,int size)
  * @param[in] <size> receive data size
  * @return none
  */
-static void PAN3031_read_fifo(uint8_t addr,uint8_t *buffer,int size)
+PAN3031_LOCAL void PAN3031_read_fifo(uint8_t addr,uint8_t *buffer,int size)
 {   
 	int i;
 	uint8_t addr_w = (0x00 | (addr<<1));
 	
 	rf_port.spi_cs_low();	
 	rf_port.spi_readwrite(addr_w);
+#if PAN3031_FIFO_CRC
+	if(fifo_crc[PAN3031_FIFO_RX] != NULL)
+	{
+		for(i =0;i<size;i++)
+		{
+			buffer[i] = rf_port.spi_readwrite(0x00);
+			if(i >= fifo_crc_skip[PAN3031_FIFO_RX])
+			{
+				RadioCrcUpdateByte(fifo_crc[PAN3031_FIFO_RX], buffer[i]);
+			}
+		}
+		rf_port.spi_cs_high();
+		return;
+	}
+#endif
 	for(i =0;i<size;i++)
 	{
 		buffer[i] = rf_port.spi_readwrite(0x00);	
@@ -99,12 +139,29 @@ static void PAN3031_read_fifo(uint8_t addr,uint8_t *buffer,int size)
 	rf_port.spi_cs_high();	
 }
 
+#if PAN3031_FIFO_CRC
+/**
+ * @brief attach a streaming CRC to one FIFO direction, every byte written (TX) or read (RX)
+ *        after the first skip bytes of a transfer is added to it
+ * @param[in] <dir> PAN3031_FIFO_TX / PAN3031_FIFO_RX
+ * @param[in] <crc> CRC state initialized by RadioCrcInit, NULL to detach
+ * @param[in] <skip> leading bytes of each transfer left out, e.g. a frame header
+ * @return none
+ */
+void PAN3031_set_fifo_crc(uint8_t dir, RadioCrc_t *crc, uint8_t skip)
+{
+	fifo_crc[dir] = NULL;
+	fifo_crc_skip[dir] = skip;
+	fifo_crc[dir] = crc;
+}
+#endif
+
 /**
  * @brief switch page
  * @param[in] <page> page to switch
  * @return result
  */
-static uint32_t PAN3031_switch_page(enum PAGE_SEL page)
+PAN3031_LOCAL uint32_t PAN3031_switch_page(enum PAGE_SEL page)
 {	
 	uint8_t page_sel = 0x00;
 	uint8_t tmpreg = 0x00;
@@ -145,6 +202,67 @@ uint32_t PAN3031_write_spec_page_reg(enum PAGE_SEL page,uint8_t addr,uint8_t val
 	}
 } 
 
+/**
+ * @brief write a register image, the page is only switched when it changes between fields
+ * @param[in] <image> fields in the order to write, grouped by page
+ * @param[in] <count> number of fields
+ * @return result
+ */
+uint32_t PAN3031_apply_image(const PAN3031_RegField_t *image, uint32_t count)
+{
+	uint32_t i;
+	uint8_t page = 0xff;
+	uint8_t value;
+
+	for(i = 0; i < count; i++)
+	{
+		if(image[i].page != page)
+		{
+			if(PAN3031_switch_page((enum PAGE_SEL)image[i].page) != OK)
+			{
+				return FAIL;
+			}
+			page = image[i].page;
+		}
+		value = image[i].value;
+		if(image[i].mask != 0xff)
+		{
+			value |= PAN3031_read_reg(image[i].addr) & ~image[i].mask;
+		}
+		if(PAN3031_write_reg(image[i].addr, value) != OK)
+		{
+			return FAIL;
+		}
+	}
+	return OK;
+}
+
+/**
+ * @brief read the registers of an image into its values, the page is only switched when it changes
+ * @param[in] <image> registers to read, grouped by page
+ * @param[in] <count> number of registers
+ * @return result
+ */
+uint32_t PAN3031_read_image(PAN3031_RegField_t *image, uint32_t count)
+{
+	uint32_t i;
+	uint8_t page = 0xff;
+
+	for(i = 0; i < count; i++)
+	{
+		if(image[i].page != page)
+		{
+			if(PAN3031_switch_page((enum PAGE_SEL)image[i].page) != OK)
+			{
+				return FAIL;
+			}
+			page = image[i].page;
+		}
+		image[i].value = PAN3031_read_reg(image[i].addr);
+	}
+	return OK;
+}
+
 /**
  * @brief read a value to register in specific page
  * @param[in] <page> the page of register
@@ -1079,9 +1197,9 @@ uint32_t PAN3031_set_freq(uint32_t freq)
 {
 	uint8_t reg_read;
 	uint8_t reg_freq;
-	float tmp_var = 0.0;
+	uint32_t tmp_var = 0;	/* freq * LO multiplier, integer part in units of 16 MHz */
 	int integer_part = 0;
-	float fractional_part = 0.0;
+	uint32_t fractional_part = 0;
 	int fb,fc;
 	uint8_t lowband_sel = 0;
 
@@ -1092,7 +1210,7 @@ uint32_t PAN3031_set_freq(uint32_t freq)
 			return FAIL;
 		}
 		lowband_sel = 1;
-		tmp_var = freq * 4 * 1.0 / 16000000;
+		tmp_var = freq * 4;
 		PAN3031_set_lo_freq(LO_400M);
 	}
 	else if ( (freq > freq_470000000) && (freq <= freq_510000000))
@@ -1102,7 +1220,7 @@ uint32_t PAN3031_set_freq(uint32_t freq)
 			return FAIL;
 		}
 		lowband_sel = 1;
-		tmp_var = freq * 4 * 1.0 / 16000000;
+		tmp_var = freq * 4;
 		PAN3031_set_lo_freq(LO_400M);
 	}
 	else if((freq >= freq_800000000) && (freq <= freq_920000000))
@@ -1112,17 +1230,18 @@ uint32_t PAN3031_set_freq(uint32_t freq)
 			return FAIL;
 		}	
         lowband_sel = 0;
-		tmp_var = freq * 2 * 1.0 / 16000000;
+		tmp_var = freq * 2;
 		PAN3031_set_lo_freq(LO_800M);
 	}	
 	else
 	{
 		return FAIL;
 	}
-	integer_part = (int)tmp_var;
+	integer_part = tmp_var / 16000000;
 	fb = integer_part - 20;
-	fractional_part = tmp_var - integer_part;
-	fc = (int)(fractional_part * 1600 / (2 * (1 + lowband_sel)));
+	fractional_part = tmp_var % 16000000;
+	/* fraction * 1600 / (2 * (1 + lowband_sel)), fraction = fractional_part / 16 MHz */
+	fc = fractional_part / (10000 * 2 * (1 + lowband_sel));
 	
 	if(fc < 0xff)
 	{
@@ -1206,20 +1325,21 @@ uint32_t PAN3031_read_freq(void)
  */
 uint32_t PAN3031_calculate_tx_time(void)
 {
-	int bw_val;
-	float tx_done_time;	
-	uint8_t pl = PAN3031_read_spec_page_reg(PAGE1_SEL,REG_PAYLOAD_LEN);
-	uint8_t sf = PAN3031_get_sf();
-	uint8_t crc = PAN3031_get_crc();
-	uint8_t code_rate = PAN3031_get_code_rate();
-	uint8_t bw = PAN3031_get_bw();
+	uint32_t bw_val = 125000;
+	uint32_t tx_done_time;	
+	PAN3031_ModemFields_t m = {0};
+	uint8_t pl, sf, crc, code_rate, bw;
 
-	float a,b,c,d=0.00;
+	int32_t a;
+	uint32_t b = 0, c;
+
+	PAN3031_get_modem_fields(&m);
+	pl = m.PayloadLen;
+	sf = m.Sf;
+	crc = m.Crc;
+	code_rate = m.Cr;
+	bw = m.Bw;
 	
-	if(bw == 7)	
-	{
-		bw_val = 125000;
-	}
 	if(bw == 8)	
 	{
 		bw_val = 250000;
@@ -1228,11 +1348,15 @@ uint32_t PAN3031_calculate_tx_time(void)
 	{
 		bw_val = 500000;
 	}
-	a = (float)(8 * pl - 4 * sf + 28 + 16 *crc) / (float)(4 * sf);
-	b = ceil(a);
+	/* b = ceil(a), a is above -1 when negative */
+	a = 8 * pl - 4 * sf + 28 + 16 *crc;
+	if(a > 0)
+	{
+		b = (a + 4 * sf - 1) / (4 * sf);
+	}
 	c = code_rate + 4;
-	d = ((float)((2<<(sf-1))) / bw_val);
-	tx_done_time =(12.25 +8 + b*c)*d*1000 ;
+	/* (12.25 + 8 + b*c) symbols of 2^sf / bw s, in hundredths of a symbol */
+	tx_done_time = (2025 + 100 * b * c) * (1UL << sf) * 10 / bw_val;
 
 	return tx_done_time + 5; 
 }
@@ -1505,6 +1629,7 @@ uint32_t PAN3031_set_timeout(uint32_t timeout)
 	}
 }
 
+#if !RF_INT_METADATA
 /**
  * @brief get snr value
  * @param[in] <none> 
@@ -1617,6 +1742,108 @@ float PAN3031_get_rssi(void)
 
 	return rssi_val;
 }
+#endif
+
+/**
+ * @brief log2 in Q8 fixed point, 8 fraction bits by repeated squaring of the mantissa
+ * @param[in] <x> value, 0 is taken as 1
+ * @return log2(x) * 256
+ */
+static int32_t PAN3031_log2_q8(uint32_t x)
+{
+	int32_t res = 31;
+	uint32_t y;
+	uint8_t i;
+
+	if(x == 0)
+	{
+		x = 1;
+	}
+	while(!(x & 0x80000000UL))
+	{
+		x <<= 1;
+		res--;
+	}
+	res <<= 8;
+	y = x >> 16;	/* mantissa in [1, 2), Q15 */
+	for(i = 0; i < 8; i++)
+	{
+		y = (y * y) >> 15;
+		if(y >= 0x10000)
+		{
+			y >>= 1;
+			res |= 0x80 >> i;
+		}
+	}
+	return res;
+}
+
+/**
+ * @brief get snr value, integer only
+ * @param[in] <none> 
+ * @return snr(in centi-dB), 10 * log10(sig_pow / 2^sf / noise_pow)
+ */
+int16_t PAN3031_get_snr_cdb(void)
+{
+	uint8_t sig_pow_l, sig_pow_m, sig_pow_h;
+	uint8_t noise_pow_l, noise_pow_m, noise_pow_h;
+	uint32_t sig_pow_val;
+	uint32_t noise_pow_val;
+	uint32_t sf_val;
+	int32_t l;
+	
+	sig_pow_l = PAN3031_read_spec_page_reg(PAGE1_SEL,0x74);
+	sig_pow_m = PAN3031_read_spec_page_reg(PAGE1_SEL,0x75);
+	sig_pow_h = PAN3031_read_spec_page_reg(PAGE1_SEL,0x76);
+	sig_pow_val = ((sig_pow_h << 16) | (sig_pow_m << 8) | sig_pow_l );
+
+	noise_pow_l = PAN3031_read_spec_page_reg(PAGE2_SEL,0x71);
+	noise_pow_m = PAN3031_read_spec_page_reg(PAGE2_SEL,0x72);
+	noise_pow_h = PAN3031_read_spec_page_reg(PAGE2_SEL,0x73);
+	noise_pow_val = ((noise_pow_h << 16) | (noise_pow_m << 8) | noise_pow_l );
+
+	sf_val = (PAN3031_read_spec_page_reg(PAGE1_SEL,0x7c) & 0xf0) >> 4;
+
+	/* log2 in Q8, 10 * log10(2) = 3.0103 dB per unit */
+	l = PAN3031_log2_q8(sig_pow_val) - (int32_t)(sf_val << 8) - PAN3031_log2_q8(noise_pow_val);
+	return (int16_t)((l * 30103 + ((l < 0) ? -12800 : 12800)) / 25600);
+}
+
+static int16_t PAN3031_rssi_cdb(int16_t snr_cdb)
+{
+	int bw_pow_val = 0;
+
+	switch(PAN3031_get_bw())
+	{
+		case 6 : 
+			bw_pow_val = 9;
+			break;
+		case 7 : 	
+			bw_pow_val = 6;
+			break;
+		case 8:		
+			bw_pow_val = 3;
+			break;
+		default:
+			break;
+	}
+
+	if(snr_cdb < 600)
+	{
+		return snr_cdb - (113 + bw_pow_val) * 100;
+	}
+	return (PAN3031_read_spec_page_reg(PAGE1_SEL,0x7e) - 256) * 100;
+}
+
+/**
+ * @brief get rssi value, integer only
+ * @param[in] <none> 
+ * @return rssi(in centi-dBm)
+ */
+int16_t PAN3031_get_rssi_cdb(void)
+{
+	return PAN3031_rssi_cdb(PAN3031_get_snr_cdb());
+}
 
 /**
  * @brief set tx_power
@@ -2020,9 +2247,12 @@ uint8_t PAN3031_get_plhd_mask(void)
 uint8_t PAN3031_recv_plhd8(uint8_t *buff)
 {
 	uint32_t i,len = 8;
+
+	/* one page switch for the whole PLHD, it is read in the early irq */
+	PAN3031_switch_page(PAGE2_SEL);
 	for(i = 0; i < len; i++)
 	{
-		buff[i] = PAN3031_read_spec_page_reg(PAGE2_SEL, 0x76 + i);
+		buff[i] = PAN3031_read_reg(0x76 + i);
 	}
 	
 	PAN3031_clr_irq();
@@ -2037,14 +2267,17 @@ uint8_t PAN3031_recv_plhd8(uint8_t *buff)
 uint8_t PAN3031_recv_plhd16(uint8_t *buff)
 {
 	uint32_t i,len = 16;	
-	for(i = 0; i < len; i++)
+
+	/* bytes 0..9 live in page 2, bytes 10..15 in page 0 */
+	PAN3031_switch_page(PAGE2_SEL);
+	for(i = 0; i < 10; i++)
 	{
-		if(i<10)
-		{
-			buff[i] = PAN3031_read_spec_page_reg(PAGE2_SEL, 0x76 + i);
-		}else{
-			buff[i] = PAN3031_read_spec_page_reg(PAGE0_SEL, 0x76 + i - 10);
-		}	
+		buff[i] = PAN3031_read_reg(0x76 + i);
+	}
+	PAN3031_switch_page(PAGE0_SEL);
+	for(i = 10; i < len; i++)
+	{
+		buff[i] = PAN3031_read_reg(0x76 + i - 10);
 	}
 
 	PAN3031_clr_irq();
@@ -2124,7 +2357,8 @@ uint32_t PAN3031_set_ldr(uint32_t mode)
  */
 void PAN3031_irq_handler(void)
 {
-	double snr,rssi,plhd_len;
+	RfMeta_t snr,rssi;
+	uint8_t plhd_len;
 	uint16_t size = 0;
 	uint8_t irq = PAN3031_get_irq();
 
@@ -2136,8 +2370,13 @@ void PAN3031_irq_handler(void)
 
 	}else if(irq & REG_IRQ_RX_DONE)
 	{
+#if RF_INT_METADATA
+		snr = PAN3031_get_snr_cdb();
+		rssi = PAN3031_rssi_cdb(snr);
+#else
 		snr = PAN3031_get_snr();
 		rssi = PAN3031_get_rssi();
+#endif
 		size = PAN3031_recv_packet(RadioRxPayload);
 		rf_rx_done_event( RadioRxPayload, size, rssi, snr );
 
@@ -0,0 +1,34 @@
+//
+// Driver paths written with the typed register fields of pan3031_regs.hpp
+//
+#include "pan3031_regs.hpp"
+
+using namespace pan3031;
+
+/**
+ * @brief set spread factor, bandwidth and code rate together: one page switch and one
+ *        read-modify-write per register instead of one of each per parameter
+ * @param[in] <sf> SF_7 / SF_8 / SF_9
+ * @param[in] <bw> BW_125K / BW_250K / BW_500K
+ * @param[in] <code_rate> CODE_RATE_45 / CODE_RATE_46 / CODE_RATE_47 / CODE_RATE_48
+ * @return result, FAIL with nothing written when a value is out of these ranges
+ */
+extern "C" uint32_t PAN3031_set_rate(uint8_t sf, uint8_t bw, uint8_t code_rate)
+{
+	if (sf < SF_7 || sf > SF_9 || bw < BW_125K || bw > BW_500K || code_rate < CODE_RATE_45 || code_rate > CODE_RATE_48)
+	{
+		return FAIL;
+	}
+	return write<reg::Sf, reg::Bw, reg::Cr>(sf, bw, code_rate);
+}
+
+/**
+ * @brief read payload length, spread factor, bandwidth, code rate and CRC in one pass
+ * @param[out] <fields> the values
+ * @return result
+ */
+extern "C" uint32_t PAN3031_get_modem_fields(PAN3031_ModemFields_t *fields)
+{
+	return read<reg::PayloadLen, reg::Sf, reg::Bw, reg::Cr, reg::Crc>(fields->PayloadLen, fields->Sf, fields->Bw,
+																	  fields->Cr, fields->Crc);
+}
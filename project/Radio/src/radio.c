@@ -11,6 +11,10 @@
 #include "stdlib.h"
 #include "stm32f0xx_hal.h"
 #include "stdio.h"
+#if RF_LZ_STAGE
+#include "lz.h"
+#include "string.h"
+#endif
 
 /*
  * flag that indicate if a new packet is received.
@@ -24,6 +28,129 @@ static int packet_transmit = RADIO_FLAG_IDLE;
 
 struct RxDoneMsg RxDoneParams;
 
+/*
+ * shadow of the modem parameters written by rf_set_para, so airtime can be computed without SPI access
+*/
+static struct RfModemCfg modem_cfg = {DEFAULT_FREQ, DEFAULT_SF, DEFAULT_BW, DEFAULT_CR, CRC_ON, 0x7F};
+
+/*
+ * PLHD allow-list, an empty list disables early filtering.
+*/
+static struct RfPlhdFilter plhd_filter[RF_PLHD_FILTER_MAX];
+static uint8_t plhd_filter_cnt = 0;
+static uint32_t plhd_reject_cnt = 0;
+
+#if RF_LZ_STAGE
+/*
+ * compression stage buffers. lz_tx_buf is one header byte plus payload, the work buffers
+ * start with the preset dictionary that the payload is compressed against.
+*/
+static uint8_t lz_tx_buf[RF_LZ_MAX_PAYLOAD + 1];
+static uint8_t lz_tx_work[RF_LZ_DICT_MAX + RF_LZ_MAX_PAYLOAD];
+static uint8_t lz_rx_work[RF_LZ_DICT_MAX + RF_LZ_MAX_PAYLOAD];
+static uint8_t lz_dict_len = 0;
+static struct RfLzStats lz_stats;
+
+/**
+ * @brief set the preset dictionary, typically one sample packet; both ends must use the same
+ * @param[in] <dict> dictionary, NULL to clear
+ * @param[in] <len> dictionary length, at most RF_LZ_DICT_MAX
+ * @return result
+ */
+uint32_t rf_set_lz_dict(const uint8_t *dict, uint8_t len)
+{
+	if(len > RF_LZ_DICT_MAX || (dict == NULL && len != 0))
+	{
+		return FAIL;
+	}
+
+	if(len != 0)
+	{
+		memcpy(lz_tx_work, dict, len);
+		memcpy(lz_rx_work, dict, len);
+	}
+	lz_dict_len = len;
+	return OK;
+}
+
+/**
+ * @brief add the stage header, compressing the payload when that makes it shorter
+ * @param[in] <buf> payload
+ * @param[in] <size> payload length, at most RF_LZ_MAX_PAYLOAD
+ * @return packet length in lz_tx_buf, 0 when the payload is too long
+ */
+static uint8_t rf_lz_pack(const uint8_t *buf, uint8_t size)
+{
+	uint32_t len;
+
+	if(size > RF_LZ_MAX_PAYLOAD)
+	{
+		return 0;
+	}
+
+	memcpy(lz_tx_work + lz_dict_len, buf, size);
+	len = LzCompress(lz_tx_work, lz_dict_len, size, lz_tx_buf + 1, size ? size - 1 : 0);
+	if(len != 0)
+	{
+		lz_tx_buf[0] = RF_LZ_HDR_COMPRESSED;
+		lz_stats.TxCompressed++;
+	}
+	else
+	{
+		lz_tx_buf[0] = 0;
+		memcpy(lz_tx_buf + 1, buf, size);
+		len = size;
+	}
+	lz_stats.TxPackets++;
+	lz_stats.TxInBytes += size;
+	lz_stats.TxOutBytes += len + 1;
+	return len + 1;
+}
+
+/**
+ * @brief strip the stage header of a received packet and decompress it
+ * @param[in/out] <payload> packet in, payload out
+ * @param[in/out] <size> packet length in, payload length out
+ * @return result
+ */
+static uint32_t rf_lz_unpack(uint8_t **payload, uint16_t *size)
+{
+	uint32_t len;
+
+	if(*size == 0)
+	{
+		return FAIL;
+	}
+	if(((*payload)[0] & RF_LZ_HDR_COMPRESSED) == 0)
+	{
+		*payload += 1;
+		*size -= 1;
+		return OK;
+	}
+
+	len = LzDecompress(*payload + 1, *size - 1, lz_rx_work, lz_dict_len, lz_dict_len + RF_LZ_MAX_PAYLOAD);
+	if(len == 0)
+	{
+		lz_stats.RxErr++;
+		return FAIL;
+	}
+	lz_stats.RxCompressed++;
+	*payload = lz_rx_work + lz_dict_len;
+	*size = len;
+	return OK;
+}
+
+/**
+ * @brief get compression stage counters, TxOutBytes / TxInBytes is the ratio achieved
+ * @param[in] <none>
+ * @return counters
+ */
+const struct RfLzStats *rf_get_lz_stats(void)
+{
+	return &lz_stats;
+}
+#endif
+
 /**
  * @brief get receive flag 
  * @param[in] <none>
@@ -170,6 +297,67 @@ uint32_t rf_get_tx_time(void)
 	return PAN3031_calculate_tx_time();
 }
 
+/**
+ * @brief integer airtime of one packet, same model as PAN3031_calculate_tx_time without the 5 ms guard
+ *        symbols = 12.25 + 8 + max(ceil((8*pl - 4*sf + 28 + 16*crc) / (4*sf)), 0) * (cr + 4)
+ * @param[in] <sf> SF_7 / SF_8 / SF_9
+ * @param[in] <bw> BW_125K / BW_250K / BW_500K
+ * @param[in] <cr> CODE_RATE_45 / CODE_RATE_46 / CODE_RATE_47 / CODE_RATE_48
+ * @param[in] <crc> CRC_ON / CRC_OFF
+ * @param[in] <len> payload length
+ * @return airtime(us)
+ */
+uint32_t rf_calc_airtime_us(uint8_t sf, uint8_t bw, uint8_t cr, uint8_t crc, uint8_t len)
+{
+	int32_t num = 8 * len - 4 * sf + 28 + 16 * crc;
+	uint32_t den = 4 * sf;
+	uint32_t blocks = 0;
+	uint32_t quarter_symbols;
+	uint32_t bw_khz;
+
+	if(num > 0)
+	{
+		blocks = (num + den - 1) / den;
+	}
+	/* 4 x (12.25 + 8) preamble and header quarter symbols */
+	quarter_symbols = 81 + 4 * blocks * (cr + 4);
+
+	switch(bw)
+	{
+		case BW_250K:
+			bw_khz = 250;
+			break;
+		case BW_500K:
+			bw_khz = 500;
+			break;
+		default:
+			bw_khz = 125;
+			break;
+	}
+	/* symbol time 2^sf / bw is a whole number of us for every supported sf/bw */
+	return quarter_symbols * (((1UL << sf) * 1000) / bw_khz) / 4;
+}
+
+/**
+ * @brief integer airtime of one packet with the current modem parameters
+ * @param[in] <len> payload length
+ * @return airtime(us)
+ */
+uint32_t rf_get_airtime_us(uint8_t len)
+{
+	return rf_calc_airtime_us(modem_cfg.Sf, modem_cfg.Bw, modem_cfg.Cr, modem_cfg.Crc, len);
+}
+
+/**
+ * @brief get the modem parameters last set by rf_set_para
+ * @param[in] <none>
+ * @return modem parameters
+ */
+const struct RfModemCfg *rf_get_modem_cfg(void)
+{
+	return &modem_cfg;
+}
+
 /**
  * @brief set rf mode
  * @param[in] <mode>    
@@ -228,6 +416,7 @@ uint32_t rf_set_rx_single_timeout(uint32_t timeout)
 	return PAN3031_set_timeout(timeout);
 }
 
+#if !RF_INT_METADATA
 /**
  * @brief get snr value
  * @param[in] <none> 
@@ -247,6 +436,27 @@ float rf_get_rssi(void)
 {
 	return PAN3031_get_rssi();
 }
+#endif
+
+/**
+ * @brief get snr value, integer only
+ * @param[in] <none> 
+ * @return snr(in centi-dB)
+ */
+int16_t rf_get_snr_cdb(void)
+{
+	return PAN3031_get_snr_cdb();
+}
+
+/**
+ * @brief get rssi value, integer only
+ * @param[in] <none> 
+ * @return rssi(in centi-dBm)
+ */
+int16_t rf_get_rssi_cdb(void)
+{
+	return PAN3031_get_rssi_cdb();
+}
 
 /**
  * @brief set preamble 
@@ -344,8 +554,126 @@ uint32_t rf_plhd_receive(uint8_t *buf,uint8_t len)
 	return PAN3031_plhd_receive(buf,len);
 }
 
+/**
+ * @brief set one entry of the PLHD allow-list, frames whose PLHD bytes match no entry are aborted early
+ * @param[in] <index> entry index, Range:0..RF_PLHD_FILTER_MAX-1
+ * @param[in] <value> expected PLHD bytes
+ * @param[in] <mask> bits of value to compare, NULL compares all bits
+ * @param[in] <len> number of bytes to compare, Range:1..RF_PLHD_FILTER_LEN
+ * @return result
+ */
+uint32_t rf_set_plhd_filter(uint8_t index, const uint8_t *value, const uint8_t *mask, uint8_t len)
+{
+	uint8_t i;
+
+	if((index >= RF_PLHD_FILTER_MAX) || (len == 0) || (len > RF_PLHD_FILTER_LEN))
+	{
+		return FAIL;
+	}
+
+	for(i = 0; i < len; i++)
+	{
+		plhd_filter[index].Mask[i] = (mask != NULL) ? mask[i] : 0xff;
+		plhd_filter[index].Value[i] = value[i] & plhd_filter[index].Mask[i];
+	}
+	plhd_filter[index].Len = len;
+
+	if(plhd_filter_cnt <= index)
+	{
+		plhd_filter_cnt = index + 1;
+	}
+	return OK;
+}
+
+/**
+ * @brief clear the PLHD allow-list, every PLHD done event is handled as before
+ * @param[in] <none>
+ * @return none
+ */
+void rf_clr_plhd_filter(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < RF_PLHD_FILTER_MAX; i++)
+	{
+		plhd_filter[i].Len = 0;
+	}
+	plhd_filter_cnt = 0;
+}
+
+/**
+ * @brief check PLHD bytes against the allow-list
+ * @param[in] <payload> PLHD bytes
+ * @param[in] <size> the length of PLHD bytes
+ * @return OK when an entry matches or no filter is set, FAIL otherwise
+ */
+uint32_t rf_plhd_filter_match(const uint8_t *payload, uint16_t size)
+{
+	uint8_t i, j;
+	const struct RfPlhdFilter *f;
+
+	if(plhd_filter_cnt == 0)
+	{
+		return OK;
+	}
+
+	for(i = 0; i < plhd_filter_cnt; i++)
+	{
+		f = &plhd_filter[i];
+		if((f->Len == 0) || (f->Len > size))
+		{
+			continue;
+		}
+		for(j = 0; j < f->Len; j++)
+		{
+			if((payload[j] & f->Mask[j]) != f->Value[j])
+			{
+				break;
+			}
+		}
+		if(j == f->Len)
+		{
+			return OK;
+		}
+	}
+	return FAIL;
+}
+
+/**
+ * @brief abort the frame being received and re-arm Rx with the current Rx mode
+ * @param[in] <none>
+ * @return result
+ */
+uint32_t rf_plhd_abort_rx(void)
+{
+	PAN3031_rst();
+
+	if(PAN3031_set_mode(PAN3031_MODE_STB3) != OK)
+	{
+		return FAIL;
+	}
+
+	if(PAN3031_set_mode(PAN3031_MODE_RX) != OK)
+	{
+		return FAIL;
+	}
+	return OK;
+}
+
+/**
+ * @brief get the number of frames aborted by the PLHD filter
+ * @param[in] <none>
+ * @return reject count
+ */
+uint32_t rf_get_plhd_reject_count(void)
+{
+	return plhd_reject_cnt;
+}
+
 /**
  * @brief RF PAN3031_irq_handler OnRadioRxPlhdDone callbact,it will use in Plhd Mode
+ *        without a PLHD filter the frame is stopped after the PLHD bytes, with a filter
+ *        unwanted frames are aborted and wanted frames continue to RX_DONE
  * @param[in] <payload> recv packet
  * @param[in] <size> the length of recv packet
  * @return none
@@ -354,21 +682,38 @@ __weak void rf_rx_plhddone_event( uint8_t *payload, uint16_t size )
 {
 	RxDoneParams.PlhdSize = size;
 	RxDoneParams.PlhdPayload = payload;
-	rf_set_recv_flag(RADIO_FLAG_PLHDRXDONE);
 
-	PAN3031_rst();//stop it
+	if(plhd_filter_cnt == 0)
+	{
+		rf_set_recv_flag(RADIO_FLAG_PLHDRXDONE);
+		PAN3031_rst();//stop it
+		return;
+	}
+
+	if(rf_plhd_filter_match(payload, size) != OK)
+	{
+		plhd_reject_cnt++;
+		rf_plhd_abort_rx();
+	}
 }
 
 /**
  * @brief RF PAN3031_irq_handler OnRadioRxDone callbact,it will use in PAN3031_RX_SINGLE/PAN3031_RX_SINGLE_TIMEOUT/PAN3031_RX_CONTINOUS Mode
  * @param[in] <payload> recv packet
  * @param[in] <size> the length of recv packet
- * @param[in] <rssi> the rssi of recv packet
- * @param[in] <snr> the snr of recv packet
+ * @param[in] <rssi> the rssi of recv packet, centi-dBm with RF_INT_METADATA
+ * @param[in] <snr> the snr of recv packet, centi-dB with RF_INT_METADATA
  * @return none
  */
-__weak void rf_rx_done_event( uint8_t *payload, uint16_t size, double rssi, double snr )
+__weak void rf_rx_done_event( uint8_t *payload, uint16_t size, RfMeta_t rssi, RfMeta_t snr )
 {
+#if RF_LZ_STAGE
+	if(rf_lz_unpack(&payload, &size) != OK)
+	{
+		rf_set_recv_flag(RADIO_FLAG_RXERR);
+		return;
+	}
+#endif
 	RxDoneParams.Payload = payload;
 	RxDoneParams.Size = size;
 	RxDoneParams.Rssi = rssi;
@@ -493,12 +838,21 @@ uint32_t rf_enter_single_rx(void)
 /**
  * @brief rf enter single tx mode and send packet
  * @param[in] <buf> buffer contain data to send
- * @param[in] <size> the length of data to send
+ * @param[in] <size> the length of data to send, at most RF_LZ_MAX_PAYLOAD with RF_LZ_STAGE
  * @param[in] <tx_time> the packet tx time
  * @return result
  */
 uint32_t rf_single_tx_data(uint8_t *buf, uint8_t size, uint32_t *tx_time)
 {     
+#if RF_LZ_STAGE
+	size = rf_lz_pack(buf, size);
+	if(size == 0)
+	{
+		return FAIL;
+	}
+	buf = lz_tx_buf;
+#endif
+
 	if(PAN3031_set_mode(PAN3031_MODE_STB3) != OK)
 	{
 		return FAIL;
@@ -546,11 +900,20 @@ uint32_t rf_enter_continous_tx(void)
 /**
  * @brief rf continous mode send packet
  * @param[in] <buf> buffer contain data to send
- * @param[in] <size> the length of data to send
+ * @param[in] <size> the length of data to send, at most RF_LZ_MAX_PAYLOAD with RF_LZ_STAGE
  * @return result
  */
 uint32_t rf_continous_tx_send_data(uint8_t *buf, uint8_t size)
 {   
+#if RF_LZ_STAGE
+	size = rf_lz_pack(buf, size);
+	if(size == 0)
+	{
+		return FAIL;
+	}
+	buf = lz_tx_buf;
+#endif
+
 	if(PAN3031_send_packet(buf, size) != OK)
 	{
 		return FAIL;
@@ -592,26 +955,32 @@ uint32_t rf_set_para(rf_para_type_t para_type, uint32_t para_val)
 		case RF_PARA_TYPE_FREQ:
 			PAN3031_set_freq(para_val);  
 			PAN3031_rst();
+			modem_cfg.Freq = para_val;
 			break;
 		case RF_PARA_TYPE_CR:
 			PAN3031_set_code_rate(para_val);
 			PAN3031_rst();
+			modem_cfg.Cr = para_val;
 			break;
 		case RF_PARA_TYPE_BW:
 			PAN3031_set_bw(para_val);  
 			PAN3031_rst();            
+			modem_cfg.Bw = para_val;
 			break;
 		case RF_PARA_TYPE_SF:
 			PAN3031_set_sf(para_val);  
 			PAN3031_rst();
+			modem_cfg.Sf = para_val;
 			break;
 		case RF_PARA_TYPE_TXPOWER:
 			PAN3031_set_tx_power(para_val);
 			PAN3031_rst(); 
+			modem_cfg.TxPower = para_val;
 			break;
 		case RF_PARA_TYPE_CRC:
 			PAN3031_set_crc(para_val);
 			PAN3031_rst(); 
+			modem_cfg.Crc = para_val;
 			break;
 		default:
 			break;    
@@ -619,6 +988,32 @@ uint32_t rf_set_para(rf_para_type_t para_type, uint32_t para_val)
 	return OK;
 }
 
+/**
+ * @brief set spread factor, bandwidth and code rate in one pass, see PAN3031_set_rate
+ * @param[in] <sf> SF_7 / SF_8 / SF_9
+ * @param[in] <bw> BW_125K / BW_250K / BW_500K
+ * @param[in] <cr> CODE_RATE_45 / CODE_RATE_46 / CODE_RATE_47 / CODE_RATE_48
+ * @return result, FAIL for a value out of range, the radio keeps its rate and mode
+ */
+uint32_t rf_set_rate(uint8_t sf, uint8_t bw, uint8_t cr)
+{
+	/* checked before the radio leaves RX, a refused rate does not interrupt reception */
+	if(sf < SF_7 || sf > SF_9 || bw < BW_125K || bw > BW_500K || cr < CODE_RATE_45 || cr > CODE_RATE_48)
+	{
+		return FAIL;
+	}
+	PAN3031_set_mode(PAN3031_MODE_STB3);
+	if(PAN3031_set_rate(sf, bw, cr) != OK)
+	{
+		return FAIL;
+	}
+	PAN3031_rst();
+	modem_cfg.Sf = sf;
+	modem_cfg.Bw = bw;
+	modem_cfg.Cr = cr;
+	return OK;
+}
+
 /**
  * @brief get rf para
  * @param[in] <para_type> get typ, rf_para_type_t para_type
@@ -654,6 +1049,25 @@ uint32_t rf_get_para(rf_para_type_t para_type, uint32_t *para_val)
 	return OK;
 }
 
+/**
+ * @brief write a modem register image in standby3, one reset for all of it
+ * @param[in] <image> register fields, see pan3031_config.hpp
+ * @param[in] <count> number of fields
+ * @param[in] <cfg> the parameters the image was made from
+ * @return result
+ */
+uint32_t rf_apply_modem_image(const PAN3031_RegField_t *image, uint32_t count, const struct RfModemCfg *cfg)
+{
+	PAN3031_set_mode(PAN3031_MODE_STB3);
+	if(PAN3031_apply_image(image, count) != OK)
+	{
+		return FAIL;
+	}
+	PAN3031_rst();
+	modem_cfg = *cfg;
+	return OK;
+}
+
 /**
  * @brief set rf default para
  * @param[in] <none>
@@ -661,6 +1075,9 @@ uint32_t rf_get_para(rf_para_type_t para_type, uint32_t *para_val)
  */
 void rf_set_default_para(void)
 {
+#if RF_MODEM_IMAGE
+	rf_apply_default_image();
+#else
 	PAN3031_set_mode(PAN3031_MODE_STB3); //参数配置通常 在 standby3 状态下进行
 	rf_set_para(RF_PARA_TYPE_FREQ, DEFAULT_FREQ);//频率设置
 	rf_set_para(RF_PARA_TYPE_CR, DEFAULT_CR);  //注：空中速率通过 SF、BW、CR三个参数确定   参考资料包里的 PAN3031计算器
@@ -670,6 +1087,7 @@ void rf_set_default_para(void)
 	rf_set_para(RF_PARA_TYPE_CRC, CRC_ON);//打开硬件CRC
 	rf_set_dcdc_mode(DCDC_OFF);//关闭DCDC
 	rf_set_ldr(LDR_OFF);
+#endif
 }
 
 /**
@@ -694,5 +1112,17 @@ uint32_t rf_set_ldr(uint32_t mode)
 	return PAN3031_set_ldr(mode);
 }
 
-
-
+#if PAN3031_FIFO_CRC
+/**
+ * @brief compute a CRC on the fly over every payload byte sent or received,
+ *        so multi-packet messages get an integrity check without a second pass
+ * @param[in] <dir> PAN3031_FIFO_TX / PAN3031_FIFO_RX, the directions do not share state
+ * @param[in] <crc> CRC state initialized by RadioCrcInit, NULL to stop
+ * @param[in] <skip> leading bytes of each packet left out, e.g. the frame header
+ * @return none
+ */
+void rf_set_fifo_crc(uint8_t dir, RadioCrc_t *crc, uint8_t skip)
+{
+	PAN3031_set_fifo_crc(dir, crc, skip);
+}
+#endif
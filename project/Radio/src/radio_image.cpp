@@ -0,0 +1,21 @@
+//
+// radio.h's default modem parameters as a register image, written by rf_set_default_para
+// with RF_MODEM_IMAGE
+//
+#include "pan3031_config.hpp"
+
+#if RF_MODEM_IMAGE
+
+namespace
+{
+
+using DefaultConfig = pan3031::ModemConfig<DEFAULT_FREQ, DEFAULT_SF, DEFAULT_BW, DEFAULT_CR, 0x7F, CRC_ON, LDR_OFF, DCDC_OFF>;
+
+} // namespace
+
+extern "C" uint32_t rf_apply_default_image(void)
+{
+	return rf_apply_modem_image(DefaultConfig::image.data(), DefaultConfig::size, &DefaultConfig::modem);
+}
+
+#endif